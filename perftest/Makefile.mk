@@ -15,3 +15,134 @@ logperf_LDADD = \
 
 logperf_LDFLAGS = \
  -pthread
+
+check_PROGRAMS += docdataperf
+
+docdataperf_SOURCES = \
+ perftest/docdataperf.cc
+
+docdataperf_LDADD = \
+ libjsonxapian.a \
+ libutils.a \
+ libjsoncpp.a \
+ libxapiancommon.a \
+ $(XAPIAN_LIBS)
+
+check_PROGRAMS += valueperf
+
+valueperf_SOURCES = \
+ perftest/valueperf.cc
+
+valueperf_LDADD = \
+ libjsonxapian.a \
+ libutils.a \
+ libxapiancommon.a \
+ $(XAPIAN_LIBS)
+
+check_PROGRAMS += taxonomyperf
+
+taxonomyperf_SOURCES = \
+ perftest/taxonomyperf.cc
+
+taxonomyperf_LDADD = \
+ libjsonxapian.a \
+ libutils.a \
+ libjsoncpp.a \
+ libxapiancommon.a \
+ $(XAPIAN_LIBS)
+
+check_PROGRAMS += ngramperf
+
+ngramperf_SOURCES = \
+ perftest/ngramperf.cc
+
+ngramperf_LDADD = \
+ libngramcat.a \
+ libutils.a \
+ libjsoncpp.a \
+ libxapiancommon.a \
+ $(XAPIAN_LIBS)
+
+check_PROGRAMS += pipeperf
+
+pipeperf_SOURCES = \
+ perftest/pipeperf.cc
+
+pipeperf_LDADD = \
+ libjsonxapian.a \
+ libngramcat.a \
+ libjsonmanip.a \
+ libutils.a \
+ libjsoncpp.a \
+ libxapiancommon.a \
+ $(XAPIAN_LIBS)
+
+check_PROGRAMS += geoperf
+
+geoperf_SOURCES = \
+ perftest/geoperf.cc
+
+geoperf_LDADD = \
+ libjsonxapian.a \
+ libngramcat.a \
+ libjsonmanip.a \
+ libcjktokenizer.a \
+ libutils.a \
+ libjsoncpp.a \
+ liblogger.a \
+ libpostingsources.a \
+ libmatchspies.a \
+ libgeospatial.a \
+ libxapiancommon.a \
+ libs/libmicrohttpd/src/daemon/libmicrohttpd.la \
+ $(XAPIAN_LIBS)
+
+geoperf_LDFLAGS = \
+ -pthread
+
+check_PROGRAMS += occurperf
+
+occurperf_SOURCES = \
+ perftest/occurperf.cc
+
+occurperf_LDADD = \
+ libmatchspies.a \
+ libutils.a \
+ libjsoncpp.a \
+ libxapiancommon.a \
+ $(XAPIAN_LIBS)
+
+check_PROGRAMS += configperf
+
+configperf_SOURCES = \
+ perftest/configperf.cc
+
+configperf_LDADD = \
+ libjsonxapian.a \
+ libngramcat.a \
+ libjsonmanip.a \
+ libcjktokenizer.a \
+ libdbgroup.a \
+ libutils.a \
+ libjsoncpp.a \
+ liblogger.a \
+ libpostingsources.a \
+ libmatchspies.a \
+ libgeospatial.a \
+ libxapiancommon.a \
+ libs/libmicrohttpd/src/daemon/libmicrohttpd.la \
+ $(XAPIAN_LIBS)
+
+configperf_LDFLAGS = \
+ -pthread
+
+check_PROGRAMS += jsonperf
+
+jsonperf_SOURCES = \
+ perftest/jsonperf.cc
+
+jsonperf_LDADD = \
+ libutils.a \
+ libjsoncpp.a \
+ libxapiancommon.a \
+ $(XAPIAN_LIBS)
@@ -0,0 +1,135 @@
+/** @file configperf.cc
+ * @brief Performance tests for processing documents with a large configuration.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "jsonxapian/collconfigs.h"
+
+#include "jsonxapian/collconfig.h"
+#include "jsonxapian/indexing.h"
+#include <memory>
+#include "realtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "str.h"
+#include <xapian.h>
+
+using namespace RestPose;
+using namespace std;
+
+static const unsigned CATEGORY_COUNT = 20000;
+static const unsigned BRANCHING = 10;
+static const unsigned DOC_COUNT = 2000;
+
+static string
+cat_name(unsigned i)
+{
+    return "category" + str(i);
+}
+
+/** Make a test document, in category i.
+ */
+static Json::Value &
+make_doc(Json::Value & doc, unsigned i)
+{
+    doc = Json::objectValue;
+    doc["title_text"] = "Document number " + str(i);
+    doc["tag"] = "tag" + str(i % 100);
+    doc["num"] = i;
+    doc["topic_cat"] = cat_name(rand() % CATEGORY_COUNT);
+    return doc;
+}
+
+/** Process DOC_COUNT documents, and return the documents per second.
+ *
+ *  If clone is true, each document is processed with a fresh copy of the
+ *  configuration (as was done before configurations were shared);
+ *  otherwise, the shared snapshot is used directly.
+ */
+static double
+process_docs(const CollectionConfigSnapshot & snapshot, bool clone)
+{
+    double start(RealTime::now());
+    for (unsigned i = 0; i != DOC_COUNT; ++i) {
+	Json::Value doc;
+	make_doc(doc, i);
+	string idterm;
+	IndexingErrors errors;
+	Xapian::Document xdoc;
+	if (clone) {
+	    auto_ptr<CollectionConfig> config(snapshot->clone());
+	    bool new_fields(false);
+	    xdoc = config->process_doc(doc, "default", str(i), idterm,
+				       errors, new_fields);
+	} else {
+	    if (!snapshot->try_process_doc(doc, "default", str(i), idterm,
+					   errors, xdoc)) {
+		fprintf(stderr, "Document %u needed the config to change\n",
+			i);
+		exit(1);
+	    }
+	}
+	if (!errors.errors.empty()) {
+	    fprintf(stderr, "Indexing error: %s\n",
+		    errors.errors[0].second.c_str());
+	    exit(1);
+	}
+    }
+    double end(RealTime::now());
+    return DOC_COUNT / (end - start);
+}
+
+int main(int argc, const char ** argv) {
+    (void) argc;
+    (void) argv;
+    srand(42);
+
+    auto_ptr<CollectionConfig> config(new CollectionConfig("test"));
+    config->set_default();
+    Categories modified;
+    for (unsigned i = 1; i != CATEGORY_COUNT; ++i) {
+	modified.clear();
+	config->category_add_parent("topic_cat", cat_name(i),
+				    cat_name((i - 1) / BRANCHING), modified);
+    }
+
+    // Process one document first, so that the schema has all the fields.
+    {
+	Json::Value doc;
+	string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	config->process_doc(make_doc(doc, 0), "default", "0", idterm, errors,
+			    new_fields);
+    }
+    CollectionConfigSnapshot snapshot(config.release());
+
+    printf("Configuration with %u categories:\n", CATEGORY_COUNT);
+    printf("Cloned config per document: %.1f docs/sec\n",
+	   process_docs(snapshot, true));
+    printf("Shared config snapshot: %.1f docs/sec\n",
+	   process_docs(snapshot, false));
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+/** @file docdataperf.cc
+ * @brief Performance test for document data compression.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <config.h>
+#include "jsonxapian/docdata.h"
+
+#include "realtime.h"
+#include <stdio.h>
+#include <string>
+#include "str.h"
+#include <vector>
+
+using namespace RestPose;
+using namespace std;
+
+static const char * levels[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+static const char * hosts[] = { "web01", "web02", "db01", "cache03" };
+static const char * log_messages[] = {
+    "Request completed successfully",
+    "Connection to upstream server timed out",
+    "User session expired; redirecting to login",
+    "Cache miss for requested resource",
+};
+
+/** Build some small log-like documents, similar in shape to what a typical
+ *  restpose collection holds.
+ */
+static void
+make_docs(vector<string> & docs, unsigned count)
+{
+    for (unsigned i = 0; i != count; ++i) {
+	DocumentData docdata;
+	docdata.set("id", "[\"" + str(i) + "\"]");
+	docdata.set("type", "[\"logentry\"]");
+	docdata.set("level", string("[\"") + levels[i % 4] + "\"]");
+	docdata.set("host", string("[\"") + hosts[(i / 3) % 4] + "\"]");
+	docdata.set("timestamp", "[" + str(1300000000 + i * 17) + "]");
+	docdata.set("message", string("[\"") + log_messages[(i / 7) % 4] +
+		    " (request " + str(i * 31) + ")\"]");
+	docs.push_back(docdata.serialise());
+    }
+}
+
+static void
+measure(const char * desc, const DocumentDataCompressor & compressor,
+	const vector<string> & docs)
+{
+    size_t raw_bytes = 0;
+    size_t stored_bytes = 0;
+    vector<string> stored;
+    for (vector<string>::const_iterator i = docs.begin();
+	 i != docs.end(); ++i) {
+	stored.push_back(compressor.compress(*i));
+	raw_bytes += i->size();
+	stored_bytes += stored.back().size();
+    }
+
+    double start(RealTime::now());
+    DocumentData docdata;
+    for (vector<string>::const_iterator i = stored.begin();
+	 i != stored.end(); ++i) {
+	docdata.unserialise(*i, &compressor);
+    }
+    double end(RealTime::now());
+
+    printf("%s: %u docs, %u bytes -> %u bytes (ratio %.3f), "
+	   "decode %.3f usec/doc\n",
+	   desc, unsigned(docs.size()), unsigned(raw_bytes),
+	   unsigned(stored_bytes), double(stored_bytes) / double(raw_bytes),
+	   (end - start) * 1000000.0 / double(docs.size()));
+}
+
+int main(int argc, const char ** argv) {
+    (void) argc;
+    (void) argv;
+
+    vector<string> training;
+    make_docs(training, 1000);
+    vector<string> docs;
+    make_docs(docs, 20000);
+
+    DocumentDataCompressor none;
+    measure("uncompressed", none, docs);
+
+    DocumentDataCompressor plain;
+    plain.set_level(6);
+    measure("zlib, no dictionary", plain, docs);
+
+    double start(RealTime::now());
+    string dictionary(DocumentDataCompressor::train(training));
+    double end(RealTime::now());
+    printf("Trained %u byte dictionary in %f seconds\n",
+	   unsigned(dictionary.size()), end - start);
+
+    DocumentDataCompressor trained;
+    trained.set_level(6);
+    trained.add_dictionary(dictionary);
+    measure("zlib, trained dictionary", trained, docs);
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+/** @file geoperf.cc
+ * @brief Performance tests for geospatial searches.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "jsonxapian/collconfig.h"
+#include "jsonxapian/indexing.h"
+#include "jsonxapian/query_builder.h"
+#include "jsonxapian/schema.h"
+#include "realtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "str.h"
+#include "utils/jsonutils.h"
+#include <xapian.h>
+
+using namespace RestPose;
+using namespace std;
+
+static const unsigned DOC_COUNT = 100000;
+static const unsigned QUERY_COUNT = 200;
+
+/** Get a random number in the range [begin, end).
+ */
+static double
+random_in(double begin, double end)
+{
+    return begin + (end - begin) * (rand() / (RAND_MAX + 1.0));
+}
+
+/** Make a coordinate, clustered around a few centers as real data tends to
+ *  be, with some points scattered over the whole globe.
+ */
+static Json::Value &
+make_point(Json::Value & point)
+{
+    static const double centers[][2] = {
+	{ -0.1, 51.5 }, { -74.0, 40.7 }, { 139.7, 35.7 }, { 151.2, -33.9 },
+    };
+    point = Json::arrayValue;
+    if (rand() % 10 == 0) {
+	point.append(random_in(-180, 180));
+	point.append(random_in(-85, 85));
+    } else {
+	const double * center = centers[rand() % 4];
+	point.append(center[0] + random_in(-2, 2));
+	point.append(center[1] + random_in(-1.5, 1.5));
+    }
+    return point;
+}
+
+/** Time running a set of searches, returning the total number of matches.
+ */
+static Xapian::doccount
+time_searches(const char * desc, const Xapian::Database & db,
+	      const CollectionConfig & config, const string & field,
+	      const string & type, const string & params)
+{
+    srand(7);
+    CollectionQueryBuilder builder(config);
+    Xapian::Enquire enq(db);
+    Xapian::doccount matches = 0;
+    double start(RealTime::now());
+    for (unsigned i = 0; i != QUERY_COUNT; ++i) {
+	Json::Value point, tmp;
+	string search("{\"field\": [\"" + field + "\", \"" + type +
+		      "\", {\"center\": " + json_serialise(make_point(point)) +
+		      ", " + params + "}]}");
+	enq.set_query(builder.build(json_unserialise(search, tmp)));
+	Xapian::MSet mset(enq.get_mset(0, 10, DOC_COUNT));
+	matches += mset.get_matches_estimated();
+    }
+    double end(RealTime::now());
+    printf("%s: %.3f msec/query (%u matches)\n", desc,
+	   (end - start) * 1000.0 / QUERY_COUNT, unsigned(matches));
+    return matches;
+}
+
+int main(int argc, const char ** argv) {
+    (void) argc;
+    (void) argv;
+    srand(42);
+
+    // The "cells" field has a group, so has grid cells indexed for it; the
+    // "plain" field holds the same points without.
+    Json::Value tmp;
+    Schema schema("");
+    schema.from_json(json_unserialise("{\"fields\": {"
+	"\"cells\": {\"type\": \"lonlat\", \"slot\": 1, \"group\": \"l\"},"
+	"\"plain\": {\"type\": \"lonlat\", \"slot\": 2}"
+	"}}", tmp));
+    CollectionConfig config("geoperf");
+    config.set_default();
+
+    Xapian::WritableDatabase db = Xapian::InMemory::open();
+    double start(RealTime::now());
+    for (unsigned i = 0; i != DOC_COUNT; ++i) {
+	Json::Value doc(Json::objectValue);
+	make_point(doc["cells"]);
+	doc["plain"] = doc["cells"];
+	string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	db.add_document(schema.process(doc, config, idterm, errors,
+				       new_fields));
+    }
+    double end(RealTime::now());
+    printf("index: %.3f usec/doc\n", (end - start) * 1000000.0 / DOC_COUNT);
+    config.set_schema("geoperf", schema);
+
+    static const char * ranges[] = {
+	"\"max_range\": 1000", "\"max_range\": 20000", "\"max_range\": 200000",
+    };
+    for (unsigned i = 0; i != sizeof(ranges) / sizeof(ranges[0]); ++i) {
+	printf("distscore %s\n", ranges[i]);
+	Xapian::doccount plain = time_searches(" scan", db, config,
+					       "plain", "distscore",
+					       ranges[i]);
+	Xapian::doccount cells = time_searches(" cells", db, config,
+					       "cells", "distscore",
+					       ranges[i]);
+	if (plain != cells) {
+	    printf(" results differ\n");
+	    return 1;
+	}
+    }
+
+    static const char * counts[] = {
+	"\"count\": 1", "\"count\": 10", "\"count\": 100",
+    };
+    for (unsigned i = 0; i != sizeof(counts) / sizeof(counts[0]); ++i) {
+	printf("nearest %s\n", counts[i]);
+	time_searches(" cells", db, config, "cells", "nearest", counts[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+/** @file jsonperf.cc
+ * @brief Performance tests for parsing JSON.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "utils/jsonutils.h"
+
+#include "realtime.h"
+#include <stdio.h>
+#include <string>
+#include "str.h"
+#include <vector>
+
+using namespace RestPose;
+using namespace std;
+
+static const unsigned ITERATIONS = 2000;
+
+/// A search request, as sent to perform_search.
+static string
+make_search()
+{
+    Json::Value search(Json::objectValue);
+    Json::Value & query = search["query"]["and"] = Json::arrayValue;
+    for (unsigned i = 0; i != 5; ++i) {
+	Json::Value & sub = query.append(Json::objectValue);
+	sub["field"] = Json::arrayValue;
+	sub["field"].append("tag");
+	sub["field"].append("is");
+	sub["field"].append("tag" + str(i));
+    }
+    search["from"] = 0;
+    search["size"] = 100;
+    search["display"] = Json::arrayValue;
+    search["display"].append("title");
+    search["display"].append("tag");
+    return json_serialise(search);
+}
+
+/// A document, as uploaded for indexing.
+static string
+make_doc(unsigned i)
+{
+    Json::Value doc(Json::objectValue);
+    doc["id"] = str(i);
+    doc["title"] = "Document number " + str(i);
+    string text;
+    for (unsigned j = 0; j != 200; ++j) {
+	text += "word" + str((i * 31 + j * 17) % 1000) + " ";
+    }
+    doc["text"] = text;
+    doc["tag"] = Json::arrayValue;
+    for (unsigned j = 0; j != 5; ++j) {
+	doc["tag"].append("tag" + str((i + j) % 50));
+    }
+    doc["num"] = i;
+    doc["score"] = i / 7.0;
+    doc["lonlat"]["lon"] = -0.1 + i / 1000.0;
+    doc["lonlat"]["lat"] = 51.5 + i / 1000.0;
+    return json_serialise(doc);
+}
+
+/// A short stored field value, as held in DocumentData for display.
+static string
+make_field(unsigned i)
+{
+    Json::Value field(Json::arrayValue);
+    field.append("Document number " + str(i));
+    return json_serialise(field);
+}
+
+/** Parse each of the inputs ITERATIONS times with a parser.
+ *
+ *  Prints and returns the throughput in MB/sec.
+ */
+static double
+time_parse(JsonParserType type, const char * parser_name,
+	   const char * input_name, const vector<string> & inputs)
+{
+    json_set_parser(type);
+    size_t bytes = 0;
+    double start(RealTime::now());
+    for (unsigned i = 0; i != ITERATIONS; ++i) {
+	for (vector<string>::const_iterator j = inputs.begin();
+	     j != inputs.end(); ++j) {
+	    Json::Value value;
+	    json_unserialise(*j, value);
+	    bytes += j->size();
+	}
+    }
+    double end(RealTime::now());
+    double mb_per_sec = bytes / (end - start) / (1024 * 1024);
+    printf("%s, %s: %.1f MB/sec, %.0f values/sec\n",
+	   parser_name, input_name, mb_per_sec,
+	   ITERATIONS * inputs.size() / (end - start));
+    return mb_per_sec;
+}
+
+static void
+compare(const char * input_name, const vector<string> & inputs)
+{
+    double jsoncpp = time_parse(JSON_PARSER_JSONCPP, "jsoncpp", input_name,
+				inputs);
+    double fast = time_parse(JSON_PARSER_FAST, "fast", input_name, inputs);
+    printf("%s: fast parser is %.2f times jsoncpp\n\n",
+	   input_name, fast / jsoncpp);
+}
+
+int main(int argc, const char ** argv) {
+    (void) argc;
+    (void) argv;
+
+    vector<string> searches;
+    searches.push_back(make_search());
+    vector<string> docs;
+    vector<string> fields;
+    for (unsigned i = 0; i != 10; ++i) {
+	docs.push_back(make_doc(i));
+	fields.push_back(make_field(i));
+    }
+
+    compare("search requests", searches);
+    compare("documents", docs);
+    compare("stored fields", fields);
+    return 0;
+}
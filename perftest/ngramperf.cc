@@ -0,0 +1,118 @@
+/** @file ngramperf.cc
+ * @brief Performance test for ngram profile building and categorisation.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "ngramcat/categoriser.h"
+
+#include "ngramcat/profile.h"
+#include "realtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "str.h"
+#include <vector>
+
+using namespace RestPose;
+using namespace std;
+
+static const char * syllables[] = {
+    "the", "and", "ing", "ion", "tio", "ent", "er", "re", "th", "qu",
+    "sch", "ei", "ch", "en", "ie", "de", "la", "le", "es", "os",
+    "\xd0\xbf\xd1\x80\xd0\xb8", // при
+    "\xd0\xb2\xd0\xb5\xd1\x82", // вет
+    "\xd0\xb4\xd0\xbe", // до
+    "\xd0\xb1\xd1\x80", // бр
+};
+static const unsigned SYLLABLE_COUNT = sizeof(syllables) / sizeof(syllables[0]);
+
+static const unsigned TEXT_LEN = 100 * 1024;
+static const unsigned BUILD_COUNT = 20;
+static const unsigned TARGET_COUNT = 20;
+static const unsigned SNIPPET_LEN = 1024;
+static const unsigned CATEGORISE_COUNT = 2000;
+
+/** Generate some text from a random selection of syllables.
+ *
+ *  Each "language" uses a different subset of the syllables.
+ */
+static string
+make_text(unsigned language, size_t len)
+{
+    string result;
+    while (result.size() < len) {
+	unsigned word_len = 1 + rand() % 4;
+	for (unsigned i = 0; i != word_len; ++i) {
+	    unsigned syllable = (language * 3 + rand() % 8) % SYLLABLE_COUNT;
+	    result += syllables[syllable];
+	}
+	result += (rand() % 10 == 0) ? ". " : " ";
+    }
+    return result;
+}
+
+int main(int argc, const char ** argv) {
+    (void) argc;
+    (void) argv;
+    srand(42);
+
+    // Build profiles from a large piece of text.
+    string text = make_text(0, TEXT_LEN);
+    SortedNGramProfile profile;
+    double start(RealTime::now());
+    for (unsigned i = 0; i != BUILD_COUNT; ++i) {
+	NGramProfileBuilder builder(5);
+	builder.add_text(text);
+	builder.build(profile, 400);
+    }
+    double end(RealTime::now());
+    printf("Built profiles at %.3f MB/s (%u ngrams kept)\n",
+	   (double(text.size()) * BUILD_COUNT / (1024 * 1024)) / (end - start),
+	   unsigned(profile.ngrams.size()));
+
+    // Categorise short snippets against a set of targets.
+    Categoriser cat;
+    for (unsigned i = 0; i != TARGET_COUNT; ++i) {
+	cat.add_target_profile("lang" + str(i), make_text(i, TEXT_LEN));
+    }
+    vector<string> snippets;
+    for (unsigned i = 0; i != CATEGORISE_COUNT; ++i) {
+	snippets.push_back(make_text(i % TARGET_COUNT, SNIPPET_LEN));
+    }
+    unsigned correct = 0;
+    vector<string> results;
+    start = RealTime::now();
+    for (unsigned i = 0; i != CATEGORISE_COUNT; ++i) {
+	cat.categorise(snippets[i], results);
+	if (results.size() == 1 && results[0] == "lang" + str(i % TARGET_COUNT)) {
+	    ++correct;
+	}
+    }
+    end = RealTime::now();
+    printf("Categorised %u byte snippets against %u targets: "
+	   "%.3f usec each (%u correct)\n",
+	   SNIPPET_LEN, TARGET_COUNT,
+	   (end - start) * 1000000.0 / CATEGORISE_COUNT, correct);
+
+    return 0;
+}
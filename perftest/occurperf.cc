@@ -0,0 +1,155 @@
+/** @file occurperf.cc
+ * @brief Performance tests for counting term occurrences.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "matchspies/termoccurmatchspy.h"
+
+#include <json/value.h>
+#include <map>
+#include "realtime.h"
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "str.h"
+#include "utils/jsonutils.h"
+#include "utils/stringutils.h"
+#include <xapian.h>
+
+using namespace RestPose;
+using namespace std;
+
+static const unsigned DOC_COUNT = 50000;
+static const unsigned TAGS_PER_DOC = 20;
+static const unsigned TAG_COUNT = 20000;
+static const unsigned REPEATS = 5;
+
+/** The previous implementation of counting term occurrences, using a set of
+ *  stopwords and a map of counts, for comparison.
+ */
+class MapTermOccurMatchSpy : public Xapian::MatchSpy {
+    string prefix;
+    set<string> stopwords;
+  public:
+    map<string, Xapian::doccount> counts;
+
+    MapTermOccurMatchSpy(const string & prefix_) : prefix(prefix_) {}
+
+    void add_stopword(const string & word) {
+	stopwords.insert(word);
+    }
+
+    void operator()(const Xapian::Document &doc, Xapian::weight) {
+	Xapian::TermIterator i = doc.termlist_begin();
+	if (i == doc.termlist_end()) {
+	    return;
+	}
+	i.skip_to(prefix);
+	while (i != doc.termlist_end()) {
+	    if (!string_startswith(*i, prefix)) {
+		break;
+	    }
+	    string suffix((*i).substr(prefix.size()));
+	    if (stopwords.find(suffix) == stopwords.end()) {
+		++counts[suffix];
+	    }
+	    ++i;
+	}
+    }
+};
+
+/** Build a database of documents with tags, with a skewed distribution so
+ *  that a few tags are common and most are rare, as for real tag clouds.
+ */
+static void
+build_db(Xapian::WritableDatabase & db)
+{
+    for (unsigned i = 0; i != DOC_COUNT; ++i) {
+	Xapian::Document doc;
+	for (unsigned j = 0; j != TAGS_PER_DOC; ++j) {
+	    unsigned tag = (unsigned(rand() % TAG_COUNT) *
+			    unsigned(rand() % TAG_COUNT)) / TAG_COUNT;
+	    doc.add_boolean_term("tag\tt" + str(tag));
+	    doc.add_term("text" + str(rand() % 1000));
+	}
+	doc.add_boolean_term("zzz\t" + str(i % 10));
+	db.add_document(doc);
+    }
+}
+
+/** Run a search over all the documents with a matchspy.
+ */
+static double
+time_spy(const Xapian::Database & db, Xapian::MatchSpy * spy)
+{
+    Xapian::Enquire enq(db);
+    enq.set_query(Xapian::Query(string()));
+    enq.set_weighting_scheme(Xapian::BoolWeight());
+    enq.add_matchspy(spy);
+    double start(RealTime::now());
+    (void) enq.get_mset(0, 0, DOC_COUNT);
+    return RealTime::now() - start;
+}
+
+int main(int argc, const char ** argv) {
+    (void) argc;
+    (void) argv;
+    srand(42);
+
+    Xapian::WritableDatabase db = Xapian::InMemory::open();
+    build_db(db);
+
+    double map_time = 0;
+    double hash_time = 0;
+    for (unsigned repeat = 0; repeat != REPEATS; ++repeat) {
+	MapTermOccurMatchSpy map_spy("tag\t");
+	map_spy.add_stopword("t0");
+	map_time += time_spy(db, &map_spy);
+
+	TermOccurMatchSpy spy("tag", "", DOC_COUNT, TAG_COUNT, false, &db);
+	spy.add_stopword("t0");
+	hash_time += time_spy(db, &spy);
+
+	// Check that the counts agree.
+	Json::Value result;
+	spy.get_result(result);
+	const Json::Value & counts = result["counts"];
+	bool ok = (counts.size() == map_spy.counts.size());
+	for (Json::Value::const_iterator i = counts.begin();
+	     ok && i != counts.end(); ++i) {
+	    ok = (map_spy.counts[(*i)[0u].asString()] == (*i)[1u].asUInt());
+	}
+	if (!ok) {
+	    printf("counts differ\n");
+	    return 1;
+	}
+    }
+
+    printf("occur (map): %.3f usec/doc\n",
+	   map_time * 1000000.0 / (DOC_COUNT * REPEATS));
+    printf("occur (hash): %.3f usec/doc\n",
+	   hash_time * 1000000.0 / (DOC_COUNT * REPEATS));
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+/** @file pipeperf.cc
+ * @brief Performance tests for applying pipe mappings.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "jsonmanip/mapping.h"
+
+#include "jsonmanip/mappingprogram.h"
+#include "jsonxapian/collconfig.h"
+#include "realtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "str.h"
+#include "utils/jsonutils.h"
+#include <vector>
+
+using namespace RestPose;
+using namespace std;
+
+static const unsigned DOC_COUNT = 1000;
+static const unsigned FIELD_COUNT = 30;
+static const unsigned REPEATS = 20;
+
+/** Make a document with a mix of flat and nested fields.
+ */
+static Json::Value
+make_doc(unsigned docnum)
+{
+    Json::Value doc(Json::objectValue);
+    doc["type"] = (docnum % 2) ? "book" : "film";
+    doc["id"] = str(docnum);
+    for (unsigned i = 0; i != FIELD_COUNT; ++i) {
+	doc["field" + str(i)] = "value " + str(rand() % 1000);
+    }
+    Json::Value & author = doc["author"] = Json::objectValue;
+    author["name"] = "name " + str(docnum);
+    author["born"] = rand() % 2000;
+    Json::Value & tags = author["tags"] = Json::arrayValue;
+    for (unsigned i = 0; i != 5; ++i) {
+	tags.append("tag" + str(rand() % 50));
+    }
+    Json::Value & parts = doc["parts"] = Json::arrayValue;
+    for (unsigned i = 0; i != 10; ++i) {
+	Json::Value part(Json::objectValue);
+	part["title"] = "part " + str(i);
+	part["length"] = rand() % 100;
+	parts.append(part);
+    }
+    return doc;
+}
+
+/** Time applying a mapping (or its compiled form) to a set of documents.
+ *
+ *  Returns the number of fields in the output documents.
+ */
+template<class T> static unsigned
+time_apply(const char * desc, const T & mapping,
+	   const CollectionConfig & config, const vector<Json::Value> & docs)
+{
+    unsigned fields = 0;
+    Json::Value output;
+    double start(RealTime::now());
+    for (unsigned r = 0; r != REPEATS; ++r) {
+	for (vector<Json::Value>::const_iterator i = docs.begin();
+	     i != docs.end(); ++i) {
+	    if (mapping.apply(config, *i, output)) {
+		fields += output.size();
+	    }
+	}
+    }
+    double end(RealTime::now());
+    printf("%s: %.0f docs/s\n", desc,
+	   double(docs.size()) * REPEATS / (end - start));
+    return fields;
+}
+
+int main(int argc, const char ** argv) {
+    (void) argc;
+    (void) argv;
+    srand(42);
+
+    CollectionConfig config("pipeperf");
+    vector<Json::Value> docs;
+    for (unsigned i = 0; i != DOC_COUNT; ++i) {
+	docs.push_back(make_doc(i));
+    }
+
+    static const char * mappings[] = {
+	// Rename a few fields, preserving the rest.
+	"{\"map\": ["
+	 "{\"from\": [\"author\", \"name\"], \"to\": \"author_name\"},"
+	 "{\"from\": [\"author\", \"tags\"], \"to\": \"tag\"},"
+	 "{\"from\": [\"parts\", 0, \"title\"], \"to\": \"first_part\"}"
+	"]}",
+
+	// Pick out a few fields, discarding the rest.
+	"{\"when\": {\"equals\": [{\"get\": [\"type\"]}, {\"literal\": \"book\"}]},"
+	 "\"default\": \"discard\","
+	 "\"map\": ["
+	 "{\"from\": [\"id\"], \"to\": \"id\"},"
+	 "{\"from\": [\"field3\"], \"to\": \"text\"},"
+	 "{\"from\": [\"author\", \"name\"], \"to\": \"author_name\"}"
+	"]}",
+    };
+
+    for (unsigned i = 0; i != sizeof(mappings) / sizeof(mappings[0]); ++i) {
+	Json::Value tmp;
+	json_unserialise(mappings[i], tmp);
+	Mapping mapping;
+	mapping.from_json(tmp);
+	MappingProgram program;
+	program.compile(mapping);
+
+	printf("Mapping %u\n", i);
+	unsigned walked = time_apply(" walked", mapping, config, docs);
+	unsigned compiled = time_apply(" compiled", program, config, docs);
+	if (walked != compiled) {
+	    printf(" output differs: %u fields vs %u\n", walked, compiled);
+	    return 1;
+	}
+    }
+
+    return 0;
+}
@@ -0,0 +1,150 @@
+/** @file taxonomyperf.cc
+ * @brief Performance test for taxonomy edits and lookups.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "jsonxapian/taxonomy.h"
+
+#include "realtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "str.h"
+#include <vector>
+
+using namespace RestPose;
+using namespace std;
+
+static const unsigned CATEGORY_COUNT = 100000;
+static const unsigned BRANCHING = 10;
+static const unsigned LOOKUP_COUNT = 100000;
+static const unsigned EDIT_COUNT = 1000;
+
+static string
+cat_name(unsigned i)
+{
+    return "category" + str(i);
+}
+
+/** Parent of category i in the test hierarchy: a tree with BRANCHING
+ *  children per category.
+ */
+static unsigned
+parent_of(unsigned i)
+{
+    return (i - 1) / BRANCHING;
+}
+
+int main(int argc, const char ** argv) {
+    (void) argc;
+    (void) argv;
+    srand(42);
+
+    // Build the hierarchy incrementally.
+    Taxonomy taxonomy;
+    Categories modified;
+    double start(RealTime::now());
+    for (unsigned i = 1; i != CATEGORY_COUNT; ++i) {
+	modified.clear();
+	taxonomy.add_parent(cat_name(i), cat_name(parent_of(i)), modified);
+    }
+    double end(RealTime::now());
+    printf("Built %u categories incrementally in %f seconds\n",
+	   unsigned(taxonomy.size()), end - start);
+
+    // Round-trip through JSON.
+    Json::Value json;
+    taxonomy.to_json(json);
+    start = RealTime::now();
+    taxonomy.from_json(json);
+    end = RealTime::now();
+    printf("Loaded %u categories from JSON in %f seconds\n",
+	   unsigned(taxonomy.size()), end - start);
+
+    // Look up ancestors of random categories, as done when indexing.
+    size_t total = 0;
+    start = RealTime::now();
+    for (unsigned i = 0; i != LOOKUP_COUNT; ++i) {
+	Taxonomy::CategoryId id =
+		taxonomy.find_id(cat_name(rand() % CATEGORY_COUNT));
+	total += taxonomy.get_ancestor_ids(id).size();
+    }
+    end = RealTime::now();
+    printf("Ancestor lookups: %.3f usec each (%u ancestors found)\n",
+	   (end - start) * 1000000.0 / LOOKUP_COUNT, unsigned(total));
+
+    // Check ancestry of random pairs of categories.
+    total = 0;
+    start = RealTime::now();
+    for (unsigned i = 0; i != LOOKUP_COUNT; ++i) {
+	Taxonomy::CategoryId id =
+		taxonomy.find_id(cat_name(rand() % CATEGORY_COUNT));
+	Taxonomy::CategoryId other =
+		taxonomy.find_id(cat_name(rand() % 1000));
+	total += taxonomy.is_ancestor(id, other);
+    }
+    end = RealTime::now();
+    printf("Ancestor checks: %.3f usec each (%u matched)\n",
+	   (end - start) * 1000000.0 / LOOKUP_COUNT, unsigned(total));
+
+    // Enumerate descendants of upper-level categories, as done when
+    // expanding queries.
+    total = 0;
+    start = RealTime::now();
+    for (unsigned i = 1; i != 1 + BRANCHING; ++i) {
+	Categories descendants;
+	taxonomy.get_descendants(taxonomy.find_id(cat_name(i)), descendants);
+	total += descendants.size();
+    }
+    end = RealTime::now();
+    printf("Descendant enumeration: %f seconds for %u descendants\n",
+	   end - start, unsigned(total));
+
+    // Move random subtrees around.
+    total = 0;
+    start = RealTime::now();
+    for (unsigned i = 0; i != EDIT_COUNT; ++i) {
+	unsigned cat = BRANCHING + 1 + rand() % (CATEGORY_COUNT - BRANCHING - 1);
+	unsigned new_parent = 1 + rand() % BRANCHING;
+	modified.clear();
+	taxonomy.remove_parent(cat_name(cat), cat_name(parent_of(cat)),
+			       modified);
+	total += modified.size();
+	modified.clear();
+	try {
+	    taxonomy.add_parent(cat_name(cat), cat_name(new_parent), modified);
+	} catch (...) {
+	    // Would have created a loop.
+	}
+	total += modified.size();
+	modified.clear();
+	taxonomy.remove_parent(cat_name(cat), cat_name(new_parent), modified);
+	taxonomy.add_parent(cat_name(cat), cat_name(parent_of(cat)), modified);
+	total += modified.size();
+    }
+    end = RealTime::now();
+    printf("Edits: %.3f usec each (%u categories modified)\n",
+	   (end - start) * 1000000.0 / (EDIT_COUNT * 4), unsigned(total));
+
+    return 0;
+}
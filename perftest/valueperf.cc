@@ -0,0 +1,112 @@
+/** @file valueperf.cc
+ * @brief Performance test for document value encoding and decoding.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "jsonxapian/docvalues.h"
+
+#include <memory>
+#include "realtime.h"
+#include <stdio.h>
+#include <string>
+#include "str.h"
+#include <vector>
+#include <xapian.h>
+
+using namespace RestPose;
+using namespace std;
+
+static const unsigned DOC_COUNT = 20000;
+static const unsigned VALUES_PER_DOC = 8;
+
+/** Build documents with values in the given encoding, and time how long it
+ *  takes to accumulate and apply the values.
+ */
+static void
+build_docs(vector<Xapian::Document> & docs, ValueEncoding encoding)
+{
+    docs.clear();
+    double start(RealTime::now());
+    for (unsigned i = 0; i != DOC_COUNT; ++i) {
+	DocumentValues vals;
+	vals.set_slot_format(0, encoding);
+	for (unsigned j = 0; j != VALUES_PER_DOC; ++j) {
+	    // Add values in a scrambled order, with some duplicates.
+	    unsigned n = (i * 7 + j * 13) % (VALUES_PER_DOC - 2);
+	    if (encoding == ENC_GEOENCODE) {
+		vals.add(0, str(100000 + n));
+	    } else {
+		vals.add(0, "value" + str(n));
+	    }
+	}
+	Xapian::Document doc;
+	vals.apply(doc);
+	docs.push_back(doc);
+    }
+    double end(RealTime::now());
+    printf("  encode: %.3f usec/doc\n",
+	   (end - start) * 1000000.0 / DOC_COUNT);
+}
+
+/** Time decoding all the values from the documents.
+ */
+static void
+decode_docs(const vector<Xapian::Document> & docs, ValueEncoding encoding)
+{
+    auto_ptr<SlotDecoder> decoder(SlotDecoder::create(0, encoding));
+    size_t count = 0;
+    double start(RealTime::now());
+    for (vector<Xapian::Document>::const_iterator i = docs.begin();
+	 i != docs.end(); ++i) {
+	decoder->newdoc(*i);
+	const char * begin;
+	size_t len;
+	while (decoder->next(&begin, &len)) {
+	    ++count;
+	}
+    }
+    double end(RealTime::now());
+    printf("  decode: %.3f usec/doc (%u values)\n",
+	   (end - start) * 1000000.0 / DOC_COUNT, unsigned(count));
+}
+
+int main(int argc, const char ** argv) {
+    (void) argc;
+    (void) argv;
+
+    vector<Xapian::Document> docs;
+
+    printf("ENC_VINT_LENGTHS:\n");
+    build_docs(docs, ENC_VINT_LENGTHS);
+    decode_docs(docs, ENC_VINT_LENGTHS);
+
+    printf("ENC_SINGLY_VALUED:\n");
+    build_docs(docs, ENC_SINGLY_VALUED);
+    decode_docs(docs, ENC_SINGLY_VALUED);
+
+    printf("ENC_GEOENCODE:\n");
+    build_docs(docs, ENC_GEOENCODE);
+    decode_docs(docs, ENC_GEOENCODE);
+
+    return 0;
+}
@@ -25,6 +25,7 @@
 #include <config.h>
 #include "dbgroup.h"
 
+#include <algorithm>
 #include <cstdio>
 #include "utils.h"
 #include <xapian.h>
@@ -373,6 +374,56 @@ DbGroup::get_document(const std::string & idterm, bool & found) const
     return group_db.get_document(*pl);
 }
 
+/** Order positions in a list of terms by the terms at those positions.
+ */
+class TermPositionLess {
+    const vector<string> & terms;
+  public:
+    TermPositionLess(const vector<string> & terms_) : terms(terms_) {}
+
+    bool operator()(size_t a, size_t b) const {
+	return terms[a] < terms[b];
+    }
+};
+
+void
+DbGroup::get_documents(const vector<string> & idterms,
+		       vector<Xapian::Document> & docs,
+		       vector<bool> & found) const
+{
+    init_group_db();
+    docs.assign(idterms.size(), Xapian::Document());
+    found.assign(idterms.size(), false);
+
+    // Look the idterms up in sorted order, so that the term dictionary of
+    // each fragment is read through in order, rather than jumped around.
+    vector<size_t> order;
+    order.reserve(idterms.size());
+    for (size_t i = 0; i != idterms.size(); ++i) {
+	order.push_back(i);
+    }
+    sort(order.begin(), order.end(), TermPositionLess(idterms));
+
+    // Each document is only in one fragment, so look in each fragment
+    // directly (newest first, as when adding documents), rather than through
+    // group_db, which would need to look in every fragment for each idterm.
+    size_t remaining = idterms.size();
+    for (size_t i = frags.size(); i > 0 && remaining != 0; --i) {
+	Xapian::Database & db = frags[i - 1]->get_db();
+	for (vector<size_t>::const_iterator j = order.begin();
+	     j != order.end(); ++j) {
+	    if (found[*j]) continue;
+	    const string & idterm = idterms[*j];
+	    Xapian::PostingIterator pl(db.postlist_begin(idterm));
+	    if (pl != db.postlist_end(idterm)) {
+		docs[*j] = db.get_document(*pl);
+		found[*j] = true;
+		--remaining;
+	    }
+	}
+    }
+}
+
 bool
 DbGroup::doc_exists(const std::string & idterm) const
 {
@@ -26,6 +26,7 @@
 #define RESTPOSE_INCLUDED_DBGROUP_H
 
 #include <string>
+#include <vector>
 #include <xapian.h>
 
 namespace RestPose {
@@ -247,6 +248,19 @@ class DbGroup {
     Xapian::Document get_document(const std::string & idterm,
 				  bool & found) const;
 
+    /** Get a set of documents, given their idterm strings.
+     *
+     *  All the documents are read from the same revision of the group.
+     *
+     *  @param idterms The idterms to look for.
+     *  @param docs Set to the documents found, in the same order as
+     *  idterms, with an empty document for each one not found.
+     *  @param found Set to flags indicating which documents were found.
+     */
+    void get_documents(const std::vector<std::string> & idterms,
+		       std::vector<Xapian::Document> & docs,
+		       std::vector<bool> & found) const;
+
     /** Check if a document exists, given its idterm string.
      *
      *  @param idterm The document ID to look for.
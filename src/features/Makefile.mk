@@ -1,6 +1,8 @@
 noinst_LIBRARIES += libfeatures.a
 
 noinst_HEADERS += \
+ src/features/categoriser_handlers.h \
+ src/features/categoriser_tasks.h \
  src/features/category_handlers.h \
  src/features/category_tasks.h \
  src/features/checkpoint_handlers.h \
@@ -9,6 +11,8 @@ noinst_HEADERS += \
  src/features/coll_tasks.h
 
 libfeatures_a_SOURCES = \
+ src/features/categoriser_handlers.cc \
+ src/features/categoriser_tasks.cc \
  src/features/category_handlers.cc \
  src/features/category_tasks.cc \
  src/features/checkpoint_handlers.cc \
@@ -0,0 +1,106 @@
+/** @file categoriser_handlers.cc
+ * @brief Handlers related to categorisers.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "features/categoriser_handlers.h"
+
+#include "features/categoriser_tasks.h"
+#include "httpserver/httpserver.h"
+#include <memory>
+#include "server/task_manager.h"
+#include "utils/jsonutils.h"
+#include "utils/rsperrors.h"
+#include "utils/validation.h"
+
+using namespace std;
+using namespace RestPose;
+
+Handler *
+CollCategoriseHandlerFactory::create(const vector<string> & path_params) const
+{
+    string coll_name = path_params[0];
+    validate_collname_throw(coll_name);
+    string categoriser_name = path_params[1];
+    return new CollCategoriseHandler(coll_name, categoriser_name);
+}
+
+Queue::QueueState
+CollCategoriseHandler::enqueue(ConnectionInfo &,
+			       const Json::Value & body)
+{
+    auto_ptr<CategoriseBatch> batchptr;
+    try {
+	json_check_object(body, "categorise request");
+	string format = json_get_string_member(body, "format", "json");
+	if (format != "json" && format != "lines") {
+	    throw InvalidValueError("Unknown result format \"" + format +
+				    "\"; must be \"json\" or \"lines\"");
+	}
+	const Json::Value & texts_obj = body["texts"];
+	json_check_array(texts_obj, "texts to categorise");
+
+	batchptr.reset(new CategoriseBatch(resulthandle, categoriser_name,
+					   format == "lines"));
+	vector<string> & texts = batchptr->get_texts();
+	texts.reserve(texts_obj.size());
+	for (Json::Value::const_iterator i = texts_obj.begin();
+	     i != texts_obj.end(); ++i) {
+	    if (!(*i).isString()) {
+		throw InvalidValueError("Texts to categorise must be strings");
+	    }
+	    texts.push_back((*i).asString());
+	}
+    } catch (const InvalidValueError & e) {
+	resulthandle.failed(e.what(), 400);
+	return Queue::HAS_SPACE;
+    }
+
+    // Hold a reference while queueing, so that the batch isn't deleted if
+    // the first tasks finish before the rest are queued.
+    CategoriseBatch * batch = batchptr.release();
+    batch->ref();
+    vector<pair<size_t, size_t> > chunks;
+    CategoriseBatch::split(batch->get_texts().size(), chunks);
+    batch->set_chunk_count(chunks.size());
+
+    Queue::QueueState state = Queue::HAS_SPACE;
+    for (vector<pair<size_t, size_t> >::const_iterator i = chunks.begin();
+	 i != chunks.end(); ++i) {
+	Queue::QueueState chunk_state = taskman->queue_readonly("categorise",
+	    new CategoriseChunkTask(resulthandle, coll_name, batch,
+				    i->first, i->second));
+	if (chunk_state == Queue::CLOSED || chunk_state == Queue::FULL) {
+	    // The chunks which were queued will skip their work; the failure
+	    // is reported by the caller.
+	    batch->cancel();
+	    state = chunk_state;
+	    break;
+	}
+	if (chunk_state == Queue::LOW_SPACE) {
+	    state = chunk_state;
+	}
+    }
+    batch->unref();
+    return state;
+}
@@ -0,0 +1,196 @@
+/** @file categoriser_tasks.cc
+ * @brief Tasks related to categorisers.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "features/categoriser_tasks.h"
+
+#include <algorithm>
+#include "httpserver/response.h"
+#include "jsonxapian/collection.h"
+#include "logger/logger.h"
+#include "str.h"
+#include "utils/jsonutils.h"
+
+using namespace RestPose;
+using namespace std;
+
+void
+CategoriseBatch::split(size_t text_count,
+		       vector<pair<size_t, size_t> > & chunks)
+{
+    size_t chunk_count = (text_count + CATEGORISE_MIN_CHUNK_SIZE - 1) /
+	    CATEGORISE_MIN_CHUNK_SIZE;
+    if (chunk_count > CATEGORISE_MAX_CHUNKS) {
+	chunk_count = CATEGORISE_MAX_CHUNKS;
+    } else if (chunk_count == 0) {
+	chunk_count = 1;
+    }
+    size_t chunk_size = (text_count + chunk_count - 1) / chunk_count;
+    chunks.clear();
+    for (size_t i = 0; i != chunk_count; ++i) {
+	size_t begin = min(text_count, i * chunk_size);
+	size_t end = min(text_count, begin + chunk_size);
+	chunks.push_back(make_pair(begin, end));
+    }
+}
+
+void
+CategoriseBatch::ref()
+{
+    ContextLocker lock(mutex);
+    ++ref_count;
+}
+
+void
+CategoriseBatch::unref()
+{
+    ContextLocker lock(mutex);
+    --ref_count;
+    if (ref_count == 0) {
+	lock.unlock();
+	delete this;
+    }
+}
+
+void
+CategoriseBatch::cancel()
+{
+    ContextLocker lock(mutex);
+    failed = true;
+}
+
+void
+CategoriseBatch::categorise(const Collection & collection,
+			    size_t begin, size_t end)
+{
+    const Categoriser * cat;
+    {
+	ContextLocker lock(mutex);
+	if (failed) {
+	    return;
+	}
+	if (categoriser.get() == NULL) {
+	    categoriser.reset(
+		new Categoriser(collection.get_categoriser(categoriser_name)));
+	}
+	cat = categoriser.get();
+    }
+
+    vector<string> categories;
+    for (size_t i = begin; i != end; ++i) {
+	cat->categorise(texts[i], categories);
+	Json::Value row(Json::arrayValue);
+	for (vector<string>::const_iterator j = categories.begin();
+	     j != categories.end(); ++j) {
+	    row.append(*j);
+	}
+	results[i] = json_serialise(row);
+    }
+}
+
+void
+CategoriseBatch::chunk_done(bool succeeded)
+{
+    ContextLocker lock(mutex);
+    if (!succeeded) {
+	failed = true;
+    }
+    --pending;
+    if (pending != 0 || failed) {
+	return;
+    }
+    lock.unlock();
+    respond();
+}
+
+void
+CategoriseBatch::respond()
+{
+    Response & response = resulthandle.response();
+    if (!lines && response.is_msgpack()) {
+	// The results are held as JSON, so parse them to serialise them as
+	// MessagePack.  The lines format is always newline separated JSON.
+	Json::Value result(Json::objectValue);
+	Json::Value & rows = result["results"] = Json::arrayValue;
+	rows.resize(results.size());
+	for (size_t i = 0; i != results.size(); ++i) {
+	    json_unserialise(results[i], rows[Json::ArrayIndex(i)]);
+	}
+	response.set(result, 200);
+	resulthandle.set_ready();
+	return;
+    }
+
+    size_t len = 0;
+    for (vector<string>::const_iterator i = results.begin();
+	 i != results.end(); ++i) {
+	len += i->size() + 1;
+    }
+
+    string body;
+    if (lines) {
+	body.reserve(len);
+	for (vector<string>::const_iterator i = results.begin();
+	     i != results.end(); ++i) {
+	    body += *i;
+	    body += '\n';
+	}
+    } else {
+	body.reserve(len + 14);
+	body = "{\"results\":[";
+	for (vector<string>::const_iterator i = results.begin();
+	     i != results.end(); ++i) {
+	    if (i != results.begin()) {
+		body += ',';
+	    }
+	    body += *i;
+	}
+	body += "]}";
+    }
+
+    response.set_data(body);
+    response.set_content_type(lines ? "application/x-ndjson" :
+				      "application/json");
+    response.set_status(200);
+    resulthandle.set_ready();
+}
+
+CategoriseChunkTask::~CategoriseChunkTask()
+{
+    batch->unref();
+}
+
+void
+CategoriseChunkTask::perform(Collection * collection)
+{
+    try {
+	batch->categorise(*collection, begin, end);
+    } catch(...) {
+	batch->chunk_done(false);
+	throw;
+    }
+    LOG_DEBUG("categorised texts " + str(begin) + " to " + str(end) +
+	      " in collection '" + collection->get_name() + "'");
+    batch->chunk_done(true);
+}
@@ -0,0 +1,211 @@
+/** @file categoriser_tasks.h
+ * @brief Tasks related to categorisers.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RESTPOSE_INCLUDED_CATEGORISER_TASKS_H
+#define RESTPOSE_INCLUDED_CATEGORISER_TASKS_H
+
+#include <memory>
+#include "ngramcat/categoriser.h"
+#include "server/basetasks.h"
+#include <string>
+#include "utils/threading.h"
+#include <utility>
+#include <vector>
+
+/** Smallest number of texts to put in each chunk of a batch.
+ */
+#define CATEGORISE_MIN_CHUNK_SIZE 64
+
+/** Largest number of chunks to split a batch into.
+ *
+ *  This is a little more than the number of search threads, so that the
+ *  threads are kept busy even if the chunks take different times.
+ */
+#define CATEGORISE_MAX_CHUNKS 16
+
+/** The state shared by the tasks categorising a batch of texts.
+ *
+ *  The texts are split into chunks, each of which is categorised by a
+ *  separate task on the search queue, so that the chunks are spread across
+ *  the search threads.  The first task to run takes a copy of the
+ *  categoriser, which all the tasks then use, so that the whole batch is
+ *  categorised consistently even if the configuration changes part way
+ *  through.  The last task to finish assembles the response.
+ *
+ *  The state is reference counted by the tasks using it, and deleted when
+ *  the last of them is destroyed (whether or not it was performed).
+ */
+class CategoriseBatch {
+    CategoriseBatch(const CategoriseBatch &);
+    void operator=(const CategoriseBatch &);
+
+    /** Mutex protecting the mutable state.
+     */
+    Mutex mutex;
+
+    /** Number of tasks holding a reference to this state.
+     */
+    unsigned int ref_count;
+
+    /** The handle to return the response through.
+     */
+    RestPose::ResultHandle resulthandle;
+
+    /** The name of the categoriser to use.
+     */
+    std::string categoriser_name;
+
+    /** The texts to categorise.
+     */
+    std::vector<std::string> texts;
+
+    /** Whether to return the results as newline separated lines.
+     */
+    bool lines;
+
+    /** The categoriser used for all the chunks.
+     *
+     *  NULL until the first chunk is performed.
+     */
+    std::auto_ptr<RestPose::Categoriser> categoriser;
+
+    /** The results for each text, serialised as JSON.
+     *
+     *  Each chunk writes only the entries for its own texts, so these may be
+     *  written without holding the mutex.
+     */
+    std::vector<std::string> results;
+
+    /** Number of chunks still to be completed.
+     */
+    unsigned int pending;
+
+    /** Flag set if a chunk failed, or the batch was cancelled.
+     *
+     *  If set, the response is left to whatever reported the failure.
+     */
+    bool failed;
+
+    /** Build the response from the results, and mark it as ready.
+     */
+    void respond();
+
+  public:
+    CategoriseBatch(const RestPose::ResultHandle & resulthandle_,
+		    const std::string & categoriser_name_,
+		    bool lines_)
+	    : ref_count(0),
+	      resulthandle(resulthandle_),
+	      categoriser_name(categoriser_name_),
+	      lines(lines_),
+	      pending(0),
+	      failed(false)
+    {}
+
+    /** Get the list of texts, to fill it before queueing any tasks.
+     */
+    std::vector<std::string> & get_texts() {
+	return texts;
+    }
+
+    /** Split a batch of texts into chunks.
+     *
+     *  Each chunk holds at least CATEGORISE_MIN_CHUNK_SIZE texts (apart
+     *  from the last), and there are at most CATEGORISE_MAX_CHUNKS chunks.
+     *  There is always at least one chunk, even for an empty batch.
+     *
+     *  @param text_count The number of texts in the batch.
+     *  @param chunks Set to the (begin, end) indices of each chunk.
+     */
+    static void split(size_t text_count,
+		      std::vector<std::pair<size_t, size_t> > & chunks);
+
+    /** Set the number of chunks the batch will be split into.
+     *
+     *  Must be called before queueing any tasks.
+     */
+    void set_chunk_count(unsigned int chunk_count) {
+	pending = chunk_count;
+	results.resize(texts.size());
+    }
+
+    /** Add a reference to the state.
+     */
+    void ref();
+
+    /** Remove a reference to the state, deleting it if it was the last.
+     */
+    void unref();
+
+    /** Cancel the batch.
+     *
+     *  Used when not all the chunks could be queued; tasks for chunks
+     *  which were queued will skip their work.
+     */
+    void cancel();
+
+    /** Categorise a chunk of the texts.
+     *
+     *  @param collection The collection to get the categoriser from, if
+     *  no chunk has done so yet.
+     *  @param begin The index of the first text in the chunk.
+     *  @param end The index after the last text in the chunk.
+     */
+    void categorise(const RestPose::Collection & collection,
+		    size_t begin, size_t end);
+
+    /** Record that a chunk has been completed.
+     *
+     *  If this was the last chunk, and no chunk failed, the response is
+     *  built and marked as ready.
+     */
+    void chunk_done(bool succeeded);
+};
+
+/** Categorise a chunk of a batch of texts.
+ */
+class CategoriseChunkTask : public ReadonlyCollTask {
+    CategoriseBatch * batch;
+    size_t begin;
+    size_t end;
+  public:
+    CategoriseChunkTask(const RestPose::ResultHandle & resulthandle_,
+			const std::string & coll_name_,
+			CategoriseBatch * batch_,
+			size_t begin_,
+			size_t end_)
+	    : ReadonlyCollTask(resulthandle_, coll_name_),
+	      batch(batch_),
+	      begin(begin_),
+	      end(end_)
+    {
+	batch->ref();
+    }
+
+    ~CategoriseChunkTask();
+
+    void perform(RestPose::Collection * collection);
+};
+
+#endif /* RESTPOSE_INCLUDED_CATEGORISER_TASKS_H */
@@ -75,35 +75,39 @@ CollGetCategoryTask::perform(Collection * coll)
 	return;
     }
 
-    const Category * cat = hier->find(cat_id);
-    if (cat == NULL) {
+    Taxonomy::CategoryId cat = hier->find_id(cat_id);
+    if (cat == Taxonomy::NO_CATEGORY) {
 	result["err"] = "Category \"" + hexesc(cat_id) + "\" not found";
 	resulthandle.response().set(result, 404);
 	resulthandle.set_ready();
 	return;
     }
 
+    Categories cats;
+    hier->get_parents(cat, cats);
     Json::Value & parents = result["parents"] = Json::arrayValue;
-    for (Categories::const_iterator i = cat->parents.begin();
-	 i != cat->parents.end(); ++i) {
+    for (Categories::const_iterator i = cats.begin(); i != cats.end(); ++i) {
 	parents.append(*i);
     }
 
+    cats.clear();
+    hier->get_children(cat, cats);
     Json::Value & children = result["children"] = Json::arrayValue;
-    for (Categories::const_iterator i = cat->children.begin();
-	 i != cat->children.end(); ++i) {
+    for (Categories::const_iterator i = cats.begin(); i != cats.end(); ++i) {
 	children.append(*i);
     }
 
+    cats.clear();
+    hier->get_ancestors(cat, cats);
     Json::Value & ancestors = result["ancestors"] = Json::arrayValue;
-    for (Categories::const_iterator i = cat->ancestors.begin();
-	 i != cat->ancestors.end(); ++i) {
+    for (Categories::const_iterator i = cats.begin(); i != cats.end(); ++i) {
 	ancestors.append(*i);
     }
 
+    cats.clear();
+    hier->get_descendants(cat, cats);
     Json::Value & descendants = result["descendants"] = Json::arrayValue;
-    for (Categories::const_iterator i = cat->descendants.begin();
-	 i != cat->descendants.end(); ++i) {
+    for (Categories::const_iterator i = cats.begin(); i != cats.end(); ++i) {
 	descendants.append(*i);
     }
 
@@ -123,15 +127,16 @@ CollGetCategoryParentTask::perform(Collection * coll)
 	resulthandle.set_ready();
     }
 
-    const Category * cat = hier->find(cat_id);
-    if (cat == NULL) {
+    Taxonomy::CategoryId cat = hier->find_id(cat_id);
+    if (cat == Taxonomy::NO_CATEGORY) {
 	result["err"] = "Category \"" + hexesc(cat_id) + "\" not found";
 	resulthandle.response().set(result, 404);
 	resulthandle.set_ready();
 	return;
     }
 
-    if (cat->parents.find(parent_id) == cat->parents.end()) {
+    Taxonomy::CategoryId parent = hier->find_id(parent_id);
+    if (parent == Taxonomy::NO_CATEGORY || !hier->is_parent(cat, parent)) {
 	result["err"] = "Category \"" + hexesc(parent_id)
 		+ "\" not a parent of \"" + hexesc(parent_id) + "\"";
 	resulthandle.response().set(result, 404);
@@ -155,13 +160,13 @@ CollGetTopCategoriesTask::perform(Collection * coll)
 	resulthandle.set_ready();
     }
 
-    for (map<string, Category>::const_iterator i = hier->begin();
-	 i != hier->end(); ++i) {
-	const Category & cat = i->second;
-	if (cat.parents.empty()) {
-	    Json::Value & catval = result[cat.name] = Json::objectValue;
-	    catval["child_count"] = Json::UInt64(cat.children.size());
-	    catval["descendant_count"] = Json::UInt64(cat.descendants.size());
+    for (Taxonomy::const_iterator i = hier->begin(); i != hier->end(); ++i) {
+	Taxonomy::CategoryId cat = i->second;
+	if (hier->is_top(cat)) {
+	    Json::Value & catval = result[i->first] = Json::objectValue;
+	    catval["child_count"] = Json::UInt64(hier->child_count(cat));
+	    catval["descendant_count"] =
+		    Json::UInt64(hier->descendant_count(cat));
 	}
     }
 
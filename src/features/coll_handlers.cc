@@ -100,3 +100,21 @@ CollSetConfigHandler::enqueue(ConnectionInfo &,
 	new ProcessingCollSetConfigTask(body),
 	false);
 }
+
+Handler *
+CollTrainCompressionHandlerFactory::create(
+	const std::vector<std::string> & path_params) const
+{
+    string coll_name = path_params[0];
+    validate_collname_throw(coll_name);
+    return new CollTrainCompressionHandler(coll_name);
+}
+
+Queue::QueueState
+CollTrainCompressionHandler::enqueue(ConnectionInfo &,
+				     const Json::Value & body)
+{
+    return taskman->queue_processing(coll_name,
+	new ProcessingCollTrainCompressionTask(body),
+	false);
+}
@@ -86,5 +86,21 @@ class CollSetConfigHandler : public NoWaitQueuedHandler {
 			      const Json::Value & body);
 };
 
+class CollTrainCompressionHandlerFactory : public HandlerFactory {
+  public:
+    Handler * create(const std::vector<std::string> & path_params) const;
+};
+
+class CollTrainCompressionHandler : public NoWaitQueuedHandler {
+    std::string coll_name;
+  public:
+    CollTrainCompressionHandler(const std::string & coll_name_)
+	    : coll_name(coll_name_)
+    {}
+
+    Queue::QueueState enqueue(ConnectionInfo & conn,
+			      const Json::Value & body);
+};
+
 
 #endif /* RESTPOSE_INCLUDED_COLL_HANDLERS_H */
@@ -32,6 +32,8 @@
 #include <memory>
 #include "server/task_manager.h"
 #include <string>
+#include "utils/jsonutils.h"
+#include "utils/rsperrors.h"
 #include <vector>
 
 using namespace std;
@@ -75,7 +77,10 @@ void
 ProcessingCollSetConfigTask::perform(const std::string & coll_name,
 				     TaskManager * taskman)
 {
-    auto_ptr<CollectionConfig> collconfig(new CollectionConfig(coll_name));
+    // Start from the current config, so that from_json() can keep its
+    // document data compression dictionaries.
+    auto_ptr<CollectionConfig> collconfig(
+	taskman->get_collconfigs().get(coll_name));
     try {
 	collconfig->from_json(config);
     } catch (InvalidValueError & e) {
@@ -91,6 +96,36 @@ ProcessingCollSetConfigTask::perform(const std::string & coll_name,
 					    new CollSetConfigTask(config));
 }
 
+void
+ProcessingCollTrainCompressionTask::perform(const std::string & coll_name,
+					    TaskManager * taskman)
+{
+    auto_ptr<CollectionConfig> collconfig(
+	taskman->get_collconfigs().get(coll_name));
+    Json::Value stats;
+    try {
+	json_check_object(params, "compression training parameters");
+	collconfig->train_docdata_compression(params["samples"],
+	    json_get_uint64_member(params, "max_size", 32768, 32768),
+	    json_get_uint64_member(params, "level", 9, 6),
+	    stats);
+    } catch (InvalidValueError & e) {
+	string msg("Training document data compression failed with ");
+	msg += e.what();
+	LOG_ERROR(msg);
+	taskman->get_checkpoints().append_error(coll_name, msg,
+						string(), string());
+	return;
+    }
+    Json::Value config;
+    collconfig->to_json(config);
+    LOG_INFO("Trained document data compression for collection \"" +
+	     coll_name + "\": " + json_serialise(stats));
+    taskman->get_collconfigs().set(coll_name, collconfig.release());
+    taskman->queue_indexing_from_processing(coll_name,
+					    new CollSetConfigTask(config));
+}
+
 
 void
 CollSetConfigTask::perform_task(const string & coll_name,
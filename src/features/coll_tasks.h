@@ -73,6 +73,22 @@ class ProcessingCollSetConfigTask : public ProcessingTask {
 		 TaskManager * taskman);
 };
 
+/** Train a compression dictionary for stored document data.
+ *
+ *  The new configuration is then applied to the collection by a
+ *  CollSetConfigTask.
+ */
+class ProcessingCollTrainCompressionTask : public ProcessingTask {
+    Json::Value params;
+  public:
+    ProcessingCollTrainCompressionTask(const Json::Value & params_)
+	    : ProcessingTask(false),
+	      params(params_)
+    {}
+    void perform(const std::string & coll_name,
+		 TaskManager * taskman);
+};
+
 class CollSetConfigTask : public IndexingTask {
     Json::Value config;
   public:
@@ -28,6 +28,7 @@
 
 #include <cstdarg>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include "logger/logger.h"
 #include <microhttpd.h>
@@ -39,16 +40,29 @@
 #include <strings.h>
 #include <sys/types.h>
 #include "safesysselect.h"
+#include "utils/compression.h"
 #include "utils/jsonutils.h"
+#include "utils/msgpack.h"
 #include "utils/rsperrors.h"
 #include <xapian.h>
 
 using namespace std;
 using namespace RestPose;
 
+/// The smallest response body which will be compressed.
+#define RESPONSE_COMPRESSION_MIN_SIZE 1024
+
+/** The zlib compression level used for response bodies.
+ *
+ *  From 1 (fastest) to 9 (smallest).
+ */
+#define RESPONSE_COMPRESSION_LEVEL 6
+
 Response::Response()
 	: response(NULL),
-	  status_code(MHD_HTTP_OK)
+	  status_code(MHD_HTTP_OK),
+	  accepted_codings(CODING_IDENTITY),
+	  msgpack(false)
 {}
 
 Response::~Response()
@@ -65,11 +79,11 @@ Response::set_status(int status_code_)
 }
 
 void
-Response::set_data(const string & outbuf_)
+Response::set_body(const string & body, const char * content_encoding)
 {
     // Copy the output buffer into the response object, so it is available
     // until after the response has been sent.
-    outbuf = outbuf_;
+    outbuf = body;
 
     if (response) {
 	MHD_destroy_response(response);
@@ -78,6 +92,57 @@ Response::set_data(const string & outbuf_)
     response = MHD_create_response_from_buffer(outbuf.size(),
 	const_cast<char *>(outbuf.data()),
 	MHD_RESPMEM_PERSISTENT);
+    if (content_encoding != NULL) {
+	add_header("Content-Encoding", content_encoding);
+    }
+    if (outbuf.size() >= RESPONSE_COMPRESSION_MIN_SIZE ||
+	content_encoding != NULL) {
+	// The body would have been different for a different Accept-Encoding.
+	add_header("Vary", "Accept-Encoding");
+    }
+}
+
+bool
+Response::will_gzip(size_t len) const
+{
+    return (accepted_codings & CODING_GZIP) &&
+	    len >= RESPONSE_COMPRESSION_MIN_SIZE;
+}
+
+string
+Response::gzip(const string & data)
+{
+    ZlibDeflater deflater(ZLIB_FORMAT_GZIP, RESPONSE_COMPRESSION_LEVEL);
+    return deflater.deflate(data.data(), data.size());
+}
+
+void
+Response::set_data(const string & outbuf_)
+{
+    if (outbuf_.size() >= RESPONSE_COMPRESSION_MIN_SIZE) {
+	if (accepted_codings & CODING_GZIP) {
+	    set_body(gzip(outbuf_), "gzip");
+	    return;
+	}
+	if (accepted_codings & CODING_DEFLATE) {
+	    // The "deflate" content coding is the zlib format.
+	    ZlibDeflater deflater(ZLIB_FORMAT_ZLIB, RESPONSE_COMPRESSION_LEVEL);
+	    set_body(deflater.deflate(outbuf_.data(), outbuf_.size()),
+		     "deflate");
+	    return;
+	}
+    }
+    set_body(outbuf_, NULL);
+}
+
+void
+Response::set_data(const string & outbuf_, const string & gzipped)
+{
+    if (!gzipped.empty() && will_gzip(outbuf_.size())) {
+	set_body(gzipped, "gzip");
+    } else {
+	set_data(outbuf_);
+    }
 }
 
 void
@@ -104,8 +169,13 @@ Response::add_header(string header, string value)
 void
 Response::set(const Json::Value & body, int status_code_)
 {
-    set_data(json_serialise(body));
-    set_content_type("application/json");
+    if (msgpack) {
+	set_data(msgpack_serialise(body));
+	set_content_type(MSGPACK_CONTENT_TYPE);
+    } else {
+	set_data(json_serialise(body));
+	set_content_type("application/json");
+    }
     set_status(status_code_);
 }
 
@@ -197,6 +267,141 @@ ConnectionInfo::get_uri_arg_bool(const string & key,
     return defval;
 }
 
+const char *
+ConnectionInfo::get_header(const char * name) const
+{
+    return MHD_lookup_connection_value(connection, MHD_HEADER_KIND, name);
+}
+
+/** Get the quality value which a header listing acceptable values (such as
+ *  Accept-Encoding, or Accept) gives to a value.
+ *
+ *  The header is a comma separated list of values, each of which may have
+ *  parameters, including a quality value ("q", 1 if not given).  An entry
+ *  naming the value exactly takes precedence over a wildcard subtype entry,
+ *  which takes precedence over a full wildcard.  If exact is non-NULL, it is
+ *  set to whether an entry named the value exactly.
+ *
+ *  Returns 0 if the value isn't listed, or is listed as not acceptable.
+ */
+static double
+header_quality(const char * header, const char * value, bool * exact = NULL)
+{
+    size_t value_len = strlen(value);
+    // How specific the best entry found so far is: 0 for none, 1 for a
+    // wildcard, 2 for a wildcard subtype, and 3 for an exact match.
+    int best_rank = 0;
+    double best_quality = 0.0;
+    const char * pos = header;
+    while (*pos != '\0') {
+	while (*pos == ' ' || *pos == '\t' || *pos == ',') ++pos;
+	const char * end = pos;
+	while (*end != '\0' && *end != ',' && *end != ';' &&
+	       *end != ' ' && *end != '\t') ++end;
+	size_t len = end - pos;
+	int rank = 0;
+	if (len == value_len && strncasecmp(pos, value, value_len) == 0) {
+	    rank = 3;
+	} else if (len > 2 && pos[len - 2] == '/' && pos[len - 1] == '*' &&
+		   len - 1 < value_len &&
+		   strncasecmp(pos, value, len - 1) == 0) {
+	    rank = 2;
+	} else if ((len == 1 && *pos == '*') ||
+		   (len == 3 && strncmp(pos, "*/*", 3) == 0)) {
+	    rank = 1;
+	}
+
+	double quality = 1.0;
+	while (*end != '\0' && *end != ',') {
+	    if (*end == ';') {
+		const char * param = end + 1;
+		while (*param == ' ' || *param == '\t') ++param;
+		if ((param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+		    quality = strtod(param + 2, NULL);
+		}
+	    }
+	    ++end;
+	}
+	if (rank > best_rank) {
+	    best_rank = rank;
+	    best_quality = quality;
+	}
+	pos = end;
+    }
+    if (exact != NULL) {
+	*exact = (best_rank == 3);
+    }
+    return best_quality > 0.0 ? best_quality : 0.0;
+}
+
+/// Check if a Content-Type header value is for MessagePack.
+static bool
+is_msgpack_type(const char * content_type)
+{
+    const char * end = content_type;
+    while (*end != '\0' && *end != ';' && *end != ' ' && *end != '\t') {
+	++end;
+    }
+    size_t len = end - content_type;
+    return (len == strlen(MSGPACK_CONTENT_TYPE) &&
+	    strncasecmp(content_type, MSGPACK_CONTENT_TYPE, len) == 0) ||
+	    (len == strlen("application/msgpack") &&
+	     strncasecmp(content_type, "application/msgpack", len) == 0);
+}
+
+bool
+ConnectionInfo::accepts_encoding(const char * encoding) const
+{
+    const char * header = get_header("Accept-Encoding");
+    if (header == NULL) {
+	return false;
+    }
+    return header_quality(header, encoding) > 0.0;
+}
+
+bool
+ConnectionInfo::accepts_msgpack() const
+{
+    const char * header = get_header("Accept");
+    if (header == NULL) {
+	return false;
+    }
+    // MessagePack must be asked for by name (so that "*/*" gets JSON), and be
+    // preferred at least as much as JSON.
+    bool exact;
+    double msgpack_quality = header_quality(header, MSGPACK_CONTENT_TYPE,
+					    &exact);
+    if (!exact) {
+	msgpack_quality = header_quality(header, "application/msgpack",
+					 &exact);
+	if (!exact) {
+	    return false;
+	}
+    }
+    return msgpack_quality > 0.0 &&
+	    msgpack_quality >= header_quality(header, "application/json");
+}
+
+bool
+ConnectionInfo::body_is_msgpack() const
+{
+    const char * content_type = get_header("Content-Type");
+    return content_type != NULL && is_msgpack_type(content_type);
+}
+
+int
+ConnectionInfo::accepted_codings() const
+{
+    int codings = CODING_IDENTITY;
+    if (accepts_encoding("gzip")) {
+	codings |= CODING_GZIP;
+    }
+    if (accepts_encoding("deflate")) {
+	codings |= CODING_DEFLATE;
+    }
+    return codings;
+}
+
 void
 ConnectionInfo::parse_url_components()
 {
@@ -238,14 +443,19 @@ void
 ConnectionInfo::respond()
 {
     Response & response(resulthandle.response());
-    struct MHD_Response * response_ptr = response.get_response();
+    respond(response.get_status_code(), response.get_response());
+}
+
+void
+ConnectionInfo::respond(int status_code, struct MHD_Response * response_ptr)
+{
     if (!response_ptr) {
 	throw RestPose::HTTPServerError("No response to send");
     }
     LOG_INFO(string(url) + " " + string(method_str()) + " " +
-	     str(response.get_status_code()));
+	     str(status_code));
 
-    if (MHD_queue_response(connection, response.get_status_code(),
+    if (MHD_queue_response(connection, status_code,
 			   response_ptr) != MHD_YES) {
 	throw RestPose::HTTPServerError("Couldn't queue response");
     }
@@ -31,6 +31,7 @@
 
 /* Forward declarations */
 struct MHD_Daemon;
+struct MHD_Response;
 class Handler;
 class Router;
 class Response;
@@ -123,6 +124,38 @@ class ConnectionInfo {
     bool get_uri_arg_bool(const std::string & key,
 			  bool defval) const;
 
+    /** Get the value of a request header.
+     *
+     *  Returns NULL if the header wasn't supplied.
+     */
+    const char * get_header(const char * name) const;
+
+    /** Check if the client accepts a content coding (eg, "gzip").
+     *
+     *  Checks the Accept-Encoding header, honouring any quality values of 0.
+     */
+    bool accepts_encoding(const char * encoding) const;
+
+    /** Check if the client accepts a MessagePack response.
+     *
+     *  Checks the Accept header for MSGPACK_CONTENT_TYPE (or
+     *  application/msgpack), which must be named explicitly, and given a
+     *  quality value at least as high as that for application/json.
+     */
+    bool accepts_msgpack() const;
+
+    /** Check if the request body is in MessagePack format.
+     *
+     *  Checks the Content-Type header; otherwise, the body is JSON.
+     */
+    bool body_is_msgpack() const;
+
+    /** Get the content codings which the client accepts for a response.
+     *
+     *  Returns a bitmap of ContentCoding values.
+     */
+    int accepted_codings() const;
+
     /** Parse the url components (separated by / ) into the components member.
      */
     void parse_url_components();
@@ -140,6 +173,15 @@ class ConnectionInfo {
 		 const std::string & outbuf,
 		 const std::string & content_type);
 
+    /** Respond to a request with a prepared libmicrohttpd response.
+     *
+     *  The caller keeps ownership of the response, which may be shared
+     *  between many requests; libmicrohttpd keeps it alive until it has been
+     *  sent.  The response held in the connection's result handle is not
+     *  used.
+     */
+    void respond(int status_code, struct MHD_Response * response_ptr);
+
     /** Require the HTTP method used to be one of the allowed methods.
      *
      *  @param allowed_methods A bitmap of HTTP methods which are allowed.
@@ -31,12 +31,34 @@
 /* Forward declarations */
 struct MHD_Response;
 
+/// The content type used for MessagePack request and response bodies.
+#define MSGPACK_CONTENT_TYPE "application/x-msgpack"
+
+/// Content codings which may be applied to a response body.
+enum ContentCoding {
+    CODING_IDENTITY = 0,
+    CODING_GZIP = 1,
+    CODING_DEFLATE = 2
+};
+
 class Response {
     struct MHD_Response * response;
     int status_code;
 
+    /// The content codings (a bitmap of ContentCoding) the client accepts.
+    int accepted_codings;
+
+    /// True if JSON response bodies should be sent as MessagePack.
+    bool msgpack;
+
     std::string outbuf;
 
+    /** Set the response body, which has had content_encoding applied.
+     *
+     *  content_encoding may be NULL, for an uncompressed body.
+     */
+    void set_body(const std::string & body, const char * content_encoding);
+
     Response(const Response &);
     void operator=(const Response &);
   public:
@@ -46,12 +68,61 @@ class Response {
     /// Set the status code for the response.
     void set_status(int status_code_);
 
+    /** Set the content codings which the client accepts.
+     *
+     *  Response bodies which are set after this call, and which are large
+     *  enough to be worth compressing, will be compressed with one of these
+     *  codings.  This should be called before the response is passed to the
+     *  thread which prepares it, so that the compression happens there
+     *  rather than in the HTTP server's thread.
+     *
+     *  @param codings A bitmap of ContentCoding values.
+     */
+    void set_accepted_codings(int codings) {
+	accepted_codings = codings;
+    }
+
+    /** Set whether the client accepts MessagePack responses.
+     *
+     *  If so, responses set with set() are serialised as MessagePack rather
+     *  than JSON.
+     */
+    void set_msgpack(bool msgpack_) {
+	msgpack = msgpack_;
+    }
+
+    /// Check if responses set with set() are serialised as MessagePack.
+    bool is_msgpack() const {
+	return msgpack;
+    }
+
+    /** Check if a response body of the given length would be sent gzip
+     *  compressed.
+     */
+    bool will_gzip(size_t len) const;
+
+    /** Compress some data with gzip, as used for response bodies.
+     */
+    static std::string gzip(const std::string & data);
+
     /** Set the response body from a string.
+     *
+     *  The body is compressed if the client accepts a compressed response,
+     *  and it is large enough to be worth compressing.
      *
      *  This clears any headers which have been set already.
      */
     void set_data(const std::string & outbuf_);
 
+    /** Set the response body from a string, and its gzip compressed form.
+     *
+     *  This avoids compressing the body again when a compressed form has
+     *  been cached.  The compressed form is used if will_gzip() returns true
+     *  for the size of the body; otherwise, this is equivalent to
+     *  set_data(outbuf_).
+     */
+    void set_data(const std::string & outbuf_, const std::string & gzipped);
+
     /** Set the content type for the response.
      *
      *  This is just a shortcut for calling add_header to set the content type.
@@ -69,12 +140,21 @@ class Response {
      *
      *  This sets the response body to be the serialised JSON value, sets the
      *  content type to application/json, and sets the status code to the value
-     *  supplied.
+     *  supplied.  If set_msgpack() has been used to enable MessagePack, the
+     *  value is serialised as MessagePack instead.
      */
     void set(const Json::Value & body, int status_code_ = 200);
 
     struct MHD_Response * get_response();
     int get_status_code() const;
+
+    /** Get the response body, as it will be sent.
+     *
+     *  This is after any content coding has been applied.
+     */
+    const std::string & get_body() const {
+	return outbuf;
+    }
 };
 
 #endif /* RESTPOSE_INCLUDED_RESPONSE_H */
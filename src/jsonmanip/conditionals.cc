@@ -25,6 +25,7 @@
 #include <config.h>
 #include "jsonmanip/conditionals.h"
 
+#include "jsonmanip/mappingprogram.h"
 #include "utils/jsonutils.h"
 #include "utils/rsperrors.h"
 
@@ -104,6 +105,12 @@ ConditionalClauseExists::apply(const Json::Value & document) const
     return true;
 }
 
+void
+ConditionalClauseExists::compile(ConditionalProgram & program) const
+{
+    program.add_exists(path);
+}
+
 
 ConditionalClauseGet::ConditionalClauseGet(const Json::Value & value)
 	: ConditionalClause("get")
@@ -152,6 +159,12 @@ ConditionalClauseGet::apply(const Json::Value & document) const
     return *current;
 }
 
+void
+ConditionalClauseGet::compile(ConditionalProgram & program) const
+{
+    program.add_get(path);
+}
+
 
 ConditionalClauseLiteral::ConditionalClauseLiteral(const Json::Value & value_)
 	: ConditionalClause("literal")
@@ -171,6 +184,12 @@ ConditionalClauseLiteral::apply(const Json::Value &) const
     return value;
 }
 
+void
+ConditionalClauseLiteral::compile(ConditionalProgram & program) const
+{
+    program.add_literal(value);
+}
+
 
 ConditionalClauseEquals::ConditionalClauseEquals(const Json::Value & value)
 	: ConditionalClause("equals")
@@ -227,6 +246,16 @@ ConditionalClauseEquals::apply(const Json::Value & document) const
     return true;
 }
 
+void
+ConditionalClauseEquals::compile(ConditionalProgram & program) const
+{
+    for (std::vector<ConditionalClause *>::const_iterator
+	 i = children.begin(); i != children.end(); ++i) {
+	(*i)->compile(program);
+    }
+    program.add_equals(children.size());
+}
+
 
 Conditional::Conditional(const Conditional & other)
 	: clause(NULL)
@@ -269,6 +298,15 @@ Conditional::from_json(const Json::Value & value)
     }
 }
 
+void
+Conditional::compile(ConditionalProgram & program) const
+{
+    program.clear();
+    if (clause != NULL) {
+	clause->compile(program);
+    }
+}
+
 bool
 Conditional::test(const Json::Value & value) const
 {
@@ -31,6 +31,8 @@
 
 namespace RestPose {
 
+    class ConditionalProgram;
+
     /** Base class of conditional clauses.
      */
     class ConditionalClause {
@@ -54,6 +56,9 @@ namespace RestPose {
 
 	/// Apply this conditional against a value.
 	virtual Json::Value apply(const Json::Value & value) const = 0;
+
+	/// Append instructions to evaluate this clause to a program.
+	virtual void compile(ConditionalProgram & program) const = 0;
     };
 
     /** A conditional clause that tests if a field exists.
@@ -72,6 +77,9 @@ namespace RestPose {
 
 	/// Apply this conditional against a value.
 	Json::Value apply(const Json::Value & value) const;
+
+	/// Append instructions to evaluate this clause to a program.
+	void compile(ConditionalProgram & program) const;
     };
 
     /** A conditional clause that gets a field from the document.
@@ -90,6 +98,9 @@ namespace RestPose {
 
 	/// Apply this conditional to a document.
 	Json::Value apply(const Json::Value & document) const;
+
+	/// Append instructions to evaluate this clause to a program.
+	void compile(ConditionalProgram & program) const;
     };
 
     /** A conditional clause which returns a literal value.
@@ -107,6 +118,9 @@ namespace RestPose {
 
 	/// apply this conditional.
 	Json::Value apply(const Json::Value &) const;
+
+	/// Append instructions to evaluate this clause to a program.
+	void compile(ConditionalProgram & program) const;
     };
 
     /** A conditional clause that tests if items are equal.
@@ -125,6 +139,9 @@ namespace RestPose {
 
 	/// Apply this conditional.
 	Json::Value apply(const Json::Value &document) const;
+
+	/// Append instructions to evaluate this clause to a program.
+	void compile(ConditionalProgram & program) const;
     };
 
     /** A conditional expression, to be applied to a JSON document.
@@ -158,6 +175,14 @@ namespace RestPose {
 	 */
 	bool test(const Json::Value & value) const;
 
+	/** Compile the conditional into a program.
+	 *
+	 *  The program gives the same results as test(), but avoids copying
+	 *  values while evaluating.  A null conditional gives an empty
+	 *  program.
+	 */
+	void compile(ConditionalProgram & program) const;
+
 	/** Check if the conditional is null.
 	 *
 	 *  An uninitialised conditional, or one initialised from null, will
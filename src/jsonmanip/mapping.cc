@@ -161,11 +161,11 @@ Mapping::from_json(const Json::Value & value)
     }
 }
 
-static void
-append_field(Json::Value & output, const std::string & key,
-	     const Json::Value & value)
+void
+RestPose::append_field(Json::Value & output, const char * key,
+		       const Json::Value & value)
 {
-    //printf("append_field(%s, %s)\n", key.c_str(), json_serialise(value).c_str());
+    //printf("append_field(%s, %s)\n", key, json_serialise(value).c_str());
     Json::Value & oldval = output[key];
     if (!oldval.isArray()) {
 	// Value should be null; we'll just override it.
@@ -187,6 +187,44 @@ append_field(Json::Value & output, const std::string & key,
     }
 }
 
+void
+MappingTarget::apply(const CollectionConfig & collconfig,
+		     const Json::Value & value,
+		     Json::Value & output) const
+{
+    if (categoriser.empty()) {
+	append_field(output, field.c_str(), value);
+	return;
+    }
+
+    std::string text;
+    if (!value.isArray()) {
+	// FIXME - log invalid value.
+	//printf("invalid value for categoriser: not an array, was %s\n", json_serialise(value).c_str());
+	if (value.isString()) {
+	    text = value.asString();
+	}
+    } else {
+	for (Json::Value::const_iterator j = value.begin();
+	     j != value.end(); ++j) {
+	    if (!(*j).isString()) {
+		//printf("invalid value in array for categoriser: not a string\n");
+		// FIXME - log invalid value.
+	    } else {
+		text.append((*j).asString());
+		text.append(" ");
+	    }
+	}
+    }
+    if (text.empty()) {
+	append_field(output, field.c_str(), Json::StaticString(""));
+    } else {
+	Json::Value category;
+	collconfig.categorise(categoriser, text, category);
+	append_field(output, field.c_str(), category);
+    }
+}
+
 bool
 Mapping::handle(const CollectionConfig & collconfig,
 		const std::vector<const MappingActions *> & stack,
@@ -214,37 +252,7 @@ Mapping::handle(const CollectionConfig & collconfig,
     for (std::vector<MappingTarget>::const_iterator
 	 i = actions->target_fields.begin();
 	 i != actions->target_fields.end(); ++i) {
-	if (i->categoriser.empty()) {
-	    append_field(output, i->field, *(event.value));
-	} else {
-	    const Json::Value & fieldval = *(event.value);
-	    std::string text;
-	    if (!fieldval.isArray()) {
-		// FIXME - log invalid value.
-		//printf("invalid value for categoriser: not an array, was %s\n", json_serialise(fieldval).c_str());
-		if (fieldval.isString()) {
-		    text = fieldval.asString();
-		}
-	    } else {
-		for (Json::Value::const_iterator j = fieldval.begin();
-		     j != fieldval.end(); ++j) {
-		    if (!(*j).isString()) {
-			//printf("invalid value in array for categoriser: not a string\n");
-			// FIXME - log invalid value.
-		    } else {
-			text.append((*j).asString());
-			text.append(" ");
-		    }
-		}
-	    }
-	    if (text.empty()) {
-		append_field(output, i->field, Json::StaticString(""));
-	    } else {
-		Json::Value category;
-		collconfig.categorise(i->categoriser, text, category);
-		append_field(output, i->field, category);
-	    }
-	}
+	i->apply(collconfig, *(event.value), output);
 	handled = true;
     }
     return handled;
@@ -257,7 +265,7 @@ Mapping::handle_default(const std::vector<const MappingActions *> & stack,
 {
     if (default_action == PRESERVE_TOP) {
 	if (stack.size() == 1) {
-	    append_field(output, event.component.key, *(event.value));
+	    append_field(output, event.component.key.c_str(), *(event.value));
 	}
     }
 }
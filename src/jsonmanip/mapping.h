@@ -41,6 +41,13 @@ namespace RestPose {
      */
     typedef std::map<JSONPathComponent, MappingActions> ActionMap;
 
+    /** Append a value to a field of an output document.
+     *
+     *  If the value is an array, its items are appended.
+     */
+    void append_field(Json::Value & output, const char * key,
+		      const Json::Value & value);
+
     struct MappingTarget {
 	/** The field to store the results in.
 	 */
@@ -53,6 +60,15 @@ namespace RestPose {
 	MappingTarget(const std::string & field_)
 		: field(field_)
 	{}
+
+	/** Store a value in the target field of an output document.
+	 *
+	 *  If a categoriser is set, the categories of the value are stored
+	 *  instead of the value itself.
+	 */
+	void apply(const CollectionConfig & collconfig,
+		   const Json::Value & value,
+		   Json::Value & output) const;
     };
 
     /** The mapping to apply at or below a particular element.
@@ -76,8 +92,14 @@ namespace RestPose {
     };
 
     /** A mapping, to be applied to a JSON document.
+     *
+     *  This applies the mapping by walking over every element of the
+     *  document.  A MappingProgram compiled from the mapping gives the same
+     *  results faster; this implementation is kept as the reference.
      */
     class Mapping {
+	friend class MappingProgram;
+
 	/// A conditional specifying when the mapping should be applied.
 	Conditional when;
 
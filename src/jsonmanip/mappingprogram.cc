@@ -0,0 +1,302 @@
+/** @file mappingprogram.cc
+ * @brief Mappings and conditionals compiled into flat programs.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "jsonmanip/mappingprogram.h"
+
+#include "jsonmanip/conditionals.h"
+#include <string.h>
+#include "utils/jsonutils.h"
+#include "utils/rsperrors.h"
+
+using namespace RestPose;
+
+/** Number of stack entries available without allocating when evaluating a
+ *  conditional program.
+ */
+#define CONDITIONAL_STACK_SIZE 16
+
+static const Json::Value json_true(true);
+static const Json::Value json_false(false);
+
+/** Find the child of a value for a path component.
+ *
+ *  Returns NULL if the value has no such child.
+ */
+static inline const Json::Value *
+find_child(const Json::Value & value, const JSONPathComponent & component)
+{
+    const Json::Value * child;
+    if (component.type == JSONPathComponent::JSONPATH_KEY) {
+	if (!value.isObject()) {
+	    return NULL;
+	}
+	child = &(value[component.key]);
+    } else {
+	if (!value.isArray() || !value.isValidIndex(component.index)) {
+	    return NULL;
+	}
+	child = &(value[component.index]);
+    }
+    // Lookups of missing members return a reference to the shared null.
+    if (child == &Json::Value::null) {
+	return NULL;
+    }
+    return child;
+}
+
+/** Find the value at a path.
+ *
+ *  Returns NULL if the path doesn't exist in the document.
+ */
+static const Json::Value *
+find_path(const JSONPath & path, const Json::Value & document)
+{
+    const Json::Value * current = &document;
+    for (std::vector<JSONPathComponent>::const_iterator
+	 i = path.path.begin(); i != path.path.end(); ++i) {
+	current = find_child(*current, *i);
+	if (current == NULL) {
+	    return NULL;
+	}
+    }
+    return current;
+}
+
+void
+ConditionalProgram::push_op(OpCode code, unsigned int arg,
+			    unsigned int popped)
+{
+    ops.push_back(Op(code, arg));
+    depth = depth - popped + 1;
+    if (depth > max_depth) {
+	max_depth = depth;
+    }
+}
+
+void
+ConditionalProgram::clear()
+{
+    ops.clear();
+    paths.clear();
+    literals.clear();
+    depth = 0;
+    max_depth = 0;
+}
+
+void
+ConditionalProgram::add_exists(const JSONPath & path)
+{
+    paths.push_back(path);
+    push_op(OP_EXISTS, paths.size() - 1, 0);
+}
+
+void
+ConditionalProgram::add_get(const JSONPath & path)
+{
+    paths.push_back(path);
+    push_op(OP_GET, paths.size() - 1, 0);
+}
+
+void
+ConditionalProgram::add_literal(const Json::Value & value)
+{
+    literals.push_back(value);
+    push_op(OP_LITERAL, literals.size() - 1, 0);
+}
+
+void
+ConditionalProgram::add_equals(unsigned int count)
+{
+    push_op(OP_EQUALS, count, count);
+}
+
+bool
+ConditionalProgram::test(const Json::Value & document) const
+{
+    if (ops.empty()) {
+	throw InvalidValueError("Attempt to test a null conditional");
+    }
+
+    const Json::Value * local_stack[CONDITIONAL_STACK_SIZE];
+    std::vector<const Json::Value *> heap_stack;
+    const Json::Value ** stack = local_stack;
+    if (max_depth > CONDITIONAL_STACK_SIZE) {
+	heap_stack.resize(max_depth);
+	stack = &(heap_stack[0]);
+    }
+
+    unsigned int top = 0;
+    for (std::vector<Op>::const_iterator i = ops.begin();
+	 i != ops.end(); ++i) {
+	switch (i->code) {
+	    case OP_EXISTS:
+		stack[top++] = find_path(paths[i->arg], document) ?
+			&json_true : &json_false;
+		break;
+	    case OP_GET: {
+		const Json::Value * value = find_path(paths[i->arg], document);
+		stack[top++] = value ? value : &Json::Value::null;
+		break;
+	    }
+	    case OP_LITERAL:
+		stack[top++] = &(literals[i->arg]);
+		break;
+	    case OP_EQUALS: {
+		unsigned int base = top - i->arg;
+		bool equal = true;
+		for (unsigned int j = base + 1; j < top; ++j) {
+		    if (*(stack[j]) != *(stack[base])) {
+			equal = false;
+			break;
+		    }
+		}
+		top = base;
+		stack[top++] = equal ? &json_true : &json_false;
+		break;
+	    }
+	}
+    }
+    return stack[0]->asBool();
+}
+
+unsigned int
+MappingProgram::add_node(const MappingActions & actions)
+{
+    unsigned int index = nodes.size();
+    nodes.push_back(Node());
+    nodes[index].first_target = targets.size();
+    nodes[index].target_count = actions.target_fields.size();
+    targets.insert(targets.end(), actions.target_fields.begin(),
+		   actions.target_fields.end());
+
+    // Reserve the node's edges before adding the children, so that they're
+    // contiguous.  The children are in sorted order, which is the same as
+    // the order in which the corresponding values are stored in a document.
+    unsigned int edge = edges.size();
+    nodes[index].first_edge = edge;
+    nodes[index].edge_count = actions.children.size();
+    edges.resize(edges.size() + actions.children.size());
+    for (ActionMap::const_iterator i = actions.children.begin();
+	 i != actions.children.end(); ++i, ++edge) {
+	edges[edge].component = i->first;
+	unsigned int child = add_node(i->second);
+	edges[edge].node = child;
+    }
+    return index;
+}
+
+void
+MappingProgram::compile(const Mapping & mapping)
+{
+    mapping.when.compile(when);
+    preserve_top = (mapping.default_action == Mapping::PRESERVE_TOP);
+    nodes.clear();
+    edges.clear();
+    targets.clear();
+    add_node(mapping.mappings);
+}
+
+bool
+MappingProgram::apply_node(const CollectionConfig & collconfig,
+			   const Node & node,
+			   const Json::Value & value,
+			   Json::Value & output) const
+{
+    bool handled = false;
+    unsigned int end_target = node.first_target + node.target_count;
+    for (unsigned int i = node.first_target; i != end_target; ++i) {
+	targets[i].apply(collconfig, value, output);
+	handled = true;
+    }
+
+    if (node.edge_count != 0 && (value.isObject() || value.isArray())) {
+	unsigned int end_edge = node.first_edge + node.edge_count;
+	for (unsigned int i = node.first_edge; i != end_edge; ++i) {
+	    const Json::Value * child = find_child(value, edges[i].component);
+	    if (child != NULL &&
+		apply_node(collconfig, nodes[edges[i].node], *child, output)) {
+		handled = true;
+	    }
+	}
+    }
+    return handled;
+}
+
+bool
+MappingProgram::apply(const CollectionConfig & collconfig,
+		      const Json::Value & input,
+		      Json::Value & output) const
+{
+    json_check_object(input, "input to mapping");
+
+    if (!when.empty() && !when.test(input)) {
+	output = Json::nullValue;
+	return false;
+    }
+    output = Json::objectValue;
+    if (nodes.empty()) {
+	return true;
+    }
+
+    const Node & root = nodes[0];
+    unsigned int edge = root.first_edge;
+    unsigned int end_edge = root.first_edge + root.edge_count;
+    if (!preserve_top) {
+	for (; edge != end_edge; ++edge) {
+	    const Json::Value * child = find_child(input, edges[edge].component);
+	    if (child != NULL) {
+		(void) apply_node(collconfig, nodes[edges[edge].node], *child,
+				  output);
+	    }
+	}
+	return true;
+    }
+
+    // Step through the top-level members of the input in order, alongside
+    // the edges from the root, preserving any members which aren't mapped.
+    // Both are in strcmp() order, and key edges sort before index edges.
+    for (Json::Value::const_iterator i = input.begin();
+	 i != input.end(); ++i) {
+	const char * key = i.memberName();
+	int cmp = -1;
+	while (edge != end_edge && edges[edge].component.is_string()) {
+	    cmp = strcmp(edges[edge].component.key.c_str(), key);
+	    if (cmp >= 0) {
+		break;
+	    }
+	    ++edge;
+	}
+	bool handled = false;
+	if (edge != end_edge && edges[edge].component.is_string() &&
+	    cmp == 0) {
+	    handled = apply_node(collconfig, nodes[edges[edge].node], *i,
+				 output);
+	}
+	if (!handled) {
+	    append_field(output, key, *i);
+	}
+    }
+    return true;
+}
@@ -0,0 +1,187 @@
+/** @file mappingprogram.h
+ * @brief Mappings and conditionals compiled into flat programs.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RESTPOSE_INCLUDED_MAPPINGPROGRAM_H
+#define RESTPOSE_INCLUDED_MAPPINGPROGRAM_H
+
+#include "json/value.h"
+#include "jsonmanip/jsonpath.h"
+#include "jsonmanip/mapping.h"
+#include <vector>
+
+namespace RestPose {
+
+    class CollectionConfig;
+
+    /** A conditional, compiled into a sequence of instructions.
+     *
+     *  The instructions are evaluated in order, using a stack of pointers to
+     *  values: paths are resolved to pointers into the document, so values
+     *  are never copied.  Built by Conditional::compile().
+     */
+    class ConditionalProgram {
+	enum OpCode {
+	    /// Push true if the path in paths[arg] exists, false otherwise.
+	    OP_EXISTS,
+
+	    /// Push the value at the path in paths[arg], or null.
+	    OP_GET,
+
+	    /// Push the value in literals[arg].
+	    OP_LITERAL,
+
+	    /// Pop arg values, and push true if they're all equal.
+	    OP_EQUALS
+	};
+
+	struct Op {
+	    OpCode code;
+	    unsigned int arg;
+
+	    Op(OpCode code_, unsigned int arg_) : code(code_), arg(arg_) {}
+	};
+
+	/// The instructions.
+	std::vector<Op> ops;
+
+	/// The paths used by OP_EXISTS and OP_GET instructions.
+	std::vector<JSONPath> paths;
+
+	/// The values used by OP_LITERAL instructions.
+	std::vector<Json::Value> literals;
+
+	/// The stack depth after each instruction so far.
+	unsigned int depth;
+
+	/// The maximum stack depth needed to evaluate the program.
+	unsigned int max_depth;
+
+	void push_op(OpCode code, unsigned int arg, unsigned int popped);
+
+      public:
+	ConditionalProgram() : depth(0), max_depth(0) {}
+
+	/// Remove all instructions from the program.
+	void clear();
+
+	/// Check if the program is empty (ie, compiled from a null
+	/// conditional).
+	bool empty() const { return ops.empty(); }
+
+	/// Append an instruction to check if a path exists.
+	void add_exists(const JSONPath & path);
+
+	/// Append an instruction to get the value at a path.
+	void add_get(const JSONPath & path);
+
+	/// Append an instruction to return a literal value.
+	void add_literal(const Json::Value & value);
+
+	/// Append an instruction to check if the last `count` values are
+	/// equal.
+	void add_equals(unsigned int count);
+
+	/** Evaluate the program against a document.
+	 *
+	 *  Gives the same result as Conditional::test() on the conditional
+	 *  the program was compiled from.
+	 */
+	bool test(const Json::Value & document) const;
+    };
+
+    /** A mapping, compiled into a flat program.
+     *
+     *  The tree of actions in a Mapping is flattened into an array of
+     *  nodes, each of which has a contiguous, sorted, range of edges to its
+     *  children and of targets to emit.  Applying the program follows only
+     *  the edges present in the mapping, looking each up directly in the
+     *  document, rather than walking every element of the document and
+     *  looking each up in the mapping.
+     *
+     *  Gives the same output as Mapping::apply().
+     */
+    class MappingProgram {
+	struct Edge {
+	    /// The path component leading to the child.
+	    JSONPathComponent component;
+
+	    /// The index of the child node.
+	    unsigned int node;
+	};
+
+	struct Node {
+	    unsigned int first_edge;
+	    unsigned int edge_count;
+	    unsigned int first_target;
+	    unsigned int target_count;
+	};
+
+	/// The conditional specifying when the mapping should be applied.
+	ConditionalProgram when;
+
+	/// Whether unmapped top-level fields are preserved.
+	bool preserve_top;
+
+	/// The nodes of the mapping; the first is the root.
+	std::vector<Node> nodes;
+
+	/// The edges between nodes.
+	std::vector<Edge> edges;
+
+	/// The targets of the nodes.
+	std::vector<MappingTarget> targets;
+
+	/** Add a node (and its descendants) for some actions.
+	 *
+	 *  Returns the index of the new node.
+	 */
+	unsigned int add_node(const MappingActions & actions);
+
+	/** Apply a (non-root) node to the corresponding value.
+	 *
+	 *  Returns true if any targets were emitted for the node or its
+	 *  descendants.
+	 */
+	bool apply_node(const CollectionConfig & collconfig,
+			const Node & node,
+			const Json::Value & value,
+			Json::Value & output) const;
+
+      public:
+	MappingProgram() : preserve_top(true) {}
+
+	/// Compile a mapping into this program.
+	void compile(const Mapping & mapping);
+
+	/** Apply the program.
+	 *
+	 *  Parameters and return value are as for Mapping::apply().
+	 */
+	bool apply(const CollectionConfig & collconfig,
+		   const Json::Value & input,
+		   Json::Value & output) const;
+    };
+};
+
+#endif /* RESTPOSE_INCLUDED_MAPPINGPROGRAM_H */
@@ -7,6 +7,7 @@ noinst_HEADERS += \
  src/jsonxapian/collection_pool.h \
  src/jsonxapian/collection.h \
  src/jsonxapian/docdata.h \
+ src/jsonxapian/document_cache.h \
  src/jsonxapian/docvalues.h \
  src/jsonxapian/doctojson.h \
  src/jsonxapian/facetinfohandler.h \
@@ -15,6 +16,7 @@ noinst_HEADERS += \
  src/jsonxapian/occurinfohandler.h \
  src/jsonxapian/pipe.h \
  src/jsonxapian/query_builder.h \
+ src/jsonxapian/query_plan_cache.h \
  src/jsonxapian/schema.h \
  src/jsonxapian/slotname.h
 
@@ -25,6 +27,7 @@ libjsonxapian_a_SOURCES = \
  src/jsonxapian/collection_pool.cc \
  src/jsonxapian/collection.cc \
  src/jsonxapian/docdata.cc \
+ src/jsonxapian/document_cache.cc \
  src/jsonxapian/docvalues.cc \
  src/jsonxapian/doctojson.cc \
  src/jsonxapian/facetinfohandler.cc \
@@ -33,5 +36,6 @@ libjsonxapian_a_SOURCES = \
  src/jsonxapian/occurinfohandler.cc \
  src/jsonxapian/pipe.cc \
  src/jsonxapian/query_builder.cc \
+ src/jsonxapian/query_plan_cache.cc \
  src/jsonxapian/schema.cc \
  src/jsonxapian/slotname.cc
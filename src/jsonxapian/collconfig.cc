@@ -25,16 +25,19 @@
 #include <config.h>
 #include "collconfig.h"
 
+#include <memory>
 #include <xapian.h>
 #include "jsonxapian/doctojson.h"
 #include "jsonxapian/indexing.h"
 #include "jsonxapian/pipe.h"
 #include "logger/logger.h"
+#include "realtime.h"
 #include "str.h"
 #include "server/task_manager.h"
 #include "utils/jsonutils.h"
 #include "utils/rsperrors.h"
 #include "utils/stringutils.h"
+#include "utils/threading.h"
 #include "utils/validation.h"
 
 using namespace std;
@@ -48,6 +51,12 @@ static const unsigned int CONFIG_FORMAT = 3u;
 // The oldest supported configuration format number.
 static const unsigned int CONFIG_FORMAT_OLDEST = 3u;
 
+/// Mutex protecting next_schemas_id.
+static Mutex schemas_id_mutex;
+
+/// The next identifier to give to the state of a config's schemas.
+static uint64_t next_schemas_id = 1;
+
 static void
 check_format_number(unsigned int format)
 {
@@ -66,6 +75,7 @@ check_format_number(unsigned int format)
 void
 CollectionConfig::clear()
 {
+    schemas_changed();
     for (map<string, Schema *>::iterator
 	 i = types.begin(); i != types.end(); ++i) {
 	delete i->second;
@@ -93,11 +103,21 @@ CollectionConfig::clear()
 	i->second = NULL;
     }
     taxonomies.clear();
+
+    docdata_compressor.from_json(Json::nullValue);
+}
+
+void
+CollectionConfig::schemas_changed()
+{
+    ContextLocker lock(schemas_id_mutex);
+    schemas_id = next_schemas_id++;
 }
 
 void
 CollectionConfig::set_default_schema()
 {
+    schemas_changed();
     for (map<string, Schema *>::iterator
 	 i = types.begin(); i != types.end(); ++i) {
 	delete i->second;
@@ -116,18 +136,18 @@ CollectionConfig::set_default_schema()
 "  \"patterns\": ["
 "    [ \"*_text\", { \"type\": \"text\", \"group\": \"t*\", \"store_field\": \"*_text\", \"processor\": \"stem_en\" } ],"
 "    [ \"text\", { \"type\": \"text\", \"group\": \"t\", \"store_field\": \"text\", \"processor\": \"stem_en\" } ],"
-"    [ \"*_num\", { \"type\": \"double\", \"slot\": \"n*\", \"store_field\": \"*_num\" } ],"
-"    [ \"num\", { \"type\": \"double\", \"slot\": \"n\", \"store_field\": \"num\" } ],"
-"    [ \"*_time\", { \"type\": \"timestamp\", \"slot\": \"d*\", \"store_field\": \"*_time\" } ],"
-"    [ \"time\", { \"type\": \"timestamp\", \"slot\": \"d\", \"store_field\": \"time\" } ],"
+"    [ \"*_num\", { \"type\": \"double\", \"group\": \"n*\", \"slot\": \"n*\", \"sort_slot\": \"sn*\", \"store_field\": \"*_num\" } ],"
+"    [ \"num\", { \"type\": \"double\", \"group\": \"n\", \"slot\": \"n\", \"sort_slot\": \"sn\", \"store_field\": \"num\" } ],"
+"    [ \"*_time\", { \"type\": \"timestamp\", \"group\": \"d*\", \"slot\": \"d*\", \"sort_slot\": \"sd*\", \"store_field\": \"*_time\" } ],"
+"    [ \"time\", { \"type\": \"timestamp\", \"group\": \"d\", \"slot\": \"d\", \"sort_slot\": \"sd\", \"store_field\": \"time\" } ],"
 "    [ \"*_tag\", { \"type\": \"exact\", \"group\": \"g*\", \"slot\": \"g*\", \"store_field\": \"*_tag\", \"max_length\": 100, \"too_long_action\": \"hash\" } ],"
 "    [ \"tag\", { \"type\": \"exact\", \"group\": \"g\", \"slot\": \"g\", \"store_field\": \"tag\", \"max_length\": 100, \"too_long_action\": \"hash\" } ],"
 "    [ \"*_url\", { \"type\": \"exact\", \"group\": \"u*\", \"slot\": \"u*\", \"store_field\": \"*_url\", \"max_length\": 100, \"too_long_action\": \"hash\" } ],"
 "    [ \"url\", { \"type\": \"exact\", \"group\": \"u\", \"slot\": \"u\", \"store_field\": \"url\", \"max_length\": 100, \"too_long_action\": \"hash\" } ],"
 "    [ \"*_cat\", { \"type\": \"cat\", \"group\": \"c*\", \"slot\": \"c*\", \"store_field\": \"*_cat\", \"taxonomy\": \"*_cat\", \"max_length\": 32, \"too_long_action\": \"hash\" } ],"
 "    [ \"cat\", { \"type\": \"cat\", \"group\": \"c\", \"slot\": \"c\", \"store_field\": \"cat\", \"taxonomy\": \"cat\", \"max_length\": 32, \"too_long_action\": \"hash\" } ],"
-"    [ \"*_lonlat\", { \"type\": \"lonlat\", \"slot\": \"l*\", \"store_field\": \"*_lonlat\" } ],"
-"    [ \"lonlat\", { \"type\": \"lonlat\", \"slot\": \"l\", \"store_field\": \"lonlat\" } ],"
+"    [ \"*_lonlat\", { \"type\": \"lonlat\", \"group\": \"l*\", \"slot\": \"l*\", \"store_field\": \"*_lonlat\" } ],"
+"    [ \"lonlat\", { \"type\": \"lonlat\", \"group\": \"l\", \"slot\": \"l\", \"store_field\": \"lonlat\" } ],"
 "    [ \"id\", { \"type\": \"id\", \"store_field\": \"id\" } ],"
 "    [ \"type\", { \"type\": \"exact\", \"group\": \"!\", \"slot\": 1, \"store_field\": \"type\" } ],"
 "    [ \"_meta\", { \"type\": \"meta\", \"group\": \"#\", \"slot\": 0 } ],"
@@ -296,8 +316,10 @@ CollectionConfig::get_or_add_taxonomy(const std::string & taxonomy_name)
 
 CollectionConfig::CollectionConfig(const string & coll_name_)
 	: coll_name(coll_name_),
-	  changed(false)
+	  changed(false),
+	  schemas_id(0)
 {
+    schemas_changed();
     string error = validate_collname(coll_name);
     if (!error.empty()) {
 	throw InvalidValueError(error);
@@ -341,6 +363,10 @@ CollectionConfig::to_json(Json::Value & value) const
     if (!taxonomies.empty()) {
 	categories_config_to_json(value);
     }
+    if (docdata_compressor.is_enabled() ||
+	docdata_compressor.dictionary_count() != 0) {
+	docdata_compressor.to_json(value["docdata_compression"]);
+    }
     value["format"] = CONFIG_FORMAT;
     return value;
 }
@@ -353,11 +379,25 @@ CollectionConfig::from_json(const Json::Value & value)
     check_format_number(json_get_uint64_member(value, "format",
 					       Json::Value::maxInt));
 
+    // Stored documents may have been compressed with the current
+    // dictionaries, so they must not be dropped.  If the new config doesn't
+    // mention compression at all, the current settings are kept.
+    Json::Value compression(value["docdata_compression"]);
+    if (compression.isNull()) {
+	if (docdata_compressor.is_enabled() ||
+	    docdata_compressor.dictionary_count() != 0) {
+	    docdata_compressor.to_json(compression);
+	}
+    } else {
+	docdata_compressor.check_keeps_dictionaries(compression);
+    }
+
     clear();
     schemas_config_from_json(value);
     pipes_config_from_json(value);
     categorisers_config_from_json(value);
     categories_config_from_json(value);
+    docdata_compressor.from_json(compression);
 }
 
 Schema *
@@ -398,12 +438,74 @@ CollectionConfig::set_schema(const string & type,
     }
 
     schemaptr->merge_from(schema);
+    schemas_changed();
     LOG_DEBUG("Config changed: schema for type '" + type + "' created or altered");
     changed = true;
 
     return schemaptr;
 }
 
+Json::Value &
+CollectionConfig::get_schema_delta(const CollectionConfig & base,
+				   Json::Value & result) const
+{
+    result = Json::objectValue;
+    for (map<string, Schema *>::const_iterator i = types.begin();
+	 i != types.end(); ++i) {
+	if (i->second == NULL) continue;
+	Json::Value schema_obj;
+	i->second->to_json(schema_obj);
+	const Schema * base_schema = base.get_schema(i->first);
+	if (base_schema == NULL) {
+	    result[i->first] = schema_obj;
+	    continue;
+	}
+
+	const Json::Value & fields_obj = schema_obj["fields"];
+	if (fields_obj.isNull()) continue;
+	for (Json::Value::const_iterator j = fields_obj.begin();
+	     j != fields_obj.end(); ++j) {
+	    if (base_schema->get(j.memberName()) == NULL) {
+		result[i->first]["fields"][j.memberName()] = *j;
+	    }
+	}
+    }
+    return result;
+}
+
+bool
+CollectionConfig::apply_schema_delta(const Json::Value & delta)
+{
+    json_check_object(delta, "schema delta");
+    bool result = false;
+    for (Json::Value::const_iterator i = delta.begin();
+	 i != delta.end(); ++i) {
+	const string & type = i.memberName();
+	const Schema * existing = get_schema(type);
+	bool needed = (existing == NULL);
+	if (!needed) {
+	    const Json::Value & fields_obj = (*i)["fields"];
+	    if (!fields_obj.isNull()) {
+		json_check_object(fields_obj, "fields in schema delta");
+		for (Json::Value::const_iterator j = fields_obj.begin();
+		     j != fields_obj.end(); ++j) {
+		    if (existing->get(j.memberName()) == NULL) {
+			needed = true;
+			break;
+		    }
+		}
+	    }
+	}
+	if (needed) {
+	    Schema schema(type);
+	    schema.from_json(*i);
+	    set_schema(type, schema);
+	    result = true;
+	}
+    }
+    return result;
+}
+
 const Pipe &
 CollectionConfig::get_pipe(const string & pipe_name) const
 {
@@ -430,6 +532,7 @@ CollectionConfig::set_pipe(const string & pipe_name, const Pipe & pipe)
 	pipeptr = i->second;
     }
     *pipeptr = pipe;
+    pipeptr->compile();
     LOG_DEBUG("Config changed: pipe '" + pipe_name + "' created or altered");
     changed = true;
 }
@@ -524,17 +627,21 @@ CollectionConfig::get_taxonomy_names(Json::Value & result) const
 }
 
 const set<string> &
-CollectionConfig::get_taxonomy_groups(const string & taxonomy_name) const
+CollectionConfig::get_taxonomy_groups(const string & taxonomy_name,
+				      bool indexed_ancestors_only) const
 {
     // Currently, the information needed for this isn't updated when things
     // change, so we just have to iterate through all the types, looking for
     // uses of the taxonomy.
-    set<string> & result(group_taxonomies[taxonomy_name]);
+    set<string> & result(indexed_ancestors_only ?
+			 group_indexed_taxonomies[taxonomy_name] :
+			 group_taxonomies[taxonomy_name]);
     result.clear();
     for (map<string, Schema *>::const_iterator i = types.begin();
 	 i != types.end(); ++i) {
 	if (i->second == NULL) continue;
-	i->second->get_taxonomy_groups(taxonomy_name, result);
+	i->second->get_taxonomy_groups(taxonomy_name, result,
+				       indexed_ancestors_only);
     }
     return result;
 }
@@ -589,6 +696,76 @@ CollectionConfig::category_remove_parent(const std::string & taxonomy_name,
     return taxonomy;
 }
 
+void
+CollectionConfig::train_docdata_compression(const Json::Value & samples,
+					    size_t max_size,
+					    int level,
+					    Json::Value & stats)
+{
+    json_check_array(samples, "list of sample documents");
+    if (samples.size() == 0) {
+	throw InvalidValueError("No sample documents supplied");
+    }
+
+    // Process the samples with a copy of the configuration, so that any new
+    // fields they contain don't get added to the schema.
+    auto_ptr<CollectionConfig> scratch(clone());
+    vector<string> serialised;
+    for (Json::Value::const_iterator i = samples.begin();
+	 i != samples.end(); ++i) {
+	Json::Value doc_obj(*i);
+	string idterm;
+	IndexingErrors errors;
+	bool new_fields;
+	Xapian::Document doc(scratch->process_doc(doc_obj, "", "", idterm,
+						  errors, new_fields));
+	if (errors.total_failure) {
+	    string msg("Sample document invalid");
+	    if (!errors.errors.empty()) {
+		msg += ": " + errors.errors[0].first + ": " +
+			errors.errors[0].second;
+	    }
+	    throw InvalidValueError(msg);
+	}
+	serialised.push_back(scratch->docdata_compressor.decompress(
+	    doc.get_data()));
+    }
+
+    string dictionary(DocumentDataCompressor::train(serialised, max_size));
+    docdata_compressor.add_dictionary(dictionary);
+    docdata_compressor.set_level(level);
+    LOG_DEBUG("Config changed: new document data compression dictionary");
+    changed = true;
+
+    // Measure how well the samples compress with the new dictionary.
+    uint64_t raw_bytes = 0;
+    uint64_t compressed_bytes = 0;
+    vector<string> compressed;
+    for (vector<string>::const_iterator i = serialised.begin();
+	 i != serialised.end(); ++i) {
+	compressed.push_back(docdata_compressor.compress(*i));
+	raw_bytes += i->size();
+	compressed_bytes += compressed.back().size();
+    }
+    double start = RealTime::now();
+    for (vector<string>::const_iterator i = compressed.begin();
+	 i != compressed.end(); ++i) {
+	(void) docdata_compressor.decompress(*i);
+    }
+    double decode_time = RealTime::now() - start;
+
+    stats = Json::objectValue;
+    stats["samples"] = Json::UInt64(serialised.size());
+    stats["dictionary_size"] = Json::UInt64(dictionary.size());
+    stats["raw_bytes"] = Json::UInt64(raw_bytes);
+    stats["compressed_bytes"] = Json::UInt64(compressed_bytes);
+    stats["ratio"] = raw_bytes == 0 ? 1.0 :
+	    double(compressed_bytes) / double(raw_bytes);
+    stats["decode_usec_per_doc"] =
+	    decode_time * 1000000.0 / double(compressed.size());
+    docdata_compressor.set_stats(stats);
+}
+
 Json::Value &
 CollectionConfig::categorise(const string & categoriser_name,
 			     const string & text,
@@ -611,20 +788,15 @@ CollectionConfig::send_to_pipe(TaskManager * taskman,
 			       Json::Value & obj,
 			       bool & new_fields)
 {
-    LOG_DEBUG("Sending to pipe \"" + pipe_name + "\"");
-    // FIXME - this method just uses a recursive implementation, and doesn't
-    // check that a document isn't being passed to a pipe it's already come
-    // from (which would almost certainly be a mistake), so it's easy for it
-    // to overflow the stack, and kill the process.  Would be better to do a
-    // non-recursive implementation, and keep track of pipes which have
-    // already been used to ensure that no loops happen.
-
-    if (pipe_name.empty()) {
+    vector<Json::Value> outputs;
+    run_pipe(pipe_name, obj, outputs);
+    for (vector<Json::Value>::iterator i = outputs.begin();
+	 i != outputs.end(); ++i) {
 	string idterm;
 	IndexingErrors errors;
 	// FIXME - remove hardcoded "default" here - pipes should have a way to
 	// say what type the output document is.
-	Xapian::Document xdoc = process_doc(obj, "default", "", idterm, errors, new_fields);
+	Xapian::Document xdoc = process_doc(*i, "default", "", idterm, errors, new_fields);
 
 	if (!errors.errors.empty()) {
 	    throw InvalidValueError(errors.errors[0].first + ": " + errors.errors[0].second);
@@ -632,18 +804,39 @@ CollectionConfig::send_to_pipe(TaskManager * taskman,
 
 	taskman->queue_indexing_from_processing(get_name(),
 	    new IndexerUpdateDocumentTask(idterm, xdoc));
+    }
+}
 
+void
+CollectionConfig::run_pipe(const string & pipe_name,
+			   const Json::Value & obj,
+			   vector<Json::Value> & outputs) const
+{
+    LOG_DEBUG("Sending to pipe \"" + pipe_name + "\"");
+    // FIXME - this method just uses a recursive implementation, and doesn't
+    // check that a document isn't being passed to a pipe it's already come
+    // from (which would almost certainly be a mistake), so it's easy for it
+    // to overflow the stack, and kill the process.  Would be better to do a
+    // non-recursive implementation, and keep track of pipes which have
+    // already been used to ensure that no loops happen.
+
+    if (pipe_name.empty()) {
+	outputs.push_back(obj);
 	return;
     }
     const Pipe & pipe = get_pipe(pipe_name);
-    vector<Mapping>::const_iterator i;
+    if (!pipe.compiled) {
+	// set_pipe() compiles every pipe, so this shouldn't happen.
+	throw InvalidStateError("Pipe \"" + pipe_name + "\" has not been compiled");
+    }
     //printf("mappings: %d\n", pipe.mappings.size());
-    for (i = pipe.mappings.begin(); i != pipe.mappings.end(); ++i) {
+    for (vector<MappingProgram>::size_type i = 0;
+	 i != pipe.programs.size(); ++i) {
 	Json::Value output;
-	bool applied = i->apply(*this, obj, output);
+	bool applied = pipe.programs[i].apply(*this, obj, output);
 	//printf("applied: %s\n", applied ? "true" : "false");
 	if (applied) {
-	    send_to_pipe(taskman, pipe.target, output, new_fields);
+	    run_pipe(pipe.target, output, outputs);
 	    if (!pipe.apply_all) {
 		break;
 	    }
@@ -651,18 +844,16 @@ CollectionConfig::send_to_pipe(TaskManager * taskman,
     }
 }
 
-Xapian::Document
-CollectionConfig::process_doc(Json::Value & doc_obj,
-			      const string & doc_type,
-			      const string & doc_id,
-			      string & idterm,
-			      IndexingErrors & errors,
-			      bool & new_fields)
+bool
+CollectionConfig::check_doc_type_and_id(Json::Value & doc_obj,
+					const string & doc_type,
+					const string & doc_id,
+					IndexingErrors & errors,
+					string & result_type) const
 {
     json_check_object(doc_obj, "input document");
-    Xapian::Document doc;
 
-    string doc_type_(doc_type);
+    result_type = doc_type;
     if (doc_type.empty()) {
 	// No document type supplied in URL - look for it in the document.
 	const Json::Value & type_obj = doc_obj[type_field];
@@ -670,35 +861,35 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 	    errors.append(type_field,
 			  "No document type supplied or stored in document.");
 	    errors.total_failure = true;
-	    return doc;
+	    return false;
 	}
 	if (type_obj.isArray()) {
 	    if (type_obj.size() == 1) {
 		string error;
-		doc_type_ = json_get_idstyle_value(type_obj[0], error);
+		result_type = json_get_idstyle_value(type_obj[0], error);
 		if (!error.empty()) {
 		    errors.append(type_field, error);
 		    errors.total_failure = true;
-		    return doc;
+		    return false;
 		}
 	    } else if (type_obj.size() == 0) {
 		errors.append(type_field,
 			      "No document type stored in document.");
 		errors.total_failure = true;
-		return doc;
+		return false;
 	    } else {
 		errors.append(type_field,
 			      "Multiple document types stored in document.");
 		errors.total_failure = true;
-		return doc;
+		return false;
 	    }
 	} else {
 	    string error;
-	    doc_type_ = json_get_idstyle_value(type_obj, error);
+	    result_type = json_get_idstyle_value(type_obj, error);
 	    if (!error.empty()) {
 		errors.append(type_field, error);
 		errors.total_failure = true;
-		return doc;
+		return false;
 	    }
 	}
     } else {
@@ -717,13 +908,13 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 		    if (!error.empty()) {
 			errors.append(type_field, error);
 			errors.total_failure = true;
-			return doc;
+			return false;
 		    }
 		} else if (type_obj.size() > 1) {
 		    errors.append(type_field,
 				  "Multiple document types stored in document.");
 		    errors.total_failure = true;
-		    return doc;
+		    return false;
 		}
 	    } else {
 		string error;
@@ -731,7 +922,7 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 		if (!error.empty()) {
 		    errors.append(type_field, error);
 		    errors.total_failure = true;
-		    return doc;
+		    return false;
 		}
 	    }
 	    if (!stored_type.empty() && doc_type != stored_type) {
@@ -739,7 +930,7 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 			      "Document type supplied differs from "
 			      "that inside document.");
 		errors.total_failure = true;
-		return doc;
+		return false;
 	    }
 	}
     }
@@ -752,7 +943,7 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 	    errors.append(id_field,
 			  "No document ID supplied or stored in document.");
 	    errors.total_failure = true;
-	    return doc;
+	    return false;
 	}
 	if (id_obj.isArray()) {
 	    if (id_obj.size() == 1) {
@@ -761,18 +952,18 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 		if (!error.empty()) {
 		    errors.append(id_field, error);
 		    errors.total_failure = true;
-		    return doc;
+		    return false;
 		}
 	    } else if (id_obj.size() == 0) {
 		errors.append(id_field,
 			      "No document ID stored in document.");
 		errors.total_failure = true;
-		return doc;
+		return false;
 	    } else {
 		errors.append(id_field,
 			      "Multiple ID values provided - must have only one");
 		errors.total_failure = true;
-		return doc;
+		return false;
 	    }
 	} else {
 	    string error;
@@ -780,7 +971,7 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 	    if (!error.empty()) {
 		errors.append(id_field, error);
 		errors.total_failure = true;
-		return doc;
+		return false;
 	    }
 	}
 
@@ -788,7 +979,7 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 	if (!error.empty()) {
 	    errors.append(id_field, error);
 	    errors.total_failure = true;
-	    return doc;
+	    return false;
 	}
     } else {
 	// Document id supplied in URL - check that it isn't different in
@@ -806,13 +997,13 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 		    if (!error.empty()) {
 			errors.append(id_field, error);
 			errors.total_failure = true;
-			return doc;
+			return false;
 		    }
 		} else if (id_obj.size() > 1) {
 		    errors.append(id_field,
 				  "Multiple ID values provided - must have only one");
 		    errors.total_failure = true;
-		    return doc;
+		    return false;
 		}
 	    } else {
 		string error;
@@ -820,7 +1011,7 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 		if (!error.empty()) {
 		    errors.append(id_field, error);
 		    errors.total_failure = true;
-		    return doc;
+		    return false;
 		}
 	    }
 	    if (!stored_id.empty() && doc_id != stored_id) {
@@ -829,31 +1020,74 @@ CollectionConfig::process_doc(Json::Value & doc_obj,
 			      "') differs from that inside document ('" +
 			      stored_id + "').");
 		errors.total_failure = true;
-		return doc;
+		return false;
 	    }
 	}
 	string error = validate_doc_id(doc_id);
 	if (!error.empty()) {
 	    errors.append(id_field, error);
 	    errors.total_failure = true;
-	    return doc;
+	    return false;
 	}
     }
 
     {
-	string error = validate_doc_type(doc_type_);
+	string error = validate_doc_type(result_type);
 	if (!error.empty()) {
 	    errors.append(type_field, error);
 	    errors.total_failure = true;
-	    return doc;
+	    return false;
 	}
     }
+    return true;
+}
+
+Xapian::Document
+CollectionConfig::process_doc(Json::Value & doc_obj,
+			      const string & doc_type,
+			      const string & doc_id,
+			      string & idterm,
+			      IndexingErrors & errors,
+			      bool & new_fields)
+{
+    string doc_type_;
+    if (!check_doc_type_and_id(doc_obj, doc_type, doc_id, errors,
+			       doc_type_)) {
+	return Xapian::Document();
+    }
     Schema * schema = get_schema(doc_type_);
     if (schema == NULL) {
 	Schema newschema(doc_type_);
 	newschema.from_json(default_type_config);
 	schema = set_schema(doc_type_, newschema);
     }
-    doc = schema->process(doc_obj, *this, idterm, errors, new_fields);
+    bool added_fields = false;
+    Xapian::Document doc(schema->process(doc_obj, *this, idterm, errors,
+					 added_fields));
+    if (added_fields) {
+	new_fields = true;
+	schemas_changed();
+    }
     return doc;
 }
+
+bool
+CollectionConfig::try_process_doc(Json::Value & doc_obj,
+				  const string & doc_type,
+				  const string & doc_id,
+				  string & idterm,
+				  IndexingErrors & errors,
+				  Xapian::Document & doc) const
+{
+    string doc_type_;
+    if (!check_doc_type_and_id(doc_obj, doc_type, doc_id, errors,
+			       doc_type_)) {
+	return true;
+    }
+    const Schema * schema = get_schema(doc_type_);
+    if (schema == NULL || !schema->has_all_fields(doc_obj, meta_field)) {
+	return false;
+    }
+    doc = schema->process_known(doc_obj, *this, idterm, errors);
+    return true;
+}
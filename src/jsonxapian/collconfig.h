@@ -25,10 +25,13 @@
 #ifndef RESTPOSE_INCLUDED_COLLCONFIG_H
 #define RESTPOSE_INCLUDED_COLLCONFIG_H
 
+#include "docdata.h"
 #include "taxonomy.h"
 #include "json/value.h"
 #include <map>
 #include <string>
+#include "utils/safe_inttypes.h"
+#include <vector>
 #include <xapian.h>
 
 class TaskManager;
@@ -72,12 +75,24 @@ class CollectionConfig {
     /// Named taxonomies.
     std::map<std::string, Taxonomy *> taxonomies;
 
+    /// Compression settings for stored document data.
+    DocumentDataCompressor docdata_compressor;
+
     /// Map from taxonomy name to groups using that taxonomy.
     mutable std::map<std::string, std::set<std::string> > group_taxonomies;
 
+    /** Map from taxonomy name to groups using that taxonomy which store
+     *  ancestor terms in documents.
+     */
+    mutable std::map<std::string, std::set<std::string> >
+	    group_indexed_taxonomies;
+
     /// Flag to track whether the collection configuration has been changed.
     bool changed;
 
+    /// Identifier for the current state of the schemas.
+    uint64_t schemas_id;
+
     CollectionConfig(const CollectionConfig &);
     void operator=(const CollectionConfig &);
 
@@ -85,6 +100,12 @@ class CollectionConfig {
      */
     void clear();
 
+    /** Record that the schemas (or the fields in them) may have changed.
+     *
+     *  Gives the schemas a new identifier.
+     */
+    void schemas_changed();
+
     /** Set the default schema configuration.
      *
      *  This sets default_type_config, id_field and type_field to default
@@ -127,6 +148,20 @@ class CollectionConfig {
     /// Get a reference to a taxonomy, adding it if it doesn't already exist.
     Taxonomy & get_or_add_taxonomy(const std::string & taxonomy_name);
 
+    /** Check the type and ID of a document to be processed.
+     *
+     *  Sets the type and ID in the document if they were supplied
+     *  separately, and sets result_type to the type of the document.
+     *
+     *  Returns false (with details of the problem in errors) if the type or
+     *  ID are missing or invalid.
+     */
+    bool check_doc_type_and_id(Json::Value & doc_obj,
+			       const std::string & doc_type,
+			       const std::string & doc_id,
+			       IndexingErrors & errors,
+			       std::string & result_type) const;
+
   public:
     CollectionConfig(const std::string & coll_name_);
     ~CollectionConfig();
@@ -143,6 +178,17 @@ class CollectionConfig {
 	changed = false;
     }
 
+    /** Get an identifier for the current state of the schemas.
+     *
+     *  This changes whenever a schema, or a field in a schema, is added,
+     *  altered or removed, and identifiers are never reused (even by other
+     *  configs), so it can be used to check that details looked up from the
+     *  schemas (including pointers to field configs) are still valid.
+     */
+    uint64_t get_schemas_id() const {
+	return schemas_id;
+    }
+
     /** Set the default configuration.
      *
      *  This is used for newly created collections, when an explicit
@@ -209,6 +255,24 @@ class CollectionConfig {
     Schema * set_schema(const std::string & type,
 			const Schema & schema);
 
+    /** Get the schema configuration added since an older configuration.
+     *
+     *  The result is a JSON object, keyed by type, holding the schemas
+     *  for types which aren't in base, and just the new fields for types
+     *  which are.  Fields removed since base are ignored.
+     */
+    Json::Value & get_schema_delta(const CollectionConfig & base,
+				   Json::Value & result) const;
+
+    /** Merge a delta returned by get_schema_delta() into the schemas.
+     *
+     *  Parts of the delta which are already present are skipped, so
+     *  applying a delta more than once has no further effect.
+     *
+     *  Returns true if the schemas were changed.
+     */
+    bool apply_schema_delta(const Json::Value & delta);
+
     /** Start iterating over the schemas in the collection.
      */
     std::map<std::string, Schema *>::const_iterator schema_begin() const
@@ -284,9 +348,14 @@ class CollectionConfig {
     Json::Value & get_taxonomy_names(Json::Value & result) const;
 
     /** Get the groups which use a taxonomy.
+     *
+     *  @param indexed_ancestors_only If true, only return groups for which
+     *  ancestor terms are stored in documents (ie, groups which need
+     *  documents to be updated when the taxonomy changes).
      */
     const std::set<std::string> & get_taxonomy_groups
-	    (const std::string & taxonomy_name) const;
+	    (const std::string & taxonomy_name,
+	     bool indexed_ancestors_only = false) const;
 
     const Taxonomy & category_add(
 	const std::string & taxonomy_name,
@@ -313,6 +382,29 @@ class CollectionConfig {
 	return meta_field;
     }
 
+    /** Get the compressor used for stored document data.
+     */
+    const DocumentDataCompressor & get_docdata_compressor() const {
+	return docdata_compressor;
+    }
+
+    /** Train a new dictionary for compressing stored document data.
+     *
+     *  The sample documents are processed as they would be for indexing (but
+     *  are not stored), and the resulting document data is used to build
+     *  the dictionary.  All new document data will be compressed using it.
+     *
+     *  @param samples An array of sample documents.
+     *  @param max_size The maximum size of the dictionary, in bytes.
+     *  @param level The zlib compression level to use.
+     *  @param stats An object which will be set to hold statistics about
+     *  the compression of the samples (sizes, ratio and decode time).
+     */
+    void train_docdata_compression(const Json::Value & samples,
+				   size_t max_size,
+				   int level,
+				   Json::Value & stats);
+
     /** Categorise a piece of text.
      *
      *  @param categoriser_name The categoriser to use.
@@ -336,7 +428,19 @@ class CollectionConfig {
 		      Json::Value & obj,
 		      bool & new_fields);
 
+    /** Run a document through an input pipe, without processing it.
+     *
+     *  The documents which come out of the end of the pipe are appended to
+     *  outputs, ready to be processed.
+     */
+    void run_pipe(const std::string & pipe_name,
+		  const Json::Value & obj,
+		  std::vector<Json::Value> & outputs) const;
+
     /** Process a JSON document into a Xapian document.
+     *
+     *  If the document is of a new type, or contains new fields, the
+     *  configuration is updated to include them, and new_fields is set.
      */
     Xapian::Document process_doc(Json::Value & doc_obj,
 				 const std::string & doc_type,
@@ -344,6 +448,23 @@ class CollectionConfig {
 				 std::string & idterm,
 				 IndexingErrors & errors,
 				 bool & new_fields);
+
+    /** Process a JSON document into a Xapian document, without changing the
+     *  configuration.
+     *
+     *  This may be called by several threads at once on a shared
+     *  configuration.  If the document is of a new type, or contains new
+     *  fields, returns false without processing it; the document should
+     *  then be processed by process_doc() on a private copy of the
+     *  configuration.  Otherwise, returns true, with the processed
+     *  document in doc (or details of the failure in errors).
+     */
+    bool try_process_doc(Json::Value & doc_obj,
+			 const std::string & doc_type,
+			 const std::string & doc_id,
+			 std::string & idterm,
+			 IndexingErrors & errors,
+			 Xapian::Document & doc) const;
 };
 
 }
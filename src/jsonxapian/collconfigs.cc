@@ -30,72 +30,167 @@
 using namespace std;
 using namespace RestPose;
 
-CollectionConfigs::~CollectionConfigs()
+class CollectionConfigSnapshot::Internal {
+    Internal(const Internal &);
+    void operator=(const Internal &);
+  public:
+    Mutex mutex;
+    unsigned ref_count;
+    auto_ptr<CollectionConfig> config;
+
+    Internal(CollectionConfig * config_)
+	    : ref_count(1),
+	      config(config_) {}
+};
+
+CollectionConfigSnapshot::CollectionConfigSnapshot(CollectionConfig * config)
+	: internal(NULL)
+{
+    auto_ptr<CollectionConfig> config_ptr(config);
+    internal = new Internal(config_ptr.get());
+    config_ptr.release();
+}
+
+CollectionConfigSnapshot::~CollectionConfigSnapshot()
+{
+    release();
+}
+
+CollectionConfigSnapshot::CollectionConfigSnapshot(
+	const CollectionConfigSnapshot & other)
+	: internal(NULL)
 {
-    for (map<string, CollectionConfig *>::iterator i = configs.begin();
-	 i != configs.end(); ++i) {
-	delete i->second;
+    ContextLocker lock(other.internal->mutex);
+    internal = other.internal;
+    ++(internal->ref_count);
+}
+
+void
+CollectionConfigSnapshot::operator=(const CollectionConfigSnapshot & other)
+{
+    if (internal == other.internal) {
+	return;
     }
+    release();
+    ContextLocker lock(other.internal->mutex);
+    internal = other.internal;
+    ++(internal->ref_count);
 }
 
-CollectionConfig *
-CollectionConfigs::get(const std::string & coll_name)
+void
+CollectionConfigSnapshot::release()
+{
+    ContextLocker lock(internal->mutex);
+    --(internal->ref_count);
+    if (internal->ref_count == 0) {
+	lock.unlock();
+	delete internal;
+    }
+    internal = NULL;
+}
+
+const CollectionConfig &
+CollectionConfigSnapshot::operator*() const
+{
+    return *(internal->config);
+}
+
+const CollectionConfig *
+CollectionConfigSnapshot::operator->() const
+{
+    return internal->config.get();
+}
+
+CollectionConfigSnapshot
+CollectionConfigs::get_snapshot(const std::string & coll_name)
 {
     ContextLocker lock(mutex);
-    map<string, CollectionConfig *>::const_iterator i = configs.find(coll_name);
-    if (i == configs.end()) {
-	if (pool.exists(coll_name)) {
-	    auto_ptr<Collection> coll(pool.get_readonly(coll_name));
-	    auto_ptr<CollectionConfig> config(coll->get_config().clone());
-	    pool.release(coll.release());
-
-	    pair<map<string, CollectionConfig *>::iterator, bool> ret;
-	    ret = configs.insert(pair<string, CollectionConfig *>(coll_name, NULL));
-	    ret.first->second = config.release();
-	    i = ret.first;
-	} else {
-	    auto_ptr<CollectionConfig> config(new CollectionConfig(coll_name));
-	    config->set_default();
-
-	    pair<map<string, CollectionConfig *>::iterator, bool> ret;
-	    ret = configs.insert(pair<string, CollectionConfig *>(coll_name, NULL));
-	    ret.first->second = config.release();
-	    i = ret.first;
-	}
+    map<string, CollectionConfigSnapshot>::const_iterator i
+	    = configs.find(coll_name);
+    if (i != configs.end()) {
+	return i->second;
+    }
+
+    auto_ptr<CollectionConfig> config;
+    if (pool.exists(coll_name)) {
+	auto_ptr<Collection> coll(pool.get_readonly(coll_name));
+	config = auto_ptr<CollectionConfig>(coll->get_config().clone());
+	pool.release(coll.release());
+    } else {
+	config = auto_ptr<CollectionConfig>(new CollectionConfig(coll_name));
+	config->set_default();
     }
-    return i->second->clone();
+    CollectionConfigSnapshot snapshot(config.release());
+    configs.insert(make_pair(coll_name, snapshot));
+    return snapshot;
+}
+
+CollectionConfig *
+CollectionConfigs::get(const std::string & coll_name)
+{
+    // The clone is made without holding the mutex, since the snapshot can't
+    // change.
+    CollectionConfigSnapshot snapshot(get_snapshot(coll_name));
+    return snapshot->clone();
 }
 
 void
 CollectionConfigs::set(const std::string & coll_name,
 		       CollectionConfig * config)
 {
-    auto_ptr<CollectionConfig> config_ptr(config);
+    set(coll_name, CollectionConfigSnapshot(config));
+}
+
+void
+CollectionConfigs::set(const std::string & coll_name,
+		       const CollectionConfigSnapshot & snapshot)
+{
     ContextLocker lock(mutex);
-    map<string, CollectionConfig *>::iterator i = configs.find(coll_name);
+    map<string, CollectionConfigSnapshot>::iterator i
+	    = configs.find(coll_name);
     if (i == configs.end()) {
-	pair<map<string, CollectionConfig *>::iterator, bool> ret;
-	ret = configs.insert(pair<string, CollectionConfig *>(coll_name, NULL));
-	ret.first->second = config_ptr.release();
+	configs.insert(make_pair(coll_name, snapshot));
     } else {
-	delete i->second;
-	i->second = config_ptr.release();
+	i->second = snapshot;
+    }
+}
+
+CollectionConfigSnapshot
+CollectionConfigs::publish_schema_delta(const std::string & coll_name,
+					const CollectionConfigSnapshot & base,
+					CollectionConfig * updated,
+					const Json::Value & delta)
+{
+    auto_ptr<CollectionConfig> updated_ptr(updated);
+    CollectionConfigSnapshot expected(base);
+    while (true) {
+	if (updated_ptr.get() == NULL) {
+	    // Clone without holding the mutex; if yet another config is
+	    // published meanwhile, we'll just go round again.
+	    updated_ptr = auto_ptr<CollectionConfig>(expected->clone());
+	    (void) updated_ptr->apply_schema_delta(delta);
+	}
+	CollectionConfigSnapshot snapshot(updated_ptr.release());
+
+	ContextLocker lock(mutex);
+	map<string, CollectionConfigSnapshot>::iterator i
+		= configs.find(coll_name);
+	if (i == configs.end()) {
+	    configs.insert(make_pair(coll_name, snapshot));
+	    return snapshot;
+	}
+	if (i->second == expected) {
+	    i->second = snapshot;
+	    return snapshot;
+	}
+	expected = i->second;
     }
 }
 
 void
 CollectionConfigs::reset(const std::string & coll_name)
 {
-    ContextLocker lock(mutex);
-    map<string, CollectionConfig *>::iterator i = configs.find(coll_name);
-    if (i == configs.end()) {
-	pair<map<string, CollectionConfig *>::iterator, bool> ret;
-	ret = configs.insert(pair<string, CollectionConfig *>(coll_name, NULL));
-	ret.first->second = new CollectionConfig(coll_name);
-	ret.first->second->set_default();
-    } else {
-	delete i->second;
-	i->second = new CollectionConfig(coll_name);
-	i->second->set_default();
-    }
+    auto_ptr<CollectionConfig> config(new CollectionConfig(coll_name));
+    config->set_default();
+    set(coll_name, config.release());
 }
@@ -33,42 +33,113 @@ class CollectionPool;
 
 namespace RestPose {
 
+/** A shared, read-only snapshot of a collection configuration.
+ *
+ *  Handles are reference counted, so copying them is cheap; the
+ *  configuration is deleted when the last handle referring to it goes away.
+ *
+ *  Only const methods of the configuration may be used, since other threads
+ *  may be using it at the same time.  To change the configuration, take a
+ *  clone() of it, change that, and publish it with CollectionConfigs::set().
+ */
+class CollectionConfigSnapshot {
+    class Internal;
+
+    Internal * internal;
+
+    /// Drop the reference to the current configuration.
+    void release();
+
+  public:
+    /** Make a snapshot holding a configuration.
+     *
+     *  Takes ownership of the supplied config.
+     */
+    explicit CollectionConfigSnapshot(CollectionConfig * config);
+
+    ~CollectionConfigSnapshot();
+    CollectionConfigSnapshot(const CollectionConfigSnapshot & other);
+    void operator=(const CollectionConfigSnapshot & other);
+
+    const CollectionConfig & operator*() const;
+    const CollectionConfig * operator->() const;
+
+    /// Return true iff both handles refer to the same configuration.
+    bool operator==(const CollectionConfigSnapshot & other) const {
+	return internal == other.internal;
+    }
+};
+
 /** Holds CollectionConfig objects for each collection.
  *
  *  Used to allow processing threads to get the appropriate configuration, even
  *  if it hasn't been comitted to the collection yet.
  *
- *  This is threadsafe - accesses are serialised by an internal mutex, and the
- *  returned results are new objects sharing no state with the internal
- *  objects.
+ *  This is threadsafe - accesses are serialised by an internal mutex.  The
+ *  stored configurations are never modified once stored: changes are made
+ *  by storing a new configuration with set(), so snapshots which have
+ *  already been handed out are unaffected.
  */
 class CollectionConfigs {
     Mutex mutex;
-    std::map<std::string, CollectionConfig *> configs;
+    std::map<std::string, CollectionConfigSnapshot> configs;
     CollectionPool & pool;
 
     CollectionConfigs(const CollectionConfigs &);
     void operator=(const CollectionConfigs &);
   public:
     CollectionConfigs(CollectionPool & pool_) : pool(pool_) {}
-    ~CollectionConfigs();
 
-    /** Get a (newly allocated) configuration for a given collection.
+    /** Get a snapshot of the configuration for a given collection.
      *
      *  If the configuration isn't already known, attempts to get a
      *  corresponding collection from the collection pool and reads the
      *  configuration from that.  If no such collection exists, returns
      *  a default configuration.
+     *
+     *  This doesn't copy the configuration, so is cheap enough to call for
+     *  each document processed.
+     */
+    CollectionConfigSnapshot get_snapshot(const std::string & coll_name);
+
+    /** Get a (newly allocated) configuration for a given collection.
+     *
+     *  As get_snapshot(), but returns a copy of the configuration, which
+     *  the caller owns and may modify.
      */
     CollectionConfig * get(const std::string & coll_name);
 
     /** Set the configuration for a collection.
      *
-     *  Takes ownership of the supplied config.
+     *  Takes ownership of the supplied config, which must not be modified
+     *  after this call.
      */
     void set(const std::string & coll_name,
 	     CollectionConfig * config);
 
+    /** Set the configuration for a collection to a snapshot.
+     */
+    void set(const std::string & coll_name,
+	     const CollectionConfigSnapshot & snapshot);
+
+    /** Publish new schema configuration found while processing.
+     *
+     *  updated should be a copy of base, with delta (as returned by
+     *  CollectionConfig::get_schema_delta()) applied to it.  If the stored
+     *  configuration is still base, it is replaced by updated.  Otherwise,
+     *  another thread has published a configuration in the meantime, so
+     *  delta is applied to a copy of that instead, to avoid losing the
+     *  other thread's changes.
+     *
+     *  Takes ownership of the supplied updated config.  Returns a snapshot
+     *  of the published configuration.
+     */
+    CollectionConfigSnapshot publish_schema_delta(
+	const std::string & coll_name,
+	const CollectionConfigSnapshot & base,
+	CollectionConfig * updated,
+	const Json::Value & delta);
+
     /** Reset the stored configuration for a given collection.
      *
      *  This sets the stored configuration to the default configuration.  This
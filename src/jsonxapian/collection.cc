@@ -26,7 +26,9 @@
 #include "collection.h"
 
 #include "infohandlers.h"
+#include "json/writer.h"
 #include "jsonxapian/doctojson.h"
+#include "jsonxapian/document_cache.h"
 #include "jsonxapian/indexing.h"
 #include "jsonxapian/pipe.h"
 #include "jsonxapian/query_builder.h"
@@ -43,10 +45,20 @@
 using namespace std;
 using namespace RestPose;
 
+/** The largest number of changed documents to track between commits.
+ *
+ *  If more documents than this are changed, all the collection's documents
+ *  are removed from the document cache when the changes are committed.
+ */
+#define MAX_CHANGED_IDTERMS 10000
+
 Collection::Collection(const string & coll_name_,
 		       const string & coll_path_)
 	: config(coll_name_),
-	  group(coll_path_)
+	  config_dirty(false),
+	  group(coll_path_),
+	  doc_cache_generation(0),
+	  many_changed(false)
 {
 }
 
@@ -71,10 +83,51 @@ Collection::open_writable()
 void
 Collection::open_readonly()
 {
+    // Get the generation before opening, so that if documents are changed
+    // after this, documents read from the old revision aren't cached.
+    doc_cache_generation = g_document_cache.get_generation(get_name());
     group.open_readonly();
     read_config();
 }
 
+void
+Collection::close()
+{
+    // Closing may commit outstanding changes, so write any schema changes
+    // which they depend on first.
+    if (config_dirty && group.is_writable()) {
+	write_config();
+    }
+    group.close();
+    invalidate_changed_docs();
+}
+
+void
+Collection::doc_changed(const string & idterm)
+{
+    if (many_changed) {
+	return;
+    }
+    if (changed_idterms.size() >= MAX_CHANGED_IDTERMS) {
+	many_changed = true;
+	changed_idterms.clear();
+	return;
+    }
+    changed_idterms.insert(idterm);
+}
+
+void
+Collection::invalidate_changed_docs()
+{
+    if (many_changed) {
+	g_document_cache.invalidate_all(get_name());
+    } else if (!changed_idterms.empty()) {
+	g_document_cache.invalidate(get_name(), changed_idterms);
+    }
+    changed_idterms.clear();
+    many_changed = false;
+}
+
 const Xapian::Database &
 Collection::get_db() const
 {
@@ -112,6 +165,7 @@ Collection::write_config()
     Json::Value config_obj;
     group.set_metadata("_restpose_config",
 		       json_serialise(config.to_json(config_obj)));
+    config_dirty = false;
 }
 
 void
@@ -168,11 +222,10 @@ Collection::update_modified_categories_group(const string & prefix,
 	    if (!string_startswith(*ti, cat_prefix)) {
 		break;
 	    }
-	    const Category * cat =
-		    taxonomy.find((*ti).substr(cat_prefix.size()));
-	    if (cat != NULL) {
-		ancestors.insert(cat->ancestors.begin(),
-				 cat->ancestors.end());
+	    Taxonomy::CategoryId cat =
+		    taxonomy.find_id((*ti).substr(cat_prefix.size()));
+	    if (cat != Taxonomy::NO_CATEGORY) {
+		taxonomy.get_ancestors(cat, ancestors);
 	    }
 	    ++ti;
 	}
@@ -210,6 +263,7 @@ Collection::update_modified_categories_group(const string & prefix,
 	}
 
         group.add_doc(doc, idterm);
+	doc_changed(idterm);
 
 	// Advance all iterators for which nextid is the minimum id.
 	piter = iters.begin();
@@ -227,7 +281,10 @@ Collection::update_modified_categories(const string & taxonomy_name,
 				       const Taxonomy & taxonomy,
 				       const Categories & modified)
 {
-    const set<string> & groups = config.get_taxonomy_groups(taxonomy_name);
+    // Groups which find ancestors at query time don't store any terms which
+    // depend on the taxonomy, so don't need updating.
+    const set<string> & groups = config.get_taxonomy_groups(taxonomy_name,
+							    true);
 
     /* Note; when there are many documents in which more than one group uses
      * the same taxonomy, it would be more efficient to do the update of all
@@ -264,6 +321,17 @@ Collection::set_schema(const string & type,
     write_config();
 }
 
+void
+Collection::apply_schema_delta(const Json::Value & delta)
+{
+    if (!group.is_writable()) {
+	throw InvalidStateError("Collection must be open for writing to set schema");
+    }
+    if (config.apply_schema_delta(delta)) {
+	config_dirty = true;
+    }
+}
+
 const Pipe &
 Collection::get_pipe(const string & pipe_name) const
 {
@@ -367,6 +435,7 @@ Collection::remove_taxonomy(const string & taxonomy_name)
 		}
 
 		group.add_doc(doc, idterm);
+		doc_changed(idterm);
 	    }
 	}
     }
@@ -488,6 +557,7 @@ Collection::raw_update_doc(const Xapian::Document & doc,
 	throw InvalidStateError("Collection must be open for writing to add document");
     }
     group.add_doc(doc, idterm);
+    doc_changed(idterm);
 }
 
 void
@@ -497,6 +567,7 @@ Collection::raw_delete_doc(const string & idterm)
 	throw InvalidStateError("Collection must be open for writing to delete document");
     }
     group.delete_doc(idterm);
+    doc_changed(idterm);
 }
 
 void
@@ -506,7 +577,11 @@ Collection::commit()
 	throw InvalidStateError("Collection must be open for writing to commit");
     }
     LOG_INFO("Committing changes to collection \"" + config.get_name() + "\"");
+    if (config_dirty) {
+	write_config();
+    }
     group.sync();
+    invalidate_changed_docs();
 }
 
 uint64_t
@@ -566,10 +641,10 @@ calc_fromdoc_offset(const Xapian::Database & db,
     throw InvalidValueError("fromdoc document not present in result set");
 }
 
-void
-Collection::perform_search(const Json::Value & search,
-			   const string & doc_type,
-			   Json::Value & results) const
+Xapian::MSet
+Collection::run_search(const Json::Value & search,
+		       const string & doc_type,
+		       Json::Value & results) const
 {
     if (!group.is_open()) {
 	throw InvalidStateError("Collection must be open to perform search");
@@ -599,10 +674,20 @@ Collection::perform_search(const Json::Value & search,
     }
 
     results = Json::objectValue;
-    Xapian::Query query(builder->build(search["query"]));
-
     Xapian::Database db(get_db());
 
+    // Plans hold the field configs from the schemas, so are cached per
+    // document type and state of the schemas.
+    string plan_context(doc_type);
+    plan_context += '\0';
+    plan_context += str(static_cast<unsigned long long>(
+	config.get_schemas_id()));
+
+    Json::Value plan;
+    Xapian::Query query(builder->build_cached(search["query"], &db,
+					      plan_context,
+					      verbose ? &plan : NULL));
+
     Xapian::doccount total_docs, from, size, check_at_least;
     total_docs = builder->total_docs(db);
     from = json_get_uint64_member(search, "from", Json::Value::maxUInt, 0);
@@ -682,12 +767,16 @@ Collection::perform_search(const Json::Value & search,
     // option for potential (though probably slight) performance increases.
     enq.set_docid_order(enq.DONT_CARE);
     auto_ptr<MultiValueKeyMaker> sorter;
+    auto_ptr<SortSlotKeyMaker> slot_sorter;
 
     if (search.isMember("order_by")) {
 	const Json::Value & order_by = search["order_by"];
 	json_check_array(order_by, "list of ordering items");
 	bool score_first = false;
 	bool score_last = false;
+	unsigned sort_field_count = 0;
+	string sort_fieldname;
+	bool sort_ascending = true;
 	for (unsigned i = 0; i != order_by.size(); ++i) {
 	    const Json::Value & order_by_item = order_by[i];
 	    json_check_object(order_by_item, "ordering item");
@@ -712,6 +801,9 @@ Collection::perform_search(const Json::Value & search,
 
 		    bool ascending = json_get_bool(order_by_item, "ascending", true);
 		    sorter->add_decoder(decoder.release(), !ascending);
+		    ++sort_field_count;
+		    sort_fieldname = fieldname;
+		    sort_ascending = ascending;
 		} else {
 		    LOG_WARN("Unable to apply requested sort by \"" +
 			     fieldname + "\" - no field config found.");
@@ -745,15 +837,28 @@ Collection::perform_search(const Json::Value & search,
 	    throw InvalidValueError("Sorting condition list may only contain "
 				    "sorting by score once.");
 	}
-	if (sorter.get() == NULL) {
+	Xapian::KeyMaker * keymaker = sorter.get();
+	bool reverse = false;
+	if (sort_field_count == 1) {
+	    // When sorting by a single field with precomputed sort keys, use
+	    // them rather than decoding the values and building keys.
+	    Xapian::valueno sort_slot = builder->get_sort_slot(sort_fieldname);
+	    if (sort_slot != Xapian::BAD_VALUENO) {
+		slot_sorter = auto_ptr<SortSlotKeyMaker>(
+			new SortSlotKeyMaker(sort_slot, !sort_ascending));
+		keymaker = slot_sorter.get();
+		reverse = !sort_ascending;
+	    }
+	}
+	if (keymaker == NULL) {
 	    enq.set_sort_by_relevance();
 	} else {
 	    if (score_first) {
-		enq.set_sort_by_relevance_then_key(sorter.get(), false);
+		enq.set_sort_by_relevance_then_key(keymaker, reverse);
 	    } else if (score_last) {
-		enq.set_sort_by_key_then_relevance(sorter.get(), false);
+		enq.set_sort_by_key_then_relevance(keymaker, reverse);
 	    } else {
-		enq.set_sort_by_key(sorter.get(), false);
+		enq.set_sort_by_key(keymaker, reverse);
 	    }
 	}
     }
@@ -774,14 +879,6 @@ Collection::perform_search(const Json::Value & search,
     results["matches_lower_bound"] = mset.get_matches_lower_bound();
     results["matches_estimated"] = mset.get_matches_estimated();
     results["matches_upper_bound"] = mset.get_matches_upper_bound();
-    Json::Value & items = results["items"] = Json::arrayValue;
-    for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
-	Xapian::Document doc(i.get_document());
-	DocumentData docdata;
-	docdata.unserialise(doc.get_data());
-	Json::Value tmp;
-	items.append(docdata.to_display(fieldlist, tmp));
-    }
     if (verbose) {
 	// Give debugging details about the search executed.
 	// Note - we can't just include query.get_description() in the output,
@@ -789,10 +886,86 @@ Collection::perform_search(const Json::Value & search,
 	// with hexesc.
 	results["query_description"] = hexesc(query.get_description());
 
+	// The query specification, as rewritten by the optimiser.
+	results["query_plan"] = plan;
+
 	// Also include the serialised form, since this can be usefully
 	// unserialised to build testcases to demonstrate problems.
 	results["query_serialised"] = hexesc(query.serialise());
     }
+    return mset;
+}
+
+void
+Collection::perform_search(const Json::Value & search,
+			   const string & doc_type,
+			   Json::Value & results) const
+{
+    Xapian::MSet mset(run_search(search, doc_type, results));
+    const Json::Value & fieldlist = search["display"];
+    Json::Value & items = results["items"] = Json::arrayValue;
+    for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
+	Xapian::Document doc(i.get_document());
+	DocumentData docdata;
+	docdata.unserialise(doc.get_data(), &config.get_docdata_compressor());
+	Json::Value tmp;
+	items.append(docdata.to_display(fieldlist, tmp));
+    }
+}
+
+void
+Collection::perform_search_json(const Json::Value & search,
+				const string & doc_type,
+				string & output) const
+{
+    Json::Value results;
+    Xapian::MSet mset(run_search(search, doc_type, results));
+    const Json::Value & fieldlist = search["display"];
+
+    // Write the members in the same order as json_serialise() would, with
+    // the items inserted in their sorted position.
+    output += '{';
+    bool items_written = false;
+    Json::Value::Members names(results.getMemberNames());
+    for (Json::Value::Members::const_iterator i = names.begin();
+	 i != names.end(); ++i) {
+	if (i != names.begin()) {
+	    output += ',';
+	}
+	if (!items_written && *i > "items") {
+	    write_search_items(mset, fieldlist, output);
+	    output += ',';
+	    items_written = true;
+	}
+	output += Json::valueToQuotedString(i->c_str());
+	output += ':';
+	output += json_serialise(results[*i]);
+    }
+    if (!items_written) {
+	if (!names.empty()) {
+	    output += ',';
+	}
+	write_search_items(mset, fieldlist, output);
+    }
+    output += '}';
+}
+
+void
+Collection::write_search_items(const Xapian::MSet & mset,
+			       const Json::Value & fieldlist,
+			       string & output) const
+{
+    output += "\"items\":[";
+    for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
+	if (i != mset.begin()) {
+	    output += ',';
+	}
+	Xapian::Document doc(i.get_document());
+	DocumentData docdata;
+	docdata.unserialise(doc.get_data(), &config.get_docdata_compressor());
+	docdata.write_display(fieldlist, output);
+    }
+    output += ']';
 }
 
 void
@@ -808,7 +981,8 @@ Collection::get_doc_fields(const Xapian::Document & doc,
     if (schema == NULL) {
 	result = Json::objectValue;
     } else {
-	schema->display_doc(doc, fieldlist, result);
+	schema->display_doc(doc, fieldlist, result,
+			    &config.get_docdata_compressor());
     }
 }
 
@@ -821,8 +995,72 @@ Collection::get_document(const string & doc_type,
     string idterm = "\t" + doc_type + "\t" + docid;
     Xapian::Document doc = group.get_document(idterm, found);
     if (found) {
-	doc_to_json(doc, result);
+	doc_to_json(doc, result, &config.get_docdata_compressor());
     } else {
 	result = Json::nullValue;
     }
 }
+
+bool
+Collection::get_document_json(const string & doc_type,
+			      const string & docid,
+			      string & result,
+			      string * gzipped) const
+{
+    string idterm = "\t" + doc_type + "\t" + docid;
+    if (g_document_cache.get(get_name(), idterm, result, gzipped)) {
+	return true;
+    }
+    if (gzipped != NULL) {
+	gzipped->clear();
+    }
+    bool found;
+    Xapian::Document doc = group.get_document(idterm, found);
+    if (!found) {
+	return false;
+    }
+    Json::Value tmp;
+    result = json_serialise(doc_to_json(doc, tmp,
+					&config.get_docdata_compressor()));
+    // Documents read while open for writing may not have been committed.
+    if (!group.is_writable()) {
+	g_document_cache.set(get_name(), idterm, result,
+			     doc_cache_generation);
+    }
+    return true;
+}
+
+void
+Collection::cache_document_gzipped(const string & doc_type,
+				   const string & docid,
+				   const string & result,
+				   const string & gzipped) const
+{
+    g_document_cache.set_gzipped(get_name(), "\t" + doc_type + "\t" + docid,
+				 result, gzipped);
+}
+
+void
+Collection::get_documents(const vector<pair<string, string> > & ids,
+			  Json::Value & result) const
+{
+    vector<string> idterms;
+    idterms.reserve(ids.size());
+    for (vector<pair<string, string> >::const_iterator i = ids.begin();
+	 i != ids.end(); ++i) {
+	idterms.push_back("\t" + i->first + "\t" + i->second);
+    }
+
+    vector<Xapian::Document> docs;
+    vector<bool> found;
+    group.get_documents(idterms, docs, found);
+
+    result = Json::arrayValue;
+    result.resize(ids.size());
+    for (size_t i = 0; i != ids.size(); ++i) {
+	if (found[i]) {
+	    doc_to_json(docs[i], result[Json::ArrayIndex(i)],
+			&config.get_docdata_compressor());
+	}
+    }
+}
@@ -30,8 +30,11 @@
 #include "jsonxapian/collconfig.h"
 #include "ngramcat/categoriser.h"
 #include "schema.h"
+#include <set>
 #include <string>
+#include <utility>
 #include "utils/safe_inttypes.h"
+#include <vector>
 #include <xapian.h>
 
 class TaskManager;
@@ -51,8 +54,30 @@ class Collection {
      */
     std::string last_config;
 
+    /** Flag, true if the config has changes which haven't been written to
+     *  the database yet.
+     */
+    bool config_dirty;
+
     RestPose::DbGroup group;
 
+    /** The document cache generation when the collection was last opened
+     *  for reading.
+     */
+    uint64_t doc_cache_generation;
+
+    /** The idterms of documents changed since the last commit.
+     *
+     *  These are removed from the document cache after the changes are
+     *  committed.
+     */
+    std::set<std::string> changed_idterms;
+
+    /** Flag, true if too many documents have been changed since the last
+     *  commit to keep track of them individually.
+     */
+    bool many_changed;
+
     /** Get a database object.
      *
      *  Will return a reference to whichever of wrdb or rodb is open,
@@ -87,6 +112,32 @@ class Collection {
 				    const Taxonomy & taxonomy,
 				    const Categories & modified);
 
+    /** Note that a document has been changed, so that it can be removed from
+     *  the document cache when the change is committed.
+     */
+    void doc_changed(const std::string & idterm);
+
+    /** Remove the documents changed since the last commit from the document
+     *  cache.
+     */
+    void invalidate_changed_docs();
+
+    /** Run a search, and get its matches.
+     *
+     *  Sets all the members of results except for the matching items, which
+     *  are to be read from the returned MSet.
+     */
+    Xapian::MSet run_search(const Json::Value & search,
+			    const std::string & doc_type,
+			    Json::Value & results) const;
+
+    /** Append the serialised JSON list of the items in an MSet, as the
+     *  "items" member of an object, to a string.
+     */
+    void write_search_items(const Xapian::MSet & mset,
+			    const Json::Value & fieldlist,
+			    std::string & output) const;
+
     /// Copying not allowed.
     Collection(const Collection &);
     /// Assignment not allowed.
@@ -125,9 +176,7 @@ class Collection {
 
     /** Close the collection.
      */
-    void close() {
-	group.close();
-    }
+    void close();
 
     /** Return true iff the collection is open for writing.
      */
@@ -157,6 +206,15 @@ class Collection {
     void set_schema(const std::string & type,
 		    const Schema & schema);
 
+    /** Merge new schema configuration found while processing documents.
+     *
+     *  The delta is as returned by CollectionConfig::get_schema_delta().
+     *  Deltas which add nothing new are ignored.  The config isn't written
+     *  to the database until the next commit, so that a series of deltas
+     *  is written all at once.
+     */
+    void apply_schema_delta(const Json::Value & delta);
+
 
     /** Get an input pipe.
      *
@@ -288,6 +346,8 @@ class Collection {
     void raw_delete_doc(const std::string & idterm);
 
     /** Commit any pending changes to the database.
+     *
+     *  Writes the config first, if it has unwritten changes.
      */
     void commit();
 
@@ -301,6 +361,18 @@ class Collection {
 			const std::string & doc_type,
 			Json::Value & results) const;
 
+    /** Perform a search, within a particular document type, and append the
+     *  results to a string as serialised JSON.
+     *
+     *  The output is the same as json_serialise() of the results from
+     *  perform_search(), but the stored fields of the matching documents are
+     *  copied directly into the output rather than being parsed and
+     *  serialised again.
+     */
+    void perform_search_json(const Json::Value & search,
+			     const std::string & doc_type,
+			     std::string & output) const;
+
     /** Get a set of stored fields from a Xapian document.
      */
     void get_doc_fields(const Xapian::Document & doc,
@@ -313,6 +385,40 @@ class Collection {
     void get_document(const std::string & doc_type,
 		      const std::string & docid,
 		      Json::Value & result) const;
+
+    /** Get the serialised JSON representation of a document, given its ID.
+     *
+     *  Uses the document cache, if the collection is open for reading.
+     *
+     *  If gzipped is not NULL, it is set to the gzip compressed form of the
+     *  document if this is in the cache, or to an empty string otherwise.
+     *
+     *  Returns false if the document wasn't found.
+     */
+    bool get_document_json(const std::string & doc_type,
+			   const std::string & docid,
+			   std::string & result,
+			   std::string * gzipped = NULL) const;
+
+    /** Store the gzip compressed form of a document in the document cache.
+     *
+     *  result must be the serialised document returned by
+     *  get_document_json().
+     */
+    void cache_document_gzipped(const std::string & doc_type,
+				const std::string & docid,
+				const std::string & result,
+				const std::string & gzipped) const;
+
+    /** Get JSON representations of a set of documents, given their IDs.
+     *
+     *  @param ids The type and ID of each document.
+     *  @param result Set to an array holding the documents, in the same
+     *  order as ids, with null for each document which wasn't found.
+     */
+    void get_documents(
+	const std::vector<std::pair<std::string, std::string> > & ids,
+	Json::Value & result) const;
 };
 
 }
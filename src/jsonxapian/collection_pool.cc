@@ -27,6 +27,7 @@
 
 #include <algorithm>
 #include "diritor.h"
+#include "jsonxapian/document_cache.h"
 #include <memory>
 #include "omassert.h"
 #include "safeerrno.h"
@@ -117,6 +118,7 @@ CollectionPool::del(const std::string & coll_name)
     if (dir_exists(topdir)) {
 	rmdir_recursive(topdir);
     }
+    g_document_cache.invalidate_all(coll_name);
 }
 
 Collection *
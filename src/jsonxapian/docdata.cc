@@ -25,14 +25,343 @@
 #include <config.h>
 
 #include "docdata.h"
+
+#include <algorithm>
+#include <cstring>
+#include "json/writer.h"
+#include <memory>
 #include "serialise.h"
+#include <set>
 #include "utils/jsonutils.h"
+#include "utils/rsperrors.h"
+#include "utils/threading.h"
 
 using namespace RestPose;
 using namespace std;
 
+/** Marker at the start of compressed document data.
+ *
+ *  Uncompressed data never starts with this, since it would represent an
+ *  empty value stored for an empty fieldname, and empty values are never
+ *  stored.
+ */
+static const char COMPRESSED_MARKER[] = { '\0', '\0' };
+
+/// Length of COMPRESSED_MARKER.
+static const size_t COMPRESSED_MARKER_LEN = sizeof(COMPRESSED_MARKER);
+
+/// Default compression level for document data.
+static const int DEFAULT_COMPRESSION_LEVEL = 6;
+
+/// Longest value to consider as a whole when building a dictionary.
+static const size_t MAX_WHOLE_FRAGMENT_LEN = 64;
+
+/// Shortest word (from longer values) to consider for a dictionary.
+static const size_t MIN_WORD_FRAGMENT_LEN = 4;
+
+DocumentDataCompressor::DocumentDataCompressor()
+	: enabled(false),
+	  level(DEFAULT_COMPRESSION_LEVEL),
+	  streams_mutex(new Mutex)
+{
+}
+
+DocumentDataCompressor::~DocumentDataCompressor()
+{
+    clear_streams();
+    delete streams_mutex;
+}
+
+void
+DocumentDataCompressor::clear_streams()
+{
+    ContextLocker lock(*streams_mutex);
+    for (vector<ZlibDeflater *>::iterator i = deflaters.begin();
+	 i != deflaters.end(); ++i) {
+	delete *i;
+    }
+    deflaters.clear();
+    for (vector<vector<ZlibInflater *> >::iterator i = inflaters.begin();
+	 i != inflaters.end(); ++i) {
+	for (vector<ZlibInflater *>::iterator j = i->begin();
+	     j != i->end(); ++j) {
+	    delete *j;
+	}
+    }
+    inflaters.clear();
+}
+
+ZlibDeflater *
+DocumentDataCompressor::take_deflater() const
+{
+    {
+	ContextLocker lock(*streams_mutex);
+	if (!deflaters.empty()) {
+	    ZlibDeflater * result = deflaters.back();
+	    deflaters.pop_back();
+	    return result;
+	}
+    }
+    auto_ptr<ZlibDeflater> result(new ZlibDeflater(ZLIB_FORMAT_RAW, level));
+    if (!dictionaries.empty()) {
+	result->set_dictionary(dictionaries.back());
+    }
+    return result.release();
+}
+
+ZlibInflater *
+DocumentDataCompressor::take_inflater(size_t dict_num) const
+{
+    {
+	ContextLocker lock(*streams_mutex);
+	if (dict_num < inflaters.size() && !inflaters[dict_num].empty()) {
+	    ZlibInflater * result = inflaters[dict_num].back();
+	    inflaters[dict_num].pop_back();
+	    return result;
+	}
+    }
+    auto_ptr<ZlibInflater> result(new ZlibInflater(ZLIB_FORMAT_RAW));
+    if (dict_num > 0) {
+	result->set_dictionary(dictionaries[dict_num - 1]);
+    }
+    return result.release();
+}
+
+void
+DocumentDataCompressor::set_level(int level_)
+{
+    if (level_ < 1 || level_ > 9) {
+	throw InvalidValueError("Compression level must be between 1 and 9");
+    }
+    level = level_;
+    enabled = true;
+    clear_streams();
+}
+
+void
+DocumentDataCompressor::add_dictionary(const string & dictionary)
+{
+    if (dictionary.size() > 32768) {
+	throw InvalidValueError("Compression dictionary must be at most "
+				"32768 bytes long");
+    }
+    dictionaries.push_back(dictionary);
+    enabled = true;
+    clear_streams();
+}
+
+bool
+DocumentDataCompressor::is_compressed(const string & stored)
+{
+    return stored.size() >= COMPRESSED_MARKER_LEN &&
+	    memcmp(stored.data(), COMPRESSED_MARKER,
+		   COMPRESSED_MARKER_LEN) == 0;
+}
+
+string
+DocumentDataCompressor::compress(const string & data) const
+{
+    if (!enabled || data.empty()) {
+	return data;
+    }
+    // If deflating fails, the stream is dropped rather than being returned
+    // to the pool.
+    auto_ptr<ZlibDeflater> deflater(take_deflater());
+    string result(COMPRESSED_MARKER, COMPRESSED_MARKER_LEN);
+    result += encode_length(dictionaries.size());
+    result += deflater->deflate(data.data(), data.size());
+    {
+	ContextLocker lock(*streams_mutex);
+	deflaters.push_back(deflater.get());
+	deflater.release();
+    }
+    if (result.size() >= data.size()) {
+	return data;
+    }
+    return result;
+}
+
+string
+DocumentDataCompressor::decompress(const string & stored) const
+{
+    if (!is_compressed(stored)) {
+	return stored;
+    }
+    const char * ptr = stored.data() + COMPRESSED_MARKER_LEN;
+    const char * endptr = stored.data() + stored.size();
+    size_t dict_num = rsp_decode_length(&ptr, endptr, false);
+    if (dict_num > dictionaries.size()) {
+	throw UnserialisationError("Document data was compressed with an "
+				   "unknown dictionary");
+    }
+    auto_ptr<ZlibInflater> inflater(take_inflater(dict_num));
+    string result;
+    try {
+	result = inflater->inflate(ptr, endptr - ptr);
+    } catch (const CompressionError & e) {
+	throw UnserialisationError(string("Invalid compressed document "
+					  "data: ") + e.what());
+    }
+    {
+	ContextLocker lock(*streams_mutex);
+	if (inflaters.size() <= dict_num) {
+	    inflaters.resize(dict_num + 1);
+	}
+	inflaters[dict_num].push_back(inflater.get());
+	inflater.release();
+    }
+    return result;
+}
+
+/// Count a fragment of text which might be worth putting in a dictionary.
+static void
+count_fragment(map<string, unsigned> & counts, const string & fragment)
+{
+    if (!fragment.empty()) {
+	++counts[fragment];
+    }
+}
+
+string
+DocumentDataCompressor::train(const vector<string> & samples,
+			      size_t max_size)
+{
+    // Count the field names and the values.  Short values are counted as a
+    // whole; longer ones are also split into words, since they're often made
+    // up of repeated phrases.
+    map<string, unsigned> counts;
+    for (vector<string>::const_iterator i = samples.begin();
+	 i != samples.end(); ++i) {
+	DocumentData docdata;
+	docdata.unserialise(*i);
+	for (DocumentData::const_iterator j = docdata.begin();
+	     j != docdata.end(); ++j) {
+	    count_fragment(counts, j->first);
+	    const string & value = j->second;
+	    if (value.size() <= MAX_WHOLE_FRAGMENT_LEN) {
+		count_fragment(counts, value);
+		continue;
+	    }
+	    string::size_type start = 0;
+	    while (start < value.size()) {
+		string::size_type end = value.find(' ', start);
+		if (end == string::npos) {
+		    end = value.size();
+		}
+		if (end - start >= MIN_WORD_FRAGMENT_LEN &&
+		    end - start <= MAX_WHOLE_FRAGMENT_LEN) {
+		    count_fragment(counts, value.substr(start, end + 1 - start));
+		}
+		start = end + 1;
+	    }
+	}
+    }
+
+    // Score each fragment by the number of bytes it occurs for in total.
+    // Fragments which occur only once can't usefully be shared between
+    // documents, unless there's only one sample.
+    unsigned min_count = samples.size() > 1 ? 2 : 1;
+    vector<pair<size_t, string> > scored;
+    for (map<string, unsigned>::const_iterator i = counts.begin();
+	 i != counts.end(); ++i) {
+	if (i->second >= min_count) {
+	    scored.push_back(pair<size_t, string>(
+		i->second * i->first.size(), i->first));
+	}
+    }
+    sort(scored.begin(), scored.end());
+
+    // Take the best fragments until the dictionary is full, then write them
+    // out with the best at the end.
+    vector<const string *> chosen;
+    size_t total = 0;
+    for (vector<pair<size_t, string> >::const_reverse_iterator
+	 i = scored.rbegin(); i != scored.rend(); ++i) {
+	if (total + i->second.size() <= max_size) {
+	    chosen.push_back(&(i->second));
+	    total += i->second.size();
+	}
+    }
+    string result;
+    result.reserve(total);
+    for (vector<const string *>::const_reverse_iterator
+	 i = chosen.rbegin(); i != chosen.rend(); ++i) {
+	result += **i;
+    }
+    return result;
+}
+
+Json::Value &
+DocumentDataCompressor::to_json(Json::Value & value) const
+{
+    value = Json::objectValue;
+    value["type"] = "zlib";
+    value["enabled"] = enabled;
+    value["level"] = level;
+    Json::Value & dicts = value["dictionaries"] = Json::arrayValue;
+    for (vector<string>::const_iterator i = dictionaries.begin();
+	 i != dictionaries.end(); ++i) {
+	dicts.append(*i);
+    }
+    if (!stats.isNull()) {
+	value["stats"] = stats;
+    }
+    return value;
+}
+
+void
+DocumentDataCompressor::from_json(const Json::Value & value)
+{
+    clear_streams();
+    enabled = false;
+    level = DEFAULT_COMPRESSION_LEVEL;
+    dictionaries.clear();
+    stats = Json::nullValue;
+    if (value.isNull()) {
+	return;
+    }
+    json_check_object(value, "document data compression settings");
+    if (json_get_string_member(value, "type", "zlib") != "zlib") {
+	throw InvalidValueError("Unknown document data compression type");
+    }
+    const Json::Value & dicts = value["dictionaries"];
+    if (!dicts.isNull()) {
+	json_check_array(dicts, "list of compression dictionaries");
+	for (Json::Value::const_iterator i = dicts.begin();
+	     i != dicts.end(); ++i) {
+	    json_check_string(*i, "compression dictionary");
+	    add_dictionary((*i).asString());
+	}
+    }
+    set_level(json_get_uint64_member(value, "level", 9,
+				     DEFAULT_COMPRESSION_LEVEL));
+    enabled = json_get_bool(value, "enabled", true);
+    stats = value.get("stats", Json::nullValue);
+}
+
+void
+DocumentDataCompressor::check_keeps_dictionaries(const Json::Value & value) const
+{
+    if (dictionaries.empty()) {
+	return;
+    }
+    const Json::Value & dicts = value.isObject() ?
+	    value["dictionaries"] : Json::Value::null;
+    if (!dicts.isArray() || dicts.size() < dictionaries.size()) {
+	throw InvalidValueError("Document data compression settings must "
+				"keep all the existing dictionaries");
+    }
+    for (Json::ArrayIndex i = 0; i != dictionaries.size(); ++i) {
+	if (!dicts[i].isString() || dicts[i].asString() != dictionaries[i]) {
+	    throw InvalidValueError("Document data compression settings must "
+				    "keep all the existing dictionaries, in "
+				    "order");
+	}
+    }
+}
+
 std::string
-DocumentData::serialise() const
+DocumentData::serialise(const DocumentDataCompressor * compressor) const
 {
     std::map<std::string, std::string>::const_iterator i;
 
@@ -53,15 +382,29 @@ DocumentData::serialise() const
 	result += i->second;
     }
 
+    if (compressor != NULL) {
+	return compressor->compress(result);
+    }
     return result;
 };
 
 void
-DocumentData::unserialise(const std::string &s)
+DocumentData::unserialise(const std::string &s,
+			  const DocumentDataCompressor * compressor)
 {
     fields.clear();
-    const char * ptr = s.data();
-    const char * endptr = ptr + s.size();
+    string uncompressed;
+    const string * data = &s;
+    if (DocumentDataCompressor::is_compressed(s)) {
+	if (compressor == NULL) {
+	    throw UnserialisationError("Document data is compressed, but no "
+				       "dictionaries were supplied");
+	}
+	uncompressed = compressor->decompress(s);
+	data = &uncompressed;
+    }
+    const char * ptr = data->data();
+    const char * endptr = ptr + data->size();
     while (ptr != endptr) {
 	size_t len = rsp_decode_length(&ptr, endptr, true);
 	std::string field(ptr, len);
@@ -105,3 +448,54 @@ DocumentData::to_display(const Json::Value & fieldlist,
     }
     return result;
 }
+
+/** Append a member of a JSON object, whose value is already serialised.
+ */
+static void
+append_member(std::string & output, bool & first,
+	      const std::string & name, const std::string & value)
+{
+    if (first) {
+	first = false;
+    } else {
+	output += ',';
+    }
+    output += Json::valueToQuotedString(name.c_str());
+    output += ':';
+    output += value;
+}
+
+void
+DocumentData::write_display(const Json::Value & fieldlist,
+			    std::string & output) const
+{
+    output += '{';
+    bool first = true;
+    if (fieldlist.isNull()) {
+	// Write all fields.
+	for (std::map<std::string, std::string>::const_iterator
+	     i = fields.begin(); i != fields.end(); ++i) {
+	    if (!i->second.empty()) {
+		append_member(output, first, i->first, i->second);
+	    }
+	}
+    } else {
+	// Write fields in fieldlist, sorted and without duplicates, as they
+	// would be held in a Json::Value object.
+	std::set<std::string> fieldnames;
+	for (Json::Value::const_iterator fiter = fieldlist.begin();
+	     fiter != fieldlist.end();
+	     ++fiter) {
+	    fieldnames.insert((*fiter).asString());
+	}
+	for (std::set<std::string>::const_iterator fname = fieldnames.begin();
+	     fname != fieldnames.end(); ++fname) {
+	    std::map<std::string, std::string>::const_iterator
+		    i = fields.find(*fname);
+	    if (i != fields.end() && !i->second.empty()) {
+		append_member(output, first, *fname, i->second);
+	    }
+	}
+    }
+    output += '}';
+}
@@ -28,8 +28,167 @@
 #include "json/value.h"
 #include <string>
 #include <map>
+#include "utils/compression.h"
+#include <vector>
+
+class Mutex;
 
 namespace RestPose {
+    /** Compression settings for stored document data.
+     *
+     *  Document data is compressed with zlib, using a preset dictionary
+     *  trained from sample documents.  Most of the stored data for typical
+     *  documents is made up of field names and commonly repeated values, so
+     *  a dictionary helps a lot for small documents, where zlib on its own
+     *  has too little context to work with.
+     *
+     *  Every dictionary which has been used is kept, so that documents
+     *  compressed before a dictionary was retrained can still be read; new
+     *  data is always compressed with the most recent dictionary.
+     *
+     *  Compression and decompression may be performed by several threads
+     *  at once: each call takes a zlib stream from a pool of idle streams
+     *  (making a new one if the pool is empty), and puts it back when done.
+     *  Changing the settings is not threadsafe.
+     */
+    class DocumentDataCompressor {
+	/// Flag, true if new document data should be compressed.
+	bool enabled;
+
+	/// The zlib compression level to use.
+	int level;
+
+	/// The dictionaries, in the order they were added.
+	std::vector<std::string> dictionaries;
+
+	/// Statistics recorded when the most recent dictionary was trained.
+	Json::Value stats;
+
+	/** Mutex protecting the pools of idle zlib streams.
+	 *
+	 *  Held by pointer, so that this header doesn't need threading.h.
+	 */
+	Mutex * streams_mutex;
+
+	/// Idle deflaters, for compressing with the most recent dictionary.
+	mutable std::vector<ZlibDeflater *> deflaters;
+
+	/** Idle inflaters, for each dictionary.
+	 *
+	 *  Indexed by dictionary number, with 0 meaning no dictionary.
+	 */
+	mutable std::vector<std::vector<ZlibInflater *> > inflaters;
+
+	/// Discard all the idle zlib streams.
+	void clear_streams();
+
+	/// Take a deflater from the pool, or make a new one.
+	ZlibDeflater * take_deflater() const;
+
+	/// Take an inflater for a dictionary from the pool, or make a new one.
+	ZlibInflater * take_inflater(size_t dict_num) const;
+
+	/// Copying not allowed.
+	DocumentDataCompressor(const DocumentDataCompressor &);
+
+	/// Assignment not allowed.
+	void operator=(const DocumentDataCompressor &);
+
+      public:
+	DocumentDataCompressor();
+	~DocumentDataCompressor();
+
+	/** Return true iff new document data should be compressed.
+	 */
+	bool is_enabled() const {
+	    return enabled;
+	}
+
+	/** Turn off compression of new document data.
+	 *
+	 *  The dictionaries are kept, so that existing data can be read.
+	 */
+	void disable() {
+	    enabled = false;
+	}
+
+	/** Set the compression level to use (as for zlib: 1 to 9).
+	 *
+	 *  Also enables compression of new document data.
+	 */
+	void set_level(int level_);
+
+	/** Add a dictionary, to be used for compressing all new data.
+	 *
+	 *  Also enables compression of new document data.
+	 */
+	void add_dictionary(const std::string & dictionary);
+
+	/** Record statistics about the most recent dictionary.
+	 */
+	void set_stats(const Json::Value & stats_) {
+	    stats = stats_;
+	}
+
+	/** Get the number of dictionaries stored.
+	 */
+	size_t dictionary_count() const {
+	    return dictionaries.size();
+	}
+
+	/** Compress serialised document data.
+	 *
+	 *  Returns the data unchanged if compression is disabled, or wouldn't
+	 *  make the data smaller.
+	 */
+	std::string compress(const std::string & data) const;
+
+	/** Decompress stored document data.
+	 *
+	 *  Returns the data unchanged if it isn't compressed.
+	 */
+	std::string decompress(const std::string & stored) const;
+
+	/** Return true if stored document data is in compressed form.
+	 */
+	static bool is_compressed(const std::string & stored);
+
+	/** Build a dictionary from some samples of serialised document data.
+	 *
+	 *  The dictionary is made from the field names and values which occur
+	 *  most often in the samples, with the most useful placed last (since
+	 *  zlib can refer to the end of the dictionary most cheaply).
+	 *
+	 *  @param samples Serialised (uncompressed) document data.
+	 *  @param max_size The maximum size of dictionary to build (zlib
+	 *  can't use more than 32768 bytes).
+	 */
+	static std::string train(const std::vector<std::string> & samples,
+				 size_t max_size = 32768);
+
+	/** Convert the compression settings to JSON.
+	 *
+	 *  Returns a reference to the value supplied, to allow easier use
+	 *  inline.
+	 */
+	Json::Value & to_json(Json::Value & value) const;
+
+	/** Set the compression settings from JSON.
+	 *
+	 *  Wipes out any previous settings.  A null value turns off
+	 *  compression.
+	 */
+	void from_json(const Json::Value & value);
+
+	/** Check that new compression settings keep the current dictionaries.
+	 *
+	 *  Stored data refers to dictionaries by number, so the settings must
+	 *  list all the current dictionaries, in the same order, before any
+	 *  new ones.  Throws InvalidValueError if they don't.
+	 */
+	void check_keeps_dictionaries(const Json::Value & value) const;
+    };
+
     /** Data to be stored in a document.
      *
      *  This is an abstraction on top of Xapian's Document data storage, which
@@ -71,17 +230,36 @@ namespace RestPose {
 	    }
 	}
 
-	/** Convert the document data to a string, for storage. */
-	std::string serialise() const;
+	/** Convert the document data to a string, for storage.
+	 *
+	 *  @param compressor The compressor to use, or NULL to store the data
+	 *  uncompressed.
+	 */
+	std::string serialise(const DocumentDataCompressor * compressor = NULL) const;
 
 	/** Unserialise the document data from a string produced by
-	 *  serialise(). */
-	void unserialise(const std::string &s);
+	 *  serialise().
+	 *
+	 *  @param compressor The compressor holding the dictionaries used
+	 *  when serialising.  May be NULL if the data isn't compressed.
+	 */
+	void unserialise(const std::string &s,
+			 const DocumentDataCompressor * compressor = NULL);
 
 	/** Output the document data in display form.
 	 */
 	Json::Value & to_display(const Json::Value & fieldlist,
 				 Json::Value & result) const;
+
+	/** Append the document data in display form to a string, as
+	 *  serialised JSON.
+	 *
+	 *  The output is the same as json_serialise() of the result of
+	 *  to_display(): the stored values are already serialised JSON, so
+	 *  they are copied into the output without being parsed.
+	 */
+	void write_display(const Json::Value & fieldlist,
+			   std::string & output) const;
     };
 };
 
@@ -34,14 +34,15 @@
 using namespace RestPose;
 
 Json::Value &
-RestPose::doc_to_json(const Xapian::Document & doc, Json::Value & result)
+RestPose::doc_to_json(const Xapian::Document & doc, Json::Value & result,
+		      const DocumentDataCompressor * compressor)
 {
     json_check_object(result, "target for doc_to_json");
     result = Json::objectValue;
 
     {
 	DocumentData docdata;
-	docdata.unserialise(doc.get_data());
+	docdata.unserialise(doc.get_data(), compressor);
 	Json::Value & dataval(result["data"]);
 	dataval = Json::objectValue;
 	for (DocumentData::const_iterator i = docdata.begin();
@@ -30,9 +30,15 @@
 #include <xapian.h>
 
 namespace RestPose {
+    class DocumentDataCompressor;
+
     /** Convert a document to a JSON object representing it.
+     *
+     *  @param compressor The compressor used for the stored document data,
+     *  or NULL if it was stored uncompressed.
      */
-    Json::Value & doc_to_json(const Xapian::Document & doc, Json::Value & result);
+    Json::Value & doc_to_json(const Xapian::Document & doc, Json::Value & result,
+			      const DocumentDataCompressor * compressor = NULL);
 };
 
 #endif /* RESTPOSE_INCLUDED_DOCTOJSON_H */
@@ -0,0 +1,287 @@
+/** @file document_cache.cc
+ * @brief A cache of rendered documents.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "jsonxapian/document_cache.h"
+
+#include "utils/hash.h"
+
+using namespace RestPose;
+using namespace std;
+
+/// The total number of bytes of documents held by the cache.
+#define DOCUMENT_CACHE_SIZE (64 * 1024 * 1024)
+
+/** Allowance for the memory used by each entry, other than the key and value.
+ *
+ *  Covers the list and map nodes, and the string headers.
+ */
+#define DOCUMENT_CACHE_ENTRY_OVERHEAD 128
+
+DocumentCache RestPose::g_document_cache(DOCUMENT_CACHE_SIZE);
+
+/// Get the key for a document.
+static inline string
+cache_key(const string & coll_name, const string & idterm)
+{
+    // Collection names can't contain tabs, and idterms start with one, so
+    // this can't be ambiguous.
+    return coll_name + idterm;
+}
+
+/// Get the number of bytes to count for an entry.
+static inline size_t
+entry_size(const string & key, const string & value)
+{
+    return key.size() * 2 + value.size() + DOCUMENT_CACHE_ENTRY_OVERHEAD;
+}
+
+/// Get the number of bytes to count for an entry, with its gzipped form.
+static inline size_t
+entry_size(const string & key, const string & value, const string & gzipped)
+{
+    return entry_size(key, value) + gzipped.size();
+}
+
+DocumentCache::DocumentCache(size_t max_bytes)
+	: max_shard_bytes(max_bytes / SHARD_COUNT)
+{
+}
+
+DocumentCache::Shard &
+DocumentCache::get_shard(const string & key)
+{
+    return shards[fnv1a_hash(key.data(), key.size()) % SHARD_COUNT];
+}
+
+void
+DocumentCache::remove_entry(Shard & shard,
+			    map<string, Entries::iterator>::iterator i)
+{
+    shard.bytes -= entry_size(i->first, i->second->value,
+			      i->second->gzipped);
+    shard.entries.erase(i->second);
+    shard.index.erase(i);
+}
+
+void
+DocumentCache::next_generation(const string & coll_name)
+{
+    ContextLocker lock(generations_mutex);
+    ++generations[coll_name];
+}
+
+uint64_t
+DocumentCache::get_generation(const string & coll_name) const
+{
+    ContextLocker lock(generations_mutex);
+    map<string, uint64_t>::const_iterator i = generations.find(coll_name);
+    if (i == generations.end()) {
+	return 0;
+    }
+    return i->second;
+}
+
+bool
+DocumentCache::get(const string & coll_name,
+		   const string & idterm,
+		   string & result,
+		   string * gzipped)
+{
+    string key(cache_key(coll_name, idterm));
+    Shard & shard = get_shard(key);
+    ContextLocker lock(shard.mutex);
+    Stats & stats = shard.stats[coll_name];
+    map<string, Entries::iterator>::iterator i = shard.index.find(key);
+    if (i == shard.index.end()) {
+	++stats.misses;
+	return false;
+    }
+    ++stats.hits;
+    // Move the entry to the front of the list.
+    shard.entries.splice(shard.entries.begin(), shard.entries, i->second);
+    result = i->second->value;
+    if (gzipped != NULL) {
+	*gzipped = i->second->gzipped;
+    }
+    return true;
+}
+
+void
+DocumentCache::set(const string & coll_name,
+		   const string & idterm,
+		   const string & value,
+		   uint64_t generation)
+{
+    string key(cache_key(coll_name, idterm));
+    size_t size = entry_size(key, value);
+    if (size > max_shard_bytes) {
+	return;
+    }
+    Shard & shard = get_shard(key);
+    ContextLocker lock(shard.mutex);
+
+    // Check the generation while holding the shard lock, so that an
+    // invalidation can't happen between the check and storing the document.
+    if (get_generation(coll_name) != generation) {
+	return;
+    }
+
+    map<string, Entries::iterator>::iterator i = shard.index.find(key);
+    if (i != shard.index.end()) {
+	remove_entry(shard, i);
+    }
+    while (shard.bytes + size > max_shard_bytes) {
+	remove_entry(shard, shard.index.find(shard.entries.back().key));
+    }
+    shard.entries.push_front(Entry(key, value));
+    shard.index[key] = shard.entries.begin();
+    shard.bytes += size;
+}
+
+void
+DocumentCache::set_gzipped(const string & coll_name,
+			   const string & idterm,
+			   const string & value,
+			   const string & gzipped)
+{
+    string key(cache_key(coll_name, idterm));
+    if (entry_size(key, value, gzipped) > max_shard_bytes) {
+	return;
+    }
+    Shard & shard = get_shard(key);
+    ContextLocker lock(shard.mutex);
+    map<string, Entries::iterator>::iterator i = shard.index.find(key);
+    if (i == shard.index.end()) {
+	return;
+    }
+    Entries::iterator entry = i->second;
+    if (!entry->gzipped.empty() || entry->value != value) {
+	// Already stored, or the document has been replaced since value was
+	// read.
+	return;
+    }
+    entry->gzipped = gzipped;
+    shard.bytes += gzipped.size();
+
+    // Make room, keeping the entry just updated.
+    shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+    while (shard.bytes > max_shard_bytes) {
+	remove_entry(shard, shard.index.find(shard.entries.back().key));
+    }
+}
+
+void
+DocumentCache::invalidate(const string & coll_name,
+			  const std::set<string> & idterms)
+{
+    // Increase the generation first, so that documents read before the
+    // change can't be stored once they've been removed.
+    next_generation(coll_name);
+    for (std::set<string>::const_iterator i = idterms.begin();
+	 i != idterms.end(); ++i) {
+	string key(cache_key(coll_name, *i));
+	Shard & shard = get_shard(key);
+	ContextLocker lock(shard.mutex);
+	map<string, Entries::iterator>::iterator j = shard.index.find(key);
+	if (j != shard.index.end()) {
+	    remove_entry(shard, j);
+	}
+    }
+}
+
+void
+DocumentCache::invalidate_all(const string & coll_name)
+{
+    next_generation(coll_name);
+    string prefix(cache_key(coll_name, "\t"));
+    for (unsigned i = 0; i != SHARD_COUNT; ++i) {
+	Shard & shard = shards[i];
+	ContextLocker lock(shard.mutex);
+	map<string, Entries::iterator>::iterator j
+		= shard.index.lower_bound(prefix);
+	while (j != shard.index.end() &&
+	       j->first.compare(0, prefix.size(), prefix) == 0) {
+	    remove_entry(shard, j++);
+	}
+    }
+}
+
+void
+DocumentCache::clear()
+{
+    for (unsigned i = 0; i != SHARD_COUNT; ++i) {
+	Shard & shard = shards[i];
+	ContextLocker lock(shard.mutex);
+	shard.index.clear();
+	shard.entries.clear();
+	shard.bytes = 0;
+	shard.stats.clear();
+    }
+    // Documents read before clearing mustn't be stored afterwards.
+    ContextLocker lock(generations_mutex);
+    for (map<string, uint64_t>::iterator i = generations.begin();
+	 i != generations.end(); ++i) {
+	++(i->second);
+    }
+}
+
+void
+DocumentCache::get_status(Json::Value & result) const
+{
+    size_t entries = 0;
+    size_t bytes = 0;
+    map<string, Stats> stats;
+    for (unsigned i = 0; i != SHARD_COUNT; ++i) {
+	const Shard & shard = shards[i];
+	ContextLocker lock(shard.mutex);
+	entries += shard.index.size();
+	bytes += shard.bytes;
+	for (map<string, Stats>::const_iterator j = shard.stats.begin();
+	     j != shard.stats.end(); ++j) {
+	    Stats & total = stats[j->first];
+	    total.hits += j->second.hits;
+	    total.misses += j->second.misses;
+	}
+    }
+
+    result = Json::objectValue;
+    result["entries"] = Json::UInt64(entries);
+    result["bytes"] = Json::UInt64(bytes);
+    result["max_bytes"] = Json::UInt64(max_shard_bytes * SHARD_COUNT);
+    Json::Value & colls = result["collections"] = Json::objectValue;
+    for (map<string, Stats>::const_iterator i = stats.begin();
+	 i != stats.end(); ++i) {
+	Json::Value & coll = colls[i->first] = Json::objectValue;
+	uint64_t hits = i->second.hits;
+	uint64_t misses = i->second.misses;
+	coll["hits"] = Json::UInt64(hits);
+	coll["misses"] = Json::UInt64(misses);
+	if (hits + misses == 0) {
+	    coll["hit_rate"] = Json::nullValue;
+	} else {
+	    coll["hit_rate"] = double(hits) / double(hits + misses);
+	}
+    }
+}
@@ -0,0 +1,205 @@
+/** @file document_cache.h
+ * @brief A cache of rendered documents.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RESTPOSE_INCLUDED_DOCUMENT_CACHE_H
+#define RESTPOSE_INCLUDED_DOCUMENT_CACHE_H
+
+#include "json/value.h"
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include "utils/safe_inttypes.h"
+#include "utils/threading.h"
+
+namespace RestPose {
+
+    /** A cache of rendered documents, keyed by collection and idterm.
+     *
+     *  Holds the serialised JSON for documents which have been fetched by
+     *  ID, up to a fixed total size, discarding the least recently used
+     *  when full.  The cache is split into shards, each with its own lock,
+     *  so that threads fetching different documents rarely contend.  All
+     *  methods are threadsafe.
+     *
+     *  Each collection has a generation number, which is increased whenever
+     *  documents in the collection are invalidated.  A document is only
+     *  stored if the generation is still the same as when the database it
+     *  was read from was opened, so a document read before a change was
+     *  committed can't be stored after the change has been invalidated.
+     */
+    class DocumentCache {
+      public:
+	/// The number of shards.
+	static const unsigned SHARD_COUNT = 16;
+
+      private:
+	/// A cached document.
+	struct Entry {
+	    /// The key of the document.
+	    std::string key;
+
+	    /// The serialised document.
+	    std::string value;
+
+	    /// The serialised document, gzip compressed, or empty if not known.
+	    std::string gzipped;
+
+	    Entry(const std::string & key_, const std::string & value_)
+		    : key(key_), value(value_)
+	    {}
+	};
+
+	typedef std::list<Entry> Entries;
+
+	/// Counts of lookups for a collection.
+	struct Stats {
+	    /// Number of lookups which found a document.
+	    uint64_t hits;
+
+	    /// Number of lookups which didn't find a document.
+	    uint64_t misses;
+
+	    Stats() : hits(0), misses(0) {}
+	};
+
+	/// A shard of the cache.
+	struct Shard {
+	    /// Mutex held while accessing the shard.
+	    mutable Mutex mutex;
+
+	    /// The documents, most recently used first.
+	    Entries entries;
+
+	    /// Index of the documents, by key.
+	    std::map<std::string, Entries::iterator> index;
+
+	    /// Approximate number of bytes used by the documents.
+	    size_t bytes;
+
+	    /// Counts of lookups in the shard, by collection.
+	    std::map<std::string, Stats> stats;
+
+	    Shard() : bytes(0) {}
+	};
+
+	/// The maximum number of bytes to use in each shard.
+	size_t max_shard_bytes;
+
+	/// The shards.
+	Shard shards[SHARD_COUNT];
+
+	/** Mutex protecting generations.
+	 *
+	 *  If a shard's mutex is also needed, it must be acquired first.
+	 */
+	mutable Mutex generations_mutex;
+
+	/// The generation number of each collection.
+	std::map<std::string, uint64_t> generations;
+
+	/// Get the shard holding a key.
+	Shard & get_shard(const std::string & key);
+
+	/// Remove an entry from a shard.
+	static void remove_entry(Shard & shard,
+		std::map<std::string, Entries::iterator>::iterator i);
+
+	/// Increase the generation number of a collection.
+	void next_generation(const std::string & coll_name);
+
+	/// No copying.
+	DocumentCache(const DocumentCache &);
+	/// No assignment.
+	void operator=(const DocumentCache &);
+
+      public:
+	DocumentCache(size_t max_bytes);
+
+	/** Get the generation number of a collection.
+	 *
+	 *  This should be called before opening a database to read documents
+	 *  from, and the result passed to set() when storing them.
+	 */
+	uint64_t get_generation(const std::string & coll_name) const;
+
+	/** Look up a document.
+	 *
+	 *  Returns true, and sets result to the serialised document, if the
+	 *  document is in the cache.  If gzipped is not NULL, it is set to the
+	 *  gzip compressed form of the document, or to an empty string if
+	 *  that hasn't been stored.
+	 */
+	bool get(const std::string & coll_name,
+		 const std::string & idterm,
+		 std::string & result,
+		 std::string * gzipped = NULL);
+
+	/** Store a document.
+	 *
+	 *  Does nothing if the collection's generation is no longer equal to
+	 *  generation, or the document is too large to cache.
+	 */
+	void set(const std::string & coll_name,
+		 const std::string & idterm,
+		 const std::string & value,
+		 uint64_t generation);
+
+	/** Store the gzip compressed form of a cached document.
+	 *
+	 *  Does nothing unless the document is in the cache, with the
+	 *  serialised form given by value.
+	 */
+	void set_gzipped(const std::string & coll_name,
+			 const std::string & idterm,
+			 const std::string & value,
+			 const std::string & gzipped);
+
+	/** Remove a set of documents, which have been changed.
+	 *
+	 *  This should be called after the changes have been committed.
+	 */
+	void invalidate(const std::string & coll_name,
+			const std::set<std::string> & idterms);
+
+	/** Remove all the documents in a collection.
+	 */
+	void invalidate_all(const std::string & coll_name);
+
+	/// Remove all documents, and reset the counts of hits and misses.
+	void clear();
+
+	/** Get the status of the cache.
+	 *
+	 *  Gives the number of documents and bytes held, and the counts and
+	 *  rate of hits for each collection.
+	 */
+	void get_status(Json::Value & result) const;
+    };
+
+    /// The cache of documents used for getting documents by ID.
+    extern DocumentCache g_document_cache;
+}
+
+#endif /* RESTPOSE_INCLUDED_DOCUMENT_CACHE_H */
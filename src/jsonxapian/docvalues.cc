@@ -25,7 +25,8 @@
 #include <config.h>
 #include "jsonxapian/docvalues.h"
 
-#include <memory>
+#include <algorithm>
+#include <cstring>
 #include "omassert.h"
 #include "serialise.h"
 #include "utils/rsperrors.h"
@@ -33,112 +34,154 @@
 using namespace RestPose;
 using namespace std;
 
-string
-SinglyValuedDocumentValue::serialise() const
+bool
+DocumentValues::ValueRefLess::operator()(const ValueRef & a,
+					 const ValueRef & b) const
 {
-    if (values.empty()) {
-	return string();
+    if (a.slot != b.slot) {
+	return a.slot < b.slot;
     }
-    return *(values.begin());
-}
-
-
-string
-VintLengthDocumentValue::serialise() const
-{
-    string result;
-    for (const_iterator i = begin(); i != end(); ++i) {
-	result += encode_length(i->size());
-	result += *i;
+    int cmp = memcmp(buf + a.offset, buf + b.offset, min(a.len, b.len));
+    if (cmp != 0) {
+	return cmp < 0;
     }
-    return result;
+    return a.len < b.len;
 }
 
-
-string
-GeoEncodeDocumentValue::serialise() const
+ValueEncoding
+DocumentValues::get_slot_format(Xapian::valueno slot) const
 {
-    string result;
-    for (const_iterator i = begin(); i != end(); ++i) {
-	Assert(i->size() == 6);
-	result += *i;
+    vector<pair<Xapian::valueno, ValueEncoding> >::const_iterator i;
+    for (i = formats.begin(); i != formats.end(); ++i) {
+	if (i->first == slot) {
+	    return i->second;
+	}
     }
-    return result;
+    return ENC_VINT_LENGTHS;
 }
 
-
-DocumentValues::~DocumentValues()
+void
+DocumentValues::set_slot_format(Xapian::valueno slot, ValueEncoding encoding)
 {
-    for (iterator i = entries.begin(); i != entries.end(); ++i) {
-	delete i->second;
+    vector<pair<Xapian::valueno, ValueEncoding> >::iterator i;
+    for (i = formats.begin(); i != formats.end(); ++i) {
+	if (i->first == slot) {
+	    i->second = encoding;
+	    return;
+	}
     }
+    formats.push_back(make_pair(slot, encoding));
 }
 
 void
-DocumentValues::set_slot_format(Xapian::valueno slot, ValueEncoding encoding)
+DocumentValues::add(Xapian::valueno slot, const std::string & value)
 {
-    formats[slot] = encoding;
+    if (!refs.empty()) {
+	const ValueRef & last = refs.back();
+	if (matches(last, slot, value)) {
+	    return;
+	}
+	if (sorted) {
+	    // Most values are added in order, so it's worth checking if the
+	    // new value keeps the references sorted.
+	    ValueRef newref(slot, buf.size(), value.size());
+	    buf.append(value);
+	    sorted = ValueRefLess(buf.data())(last, newref);
+	    refs.push_back(newref);
+	    return;
+	}
+    }
+    refs.push_back(ValueRef(slot, buf.size(), value.size()));
+    buf.append(value);
 }
 
 void
-DocumentValues::add(Xapian::valueno slot, const std::string & value)
+DocumentValues::remove(Xapian::valueno slot, const std::string & value)
 {
-    DocumentValue * valptr;
-    iterator i = entries.find(slot);
-    if (i == entries.end()) {
-	ValueEncoding encoding(ENC_VINT_LENGTHS);
-	map<Xapian::valueno, ValueEncoding>::const_iterator format =
-		formats.find(slot);
-	if (format != formats.end()) {
-	    encoding = format->second;
+    vector<ValueRef>::iterator out = refs.begin();
+    for (vector<ValueRef>::const_iterator i = refs.begin();
+	 i != refs.end(); ++i) {
+	if (!matches(*i, slot, value)) {
+	    *out++ = *i;
 	}
+    }
+    refs.erase(out, refs.end());
+}
 
-	auto_ptr<DocumentValue> newvalue(NULL);
-	switch (encoding) {
-	    case ENC_VINT_LENGTHS:
-		newvalue =
-			auto_ptr<DocumentValue>(new VintLengthDocumentValue);
-		break;
-	    case ENC_SINGLY_VALUED:
-		newvalue =
-			auto_ptr<DocumentValue>(new SinglyValuedDocumentValue);
-		break;
-	    case ENC_GEOENCODE:
-		newvalue =
-			auto_ptr<DocumentValue>(new GeoEncodeDocumentValue);
-		break;
+bool
+DocumentValues::empty(Xapian::valueno slot) const
+{
+    for (vector<ValueRef>::const_iterator i = refs.begin();
+	 i != refs.end(); ++i) {
+	if (i->slot == slot) {
+	    return false;
 	}
-
-	pair<iterator, bool> ret;
-	pair<Xapian::valueno, DocumentValue *> item(slot, NULL);
-	ret = entries.insert(item);
-	valptr = newvalue.get();
-	ret.first->second = newvalue.release();
-    } else {
-	valptr = i->second;
     }
-    valptr->add(value);
+    return true;
 }
 
 void
-DocumentValues::remove(Xapian::valueno slot, const std::string & value)
+DocumentValues::normalise() const
 {
-    iterator i = entries.find(slot);
-    if (i == entries.end()) {
+    if (sorted) {
 	return;
     }
-    DocumentValue & val(*(i->second));
-    val.remove(value);
-    if (val.empty()) {
-	entries.erase(i);
+    ValueRefLess less(buf.data());
+    sort(refs.begin(), refs.end(), less);
+
+    // Remove duplicates: adjacent entries which neither sort before the
+    // other.
+    vector<ValueRef>::iterator out = refs.begin();
+    for (vector<ValueRef>::const_iterator i = refs.begin();
+	 i != refs.end(); ++i) {
+	if (out == refs.begin() || less(*(out - 1), *i)) {
+	    *out++ = *i;
+	}
+    }
+    refs.erase(out, refs.end());
+    sorted = true;
+}
+
+void
+DocumentValues::encode(string & result, ValueEncoding encoding,
+		       vector<ValueRef>::const_iterator begin,
+		       vector<ValueRef>::const_iterator end) const
+{
+    result.resize(0);
+    switch (encoding) {
+	case ENC_SINGLY_VALUED:
+	    // Only the first (lowest) value is stored.
+	    result.assign(buf, begin->offset, begin->len);
+	    break;
+	case ENC_VINT_LENGTHS:
+	    for (; begin != end; ++begin) {
+		result += encode_length(begin->len);
+		result.append(buf, begin->offset, begin->len);
+	    }
+	    break;
+	case ENC_GEOENCODE:
+	    for (; begin != end; ++begin) {
+		Assert(begin->len == 6);
+		result.append(buf, begin->offset, begin->len);
+	    }
+	    break;
     }
 }
 
 void
 DocumentValues::apply(Xapian::Document & doc) const
 {
-    for (const_iterator i = begin(); i != end(); ++i) {
-	doc.add_value(i->first, i->second->serialise());
+    normalise();
+    string encoded;
+    vector<ValueRef>::const_iterator i = refs.begin();
+    while (i != refs.end()) {
+	vector<ValueRef>::const_iterator slot_end = i + 1;
+	while (slot_end != refs.end() && slot_end->slot == i->slot) {
+	    ++slot_end;
+	}
+	encode(encoded, get_slot_format(i->slot), i, slot_end);
+	doc.add_value(i->slot, encoded);
+	i = slot_end;
     }
 }
 
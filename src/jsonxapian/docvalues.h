@@ -26,7 +26,8 @@
 #define RESTPOSE_INCLUDED_DOCVALUES_H
 
 #include <string>
-#include <set>
+#include <utility>
+#include <vector>
 #include <xapian.h>
 
 namespace RestPose {
@@ -44,83 +45,76 @@ namespace RestPose {
     };
 
 
-    /** A set of values stored in a document slot.
+    /** The values to be stored in the slots of a document.
+     *
+     *  Values are accumulated in a single buffer for the document, with a
+     *  flat list of references into it, rather than in a container per slot,
+     *  since most documents only have a handful of values.  The references
+     *  are sorted and deduplicated when the values are applied, and each
+     *  slot is then encoded directly from the buffer.
      */
-    class DocumentValue {
-      protected:
-	std::set<std::string> values;
+    class DocumentValues {
+	/// A reference to a value held in the buffer.
+	struct ValueRef {
+	    /// The slot the value is stored in.
+	    Xapian::valueno slot;
+
+	    /// The offset of the value in the buffer.
+	    size_t offset;
+
+	    /// The length of the value.
+	    size_t len;
+
+	    ValueRef(Xapian::valueno slot_, size_t offset_, size_t len_)
+		    : slot(slot_), offset(offset_), len(len_)
+	    {}
+	};
+
+	/// Comparison for ValueRefs, ordering by slot and then by value.
+	class ValueRefLess {
+	    const char * buf;
+	  public:
+	    ValueRefLess(const char * buf_) : buf(buf_) {}
+	    bool operator()(const ValueRef & a, const ValueRef & b) const;
+	};
+
+	/// The buffer holding all the values.
+	std::string buf;
+
+	/** References to the values.
+	 *
+	 *  Sorted and deduplicated lazily, so mutable.
+	 */
+	mutable std::vector<ValueRef> refs;
 
-      public:
-	typedef std::set<std::string>::const_iterator const_iterator;
-	const_iterator begin() const {
-	    return values.begin();
-	}
-	const_iterator end() const {
-	    return values.end();
-	}
+	/// Flag, true if refs is known to be sorted and deduplicated.
+	mutable bool sorted;
 
-	/// Return true iff no values are stored in the slot.
-	bool empty() const {
-	    return values.empty();
-	}
+	/// Encodings for slots which don't use the default encoding.
+	std::vector<std::pair<Xapian::valueno, ValueEncoding> > formats;
 
-	/// Add a value.
-	void add(const std::string & value) {
-	    values.insert(value);
-	}
+	/// Get the encoding used for a slot.
+	ValueEncoding get_slot_format(Xapian::valueno slot) const;
 
-	/// Remove a value.
-	void remove(const std::string & value) {
-	    values.erase(value);
+	/// Check if a reference refers to a given value.
+	bool matches(const ValueRef & ref, Xapian::valueno slot,
+		     const std::string & value) const {
+	    return ref.slot == slot && ref.len == value.size() &&
+		    buf.compare(ref.offset, ref.len, value) == 0;
 	}
 
-	/** Convert the values to a string, for storage. */
-	virtual std::string serialise() const = 0;
-    };
-
-
-    /** A document value holder for slots which hold a single value.
-     */
-    class SinglyValuedDocumentValue : public DocumentValue {
-      public:
-	std::string serialise() const;
-    };
-
-
-    /** A document value holder for slots which hold values prefixed by length.
-     *
-     *  The lengths are stored in standard Xapian vint form.
-     */
-    class VintLengthDocumentValue : public DocumentValue {
-      public:
-	std::string serialise() const;
-    };
-
-
-    /** A document value holder for slots holding multiple geoencoded values.
-     */
-    class GeoEncodeDocumentValue : public DocumentValue {
-      public:
-	std::string serialise() const;
-    };
+	/// Sort the references and remove duplicates.
+	void normalise() const;
 
+	/** Encode the values in a range of references (all for the same
+	 *  slot).
+	 */
+	void encode(std::string & result, ValueEncoding encoding,
+		    std::vector<ValueRef>::const_iterator begin,
+		    std::vector<ValueRef>::const_iterator end) const;
 
-    class DocumentValues {
-        std::map<Xapian::valueno, DocumentValue *> entries;
-	std::map<Xapian::valueno, ValueEncoding> formats;
       public:
-	typedef std::map<Xapian::valueno, DocumentValue *>::const_iterator
-		const_iterator;
-	typedef std::map<Xapian::valueno, DocumentValue *>::iterator iterator;
-
-	~DocumentValues();
-
-	const_iterator begin() const {
-	    return entries.begin();
-	}
-	const_iterator end() const {
-	    return entries.end();
-	}
+	DocumentValues() : sorted(true) {}
 
 	/** Set the encoding used to store values in a slot.
 	 */
@@ -136,13 +130,7 @@ namespace RestPose {
 
 	/** Check if a value slot is empty.
 	 */
-	bool empty(Xapian::valueno slot) const {
-	    const_iterator i = entries.find(slot);
-	    if (i == entries.end()) {
-		return true;
-	    }
-	    return i->second->empty();
-	}
+	bool empty(Xapian::valueno slot) const;
 
 	/** Apply the values to a document.
 	 */
@@ -33,12 +33,15 @@
 #include <map>
 #include "str.h"
 #include <string>
+#include <vector>
 #include <xapian.h>
 
 #include "docdata.h"
 #include "hashterm.h"
 #include "jsonxapian/collconfig.h"
 #include "jsonxapian/taxonomy.h"
+#include "postingsources/geocells.h"
+#include "postingsources/multivaluerange_source.h"
 #include "utils/jsonutils.h"
 #include "utils/rsperrors.h"
 #include "utils/validation.h"
@@ -47,6 +50,56 @@
 using namespace RestPose;
 using namespace std;
 
+/** Add a value to the terms used for range searches, if there are any.
+ */
+static void
+add_range_terms(IndexingState & state, const std::string & prefix,
+		const std::string & value)
+{
+    if (prefix.empty()) {
+	return;
+    }
+    vector<string> terms;
+    MultiValueRangeSource::get_index_terms(prefix, value, terms);
+    for (vector<string>::const_iterator i = terms.begin();
+	 i != terms.end(); ++i) {
+	state.doc.add_term(*i, 0);
+    }
+}
+
+/** The length that serialised numbers are padded to in sort slots.
+ *
+ *  Xapian::sortable_serialise() returns at most 9 bytes, and drops
+ *  trailing zero bytes, so padding with zero bytes gives a fixed-width key
+ *  which sorts in the same order.
+ */
+#define SORTABLE_NUMBER_LENGTH 9
+
+/** Pad a serialised number to a fixed width, for use as a sort key.
+ */
+static std::string
+fixed_width_number(const std::string & serialised)
+{
+    std::string result(serialised);
+    result.resize(SORTABLE_NUMBER_LENGTH, '\0');
+    return result;
+}
+
+/** Add a key to the sort slot for a field, if there is one.
+ *
+ *  Only the lowest key added to the slot for a document is stored.
+ */
+static void
+add_sort_key(IndexingState & state, Xapian::valueno sort_slot,
+	     const std::string & key)
+{
+    if (sort_slot == Xapian::BAD_VALUENO) {
+	return;
+    }
+    state.docvals.set_slot_format(sort_slot, ENC_SINGLY_VALUED);
+    state.docvals.add(sort_slot, key);
+}
+
 void
 IndexingState::set_idterm(const std::string & fieldname,
 			  const std::string & idterm_)
@@ -219,8 +272,10 @@ DoubleIndexer::index(IndexingState & state,
 	    state.field_empty(fieldname);
 	} else if ((*i).isConvertibleTo(Json::realValue)) {
 	    state.field_nonempty(fieldname);
-	    state.docvals.add(slot,
-			      Xapian::sortable_serialise((*i).asDouble()));
+	    string value(Xapian::sortable_serialise((*i).asDouble()));
+	    state.docvals.add(slot, value);
+	    add_range_terms(state, prefix, value);
+	    add_sort_key(state, sort_slot, fixed_width_number(value));
 	} else {
 	    state.field_nonempty(fieldname);
 	    state.append_error(fieldname, "Double field must be numeric; was "
@@ -248,8 +303,10 @@ TimeStampIndexer::index(IndexingState & state,
 	    state.field_empty(fieldname);
 	} else if ((*i).isConvertibleTo(Json::realValue)) {
 	    state.field_nonempty(fieldname);
-	    state.docvals.add(slot,
-			      Xapian::sortable_serialise((*i).asDouble()));
+	    string value(Xapian::sortable_serialise((*i).asDouble()));
+	    state.docvals.add(slot, value);
+	    add_range_terms(state, prefix, value);
+	    add_sort_key(state, sort_slot, fixed_width_number(value));
 	} else {
 	    state.field_nonempty(fieldname);
 	    state.append_error(fieldname, "Timestamp field must be numeric; "
@@ -283,6 +340,12 @@ DateIndexer::index(IndexingState & state,
 	} else {
 	    state.field_nonempty(fieldname);
 	    state.docvals.add(slot, parsed);
+	    add_range_terms(state, prefix, parsed);
+	    // The year is a serialised number, followed by the month and day
+	    // in one byte each.
+	    add_sort_key(state, sort_slot,
+			 fixed_width_number(parsed.substr(0, parsed.size() - 2)) +
+			 parsed.substr(parsed.size() - 2));
 	}
     }
 
@@ -353,8 +416,10 @@ CategoryIndexer::index(IndexingState & state,
 		       const std::string & fieldname,
 		       const Json::Value & values) const
 {
-    const Taxonomy * taxonomy =
-	    state.collconfig.get_taxonomy(taxonomy_name);
+    const Taxonomy * taxonomy = NULL;
+    if (index_ancestors) {
+	taxonomy = state.collconfig.get_taxonomy(taxonomy_name);
+    }
     for (Json::Value::const_iterator i = values.begin();
 	 i != values.end(); ++i) {
 
@@ -394,11 +459,14 @@ CategoryIndexer::index(IndexingState & state,
 	state.doc.add_term(prefix + "C" + val, 0);
 	if (taxonomy != NULL) {
 	    // Add terms for the parent categories.
-	    const Category * cat_ptr = taxonomy->find(val);
-	    if (cat_ptr != NULL) {
-		for (Categories::const_iterator j = cat_ptr->ancestors.begin();
-		     j != cat_ptr->ancestors.end(); ++j) {
-		    state.doc.add_term(prefix + "A" + *j, 0);
+	    Taxonomy::CategoryId cat = taxonomy->find_id(val);
+	    if (cat != Taxonomy::NO_CATEGORY) {
+		const std::vector<Taxonomy::CategoryId> & ancestors =
+			taxonomy->get_ancestor_ids(cat);
+		for (std::vector<Taxonomy::CategoryId>::const_iterator
+		     j = ancestors.begin(); j != ancestors.end(); ++j) {
+		    state.doc.add_term(prefix + "A" + taxonomy->get_name(*j),
+				       0);
 		}
 	    }
 	}
@@ -434,6 +502,14 @@ LonLatIndexer::index(IndexingState & state,
 	    state.field_nonempty(fieldname);
 	    Xapian::LatLongCoord coord(latitude, longitude);
 	    state.docvals.add(slot, coord.serialise());
+	    if (!prefix.empty()) {
+		vector<string> terms;
+		geo_index_terms(prefix, coord, terms);
+		for (vector<string>::const_iterator j = terms.begin();
+		     j != terms.end(); ++j) {
+		    state.doc.add_term(*j, 0);
+		}
+	    }
 	}
     }
 
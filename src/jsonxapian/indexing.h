@@ -249,10 +249,22 @@ namespace RestPose {
     class DoubleIndexer : public FieldIndexer {
 	unsigned int slot;
 	std::string store_field;
+	std::string prefix;
+	Xapian::valueno sort_slot;
       public:
+	/** Create the indexer.
+	 *
+	 *  If prefix is not empty, values are also indexed as terms with that
+	 *  prefix, to allow fast range searches.  If sort_slot is not
+	 *  BAD_VALUENO, a fixed-width sort key for the lowest value is stored
+	 *  in it.
+	 */
 	DoubleIndexer(unsigned int slot_,
-		      const std::string & store_field_)
-		: slot(slot_), store_field(store_field_)
+		      const std::string & store_field_,
+		      const std::string & prefix_,
+		      Xapian::valueno sort_slot_)
+		: slot(slot_), store_field(store_field_), prefix(prefix_),
+		  sort_slot(sort_slot_)
 	{}
 
 	virtual ~DoubleIndexer();
@@ -268,10 +280,22 @@ namespace RestPose {
     class TimeStampIndexer : public FieldIndexer {
 	unsigned int slot;
 	std::string store_field;
+	std::string prefix;
+	Xapian::valueno sort_slot;
       public:
+	/** Create the indexer.
+	 *
+	 *  If prefix is not empty, values are also indexed as terms with that
+	 *  prefix, to allow fast range searches.  If sort_slot is not
+	 *  BAD_VALUENO, a fixed-width sort key for the lowest value is stored
+	 *  in it.
+	 */
 	TimeStampIndexer(unsigned int slot_,
-			 const std::string & store_field_)
-		: slot(slot_), store_field(store_field_)
+			 const std::string & store_field_,
+			 const std::string & prefix_,
+			 Xapian::valueno sort_slot_)
+		: slot(slot_), store_field(store_field_), prefix(prefix_),
+		  sort_slot(sort_slot_)
 	{}
 
 	virtual ~TimeStampIndexer();
@@ -294,10 +318,22 @@ namespace RestPose {
     class DateIndexer : public FieldIndexer {
 	unsigned int slot;
 	std::string store_field;
+	std::string prefix;
+	Xapian::valueno sort_slot;
       public:
+	/** Create the indexer.
+	 *
+	 *  If prefix is not empty, values are also indexed as terms with that
+	 *  prefix, to allow fast range searches.  If sort_slot is not
+	 *  BAD_VALUENO, a fixed-width sort key for the lowest value is stored
+	 *  in it.
+	 */
 	DateIndexer(unsigned int slot_,
-		    const std::string & store_field_)
-		: slot(slot_), store_field(store_field_)
+		    const std::string & store_field_,
+		    const std::string & prefix_,
+		    Xapian::valueno sort_slot_)
+		: slot(slot_), store_field(store_field_), prefix(prefix_),
+		  sort_slot(sort_slot_)
 	{}
 
 	virtual ~DateIndexer();
@@ -326,19 +362,24 @@ namespace RestPose {
 	unsigned int max_length;
 	MaxLenFieldConfig::TooLongAction too_long_action;
 	unsigned int slot;
+
+	/// Flag, true if terms for ancestor categories should be stored.
+	bool index_ancestors;
       public:
 	CategoryIndexer(const std::string & prefix_,
 			const std::string & taxonomy_name_,
 			const std::string & store_field_,
 			unsigned int max_length_,
 			MaxLenFieldConfig::TooLongAction too_long_action_,
-			unsigned int slot_)
+			unsigned int slot_,
+			bool index_ancestors_)
 		: prefix(prefix_),
 		  taxonomy_name(taxonomy_name_),
 		  store_field(store_field_),
 		  max_length(max_length_),
 		  too_long_action(too_long_action_),
-		  slot(slot_)
+		  slot(slot_),
+		  index_ancestors(index_ancestors_)
 	{}
 
 	virtual ~CategoryIndexer();
@@ -354,10 +395,18 @@ namespace RestPose {
     class LonLatIndexer : public FieldIndexer {
 	unsigned int slot;
 	std::string store_field;
+	std::string prefix;
       public:
+	/** Create the indexer.
+	 *
+	 *  If prefix is not empty, the cells holding each coordinate are also
+	 *  indexed as terms with that prefix, to allow fast geospatial
+	 *  searches.
+	 */
 	LonLatIndexer(unsigned int slot_,
-		      const std::string & store_field_)
-		: slot(slot_), store_field(store_field_)
+		      const std::string & store_field_,
+		      const std::string & prefix_)
+		: slot(slot_), store_field(store_field_), prefix(prefix_)
 	{}
 
 	virtual ~LonLatIndexer();
@@ -33,6 +33,19 @@
 using namespace RestPose;
 using namespace std;
 
+/** Default number of documents to count co-occurrences in exactly.
+ */
+#define COOCCUR_DEFAULT_EXACT_DOC_LIMIT 10000
+
+/** Default memory to use for counting co-occurrences, in bytes.
+ */
+#define COOCCUR_DEFAULT_MAX_MEMORY (16 * 1024 * 1024)
+
+/** Largest memory which may be requested for counting co-occurrences, in
+ *  bytes.
+ */
+#define COOCCUR_MAX_MAX_MEMORY (256 * 1024 * 1024)
+
 BaseOccurInfoHandler::~BaseOccurInfoHandler()
 {
     delete spy;
@@ -95,8 +108,14 @@ CoOccurInfoHandler::CoOccurInfoHandler(const Json::Value & params,
     Xapian::doccount result_limit = json_get_uint64_member(params,
 	"result_limit", UINT_MAX, UINT_MAX);
     bool get_termfreqs = json_get_bool(params, "get_termfreqs", false);
-    spy = new TermCoOccurMatchSpy(group, prefix, doc_limit, result_limit,
-				  get_termfreqs, db);
+    Xapian::doccount exact_doc_limit = json_get_uint64_member(params,
+	"exact_doc_limit", UINT_MAX, COOCCUR_DEFAULT_EXACT_DOC_LIMIT);
+    size_t max_memory = json_get_uint64_member(params,
+	"max_memory", COOCCUR_MAX_MAX_MEMORY, COOCCUR_DEFAULT_MAX_MEMORY);
+    TermCoOccurMatchSpy * cooccur_spy = new TermCoOccurMatchSpy(group,
+	prefix, doc_limit, result_limit, get_termfreqs, db);
+    spy = cooccur_spy;
+    cooccur_spy->set_approximation(exact_doc_limit, max_memory);
     const Json::Value & stopwords = params["stopwords"];
     if (!stopwords.isNull()) {
 	json_check_array(stopwords, "list of stopwords");
@@ -56,6 +56,8 @@ void
 Pipe::from_json(const Json::Value & value)
 {
     mappings.clear();
+    programs.clear();
+    compiled = false;
     apply_all = false;
     target.resize(0);
 
@@ -86,3 +88,14 @@ Pipe::from_json(const Json::Value & value)
 	target = tmp.asString();
     }
 }
+
+void
+Pipe::compile()
+{
+    programs.clear();
+    programs.resize(mappings.size());
+    for (vector<Mapping>::size_type i = 0; i != mappings.size(); ++i) {
+	programs[i].compile(mappings[i]);
+    }
+    compiled = true;
+}
@@ -27,6 +27,8 @@
 
 #include <string>
 #include "jsonmanip/mapping.h"
+#include "jsonmanip/mappingprogram.h"
+#include <vector>
 
 namespace RestPose {
 
@@ -39,6 +41,19 @@ struct Pipe {
     /// The mappings in the pipe.
     std::vector<Mapping> mappings;
 
+    /** The mappings, compiled into programs.
+     *
+     *  Built by compile(); one program for each mapping.
+     */
+    std::vector<MappingProgram> programs;
+
+    /** Flag, true if programs has been built from the current mappings.
+     *
+     *  Set by compile(), and cleared by from_json().  Anything else which
+     *  changes the mappings must clear it.
+     */
+    bool compiled;
+
     /// Whether to apply all the mappings, or just the first that matches.
     bool apply_all;
 
@@ -46,13 +61,19 @@ struct Pipe {
     std::string target;
 
 
-    Pipe() : mappings(), apply_all(false), target() {}
+    Pipe()
+	    : mappings(), programs(), compiled(false), apply_all(false),
+	      target()
+    {}
 
     /// Convert the pipe to a JSON object.
     Json::Value & to_json(Json::Value & value) const;
 
     /// Initialise the pipe from a JSON object.
     void from_json(const Json::Value & value);
+
+    /// Compile the mappings into programs.
+    void compile();
 };
 
 }
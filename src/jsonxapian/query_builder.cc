@@ -26,11 +26,18 @@
 #include "jsonxapian/query_builder.h"
 
 #include "jsonxapian/collection.h"
+#include "jsonxapian/query_plan_cache.h"
 #include "jsonxapian/schema.h"
 #include "jsonxapian/slotname.h"
 #include "logger/logger.h"
 #include "utils/jsonutils.h"
 #include "utils/rsperrors.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
 #include <vector>
 #include <xapian.h>
 
@@ -261,6 +268,970 @@ QueryBuilder::build_query(const Json::Value & jsonquery) const
     throw InvalidValueError("Invalid query specification - no known members in query object (" + json_serialise(jsonquery) + ")");
 }
 
+/** Get the operator of a node in a query specification.
+ *
+ *  Returns an empty string if the node isn't an object with exactly one
+ *  member.
+ */
+static string
+query_op(const Json::Value & jsonquery)
+{
+    if (!jsonquery.isObject() || jsonquery.size() != 1) {
+	return string();
+    }
+    return jsonquery.begin().memberName();
+}
+
+/** Get the subqueries of a node, if it has the given operator.
+ *
+ *  Returns NULL if the node has a different operator, or if its parameters
+ *  aren't a non-empty list.
+ */
+static const Json::Value *
+get_subqueries(const Json::Value & jsonquery, const string & op)
+{
+    if (query_op(jsonquery) != op) {
+	return NULL;
+    }
+    const Json::Value & params = jsonquery[op];
+    if (!params.isArray() || params.empty()) {
+	return NULL;
+    }
+    return &params;
+}
+
+/** Append a subquery to a list.
+ *
+ *  If seen is not NULL, the subquery is only appended if it hasn't been
+ *  seen before.
+ */
+static void
+append_subquery(Json::Value & queries, const Json::Value & subquery,
+		set<string> * seen)
+{
+    if (seen == NULL || seen->insert(json_serialise(subquery)).second) {
+	queries.append(subquery);
+    }
+}
+
+/** Append the values in a parameter to a list of values.
+ *
+ *  If the parameter is a list, each of its values is appended.  Values which
+ *  have been seen before are skipped.
+ */
+static void
+append_param(Json::Value & values, const Json::Value & param,
+	     set<string> & seen)
+{
+    if (!param.isArray()) {
+	append_subquery(values, param, &seen);
+	return;
+    }
+    for (Json::Value::const_iterator i = param.begin();
+	 i != param.end(); ++i) {
+	append_subquery(values, *i, &seen);
+    }
+}
+
+/** Estimate the number of documents matching a query for a field.
+ *
+ *  Uses the sum of the frequencies of the terms in the query.  This is exact
+ *  for searches for lists of values, and an upper bound for most other
+ *  queries.
+ */
+static Xapian::doccount
+leaf_freq(const Xapian::Query & query, const Xapian::Database & db)
+{
+    if (query.empty()) {
+	return 0;
+    }
+    Xapian::doccount doccount = db.get_doccount();
+    if (query.get_terms_begin() == query.get_terms_end()) {
+	// No terms; eg, a range search.
+	return doccount;
+    }
+    Xapian::doccount freq = 0;
+    for (Xapian::TermIterator i = query.get_terms_begin();
+	 i != query.get_terms_end(); ++i) {
+	Xapian::doccount termfreq = db.get_termfreq(*i);
+	if (termfreq >= doccount - freq) {
+	    return doccount;
+	}
+	freq += termfreq;
+    }
+    return freq;
+}
+
+/** Restrict a query to the documents searched by a query builder.
+ */
+static Xapian::Query
+restrict_query(const Xapian::Query & query,
+	       const Xapian::Query & restriction)
+{
+    if (restriction.empty()) {
+	return query;
+    }
+    return Xapian::Query(Xapian::Query::OP_FILTER, query, restriction);
+}
+
+/** Check if a node is a search for a list of values in a field.
+ *
+ *  For the "is" style searches, searching for a list of values is the same
+ *  as an OR of searches for each of the values.
+ *
+ *  If so, sets key to identify the field and the type of search.
+ */
+static bool
+is_value_search(const Json::Value & jsonquery, string & key)
+{
+    if (query_op(jsonquery) != "field") {
+	return false;
+    }
+    const Json::Value & params = jsonquery["field"];
+    if (!params.isArray() || params.size() != 3 ||
+	!params[0u].isString() || !params[1u].isString()) {
+	return false;
+    }
+    string querytype = params[1u].asString();
+    if (querytype != "is" && querytype != "is_descendant" &&
+	querytype != "is_or_is_descendant") {
+	return false;
+    }
+    key = params[0u].asString();
+    key += '\0';
+    key += querytype;
+    return true;
+}
+
+void
+QueryBuilder::append_unique(Json::Value & queries,
+			    const Json::Value & subquery,
+			    set<string> * seen,
+			    bool weighted) const
+{
+    if (weighted && seen != NULL && !is_filter(subquery)) {
+	seen = NULL;
+    }
+    append_subquery(queries, subquery, seen);
+}
+
+void
+QueryBuilder::combine_value_searches(Json::Value & queries,
+				     bool weighted) const
+{
+    const Json::Value & input = queries;
+    string key;
+    map<string, unsigned int> counts;
+    for (Json::Value::const_iterator i = input.begin();
+	 i != input.end(); ++i) {
+	if (is_value_search(*i, key) && (!weighted || is_filter(*i))) {
+	    ++counts[key];
+	}
+    }
+
+    Json::Value result(Json::arrayValue);
+    map<string, Json::Value::ArrayIndex> positions;
+    map<string, set<string> > seen;
+    for (Json::Value::const_iterator i = input.begin();
+	 i != input.end(); ++i) {
+	if (!is_value_search(*i, key) || counts[key] < 2) {
+	    result.append(*i);
+	    continue;
+	}
+	map<string, Json::Value::ArrayIndex>::const_iterator
+		pos = positions.find(key);
+	if (pos == positions.end()) {
+	    positions[key] = result.size();
+	    result.append(*i)["field"][2u] = Json::arrayValue;
+	    pos = positions.find(key);
+	}
+	Json::Value & values = result[pos->second]["field"][2u];
+	const Json::Value & newvalues = (*i)["field"][2u];
+	set<string> & key_seen = seen[key];
+	if (newvalues.isArray()) {
+	    for (Json::Value::const_iterator j = newvalues.begin();
+		 j != newvalues.end(); ++j) {
+		append_subquery(values, *j, &key_seen);
+	    }
+	} else {
+	    append_subquery(values, newvalues, &key_seen);
+	}
+    }
+    queries.swap(result);
+}
+
+/** Get the position of the value searched for in a field or meta query.
+ *
+ *  Returns -1 if the node isn't a (well formed) field or meta query.
+ */
+static int
+leaf_value_pos(const Json::Value & jsonquery, const string & op)
+{
+    if (op != "field" && op != "meta") {
+	return -1;
+    }
+    const Json::Value & params = jsonquery[op];
+    if (!params.isArray()) {
+	return -1;
+    }
+    if (op == "field") {
+	return (params.size() == 3) ? 2 : -1;
+    }
+    return (params.size() == 2) ? 1 : -1;
+}
+
+/** Check if an operator has a list of subqueries.
+ */
+static bool
+has_subqueries(const string & op)
+{
+    return (op == "and" || op == "or" || op == "xor" || op == "and_not" ||
+	    op == "and_maybe" || op == "filter");
+}
+
+/** Replace the values searched for in a query by parameters.
+ *
+ *  Each distinct value is appended to params, and replaced in the shape by
+ *  its index in params.  Repeated values get the same index, so that
+ *  optimisations which depend on values being equal give the same results
+ *  for any query with the same shape.
+ */
+static void
+extract_params(const Json::Value & jsonquery, Json::Value & shape,
+	       Json::Value & params, map<string, Json::Value::UInt> & seen)
+{
+    string op = query_op(jsonquery);
+    int pos = leaf_value_pos(jsonquery, op);
+    if (pos >= 0) {
+	const Json::Value & value = jsonquery[op][pos];
+	string value_str = json_serialise(value);
+	map<string, Json::Value::UInt>::const_iterator i =
+		seen.find(value_str);
+	Json::Value::UInt param;
+	if (i == seen.end()) {
+	    param = params.size();
+	    params.append(value);
+	    seen[value_str] = param;
+	} else {
+	    param = i->second;
+	}
+	shape = jsonquery;
+	shape[op][pos] = param;
+	return;
+    }
+
+    if (has_subqueries(op) && jsonquery[op].isArray()) {
+	const Json::Value & subqueries = jsonquery[op];
+	shape = Json::objectValue;
+	Json::Value & subshapes = shape[op] = Json::arrayValue;
+	for (Json::Value::const_iterator i = subqueries.begin();
+	     i != subqueries.end(); ++i) {
+	    extract_params(*i, subshapes.append(Json::nullValue), params,
+			   seen);
+	}
+	return;
+    }
+
+    shape = jsonquery;
+    if (op == "scale") {
+	const Json::Value & scale = jsonquery[op];
+	if (scale.isObject() && scale.isMember("query")) {
+	    extract_params(scale["query"], shape[op]["query"], params, seen);
+	}
+    }
+}
+
+/** Bind values into a plan made from a query shape.
+ *
+ *  Lists of parameters (made by combining searches for values in the same
+ *  field) become the list of all the values in the parameters.
+ */
+static void
+bind_params(const Json::Value & plan, const Json::Value & params,
+	    Json::Value & result)
+{
+    string op = query_op(plan);
+    int pos = leaf_value_pos(plan, op);
+    if (pos >= 0) {
+	const Json::Value & value = plan[op][pos];
+	result = plan;
+	Json::Value & bound = result[op][pos];
+	if (!value.isArray()) {
+	    bound = params[value.asUInt()];
+	    return;
+	}
+	bound = Json::arrayValue;
+	set<string> seen;
+	for (Json::Value::const_iterator i = value.begin();
+	     i != value.end(); ++i) {
+	    append_param(bound, params[(*i).asUInt()], seen);
+	}
+	return;
+    }
+
+    if (has_subqueries(op) && plan[op].isArray()) {
+	const Json::Value & subplans = plan[op];
+	result = Json::objectValue;
+	Json::Value & subqueries = result[op] = Json::arrayValue;
+	for (Json::Value::const_iterator i = subplans.begin();
+	     i != subplans.end(); ++i) {
+	    bind_params(*i, params, subqueries.append(Json::nullValue));
+	}
+	return;
+    }
+
+    result = plan;
+    if (op == "scale") {
+	const Json::Value & scale = plan[op];
+	if (scale.isObject() && scale.isMember("query")) {
+	    bind_params(scale["query"], params, result[op]["query"]);
+	}
+    }
+}
+
+void
+QueryBuilder::optimise_node(const Json::Value & jsonquery,
+			    Json::Value & result) const
+{
+    string op = query_op(jsonquery);
+    if (op.empty()) {
+	result = jsonquery;
+	return;
+    }
+    const Json::Value & params = jsonquery[op];
+
+    if (op == "and" || op == "or" || op == "xor") {
+	if (!params.isArray()) {
+	    result = jsonquery;
+	    return;
+	}
+
+	// Repeated subqueries of an XOR cancel each other out, so they can't
+	// just be removed.  Repeated subqueries of an AND or OR add their
+	// weight again, so only those which just filter can be removed.
+	set<string> seen;
+	set<string> * seen_ptr = (op == "xor") ? NULL : &seen;
+	Json::Value queries(Json::arrayValue);
+	Json::Value subquery;
+	for (Json::Value::const_iterator i = params.begin();
+	     i != params.end(); ++i) {
+	    optimise_node(*i, subquery);
+	    const Json::Value * nested = get_subqueries(subquery, op);
+	    if (nested == NULL) {
+		append_unique(queries, subquery, seen_ptr, true);
+		continue;
+	    }
+	    for (Json::Value::const_iterator j = nested->begin();
+		 j != nested->end(); ++j) {
+		append_unique(queries, *j, seen_ptr, true);
+	    }
+	}
+
+	if (op == "and") {
+	    // Subqueries matching everything have no effect on an AND.
+	    Json::Value restricting(Json::arrayValue);
+	    for (Json::Value::iterator i = queries.begin();
+		 i != queries.end(); ++i) {
+		if (query_op(*i) != "matchall" || (*i)["matchall"] != true) {
+		    restricting.append(*i);
+		}
+	    }
+	    if (!restricting.empty()) {
+		queries.swap(restricting);
+	    }
+	} else if (op == "or") {
+	    combine_value_searches(queries, true);
+	}
+
+	if (queries.size() == 1) {
+	    result = queries[0u];
+	    return;
+	}
+
+	if (op == "and") {
+	    // Move subqueries which only filter the results into a FILTER.
+	    // "A AND (B FILTER C)" is the same as "(A AND B) FILTER C".
+	    const Json::Value & input = queries;
+	    set<string> scored_seen;
+	    set<string> filters_seen;
+	    Json::Value scored(Json::arrayValue);
+	    Json::Value filters(Json::arrayValue);
+	    for (Json::Value::const_iterator i = input.begin();
+		 i != input.end(); ++i) {
+		const Json::Value * nested = get_subqueries(*i, "filter");
+		if (nested == NULL || nested->size() < 2) {
+		    if (is_filter(*i)) {
+			append_subquery(filters, *i, &filters_seen);
+		    } else {
+			append_subquery(scored, *i, NULL);
+		    }
+		    continue;
+		}
+		Json::Value::const_iterator j = nested->begin();
+		const Json::Value * nested_scored = get_subqueries(*j, "and");
+		if (nested_scored == NULL) {
+		    append_unique(scored, *j, &scored_seen, true);
+		} else {
+		    for (Json::Value::const_iterator k = nested_scored->begin();
+			 k != nested_scored->end(); ++k) {
+			append_unique(scored, *k, &scored_seen, true);
+		    }
+		}
+		for (++j; j != nested->end(); ++j) {
+		    append_subquery(filters, *j, &filters_seen);
+		}
+	    }
+	    if (!scored.empty() && !filters.empty()) {
+		result = Json::objectValue;
+		Json::Value & filter = result["filter"] = Json::arrayValue;
+		if (scored.size() == 1) {
+		    filter.append(scored[0u]);
+		} else {
+		    filter.append(Json::objectValue)["and"] = scored;
+		}
+		for (Json::Value::iterator i = filters.begin();
+		     i != filters.end(); ++i) {
+		    filter.append(*i);
+		}
+		return;
+	    }
+	}
+
+	result = Json::objectValue;
+	result[op] = queries;
+	return;
+    }
+
+    if (op == "and_not" || op == "and_maybe" || op == "filter") {
+	if (!params.isArray() || params.size() < 2) {
+	    result = jsonquery;
+	    return;
+	}
+
+	// The subqueries after the first are combined with OR, except for
+	// FILTER, where they're combined with AND.  "(A op B) op C" is the
+	// same as "A op (B combine C)".  Only the subqueries after the first
+	// of an AND_MAYBE contribute to the weights.
+	string combine_op = (op == "filter") ? "and" : "or";
+	bool weighted = (op == "and_maybe");
+	set<string> seen;
+	Json::Value main;
+	Json::Value others(Json::arrayValue);
+	Json::Value subquery;
+
+	Json::Value::const_iterator i = params.begin();
+	optimise_node(*i, subquery);
+	const Json::Value * nested = get_subqueries(subquery, op);
+	if (nested != NULL && nested->size() >= 2) {
+	    Json::Value::const_iterator j = nested->begin();
+	    main = *j;
+	    for (++j; j != nested->end(); ++j) {
+		append_unique(others, *j, &seen, weighted);
+	    }
+	} else {
+	    main = subquery;
+	}
+
+	for (++i; i != params.end(); ++i) {
+	    optimise_node(*i, subquery);
+	    nested = get_subqueries(subquery, combine_op);
+	    if (nested == NULL) {
+		append_unique(others, subquery, &seen, weighted);
+		continue;
+	    }
+	    for (Json::Value::const_iterator j = nested->begin();
+		 j != nested->end(); ++j) {
+		append_unique(others, *j, &seen, weighted);
+	    }
+	}
+	if (combine_op == "or") {
+	    combine_value_searches(others, weighted);
+	}
+
+	result = Json::objectValue;
+	Json::Value & queries = result[op] = Json::arrayValue;
+	queries.append(main);
+	for (Json::Value::iterator j = others.begin();
+	     j != others.end(); ++j) {
+	    queries.append(*j);
+	}
+	return;
+    }
+
+    if (op == "scale") {
+	result = jsonquery;
+	if (params.isObject() && params.isMember("query")) {
+	    optimise_node(params["query"], result["scale"]["query"]);
+	}
+	return;
+    }
+
+    result = jsonquery;
+}
+
+bool
+QueryBuilder::is_filter(const Json::Value & jsonquery) const
+{
+    string op = query_op(jsonquery);
+    if (op == "field" || op == "meta") {
+	string fieldname;
+	if (op == "field") {
+	    string key;
+	    if (!is_value_search(jsonquery, key)) {
+		return false;
+	    }
+	    fieldname = jsonquery["field"][0u].asString();
+	} else {
+	    fieldname = collconfig.get_meta_field();
+	}
+	return boolean_field(fieldname);
+    }
+
+    if (op == "and" || op == "or" || op == "filter") {
+	const Json::Value * subqueries = get_subqueries(jsonquery, op);
+	if (subqueries == NULL) {
+	    return false;
+	}
+	for (Json::Value::const_iterator i = subqueries->begin();
+	     i != subqueries->end(); ++i) {
+	    if (!is_filter(*i)) {
+		return false;
+	    }
+	}
+	return true;
+    }
+
+    return false;
+}
+
+Xapian::doccount
+QueryBuilder::estimate_freq(const Json::Value & jsonquery,
+			    const Xapian::Database & db) const
+{
+    Xapian::doccount doccount = db.get_doccount();
+    string op = query_op(jsonquery);
+
+    if (op == "matchnothing" || jsonquery.isNull() ||
+	(jsonquery.isObject() && jsonquery.empty())) {
+	return 0;
+    }
+
+    if (op == "field" || op == "meta") {
+	return leaf_freq(build_query(jsonquery), db);
+    }
+
+    if (op == "and" || op == "filter" || op == "or" || op == "xor") {
+	const Json::Value * subqueries = get_subqueries(jsonquery, op);
+	if (subqueries == NULL) {
+	    return doccount;
+	}
+	bool conjunction = (op == "and" || op == "filter");
+	Xapian::doccount freq = conjunction ? doccount : 0;
+	for (Json::Value::const_iterator i = subqueries->begin();
+	     i != subqueries->end(); ++i) {
+	    Xapian::doccount subfreq = estimate_freq(*i, db);
+	    if (conjunction) {
+		freq = std::min(freq, subfreq);
+	    } else if (subfreq >= doccount - freq) {
+		return doccount;
+	    } else {
+		freq += subfreq;
+	    }
+	}
+	return freq;
+    }
+
+    if (op == "and_not" || op == "and_maybe") {
+	const Json::Value * subqueries = get_subqueries(jsonquery, op);
+	if (subqueries == NULL) {
+	    return doccount;
+	}
+	return estimate_freq((*subqueries)[0u], db);
+    }
+
+    if (op == "scale") {
+	const Json::Value & scale = jsonquery["scale"];
+	if (scale.isObject() && scale.isMember("query")) {
+	    return estimate_freq(scale["query"], db);
+	}
+    }
+
+    return doccount;
+}
+
+void
+QueryBuilder::order_by_freq(Json::Value & jsonquery,
+			    const Xapian::Database & db) const
+{
+    string op = query_op(jsonquery);
+    if (op == "scale") {
+	Json::Value & scale = jsonquery["scale"];
+	if (scale.isObject() && scale.isMember("query")) {
+	    order_by_freq(scale["query"], db);
+	}
+	return;
+    }
+    if (!has_subqueries(op)) {
+	return;
+    }
+    Json::Value & subqueries = jsonquery[op];
+    if (!subqueries.isArray()) {
+	return;
+    }
+    for (Json::Value::iterator i = subqueries.begin();
+	 i != subqueries.end(); ++i) {
+	order_by_freq(*i, db);
+    }
+
+    // Only the subqueries of conjunctions are reordered; the first subquery
+    // of a FILTER is the one being filtered, so it stays first.
+    Json::Value::ArrayIndex first;
+    if (op == "and") {
+	first = 0;
+    } else if (op == "filter") {
+	first = 1;
+    } else {
+	return;
+    }
+    if (subqueries.size() < first + 2) {
+	return;
+    }
+
+    vector<pair<Xapian::doccount, Json::Value::ArrayIndex> > freqs;
+    for (Json::Value::ArrayIndex i = first; i != subqueries.size(); ++i) {
+	freqs.push_back(make_pair(estimate_freq(subqueries[i], db), i));
+    }
+    // Ties are broken by the original position, so the sort is stable.
+    sort(freqs.begin(), freqs.end());
+
+    Json::Value ordered(Json::arrayValue);
+    for (Json::Value::ArrayIndex i = 0; i != first; ++i) {
+	ordered.append(subqueries[i]);
+    }
+    for (vector<pair<Xapian::doccount, Json::Value::ArrayIndex> >::const_iterator
+	 i = freqs.begin(); i != freqs.end(); ++i) {
+	ordered.append(subqueries[i->second]);
+    }
+    subqueries.swap(ordered);
+}
+
+Json::Value &
+QueryBuilder::optimise(const Json::Value & jsonquery,
+		       const Xapian::Database * db,
+		       Json::Value & result) const
+{
+    optimise_node(jsonquery, result);
+    if (db != NULL) {
+	order_by_freq(result, *db);
+    }
+    return result;
+}
+
+Xapian::Query
+QueryBuilder::field_query(const std::string & fieldname,
+			  const std::string & querytype,
+			  const Json::Value & queryparams) const
+{
+    vector<const FieldConfig *> configs;
+    get_field_configs(fieldname, configs);
+    return configs_query(configs, querytype, queryparams);
+}
+
+Xapian::Query
+QueryBuilder::configs_query(const vector<const FieldConfig *> & configs,
+			    const std::string & querytype,
+			    const Json::Value & queryparams) const
+{
+    if (configs.size() == 1) {
+	return configs[0]->query_with_config(querytype, queryparams,
+					     collconfig);
+    }
+
+    vector<Xapian::Query> queries;
+    queries.reserve(configs.size());
+    for (vector<const FieldConfig *>::const_iterator i = configs.begin();
+	 i != configs.end(); ++i) {
+	queries.push_back((*i)->query_with_config(querytype, queryparams,
+						  collconfig));
+    }
+    return Xapian::Query(Xapian::Query::OP_OR,
+			 queries.begin(), queries.end());
+}
+
+size_t
+QueryBuilder::compile_node(const Json::Value & jsonquery,
+			   QueryPlan & plan) const
+{
+    string op = query_op(jsonquery);
+    int value_pos = leaf_value_pos(jsonquery, op);
+    if (value_pos >= 0) {
+	size_t pos = plan.add_node(QueryPlan::LEAF);
+	QueryPlan::Node & node = plan.get_node(pos);
+	const Json::Value & params = jsonquery[op];
+	string fieldname;
+	if (op == "field") {
+	    fieldname = params[0u].asString();
+	    node.querytype = params[1u].asString();
+	} else {
+	    fieldname = collconfig.get_meta_field();
+	    node.querytype = params[0u].asString();
+	}
+	get_field_configs(fieldname, node.configs);
+
+	const Json::Value & value = params[value_pos];
+	if (value.isArray()) {
+	    node.param_list = true;
+	    for (Json::Value::const_iterator i = value.begin();
+		 i != value.end(); ++i) {
+		node.params.push_back((*i).asUInt());
+	    }
+	} else {
+	    node.params.push_back(value.asUInt());
+	}
+	return pos;
+    }
+
+    if (op.empty() || op == "matchnothing") {
+	// Null and empty queries match nothing.
+	return plan.add_node(QueryPlan::MATCH_NOTHING);
+    }
+    if (op == "matchall") {
+	return plan.add_node(QueryPlan::MATCH_ALL);
+    }
+
+    if (op == "scale") {
+	const Json::Value & params = jsonquery[op];
+	size_t pos = plan.add_node(QueryPlan::SCALE);
+	size_t child = compile_node(params["query"], plan);
+	QueryPlan::Node & node = plan.get_node(pos);
+	node.factor = json_get_double_member(params, "factor", 0.0);
+	node.children.push_back(child);
+	return pos;
+    }
+
+    Xapian::Query::op xop;
+    if (op == "and") {
+	xop = Xapian::Query::OP_AND;
+    } else if (op == "or") {
+	xop = Xapian::Query::OP_OR;
+    } else if (op == "xor") {
+	xop = Xapian::Query::OP_XOR;
+    } else if (op == "and_not") {
+	xop = Xapian::Query::OP_AND_NOT;
+    } else if (op == "and_maybe") {
+	xop = Xapian::Query::OP_AND_MAYBE;
+    } else if (op == "filter") {
+	xop = Xapian::Query::OP_FILTER;
+    } else {
+	// The plan has been checked before compiling it.
+	throw InvalidValueError("Invalid query specification - unknown operator in plan (" + op + ")");
+    }
+
+    // Nodes are added depth first, so the node may move as its children are
+    // added; hold its position rather than a reference to it.
+    size_t pos = plan.add_node(QueryPlan::OPERATOR);
+    const Json::Value & subqueries = jsonquery[op];
+    vector<size_t> children;
+    children.reserve(subqueries.size());
+    for (Json::Value::const_iterator i = subqueries.begin();
+	 i != subqueries.end(); ++i) {
+	children.push_back(compile_node(*i, plan));
+    }
+    QueryPlan::Node & node = plan.get_node(pos);
+    node.op = xop;
+    node.children.swap(children);
+    return pos;
+}
+
+Xapian::Query
+QueryBuilder::run_node(const QueryPlan & plan, size_t pos,
+		       const Json::Value & params,
+		       const Xapian::Database * db,
+		       Xapian::doccount & freq) const
+{
+    const QueryPlan::Node & node = plan.get_node(pos);
+    switch (node.type) {
+	case QueryPlan::MATCH_NOTHING:
+	    freq = 0;
+	    return Xapian::Query::MatchNothing;
+
+	case QueryPlan::MATCH_ALL:
+	    if (db != NULL) {
+		freq = db->get_doccount();
+	    }
+	    return Xapian::Query::MatchAll;
+
+	case QueryPlan::LEAF: {
+	    Xapian::Query query;
+	    if (node.param_list) {
+		Json::Value values(Json::arrayValue);
+		set<string> seen;
+		for (vector<Json::Value::UInt>::const_iterator
+		     i = node.params.begin(); i != node.params.end(); ++i) {
+		    append_param(values, params[*i], seen);
+		}
+		query = configs_query(node.configs, node.querytype, values);
+	    } else {
+		query = configs_query(node.configs, node.querytype,
+				      params[node.params[0]]);
+	    }
+	    if (db != NULL) {
+		freq = leaf_freq(query, *db);
+	    }
+	    return query;
+	}
+
+	case QueryPlan::SCALE:
+	    return Xapian::Query(Xapian::Query::OP_SCALE_WEIGHT,
+				 run_node(plan, node.children[0], params, db,
+					  freq),
+				 node.factor);
+
+	case QueryPlan::OPERATOR:
+	    break;
+    }
+
+    vector<Xapian::Query> queries;
+    vector<pair<Xapian::doccount, size_t> > freqs;
+    queries.reserve(node.children.size());
+    freqs.reserve(node.children.size());
+    for (vector<size_t>::const_iterator i = node.children.begin();
+	 i != node.children.end(); ++i) {
+	Xapian::doccount subfreq = 0;
+	queries.push_back(run_node(plan, *i, params, db, subfreq));
+	freqs.push_back(make_pair(subfreq, queries.size() - 1));
+    }
+
+    if (db != NULL) {
+	// Estimate the frequency in the same way as estimate_freq().
+	Xapian::doccount doccount = db->get_doccount();
+	switch (node.op) {
+	    case Xapian::Query::OP_AND:
+	    case Xapian::Query::OP_FILTER:
+		freq = doccount;
+		for (vector<pair<Xapian::doccount, size_t> >::const_iterator
+		     i = freqs.begin(); i != freqs.end(); ++i) {
+		    freq = std::min(freq, i->first);
+		}
+		break;
+	    case Xapian::Query::OP_AND_NOT:
+	    case Xapian::Query::OP_AND_MAYBE:
+		freq = freqs[0].first;
+		break;
+	    default:
+		if (freqs.empty()) {
+		    freq = doccount;
+		    break;
+		}
+		freq = 0;
+		for (vector<pair<Xapian::doccount, size_t> >::const_iterator
+		     i = freqs.begin(); i != freqs.end(); ++i) {
+		    if (i->first >= doccount - freq) {
+			freq = doccount;
+			break;
+		    }
+		    freq += i->first;
+		}
+		break;
+	}
+
+	// Order the subqueries of conjunctions, as order_by_freq() does.
+	size_t first = (node.op == Xapian::Query::OP_FILTER) ? 1 : 0;
+	if ((node.op == Xapian::Query::OP_AND ||
+	     node.op == Xapian::Query::OP_FILTER) &&
+	    queries.size() >= first + 2) {
+	    // Ties are broken by the original position, so the sort is
+	    // stable.
+	    sort(freqs.begin() + first, freqs.end());
+	    vector<Xapian::Query> ordered;
+	    ordered.reserve(queries.size());
+	    for (vector<pair<Xapian::doccount, size_t> >::const_iterator
+		 i = freqs.begin(); i != freqs.end(); ++i) {
+		ordered.push_back(queries[i->second]);
+	    }
+	    queries.swap(ordered);
+	}
+    }
+
+    switch (node.op) {
+	case Xapian::Query::OP_AND_NOT:
+	case Xapian::Query::OP_AND_MAYBE:
+	    return Xapian::Query(node.op, queries[0],
+				 Xapian::Query(Xapian::Query::OP_OR,
+					       queries.begin() + 1,
+					       queries.end()));
+	case Xapian::Query::OP_FILTER:
+	    return Xapian::Query(node.op, queries[0],
+				 Xapian::Query(Xapian::Query::OP_AND,
+					       queries.begin() + 1,
+					       queries.end()));
+	default:
+	    return Xapian::Query(node.op, queries.begin(), queries.end());
+    }
+}
+
+Xapian::Query
+QueryBuilder::build_cached(const Json::Value & jsonquery,
+			   const Xapian::Database * db,
+			   const string & context,
+			   Json::Value * plan) const
+{
+    Xapian::Query restriction;
+    if (!get_restriction(restriction)) {
+	// Nothing can match, so the query isn't checked, as in build().
+	if (plan != NULL) {
+	    optimise(jsonquery, db, *plan);
+	}
+	return Xapian::Query::MatchNothing;
+    }
+
+    Json::Value shape;
+    Json::Value params(Json::arrayValue);
+    map<string, Json::Value::UInt> seen;
+    extract_params(jsonquery, shape, params, seen);
+
+    string key(context);
+    key += '\0';
+    key += json_serialise(shape);
+
+    QueryPlanRef cached(g_query_plans, g_query_plans.get(key));
+    if (cached.get() == NULL) {
+	Json::Value optimised;
+	optimise_node(shape, optimised);
+
+	// Check the plan by building it.  The checks of the structure of the
+	// query only depend on its shape, so are only needed once per plan.
+	Json::Value bound;
+	bind_params(optimised, params, bound);
+	(void) build_query(bound);
+
+	auto_ptr<QueryPlan> newplan(new QueryPlan(optimised));
+	compile_node(optimised, *newplan);
+	cached.reset(g_query_plans.set(key, newplan.release()));
+    }
+
+    Xapian::doccount freq = 0;
+    Xapian::Query query(run_node(*(cached.get()), 0, params, db, freq));
+
+    if (plan != NULL) {
+	bind_params(cached->get_plan(), params, *plan);
+	if (db != NULL) {
+	    order_by_freq(*plan, *db);
+	}
+    }
+    return restrict_query(query, restriction);
+}
+
+Xapian::Query
+QueryBuilder::build(const Json::Value & jsonquery) const
+{
+    Xapian::Query restriction;
+    if (!get_restriction(restriction)) {
+	return Xapian::Query::MatchNothing;
+    }
+    return restrict_query(build_query(jsonquery), restriction);
+}
+
 QueryBuilder::QueryBuilder(const CollectionConfig & collconfig_)
 	: collconfig(collconfig_)
 {
@@ -273,30 +1244,27 @@ CollectionQueryBuilder::CollectionQueryBuilder(
 {
 }
 
-Xapian::Query
-CollectionQueryBuilder::field_query(const std::string & fieldname,
-				    const std::string & querytype,
-				    const Json::Value & queryparams) const
+void
+CollectionQueryBuilder::get_field_configs(
+    const std::string & fieldname,
+    vector<const FieldConfig *> & configs) const
 {
-    vector<Xapian::Query> queries;
-
     for (map<string, Schema *>::const_iterator i = collconfig.schema_begin();
 	 i != collconfig.schema_end(); ++i)
     {
 	const FieldConfig * config = i->second->get(fieldname);
 	if (config != NULL) {
-	    queries.push_back(config->query(querytype, queryparams));
+	    configs.push_back(config);
 	}
     }
-
-    return Xapian::Query(Xapian::Query::OP_OR,
-			 queries.begin(), queries.end());
 }
 
-Xapian::Query
-CollectionQueryBuilder::build(const Json::Value & jsonquery) const
+bool
+CollectionQueryBuilder::get_restriction(Xapian::Query & restriction) const
 {
-    return build_query(jsonquery);
+    // Searches cover the whole collection.
+    restriction = Xapian::Query();
+    return true;
 }
 
 Xapian::doccount
@@ -358,6 +1326,55 @@ CollectionQueryBuilder::get_slot_decoder(const std::string & fieldname) const
     return SlotDecoder::create(slot, encoding);
 }
 
+Xapian::valueno
+CollectionQueryBuilder::get_sort_slot(const std::string & fieldname) const
+{
+    Xapian::valueno sort_slot(Xapian::BAD_VALUENO);
+    for (map<string, Schema *>::const_iterator i = collconfig.schema_begin();
+	 i != collconfig.schema_end(); ++i)
+    {
+	const FieldConfig * config = i->second->get(fieldname);
+	if (config == NULL) {
+	    continue;
+	}
+	ValueEncoding field_encoding;
+	if (config->get_slot(field_encoding) == Xapian::BAD_VALUENO) {
+	    continue;
+	}
+	// Every type with values for the field must have the same sort slot,
+	// or the sort keys would be missing for some documents.
+	Xapian::valueno field_sort_slot(config->get_sort_slot());
+	if (field_sort_slot == Xapian::BAD_VALUENO ||
+	    (sort_slot != Xapian::BAD_VALUENO &&
+	     sort_slot != field_sort_slot)) {
+	    return Xapian::BAD_VALUENO;
+	}
+	sort_slot = field_sort_slot;
+    }
+    return sort_slot;
+}
+
+bool
+CollectionQueryBuilder::boolean_field(const std::string & fieldname) const
+{
+    // The query on the field is combined from the queries for every type,
+    // so it only filters if each of those does.
+    bool found = false;
+    for (map<string, Schema *>::const_iterator i = collconfig.schema_begin();
+	 i != collconfig.schema_end(); ++i)
+    {
+	const FieldConfig * config = i->second->get(fieldname);
+	if (config == NULL) {
+	    continue;
+	}
+	if (!config->boolean_queries()) {
+	    return false;
+	}
+	found = true;
+    }
+    return found;
+}
+
 
 DocumentTypeQueryBuilder::DocumentTypeQueryBuilder(
     const CollectionConfig & collconfig_,
@@ -367,26 +1384,29 @@ DocumentTypeQueryBuilder::DocumentTypeQueryBuilder(
 {
 }
 
-Xapian::Query
-DocumentTypeQueryBuilder::field_query(const std::string & fieldname,
-				      const std::string & querytype,
-				      const Json::Value & queryparams) const
+void
+DocumentTypeQueryBuilder::get_field_configs(
+    const std::string & fieldname,
+    vector<const FieldConfig *> & configs) const
 {
-    // Schema cannot be NULL, because this is checked in build().
+    if (schema == NULL) {
+	// Checked in get_restriction(), but queries may also be built while
+	// optimising them.
+	return;
+    }
     const FieldConfig * config = schema->get(fieldname);
-    if (config == NULL) {
-	return Xapian::Query::MatchNothing;
+    if (config != NULL) {
+	configs.push_back(config);
     }
-    return config->query(querytype, queryparams);
 }
 
-Xapian::Query
-DocumentTypeQueryBuilder::build(const Json::Value & jsonquery) const
+bool
+DocumentTypeQueryBuilder::get_restriction(Xapian::Query & restriction) const
 {
     if (schema == NULL) {
 	// Will happen if no documents have been added yet with this type, so
 	// this isn't an error.
-	return Xapian::Query::MatchNothing;
+	return false;
     }
 
     // Filter to return only documents of this type.
@@ -394,12 +1414,10 @@ DocumentTypeQueryBuilder::build(const Json::Value & jsonquery) const
     if (typeconfig == NULL) {
 	// Should only happen if there isn't a type field, so a type-specific
 	// search should return nothing.
-	return Xapian::Query::MatchNothing;
+	return false;
     }
-    Xapian::Query type_query(typeconfig->query("is", schema->get_doctype()));
-
-    return Xapian::Query(Xapian::Query::OP_FILTER,
-			 build_query(jsonquery), type_query);
+    restriction = typeconfig->query("is", schema->get_doctype());
+    return true;
 }
 
 Xapian::doccount
@@ -454,3 +1472,24 @@ DocumentTypeQueryBuilder::get_slot_decoder(const std::string & fieldname) const
     Xapian::valueno slot = fieldconfig->get_slot(encoding);
     return SlotDecoder::create(slot, encoding);
 }
+
+Xapian::valueno
+DocumentTypeQueryBuilder::get_sort_slot(const std::string & fieldname) const
+{
+    if (schema == NULL) {
+	return Xapian::BAD_VALUENO;
+    }
+
+    const FieldConfig * fieldconfig = schema->get(fieldname);
+    if (fieldconfig == NULL) {
+	return Xapian::BAD_VALUENO;
+    }
+    return fieldconfig->get_sort_slot();
+}
+
+bool
+DocumentTypeQueryBuilder::boolean_field(const std::string & fieldname) const
+{
+    const FieldConfig * config = get_field_config(fieldname);
+    return config != NULL && config->boolean_queries();
+}
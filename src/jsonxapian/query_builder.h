@@ -27,12 +27,16 @@
 
 #include "json/value.h"
 #include "jsonxapian/slotname.h"
+#include <set>
+#include <string>
+#include <vector>
 #include <xapian.h>
 
 namespace RestPose {
     class Collection;
     class CollectionConfig;
     class FieldConfig;
+    class QueryPlan;
     class Schema;
     class SlotDecoder;
 
@@ -52,17 +56,153 @@ namespace RestPose {
 
 	/** Build a query for a particular field.
 	 */
-	virtual Xapian::Query
-		field_query(const std::string & fieldname,
-			    const std::string & querytype,
-			    const Json::Value & queryparams) const = 0;
+	Xapian::Query field_query(const std::string & fieldname,
+				  const std::string & querytype,
+				  const Json::Value & queryparams) const;
+
+	/** Build a query searching each of a list of configs for a field.
+	 */
+	Xapian::Query
+		configs_query(const std::vector<const FieldConfig *> & configs,
+			      const std::string & querytype,
+			      const Json::Value & queryparams) const;
+
+	/** Get the configs to search for a given field.
+	 *
+	 *  Appends the config of the field for each of the types that the
+	 *  query builder is for which has the field.
+	 */
+	virtual void
+		get_field_configs(const std::string & fieldname,
+				  std::vector<const FieldConfig *> & configs) const = 0;
+
+	/** Get the query restricting results to the documents searched.
+	 *
+	 *  Sets restriction to an empty query if no restriction is needed.
+	 *
+	 *  Returns false if no documents can match queries built by this
+	 *  builder.
+	 */
+	virtual bool get_restriction(Xapian::Query & restriction) const = 0;
+
+	/** Compile a node of a (optimised, checked) query plan.
+	 *
+	 *  Returns the position of the compiled node in the plan.
+	 */
+	size_t compile_node(const Json::Value & jsonquery,
+			    QueryPlan & plan) const;
+
+	/** Build a query from a node of a compiled plan.
+	 *
+	 *  If db is not NULL, the subqueries of conjunctions are ordered by
+	 *  their estimated frequencies in it, rarest first, and freq is set
+	 *  to the estimated frequency of the node.
+	 */
+	Xapian::Query run_node(const QueryPlan & plan, size_t pos,
+			       const Json::Value & params,
+			       const Xapian::Database * db,
+			       Xapian::doccount & freq) const;
+
+	/** Optimise a node of a JSON query specification.
+	 *
+	 *  Rewrites the structure of the node, and its children.  Anything
+	 *  which isn't understood is copied unchanged, so that building the
+	 *  result reports the same errors as building the original.
+	 */
+	void optimise_node(const Json::Value & jsonquery,
+			   Json::Value & result) const;
+
+	/** Check if a (optimised) query only filters results.
+	 */
+	bool is_filter(const Json::Value & jsonquery) const;
+
+	/** Append a (optimised) subquery to a list, unless it's a repeat.
+	 *
+	 *  If seen is NULL, the subquery is always appended.  If weighted is
+	 *  true, the subqueries contribute to the weights of the results, and
+	 *  repeating a subquery adds its weight again, so repeats are only
+	 *  skipped for subqueries which just filter the results.
+	 */
+	void append_unique(Json::Value & queries,
+			   const Json::Value & subquery,
+			   std::set<std::string> * seen,
+			   bool weighted) const;
+
+	/** Combine searches for values in the same field in a list of
+	 *  (optimised) subqueries which are combined with OR.
+	 *
+	 *  Each set of searches is replaced by a single search for the list
+	 *  of all their values, in the position of the first search, so that
+	 *  the resulting query has a single posting list per term, rather
+	 *  than a nested OR for each search.  Repeated values are removed
+	 *  from the list, so if weighted is true, only searches which just
+	 *  filter the results are combined.
+	 */
+	void combine_value_searches(Json::Value & queries,
+				    bool weighted) const;
+
+	/** Estimate the number of documents matching a (optimised) query.
+	 */
+	Xapian::doccount estimate_freq(const Json::Value & jsonquery,
+				       const Xapian::Database & db) const;
+
+	/** Order the subqueries of conjunctions in a (optimised) query by
+	 *  their estimated frequencies, rarest first.
+	 */
+	void order_by_freq(Json::Value & jsonquery,
+			   const Xapian::Database & db) const;
 
       public:
 	QueryBuilder(const CollectionConfig & collconfig_);
 
+	/** Optimise a JSON query specification.
+	 *
+	 *  Produces a specification which is cheaper to run, but matches the
+	 *  same documents with the same weights: nested conjunctions and
+	 *  disjunctions are flattened, repeated subqueries are removed where
+	 *  they don't add to the weights, subqueries which only filter results
+	 *  are moved into FILTER queries, and disjunctions of "is" searches on
+	 *  a field which only filter results are combined into a single
+	 *  search for a list of values.
+	 *
+	 *  If db is not NULL, term frequencies from it are used to order the
+	 *  subqueries of conjunctions, rarest first.
+	 *
+	 *  Returns a reference to result.
+	 */
+	Json::Value & optimise(const Json::Value & jsonquery,
+			       const Xapian::Database * db,
+			       Json::Value & result) const;
+
+	/** Build a query from a JSON query specification, using the cache of
+	 *  plans.
+	 *
+	 *  The values searched for in the query are replaced by parameters,
+	 *  and the plan for the resulting query shape is looked up in the
+	 *  cache, keyed by the shape and by context.  The context must
+	 *  identify the document type searched and the state of the schemas
+	 *  (see CollectionConfig::get_schemas_id()), since the plan holds the
+	 *  field configs looked up in them.  On a miss, the shape is
+	 *  optimised, checked, compiled and stored.  The query is then built
+	 *  from the compiled plan and the values.
+	 *
+	 *  Gives the same query as build(optimise(jsonquery, db)), except that
+	 *  a combined list of values is never treated as a repeat of another
+	 *  subquery (so may occasionally be left in place, which is redundant
+	 *  but harmless).  The ordering of subqueries is not cached; it is
+	 *  worked out for each query, from the frequencies in db.
+	 *
+	 *  If plan is not NULL, it is set to the optimised query specification
+	 *  that was built.
+	 */
+	Xapian::Query build_cached(const Json::Value & jsonquery,
+				   const Xapian::Database * db,
+				   const std::string & context,
+				   Json::Value * plan) const;
+
 	/** Build a query from a JSON query specification.
 	 */
-	virtual Xapian::Query build(const Json::Value & jsonquery) const = 0;
+	Xapian::Query build(const Json::Value & jsonquery) const;
 
 	/** Get the total number of documents searched in the database
 	 *  specified by queries built by this builder.
@@ -87,6 +227,23 @@ namespace RestPose {
 	 */
 	virtual SlotDecoder *
 		get_slot_decoder(const std::string & fieldname) const = 0;
+
+	/** Get the slot holding precomputed sort keys for a given field.
+	 *
+	 *  Returns BAD_VALUENO if the field has no sort slot, or if the sort
+	 *  slot isn't the same in all the types that the query builder is
+	 *  for.
+	 */
+	virtual Xapian::valueno
+		get_sort_slot(const std::string & fieldname) const = 0;
+
+	/** Check if queries on a given field are purely boolean.
+	 *
+	 *  Returns false if the field isn't purely boolean in every one of
+	 *  the types that the query builder is for which has the field, or if
+	 *  no type has the field.
+	 */
+	virtual bool boolean_field(const std::string & fieldname) const = 0;
     };
 
     /** A query builder for searches across a whole collection.
@@ -94,25 +251,24 @@ namespace RestPose {
      *  Implements leaf queries which search the whole collection.
      */
     class CollectionQueryBuilder : public QueryBuilder {
-	/** Build a query for a particular field.
-	 */
-	Xapian::Query field_query(const std::string & fieldname,
-				  const std::string & querytype,
-				  const Json::Value & queryparams) const;
+	void get_field_configs(const std::string & fieldname,
+			       std::vector<const FieldConfig *> & configs) const;
+
+	bool get_restriction(Xapian::Query & restriction) const;
 
       public:
 	CollectionQueryBuilder(const CollectionConfig & collconfig_);
 
-	/** Build a query from a JSON query specification.
-	 */
-	Xapian::Query build(const Json::Value & jsonquery) const;
-
 	Xapian::doccount total_docs(const Xapian::Database & db) const;
 
 	const FieldConfig *
 		get_field_config(const std::string & fieldname) const;
 
 	SlotDecoder * get_slot_decoder(const std::string & fieldname) const;
+
+	Xapian::valueno get_sort_slot(const std::string & fieldname) const;
+
+	bool boolean_field(const std::string & fieldname) const;
     };
 
     /** A query builder for searching a particular document type.
@@ -123,24 +279,25 @@ namespace RestPose {
     class DocumentTypeQueryBuilder : public QueryBuilder {
 	const Schema * schema;
 
-	/** Build a query for a particular field.
-	 */
-	Xapian::Query field_query(const std::string & fieldname,
-				  const std::string & querytype,
-				  const Json::Value & queryparams) const;
+	void get_field_configs(const std::string & fieldname,
+			       std::vector<const FieldConfig *> & configs) const;
+
+	bool get_restriction(Xapian::Query & restriction) const;
 
       public:
 	DocumentTypeQueryBuilder(const CollectionConfig & collconfig_,
 				 const std::string & doc_type);
 
-	Xapian::Query build(const Json::Value & jsonquery) const;
-
 	Xapian::doccount total_docs(const Xapian::Database & db) const;
 
 	const FieldConfig *
 		get_field_config(const std::string & fieldname) const;
 
 	SlotDecoder * get_slot_decoder(const std::string & fieldname) const;
+
+	Xapian::valueno get_sort_slot(const std::string & fieldname) const;
+
+	bool boolean_field(const std::string & fieldname) const;
     };
 };
 
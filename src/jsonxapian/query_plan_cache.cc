@@ -0,0 +1,135 @@
+/** @file query_plan_cache.cc
+ * @brief A cache of optimised query plans.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "jsonxapian/query_plan_cache.h"
+
+using namespace RestPose;
+using namespace std;
+
+/// The number of plans held by the cache used for searches.
+#define QUERY_PLAN_CACHE_SIZE 1000
+
+QueryPlanCache RestPose::g_query_plans(QUERY_PLAN_CACHE_SIZE);
+
+QueryPlanCache::QueryPlanCache(size_t max_entries_)
+	: max_entries(max_entries_),
+	  hits(0),
+	  misses(0)
+{
+}
+
+QueryPlanCache::~QueryPlanCache()
+{
+    clear();
+}
+
+void
+QueryPlanCache::unref(QueryPlan * plan)
+{
+    --(plan->ref_count);
+    if (plan->ref_count == 0) {
+	delete plan;
+    }
+}
+
+const QueryPlan *
+QueryPlanCache::get(const string & key)
+{
+    ContextLocker lock(mutex);
+    map<string, Entries::iterator>::iterator i = index.find(key);
+    if (i == index.end()) {
+	++misses;
+	return NULL;
+    }
+    ++hits;
+    // Move the entry to the front of the list.
+    entries.splice(entries.begin(), entries, i->second);
+    QueryPlan * plan = i->second->second;
+    ++(plan->ref_count);
+    return plan;
+}
+
+const QueryPlan *
+QueryPlanCache::set(const string & key, QueryPlan * plan)
+{
+    ContextLocker lock(mutex);
+    // One reference for the caller.
+    ++(plan->ref_count);
+    if (max_entries == 0) {
+	return plan;
+    }
+    ++(plan->ref_count);
+    map<string, Entries::iterator>::iterator i = index.find(key);
+    if (i != index.end()) {
+	entries.splice(entries.begin(), entries, i->second);
+	unref(i->second->second);
+	i->second->second = plan;
+	return plan;
+    }
+    while (index.size() >= max_entries) {
+	index.erase(entries.back().first);
+	unref(entries.back().second);
+	entries.pop_back();
+    }
+    entries.push_front(make_pair(key, plan));
+    index[key] = entries.begin();
+    return plan;
+}
+
+void
+QueryPlanCache::release(const QueryPlan * plan)
+{
+    ContextLocker lock(mutex);
+    unref(const_cast<QueryPlan *>(plan));
+}
+
+void
+QueryPlanCache::clear()
+{
+    ContextLocker lock(mutex);
+    for (Entries::iterator i = entries.begin(); i != entries.end(); ++i) {
+	unref(i->second);
+    }
+    index.clear();
+    entries.clear();
+    hits = 0;
+    misses = 0;
+}
+
+void
+QueryPlanCache::get_status(Json::Value & result) const
+{
+    ContextLocker lock(mutex);
+    result = Json::objectValue;
+    result["entries"] = Json::UInt64(index.size());
+    result["max_entries"] = Json::UInt64(max_entries);
+    result["hits"] = Json::UInt64(hits);
+    result["misses"] = Json::UInt64(misses);
+    if (hits + misses == 0) {
+	result["hit_rate"] = Json::nullValue;
+    } else {
+	result["hit_rate"] = double(hits) / double(hits + misses);
+    }
+}
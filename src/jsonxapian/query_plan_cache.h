@@ -0,0 +1,286 @@
+/** @file query_plan_cache.h
+ * @brief A cache of optimised query plans.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RESTPOSE_INCLUDED_QUERY_PLAN_CACHE_H
+#define RESTPOSE_INCLUDED_QUERY_PLAN_CACHE_H
+
+#include "json/value.h"
+#include <list>
+#include <map>
+#include <string>
+#include "utils/safe_inttypes.h"
+#include "utils/threading.h"
+#include <utility>
+#include <vector>
+#include <xapian.h>
+
+namespace RestPose {
+    class FieldConfig;
+    class QueryPlanCache;
+
+    /** An optimised query plan.
+     *
+     *  Holds the optimised form of a query shape (with the values searched
+     *  for replaced by indices of parameters), and the same plan compiled
+     *  into a tree of nodes, with the field configs for each leaf already
+     *  looked up, so that a query can be built from the plan and a list of
+     *  parameters without checking or resolving anything.
+     *
+     *  The field configs belong to the schemas they were looked up in, so a
+     *  plan must only be used while those schemas are unchanged.
+     *
+     *  Plans are reference counted by the cache and the searches using
+     *  them, and deleted when the last reference is released.
+     */
+    class QueryPlan {
+	friend class QueryPlanCache;
+
+      public:
+	/// The types of node in a compiled plan.
+	enum node_type {
+	    /// A node which matches nothing.
+	    MATCH_NOTHING,
+
+	    /// A node which matches everything.
+	    MATCH_ALL,
+
+	    /// A search in a field.
+	    LEAF,
+
+	    /// An operator combining the child nodes.
+	    OPERATOR,
+
+	    /// A node scaling the weights of its child.
+	    SCALE
+	};
+
+	/// A node of a compiled plan.
+	struct Node {
+	    node_type type;
+
+	    /** The operator, for OPERATOR nodes.
+	     *
+	     *  For OP_AND_NOT, OP_AND_MAYBE and OP_FILTER, the first child
+	     *  is combined with the rest of the children, which are combined
+	     *  with OP_AND for OP_FILTER and OP_OR otherwise.
+	     */
+	    Xapian::Query::op op;
+
+	    /// The positions of the child nodes in the plan.
+	    std::vector<size_t> children;
+
+	    /// The factor to scale weights by, for SCALE nodes.
+	    double factor;
+
+	    /// The configs of the field searched by a LEAF node.
+	    std::vector<const FieldConfig *> configs;
+
+	    /// The type of search performed by a LEAF node.
+	    std::string querytype;
+
+	    /// The parameters holding the values searched for by a LEAF node.
+	    std::vector<Json::Value::UInt> params;
+
+	    /** Flag, true if a LEAF node searches for the list of all the
+	     *  values in its parameters, rather than for a single parameter.
+	     */
+	    bool param_list;
+
+	    Node(node_type type_)
+		    : type(type_),
+		      op(Xapian::Query::OP_OR),
+		      factor(0.0),
+		      param_list(false)
+	    {}
+	};
+
+      private:
+	/// No copying.
+	QueryPlan(const QueryPlan &);
+	/// No assignment.
+	void operator=(const QueryPlan &);
+
+	/// The optimised query shape.
+	Json::Value plan;
+
+	/// The compiled plan, with the root node first.
+	std::vector<Node> nodes;
+
+	/// Number of references held to the plan.  Protected by the cache.
+	unsigned int ref_count;
+
+      public:
+	QueryPlan(const Json::Value & plan_)
+		: plan(plan_),
+		  ref_count(0)
+	{}
+
+	/// Get the optimised query shape.
+	const Json::Value & get_plan() const {
+	    return plan;
+	}
+
+	/** Add a node to the compiled plan.
+	 *
+	 *  Returns the position of the node.
+	 */
+	size_t add_node(node_type type) {
+	    nodes.push_back(Node(type));
+	    return nodes.size() - 1;
+	}
+
+	/// Get a node of the compiled plan.
+	Node & get_node(size_t pos) {
+	    return nodes[pos];
+	}
+
+	/// Get a node of the compiled plan.
+	const Node & get_node(size_t pos) const {
+	    return nodes[pos];
+	}
+
+	/// Check if the compiled plan has no nodes.
+	bool empty() const {
+	    return nodes.empty();
+	}
+    };
+
+    /** A cache of optimised query plans, keyed by query shape.
+     *
+     *  Holds up to a fixed number of plans, discarding the least recently
+     *  used when full.  All methods are threadsafe.
+     *
+     *  Plans returned by get() and set() stay valid until passed to
+     *  release(), even if they're discarded from the cache meanwhile.
+     */
+    class QueryPlanCache {
+	typedef std::list<std::pair<std::string, QueryPlan *> > Entries;
+
+	/// Mutex held by all methods.
+	mutable Mutex mutex;
+
+	/// The maximum number of plans to hold.
+	size_t max_entries;
+
+	/// The plans, most recently used first.
+	Entries entries;
+
+	/// Index of the plans, by key.
+	std::map<std::string, Entries::iterator> index;
+
+	/// Number of lookups which found a plan.
+	uint64_t hits;
+
+	/// Number of lookups which didn't find a plan.
+	uint64_t misses;
+
+	/// No copying.
+	QueryPlanCache(const QueryPlanCache &);
+	/// No assignment.
+	void operator=(const QueryPlanCache &);
+
+	/** Drop a reference to a plan, deleting it if it was the last.
+	 *
+	 *  Must be called with the mutex held.
+	 */
+	static void unref(QueryPlan * plan);
+
+      public:
+	QueryPlanCache(size_t max_entries_);
+	~QueryPlanCache();
+
+	/** Look up a plan.
+	 *
+	 *  Returns NULL if no plan is stored for the key.  Otherwise, returns
+	 *  the plan, which must be passed to release() when finished with.
+	 */
+	const QueryPlan * get(const std::string & key);
+
+	/** Store a plan.
+	 *
+	 *  Takes ownership of the plan, replacing any plan already stored for
+	 *  the key.  Returns the plan, which must be passed to release() when
+	 *  finished with.
+	 */
+	const QueryPlan * set(const std::string & key, QueryPlan * plan);
+
+	/// Release a plan returned by get() or set().
+	void release(const QueryPlan * plan);
+
+	/// Remove all plans, and reset the counts of hits and misses.
+	void clear();
+
+	/** Get the status of the cache.
+	 *
+	 *  Gives the number of plans held, and the counts and rate of hits.
+	 */
+	void get_status(Json::Value & result) const;
+    };
+
+    /** Hold a plan returned by a QueryPlanCache, and release it when
+     *  destroyed.
+     */
+    class QueryPlanRef {
+	QueryPlanCache & cache;
+	const QueryPlan * plan;
+
+	/// No copying.
+	QueryPlanRef(const QueryPlanRef &);
+	/// No assignment.
+	void operator=(const QueryPlanRef &);
+
+      public:
+	QueryPlanRef(QueryPlanCache & cache_, const QueryPlan * plan_ = NULL)
+		: cache(cache_),
+		  plan(plan_)
+	{}
+
+	~QueryPlanRef() {
+	    if (plan != NULL) {
+		cache.release(plan);
+	    }
+	}
+
+	/// Hold a plan, releasing any plan already held.
+	void reset(const QueryPlan * plan_) {
+	    if (plan != NULL) {
+		cache.release(plan);
+	    }
+	    plan = plan_;
+	}
+
+	const QueryPlan * get() const {
+	    return plan;
+	}
+
+	const QueryPlan * operator->() const {
+	    return plan;
+	}
+    };
+
+    /// The cache of query plans used for searches.
+    extern QueryPlanCache g_query_plans;
+}
+
+#endif /* RESTPOSE_INCLUDED_QUERY_PLAN_CACHE_H */
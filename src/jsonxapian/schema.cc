@@ -38,6 +38,8 @@
 #include "logger/logger.h"
 #include "matchspies/facetmatchspy.h"
 #include <memory>
+#include "postingsources/geocells.h"
+#include "postingsources/geonearest_source.h"
 #include "postingsources/multivaluerange_source.h"
 #include <set>
 #include "slotname.h"
@@ -53,9 +55,30 @@
 using namespace RestPose;
 using namespace std;
 
+Xapian::Query
+FieldConfig::query_with_config(const std::string & qtype,
+			       const Json::Value & value,
+			       const CollectionConfig &) const
+{
+    return query(qtype, value);
+}
+
+bool
+FieldConfig::boolean_queries() const
+{
+    return false;
+}
+
+Xapian::valueno
+FieldConfig::get_sort_slot() const
+{
+    return Xapian::BAD_VALUENO;
+}
+
 void
 FieldConfig::add_group_if_taxonomy(const std::string &,
-				   std::set<std::string> &) const
+				   std::set<std::string> &,
+				   bool) const
 {
 }
 
@@ -690,11 +713,32 @@ TextFieldConfig::to_json(Json::Value & value) const
 }
 
 
+/** Get the term prefix for a field in which the group is optional.
+ *
+ *  The "group" member is optional for range and lonlat fields: if not set,
+ *  values aren't indexed by terms, and an empty prefix is returned.
+ */
+static string
+optional_field_prefix(const Json::Value & value)
+{
+    string group = json_get_string_member(value, "group", string());
+    if (group.empty()) {
+	return group;
+    }
+    if (group.find('\t') != string::npos) {
+	throw InvalidValueError("Field configuration argument \"group\""
+				" contains invalid character \\t");
+    }
+    return group + "\t";
+}
+
 DoubleFieldConfig::DoubleFieldConfig(const Json::Value & value)
 {
     json_check_object(value, "schema object");
     slot = value["slot"];
     store_field = json_get_string_member(value, "store_field", string());
+    prefix = optional_field_prefix(value);
+    sort_slot = value["sort_slot"];
 }
 
 DoubleFieldConfig::~DoubleFieldConfig()
@@ -703,7 +747,8 @@ DoubleFieldConfig::~DoubleFieldConfig()
 FieldIndexer *
 DoubleFieldConfig::indexer() const
 {
-    return new DoubleIndexer(slot.get(), store_field);
+    return new DoubleIndexer(slot.get(), store_field, prefix,
+			     sort_slot.get());
 }
 
 Xapian::Query
@@ -734,7 +779,7 @@ DoubleFieldConfig::query(const string & qtype,
     string start = Xapian::sortable_serialise(value[0u].asDouble());
     string end = Xapian::sortable_serialise(value[1u].asDouble());
 
-    MultiValueRangeSource source(slot.get(), 1.0, start, end);
+    MultiValueRangeSource source(slot.get(), 1.0, start, end, prefix);
     return Xapian::Query(&source);
 }
 
@@ -744,6 +789,10 @@ DoubleFieldConfig::to_json(Json::Value & value) const
     value["type"] = "double";
     slot.to_json(value, "slot");
     value["store_field"] = store_field;
+    if (!prefix.empty()) {
+	value["group"] = prefix.substr(0, prefix.size() - 1);
+    }
+    sort_slot.to_json(value, "sort_slot");
 }
 
 
@@ -752,6 +801,8 @@ TimestampFieldConfig::TimestampFieldConfig(const Json::Value & value)
     json_check_object(value, "schema object");
     slot = value["slot"];
     store_field = json_get_string_member(value, "store_field", string());
+    prefix = optional_field_prefix(value);
+    sort_slot = value["sort_slot"];
 }
 
 TimestampFieldConfig::~TimestampFieldConfig()
@@ -760,7 +811,8 @@ TimestampFieldConfig::~TimestampFieldConfig()
 FieldIndexer *
 TimestampFieldConfig::indexer() const
 {
-    return new TimeStampIndexer(slot.get(), store_field);
+    return new TimeStampIndexer(slot.get(), store_field, prefix,
+				sort_slot.get());
 }
 
 Xapian::Query
@@ -778,7 +830,7 @@ TimestampFieldConfig::query(const string & qtype,
     string start = Xapian::sortable_serialise(json_get_uint64(value[Json::UInt(0u)]));
     string end = Xapian::sortable_serialise(json_get_uint64(value[1u]));
 
-    MultiValueRangeSource source(slot.get(), 1.0, start, end);
+    MultiValueRangeSource source(slot.get(), 1.0, start, end, prefix);
     return Xapian::Query(&source);
 }
 
@@ -788,6 +840,10 @@ TimestampFieldConfig::to_json(Json::Value & value) const
     value["type"] = "timestamp";
     slot.to_json(value, "slot");
     value["store_field"] = store_field;
+    if (!prefix.empty()) {
+	value["group"] = prefix.substr(0, prefix.size() - 1);
+    }
+    sort_slot.to_json(value, "sort_slot");
 }
 
 
@@ -796,6 +852,8 @@ DateFieldConfig::DateFieldConfig(const Json::Value & value)
     json_check_object(value, "schema object");
     slot = value["slot"];
     store_field = json_get_string_member(value, "store_field", string());
+    prefix = optional_field_prefix(value);
+    sort_slot = value["sort_slot"];
 }
 
 DateFieldConfig::~DateFieldConfig()
@@ -804,7 +862,8 @@ DateFieldConfig::~DateFieldConfig()
 FieldIndexer *
 DateFieldConfig::indexer() const
 {
-    return new DateIndexer(slot.get(), store_field);
+    return new DateIndexer(slot.get(), store_field, prefix,
+			   sort_slot.get());
 }
 
 Xapian::Query
@@ -829,7 +888,7 @@ DateFieldConfig::query(const string & qtype,
 	throw InvalidValueError(error);
     }
 
-    MultiValueRangeSource source(slot.get(), 1.0, start, end);
+    MultiValueRangeSource source(slot.get(), 1.0, start, end, prefix);
     return Xapian::Query(&source);
 }
 
@@ -851,6 +910,10 @@ DateFieldConfig::to_json(Json::Value & value) const
     value["type"] = "date";
     slot.to_json(value, "slot");
     value["store_field"] = store_field;
+    if (!prefix.empty()) {
+	value["group"] = prefix.substr(0, prefix.size() - 1);
+    }
+    sort_slot.to_json(value, "sort_slot");
 }
 
 
@@ -882,6 +945,16 @@ CategoryFieldConfig::CategoryFieldConfig(const Json::Value & value)
 
     store_field = json_get_string_member(value, "store_field", string());
     slot = value["slot"];
+
+    string ancestors = json_get_string_member(value, "ancestors", "index");
+    if (ancestors == "index") {
+	ancestors_at_query = false;
+    } else if (ancestors == "query") {
+	ancestors_at_query = true;
+    } else {
+	throw InvalidValueError("Field configuration argument \"ancestors\""
+				" must be \"index\" or \"query\"");
+    }
 }
 
 CategoryFieldConfig::~CategoryFieldConfig()
@@ -891,12 +964,14 @@ FieldIndexer *
 CategoryFieldConfig::indexer() const
 {
     return new CategoryIndexer(prefix, taxonomy_name, store_field,
-			       max_length, too_long_action, slot.get());
+			       max_length, too_long_action, slot.get(),
+			       !ancestors_at_query);
 }
 
-Xapian::Query
-CategoryFieldConfig::query(const string & qtype,
-			   const Json::Value & value) const
+/** Get the category names to search for from a query value.
+ */
+static void
+get_query_categories(const Json::Value & value, vector<string> & result)
 {
     // Ensure we have a JSON array.
     const Json::Value * value_ptr;
@@ -908,6 +983,32 @@ CategoryFieldConfig::query(const string & qtype,
 	value_ptr = &value;
     }
 
+    for (Json::Value::const_iterator iter = value_ptr->begin();
+	 iter != value_ptr->end(); ++iter) {
+	if ((*iter).isString()) {
+	    result.push_back((*iter).asString());
+	} else {
+	    if (!(*iter).isConvertibleTo(Json::uintValue)) {
+		throw InvalidValueError("Category value must be an integer or a string");
+	    }
+	    if ((*iter) < Json::Value::Int(0)) {
+		throw InvalidValueError("JSON value for category was negative - wanted unsigned int");
+	    }
+	    if ((*iter) > Json::Value::maxUInt64) {
+		throw InvalidValueError("JSON value " + (*iter).toStyledString() +
+					" was larger than maximum allowed (" +
+					Json::valueToString(Json::Value::maxUInt64) +
+					")");
+	    }
+	    result.push_back(Json::valueToString((*iter).asUInt64()));
+	}
+    }
+}
+
+Xapian::Query
+CategoryFieldConfig::query(const string & qtype,
+			   const Json::Value & value) const
+{
     vector<string> term_prefixes;
     if (qtype == "is") {
 	// The categories associated with a document are stored with an
@@ -929,40 +1030,75 @@ CategoryFieldConfig::query(const string & qtype,
 				"\" for category field");
     }
 
+    vector<string> cats;
+    get_query_categories(value, cats);
     vector<string> terms;
-    for (Json::Value::const_iterator iter = value_ptr->begin();
-	 iter != value_ptr->end(); ++iter) {
-	if ((*iter).isString()) {
-	    for (vector<string>::const_iterator i = term_prefixes.begin();
-		 i != term_prefixes.end(); ++i) {
-		terms.push_back(*i + (*iter).asString());
-	    }
-	} else {
-	    if (!(*iter).isConvertibleTo(Json::uintValue)) {
-		throw InvalidValueError("Category value must be an integer or a string");
-	    }
-	    if ((*iter) < Json::Value::Int(0)) {
-		throw InvalidValueError("JSON value for category was negative - wanted unsigned int");
-	    }
-	    if ((*iter) > Json::Value::maxUInt64) {
-		throw InvalidValueError("JSON value " + (*iter).toStyledString() +
-					" was larger than maximum allowed (" +
-					Json::valueToString(Json::Value::maxUInt64) +
-					")");
-	    }
-	    for (vector<string>::const_iterator i = term_prefixes.begin();
-		 i != term_prefixes.end(); ++i) {
-		terms.push_back(*i + Json::valueToString((*iter).asUInt64()));
+    for (vector<string>::const_iterator cat = cats.begin();
+	 cat != cats.end(); ++cat) {
+	for (vector<string>::const_iterator i = term_prefixes.begin();
+	     i != term_prefixes.end(); ++i) {
+	    terms.push_back(*i + *cat);
+	}
+    }
+    return Xapian::Query(Xapian::Query::OP_OR, terms.begin(), terms.end());
+}
+
+Xapian::Query
+CategoryFieldConfig::query_with_config(const string & qtype,
+				       const Json::Value & value,
+				       const CollectionConfig & collconfig) const
+{
+    if (!ancestors_at_query || qtype == "is") {
+	return query(qtype, value);
+    }
+
+    bool include_self;
+    if (qtype == "is_descendant") {
+	include_self = false;
+    } else if (qtype == "is_or_is_descendant") {
+	include_self = true;
+    } else {
+	throw InvalidValueError("Invalid query type \"" + qtype +
+				"\" for category field");
+    }
+
+    // No ancestor terms are stored, so search for the categories directly,
+    // expanding each category to all its descendants using the taxonomy.
+    vector<string> cats;
+    get_query_categories(value, cats);
+    const Taxonomy * taxonomy = collconfig.get_taxonomy(taxonomy_name);
+    Categories expanded;
+    for (vector<string>::const_iterator cat = cats.begin();
+	 cat != cats.end(); ++cat) {
+	if (include_self) {
+	    expanded.insert(*cat);
+	}
+	if (taxonomy != NULL) {
+	    Taxonomy::CategoryId cat_id = taxonomy->find_id(*cat);
+	    if (cat_id != Taxonomy::NO_CATEGORY) {
+		taxonomy->get_descendants(cat_id, expanded);
 	    }
 	}
     }
+
+    vector<string> terms;
+    terms.reserve(expanded.size());
+    string cat_prefix(prefix + "C");
+    for (Categories::const_iterator i = expanded.begin();
+	 i != expanded.end(); ++i) {
+	terms.push_back(cat_prefix + *i);
+    }
     return Xapian::Query(Xapian::Query::OP_OR, terms.begin(), terms.end());
 }
 
 void
 CategoryFieldConfig::add_group_if_taxonomy(const string & taxonomy_name_,
-					   set<string> & result) const
+					   set<string> & result,
+					   bool indexed_ancestors_only) const
 {
+    if (indexed_ancestors_only && ancestors_at_query) {
+	return;
+    }
     if (taxonomy_name == taxonomy_name_) {
 	result.insert(prefix.substr(0, prefix.size() - 1));
     }
@@ -977,6 +1113,9 @@ CategoryFieldConfig::to_json(Json::Value & value) const
     value["taxonomy"] = taxonomy_name;
     value["store_field"] = store_field;
     slot.to_json(value, "slot");
+    if (ancestors_at_query) {
+	value["ancestors"] = "query";
+    }
 }
 
 
@@ -985,6 +1124,7 @@ LonLatFieldConfig::LonLatFieldConfig(const Json::Value & value)
     json_check_object(value, "schema object");
     slot = value["slot"];
     store_field = json_get_string_member(value, "store_field", string());
+    prefix = optional_field_prefix(value);
 }
 
 LonLatFieldConfig::~LonLatFieldConfig()
@@ -993,20 +1133,20 @@ LonLatFieldConfig::~LonLatFieldConfig()
 FieldIndexer *
 LonLatFieldConfig::indexer() const
 {
-    return new LonLatIndexer(slot.get(), store_field);
+    return new LonLatIndexer(slot.get(), store_field, prefix);
 }
 
 Xapian::Query
 LonLatFieldConfig::query(const string & qtype,
 		       const Json::Value & value) const
 {
-    if (qtype != "distscore") {
+    if (qtype != "distscore" && qtype != "nearest") {
 	throw InvalidValueError("Invalid query type \"" + qtype +
 				"\" for lonlat field");
     }
-    json_check_object(value, "distscore filter value");
+    json_check_object(value, (qtype + " filter value").c_str());
     if (!value.isMember("center")) {
-	throw InvalidValueError("distscore query must specify center "
+	throw InvalidValueError(qtype + " query must specify center "
 				"parameter");
     }
 
@@ -1021,6 +1161,17 @@ LonLatFieldConfig::query(const string & qtype,
 	center.latitude = latitude;
     }
 
+    if (qtype == "nearest") {
+	if (prefix.empty()) {
+	    throw InvalidValueError("\"nearest\" search requires a lonlat "
+				    "field with a group");
+	}
+	Xapian::doccount count = json_get_uint64_member(value, "count",
+		Json::Value::maxUInt, 10);
+	GeoNearestSource source(slot.get(), prefix, center, count);
+	return Xapian::Query(&source);
+    }
+
     double range = 0;
     if (value.isMember("max_range")) {
 	if (!value["max_range"].isDouble()) {
@@ -1032,7 +1183,18 @@ LonLatFieldConfig::query(const string & qtype,
     Xapian::GreatCircleMetric metric;
     Xapian::LatLongDistancePostingSource source(slot.get(), center,
 						metric, range);
-    return Xapian::Query(&source);
+    Xapian::Query query(&source);
+
+    // If the cells are indexed, only check the distance of documents in
+    // cells covering the range.
+    vector<string> cells;
+    if (!prefix.empty() && range > 0 &&
+	geo_cover_terms(prefix, center, range, cells)) {
+	query = Xapian::Query(Xapian::Query::OP_FILTER, query,
+			      Xapian::Query(Xapian::Query::OP_OR,
+					    cells.begin(), cells.end()));
+    }
+    return query;
 }
 
 void
@@ -1041,6 +1203,9 @@ LonLatFieldConfig::to_json(Json::Value & value) const
     value["type"] = "lonlat";
     slot.to_json(value, "slot");
     value["store_field"] = store_field;
+    if (!prefix.empty()) {
+	value["group"] = prefix.substr(0, prefix.size() - 1);
+    }
 }
 
 
@@ -1306,10 +1471,6 @@ Schema::merge_from(const Schema & other)
 	    set(i->first, FieldConfig::from_json(tmp, doc_type));
 	} else {
 	    // Complain if configuration is not identical.
-	    //
-	    // Note, if this is changed in future to allow field
-	    // configuration to be changed, don't forget to clear the cache
-	    // (in indexers).
 
 	    Json::Value tmp2;
 	    j->second->to_json(tmp2);
@@ -1336,24 +1497,10 @@ Schema::get_indexer(const string & fieldname) const
 {
     map<string, FieldIndexer *>::const_iterator i;
     i = indexers.find(fieldname);
-    if (i != indexers.end()) {
-	return i->second;
-    }
-
-    map<string, FieldConfig *>::const_iterator j;
-    j = fields.find(fieldname);
-    if (j == fields.end()) {
+    if (i == indexers.end()) {
 	return NULL;
     }
-
-    // Make a new FieldIndexer, store it, and return it.
-    auto_ptr<FieldIndexer> newptr(j->second->indexer());
-    const FieldIndexer * result = newptr.get();
-    pair<map<string, FieldIndexer *>::iterator, bool> ret;
-    pair<string, FieldIndexer *> item(fieldname, NULL);
-    ret = indexers.insert(item);
-    ret.first->second = newptr.release();
-    return result;
+    return i->second;
 }
 
 void
@@ -1368,27 +1515,46 @@ Schema::set(const string & fieldname, FieldConfig * config)
 	    i->second = NULL;
 	    fields.erase(i);
 	}
+	map<string, FieldIndexer *>::iterator j;
+	j = indexers.find(fieldname);
+	if (j != indexers.end()) {
+	    delete j->second;
+	    j->second = NULL;
+	    indexers.erase(j);
+	}
 	return;
     }
 
     LOG_DEBUG("Setting config for field '" + fieldname + "'");
     auto_ptr<FieldConfig> configptr(config);
-    pair<string, FieldConfig*> item(fieldname, NULL);
-    pair<map<string, FieldConfig *>::iterator, bool> ret;
-    ret = fields.insert(item);
-    delete(ret.first->second);
-    ret.first->second = configptr.release();
+    auto_ptr<FieldIndexer> indexerptr(config->indexer());
+    {
+	pair<string, FieldConfig*> item(fieldname, NULL);
+	pair<map<string, FieldConfig *>::iterator, bool> ret;
+	ret = fields.insert(item);
+	delete(ret.first->second);
+	ret.first->second = configptr.release();
+    }
+    {
+	pair<string, FieldIndexer*> item(fieldname, NULL);
+	pair<map<string, FieldIndexer *>::iterator, bool> ret;
+	ret = indexers.insert(item);
+	delete(ret.first->second);
+	ret.first->second = indexerptr.release();
+    }
 }
 
 void
 Schema::get_taxonomy_groups(const string & taxonomy_name,
-			    std::set<string> & result) const
+			    std::set<string> & result,
+			    bool indexed_ancestors_only) const
 {
     // iterate through fields, looking for category fields which have taxonomy
     // equal to taxonomy_name, and add the groups of these to the result.
     for (map<string, FieldConfig *>::const_iterator i = fields.begin();
 	 i != fields.end(); ++i) {
-	i->second->add_group_if_taxonomy(taxonomy_name, result);
+	i->second->add_group_if_taxonomy(taxonomy_name, result,
+					 indexed_ancestors_only);
     }
 }
 
@@ -1401,6 +1567,69 @@ Schema::process(const Json::Value & value,
 {
     json_check_object(value, "input document");
 
+    string meta_field(collconfig.get_meta_field());
+
+    for (Json::Value::const_iterator viter = value.begin();
+	 viter != value.end();
+	 ++viter) {
+	const string & fieldname = viter.memberName();
+	if (fieldname == meta_field) {
+	    continue;
+	}
+	if (fields.find(fieldname) == fields.end()) {
+	    LOG_DEBUG(string("New field type: ") + fieldname);
+	    set(fieldname, patterns.get(fieldname, doc_type));
+	    new_fields = true;
+	}
+    }
+
+    if (!meta_field.empty() && fields.find(meta_field) == fields.end()) {
+	LOG_DEBUG(string("New meta field type: ") + meta_field);
+	set(meta_field, patterns.get(meta_field, doc_type));
+	new_fields = true;
+    }
+
+    return process_known(value, collconfig, idterm, errors);
+}
+
+bool
+Schema::has_all_fields(const Json::Value & value,
+		       const string & meta_field) const
+{
+    json_check_object(value, "input document");
+    for (Json::Value::const_iterator viter = value.begin();
+	 viter != value.end();
+	 ++viter) {
+	const string & fieldname = viter.memberName();
+	if (fieldname == meta_field) {
+	    continue;
+	}
+	if (fields.find(fieldname) == fields.end()) {
+	    // Fields which no pattern matches are just ignored, so don't
+	    // need the schema to change.
+	    auto_ptr<FieldConfig> config(patterns.get(fieldname, doc_type));
+	    if (config.get() != NULL) {
+		return false;
+	    }
+	}
+    }
+    if (!meta_field.empty() && fields.find(meta_field) == fields.end()) {
+	auto_ptr<FieldConfig> config(patterns.get(meta_field, doc_type));
+	if (config.get() != NULL) {
+	    return false;
+	}
+    }
+    return true;
+}
+
+Xapian::Document
+Schema::process_known(const Json::Value & value,
+		      const CollectionConfig & collconfig,
+		      string & idterm,
+		      IndexingErrors & errors) const
+{
+    json_check_object(value, "input document");
+
     IndexingState state(collconfig, idterm, errors);
 
     string meta_field(collconfig.get_meta_field());
@@ -1417,13 +1646,6 @@ Schema::process(const Json::Value & value,
 	}
 
 	const FieldIndexer * indexer = get_indexer(fieldname);
-	if (!indexer) {
-	    LOG_DEBUG(string("New field type: ") + fieldname);
-	    set(fieldname, patterns.get(fieldname, doc_type));
-	    new_fields = true;
-	    indexer = get_indexer(fieldname);
-	}
-
 	if (indexer) {
 	    if ((*viter).isNull()) {
 		state.field_empty(fieldname);
@@ -1441,18 +1663,13 @@ Schema::process(const Json::Value & value,
 
     if (!meta_field.empty()) {
 	const FieldIndexer * indexer = get_indexer(meta_field);
-	if (!indexer) {
-	    LOG_DEBUG(string("New meta field type: ") + meta_field);
-	    set(meta_field, patterns.get(meta_field, doc_type));
-	    new_fields = true;
-	    indexer = get_indexer(meta_field);
-	}
 	if (indexer) {
 	    indexer->index(state, meta_field, Json::nullValue);
 	}
     }
 
-    state.doc.set_data(state.docdata.serialise());
+    state.doc.set_data(state.docdata.serialise(
+	&collconfig.get_docdata_compressor()));
     state.docvals.apply(state.doc);
     return state.doc;
 }
@@ -1475,12 +1692,13 @@ Schema::get_fieldlist(Json::Value & result, const Json::Value & search) const
 void
 Schema::display_doc(const Xapian::Document & doc,
 		    const Json::Value & fieldlist,
-		    Json::Value & result) const
+		    Json::Value & result,
+		    const DocumentDataCompressor * compressor) const
 {
     json_check_array(fieldlist, "display field list");
     result = Json::objectValue;
     DocumentData docdata;
-    docdata.unserialise(doc.get_data());
+    docdata.unserialise(doc.get_data(), compressor);
     for (Json::Value::const_iterator fiter = fieldlist.begin();
 	 fiter != fieldlist.end();
 	 ++fiter) {
@@ -1498,7 +1716,8 @@ Schema::display_doc(const Xapian::Document & doc,
 
 void
 Schema::display_doc(const Xapian::Document & doc,
-		    Json::Value & result) const
+		    Json::Value & result,
+		    const DocumentDataCompressor * compressor) const
 {
     Json::Value fieldlist(Json::arrayValue);
     for (map<string, FieldConfig *>::const_iterator
@@ -1510,24 +1729,26 @@ Schema::display_doc(const Xapian::Document & doc,
 	    }
 	}
     }
-    display_doc(doc, fieldlist, result);
+    display_doc(doc, fieldlist, result, compressor);
 }
 
 string
 Schema::display_doc_as_string(const Xapian::Document & doc,
-			      const Json::Value & fieldlist) const
+			      const Json::Value & fieldlist,
+			      const DocumentDataCompressor * compressor) const
 {
     Json::Value result(Json::objectValue);
-    display_doc(doc, fieldlist, result);
+    display_doc(doc, fieldlist, result, compressor);
     Json::FastWriter writer;
     return writer.write(result);
 }
 
 string
-Schema::display_doc_as_string(const Xapian::Document & doc) const
+Schema::display_doc_as_string(const Xapian::Document & doc,
+			      const DocumentDataCompressor * compressor) const
 {
     Json::Value result(Json::objectValue);
-    display_doc(doc, result);
+    display_doc(doc, result, compressor);
     Json::FastWriter writer;
     return writer.write(result);
 }
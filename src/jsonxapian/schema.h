@@ -30,6 +30,7 @@
 #include <map>
 #include "jsonxapian/docvalues.h"
 #include "jsonxapian/slotname.h"
+#include <set>
 #include <string>
 #include <xapian.h>
 
@@ -37,6 +38,7 @@ namespace RestPose {
     // Forward declaration
     class BaseFacetMatchSpy;
     class CollectionConfig;
+    class DocumentDataCompressor;
     class FieldIndexer;
     struct IndexingErrors;
 
@@ -50,9 +52,28 @@ namespace RestPose {
 	virtual Xapian::Query query(const std::string & qtype,
 				    const Json::Value & value) const = 0;
 
+	/** Create a query to search this field, in a collection.
+	 *
+	 *  This is used when building queries for searches, and allows
+	 *  fields to use other parts of the collection configuration (such
+	 *  as taxonomies) when building the query.  By default, this just
+	 *  calls query().
+	 */
+	virtual Xapian::Query query_with_config(const std::string & qtype,
+		const Json::Value & value,
+		const CollectionConfig & collconfig) const;
+
 	/// Get the field that values are being stored under. ("" if none).
 	virtual std::string stored_field() const = 0;
 
+	/** Check if queries on this field are purely boolean.
+	 *
+	 *  Returns true if the terms searched for by queries on the field are
+	 *  stored with no wdf, so the queries only filter the results, and
+	 *  never contribute to their weights.  By default, returns false.
+	 */
+	virtual bool boolean_queries() const;
+
 	/** Get the slot used by the field.
 	 *
 	 *  @param encoding A reference used to return the type of encoding
@@ -63,11 +84,27 @@ namespace RestPose {
 	 */
 	virtual Xapian::valueno get_slot(ValueEncoding & encoding) const = 0;
 
+	/** Get the slot holding precomputed sort keys for the field.
+	 *
+	 *  Fields with a sort slot store a single fixed-width key in it for
+	 *  each document (derived from the lowest value in the field), which
+	 *  can be used for sorting without decoding the values in the main
+	 *  slot.  The key is missing for documents with no values.
+	 *
+	 *  Returns BAD_VALUENO if the field has no sort slot.  By default,
+	 *  returns BAD_VALUENO.
+	 */
+	virtual Xapian::valueno get_sort_slot() const;
+
 	/** For fields which use taxonomies; if the taxonomy_name
 	 *  is as given, add the group to result.
+	 *
+	 *  If indexed_ancestors_only is true, the group is only added if
+	 *  ancestor terms are stored in documents for the field.
 	 */
 	virtual void add_group_if_taxonomy(const std::string & taxonomy_name,
-		std::set<std::string> & result) const;
+		std::set<std::string> & result,
+		bool indexed_ancestors_only) const;
 
 	/** Create a facet spy for this field.
 	 */
@@ -126,6 +163,11 @@ namespace RestPose {
 	    return std::string();
 	}
 
+	/// Queries on the meta field are purely boolean.
+	bool boolean_queries() const {
+	    return true;
+	}
+
 	/** Get the slot used by the field.
 	 *
 	 *  @param encoding A reference used to return the type of encoding
@@ -224,6 +266,11 @@ namespace RestPose {
 	    return store_field;
 	}
 
+	/// Queries on ID fields are purely boolean.
+	bool boolean_queries() const {
+	    return true;
+	}
+
 	/// Add the configuration for a field to a JSON object.
 	void to_json(Json::Value & value) const;
     };
@@ -275,6 +322,11 @@ namespace RestPose {
 	    return store_field;
 	}
 
+	/// Queries on exact fields are purely boolean unless wdfinc is set.
+	bool boolean_queries() const {
+	    return wdfinc == 0;
+	}
+
 	/// Add the configuration for a field to a JSON object.
 	void to_json(Json::Value & value) const;
     };
@@ -346,14 +398,31 @@ namespace RestPose {
 	/// The fieldname to store field values under (empty to not store).
 	std::string store_field;
 
+	/** The prefix of terms used to index values for range searches.
+	 *
+	 *  Empty if values aren't indexed by terms, in which case range
+	 *  searches check the value of every document.
+	 */
+	std::string prefix;
+
+	/** The slot to store precomputed sort keys in.
+	 *
+	 *  BAD_VALUENO if sort keys aren't stored for the field.
+	 */
+	SlotName sort_slot;
+
 	/// Create from a JSON object.
 	DoubleFieldConfig(const Json::Value & value);
 
 	/// Create from parameters.
 	DoubleFieldConfig(unsigned int slot_,
-			  const std::string & store_field_)
+			  const std::string & store_field_,
+			  const std::string & group_ = std::string(),
+			  unsigned int sort_slot_ = Xapian::BAD_VALUENO)
 		: slot(slot_),
-		  store_field(store_field_)
+		  store_field(store_field_),
+		  prefix(group_.empty() ? group_ : group_ + "\t"),
+		  sort_slot(sort_slot_)
 	{}
 
 	virtual ~DoubleFieldConfig();
@@ -383,6 +452,11 @@ namespace RestPose {
 	    return slot.get();
 	}
 
+	/// Get the slot holding precomputed sort keys for the field.
+	Xapian::valueno get_sort_slot() const {
+	    return sort_slot.get();
+	}
+
 	/// Add the configuration for a field to a JSON object.
 	void to_json(Json::Value & value) const;
     };
@@ -394,14 +468,31 @@ namespace RestPose {
 	/// The fieldname to store field values under (empty to not store).
 	std::string store_field;
 
+	/** The prefix of terms used to index values for range searches.
+	 *
+	 *  Empty if values aren't indexed by terms, in which case range
+	 *  searches check the value of every document.
+	 */
+	std::string prefix;
+
+	/** The slot to store precomputed sort keys in.
+	 *
+	 *  BAD_VALUENO if sort keys aren't stored for the field.
+	 */
+	SlotName sort_slot;
+
 	/// Create from a JSON object.
 	TimestampFieldConfig(const Json::Value & value);
 
 	/// Create from parameters.
 	TimestampFieldConfig(unsigned int slot_,
-			     const std::string & store_field_)
+			     const std::string & store_field_,
+			     const std::string & group_ = std::string(),
+			     unsigned int sort_slot_ = Xapian::BAD_VALUENO)
 		: slot(slot_),
-		  store_field(store_field_)
+		  store_field(store_field_),
+		  prefix(group_.empty() ? group_ : group_ + "\t"),
+		  sort_slot(sort_slot_)
 	{}
 
 	virtual ~TimestampFieldConfig();
@@ -431,6 +522,11 @@ namespace RestPose {
 	    return slot.get();
 	}
 
+	/// Get the slot holding precomputed sort keys for the field.
+	Xapian::valueno get_sort_slot() const {
+	    return sort_slot.get();
+	}
+
 	/// Add the configuration for a field to a JSON object.
 	void to_json(Json::Value & value) const;
     };
@@ -442,14 +538,31 @@ namespace RestPose {
 	/// The fieldname to store field values under (empty to not store).
 	std::string store_field;
 
+	/** The prefix of terms used to index values for range searches.
+	 *
+	 *  Empty if values aren't indexed by terms, in which case range
+	 *  searches check the value of every document.
+	 */
+	std::string prefix;
+
+	/** The slot to store precomputed sort keys in.
+	 *
+	 *  BAD_VALUENO if sort keys aren't stored for the field.
+	 */
+	SlotName sort_slot;
+
 	/// Create from a JSON object.
 	DateFieldConfig(const Json::Value & value);
 
 	/// Create from parameters.
 	DateFieldConfig(unsigned int slot_,
-			const std::string & store_field_)
+			const std::string & store_field_,
+			const std::string & group_ = std::string(),
+			unsigned int sort_slot_ = Xapian::BAD_VALUENO)
 		: slot(slot_),
-		  store_field(store_field_)
+		  store_field(store_field_),
+		  prefix(group_.empty() ? group_ : group_ + "\t"),
+		  sort_slot(sort_slot_)
 	{}
 
 	virtual ~DateFieldConfig();
@@ -479,6 +592,11 @@ namespace RestPose {
 	    return slot.get();
 	}
 
+	/// Get the slot holding precomputed sort keys for the field.
+	Xapian::valueno get_sort_slot() const {
+	    return sort_slot.get();
+	}
+
 	/** Create a facet spy for this field.
 	 */
 	BaseFacetMatchSpy * new_facet_spy(SlotDecoder * decoder,
@@ -504,6 +622,17 @@ namespace RestPose {
 	/// The fieldname to store field values under (empty to not store).
 	std::string store_field;
 
+	/** Flag, true if ancestors are found using the taxonomy at query time.
+	 *
+	 *  If false (the default), terms for the ancestors of each category
+	 *  are stored in documents, and all affected documents are updated
+	 *  whenever the taxonomy changes.  If true, no ancestor terms are
+	 *  stored, and searches for descendants are expanded to search for
+	 *  each descendant category instead; this makes changes to the
+	 *  taxonomy cheap, at the expense of larger queries.
+	 */
+	bool ancestors_at_query;
+
 	/// Create from a JSON object.
 	CategoryFieldConfig(const Json::Value & value);
 
@@ -512,11 +641,13 @@ namespace RestPose {
 			    std::string taxonomy_name_,
 			    unsigned int max_length_ = 64,
 			    MaxLenFieldConfig::TooLongAction too_long_action_ = TOOLONG_ERROR,
-			    const std::string & store_field_ = std::string())
+			    const std::string & store_field_ = std::string(),
+			    bool ancestors_at_query_ = false)
 		: MaxLenFieldConfig(max_length_, too_long_action_),
 		  prefix(prefix_ + "\t"),
 		  taxonomy_name(taxonomy_name_),
-		  store_field(store_field_)
+		  store_field(store_field_),
+		  ancestors_at_query(ancestors_at_query_)
 	{}
 
 	virtual ~CategoryFieldConfig();
@@ -528,11 +659,25 @@ namespace RestPose {
 	Xapian::Query query(const std::string & qtype,
 			    const Json::Value & value) const;
 
+	/** Create a query to search this field, in a collection.
+	 *
+	 *  If ancestors are found at query time, searches for descendants
+	 *  are expanded using the collection's taxonomy.
+	 */
+	Xapian::Query query_with_config(const std::string & qtype,
+					const Json::Value & value,
+					const CollectionConfig & collconfig) const;
+
 	/// Get the field that values are being stored under.
 	std::string stored_field() const {
 	    return store_field;
 	}
 
+	/// Queries on category fields are purely boolean.
+	bool boolean_queries() const {
+	    return true;
+	}
+
 	/** Get the slot used by the field.
 	 *
 	 *  @param encoding A reference used to return the type of encoding
@@ -548,7 +693,8 @@ namespace RestPose {
 
 	/// If the taxonomy_name is as given, add the group to result.
 	void add_group_if_taxonomy(const std::string & taxonomy_name,
-				   std::set<std::string> & result) const;
+				   std::set<std::string> & result,
+				   bool indexed_ancestors_only) const;
 
 	/// Add the configuration for a field to a JSON object.
 	void to_json(Json::Value & value) const;
@@ -564,6 +710,13 @@ namespace RestPose {
 	/// The fieldname to store field values under (empty to not store).
 	std::string store_field;
 
+	/** The prefix of terms used to index the cells holding coordinates.
+	 *
+	 *  Empty if cells aren't indexed, in which case searches check the
+	 *  coordinates of every document.
+	 */
+	std::string prefix;
+
 	/// Create from a JSON object.
 	LonLatFieldConfig(const Json::Value & value);
 
@@ -748,9 +901,13 @@ namespace RestPose {
 	 */
 	std::map<std::string, FieldConfig *> fields;
 
-	/** Cache of mappings from fieldname to indexer for a field.
+	/** Mappings from fieldname to indexer for a field.
+	 *
+	 *  Kept up to date by set(), rather than filled in lazily, so that
+	 *  a schema can be used by several threads at once for processing
+	 *  documents.
 	 */
-	mutable std::map<std::string, FieldIndexer *> indexers;
+	std::map<std::string, FieldIndexer *> indexers;
 
 	FieldConfigPatterns patterns;
 
@@ -807,9 +964,13 @@ namespace RestPose {
 	void set(const std::string & fieldname, FieldConfig * config);
 
 	/** Get the groups using a given taxonomy.
+	 *
+	 *  If indexed_ancestors_only is true, only get the groups for which
+	 *  ancestor terms are stored in documents.
 	 */
 	void get_taxonomy_groups(const std::string & taxonomy_name,
-				 std::set<std::string> & result) const;
+				 std::set<std::string> & result,
+				 bool indexed_ancestors_only = false) const;
 
         /** Process a JSON object into a Xapian document.
 	 *
@@ -825,29 +986,64 @@ namespace RestPose {
 				 IndexingErrors & errors,
 				 bool & new_fields);
 
+	/** Check if a JSON object can be processed without changing the
+	 *  schema.
+	 *
+	 *  Returns false if the object contains fields which aren't in the
+	 *  schema, but for which the patterns would supply configuration.
+	 */
+	bool has_all_fields(const Json::Value & value,
+			    const std::string & meta_field) const;
+
+	/** Process a JSON object into a Xapian document, using only the
+	 *  fields already in the schema.
+	 *
+	 *  Fields which aren't in the schema are ignored, so this should
+	 *  normally only be called after has_all_fields() has returned true.
+	 *  Doesn't modify the schema, so may be called by several threads
+	 *  at once.
+	 */
+	Xapian::Document process_known(const Json::Value & value,
+				       const CollectionConfig & collconfig,
+				       std::string & idterm,
+				       IndexingErrors & errors) const;
+
 	/// Get the list of fields to return, from a search
 	void get_fieldlist(Json::Value & result,
 			   const Json::Value & search) const;
 
 	/** Get a set of stored fields from a Xapian document.
+	 *
+	 *  @param compressor The compressor used for the stored document
+	 *  data, or NULL if it was stored uncompressed.
 	 */
 	void display_doc(const Xapian::Document & doc,
 			 const Json::Value & fieldlist,
-			 Json::Value & result) const;
+			 Json::Value & result,
+			 const DocumentDataCompressor * compressor = NULL) const;
 
 	/** Get all stored fields from a Xapian document.
 	 */
 	void display_doc(const Xapian::Document & doc,
-			 Json::Value & result) const;
+			 Json::Value & result,
+			 const DocumentDataCompressor * compressor = NULL) const;
 
 	/** Get all stored fields from a Xapian document as a string.
+	 *
+	 *  @param compressor The compressor used for the stored document
+	 *  data, or NULL if it was stored uncompressed.
 	 */
 	std::string display_doc_as_string(const Xapian::Document & doc,
-					  const Json::Value & fieldlist) const;
+		const Json::Value & fieldlist,
+		const DocumentDataCompressor * compressor = NULL) const;
 
 	/** Get a set of stored fields from a Xapian document as a string.
+	 *
+	 *  @param compressor The compressor used for the stored document
+	 *  data, or NULL if it was stored uncompressed.
 	 */
-	std::string display_doc_as_string(const Xapian::Document & doc) const;
+	std::string display_doc_as_string(const Xapian::Document & doc,
+		const DocumentDataCompressor * compressor = NULL) const;
     };
 };
 
@@ -25,194 +25,242 @@
 #include <config.h>
 #include "taxonomy.h"
 
-#include "logger/logger.h"
+#include <algorithm>
 #include "utils/jsonutils.h"
 #include "utils/rsperrors.h"
-#include "utils/stringutils.h"
 
 using namespace RestPose;
 using namespace std;
 
-void
-Category::add_parent(const std::string & parent, Categories & modified)
+typedef Taxonomy::CategoryId CategoryId;
+
+const CategoryId Taxonomy::NO_CATEGORY;
+
+/** Insert an ID into a sorted list of IDs.
+ *
+ *  Returns true if the ID wasn't already present.
+ */
+static bool
+sorted_insert(vector<CategoryId> & ids, CategoryId id)
 {
-    if (parents.insert(parent).second + ancestors.insert(parent).second) {
-	modified.insert(name);
+    vector<CategoryId>::iterator i = lower_bound(ids.begin(), ids.end(), id);
+    if (i != ids.end() && *i == id) {
+	return false;
     }
+    ids.insert(i, id);
+    return true;
 }
 
-void
-Category::add_child(const std::string & child, Categories & modified)
+/** Remove an ID from a sorted list of IDs.
+ *
+ *  Returns true if the ID was present.
+ */
+static bool
+sorted_erase(vector<CategoryId> & ids, CategoryId id)
 {
-    if (children.insert(child).second + descendants.insert(child).second) {
-	modified.insert(name);
+    vector<CategoryId>::iterator i = lower_bound(ids.begin(), ids.end(), id);
+    if (i == ids.end() || *i != id) {
+	return false;
     }
+    ids.erase(i);
+    return true;
 }
 
-void
-Category::add_ancestor(const std::string & ancestor, Categories & modified)
+CategoryId
+Taxonomy::add_id(const string & cat_name, Categories & modified)
 {
-    if (ancestors.insert(ancestor).second) {
-	modified.insert(name);
+    map<string, CategoryId>::const_iterator i = ids.find(cat_name);
+    if (i != ids.end()) {
+	return i->second;
     }
+    CategoryId id;
+    if (free_ids.empty()) {
+	id = CategoryId(names.size());
+	names.push_back(cat_name);
+	nodes.push_back(Node());
+    } else {
+	id = free_ids.back();
+	free_ids.pop_back();
+	names[id] = cat_name;
+    }
+    ids.insert(make_pair(cat_name, id));
+    modified.insert(cat_name);
+    return id;
 }
 
 void
-Category::add_descendant(const std::string & descendant, Categories & modified)
+Taxonomy::collect_descendants(CategoryId id,
+			      vector<CategoryId> & result) const
 {
-    if (descendants.insert(descendant).second) {
-	modified.insert(name);
+    vector<bool> seen(nodes.size());
+    vector<CategoryId> stack(nodes[id].children);
+    while (!stack.empty()) {
+	CategoryId next = stack.back();
+	stack.pop_back();
+	if (seen[next]) {
+	    continue;
+	}
+	seen[next] = true;
+	result.push_back(next);
+	const vector<CategoryId> & children = nodes[next].children;
+	stack.insert(stack.end(), children.begin(), children.end());
     }
 }
 
 void
-Category::remove_parent(const std::string & parent, Categories & modified)
+Taxonomy::calc_ancestors(CategoryId id, vector<CategoryId> & result) const
 {
-    if (parents.erase(parent)) {
-	modified.insert(name);
+    result.clear();
+    vector<bool> seen(nodes.size());
+    vector<CategoryId> stack(nodes[id].parents);
+    while (!stack.empty()) {
+	CategoryId next = stack.back();
+	stack.pop_back();
+	if (seen[next]) {
+	    continue;
+	}
+	seen[next] = true;
+	result.push_back(next);
+	const vector<CategoryId> & parents = nodes[next].parents;
+	stack.insert(stack.end(), parents.begin(), parents.end());
     }
+    sort(result.begin(), result.end());
 }
 
 void
-Category::remove_child(const std::string & child, Categories & modified)
+Taxonomy::recalc_ancestors(const vector<CategoryId> & cat_ids,
+			   Categories & modified)
 {
-    if (children.erase(child)) {
-	modified.insert(name);
+    vector<CategoryId> ancestors;
+    vector<CategoryId> lost;
+    vector<CategoryId> gained;
+    for (vector<CategoryId>::const_iterator i = cat_ids.begin();
+	 i != cat_ids.end(); ++i) {
+	calc_ancestors(*i, ancestors);
+	vector<CategoryId> & old_ancestors = nodes[*i].ancestors;
+	if (ancestors == old_ancestors) {
+	    continue;
+	}
+	lost.clear();
+	set_difference(old_ancestors.begin(), old_ancestors.end(),
+		       ancestors.begin(), ancestors.end(),
+		       back_inserter(lost));
+	gained.clear();
+	set_difference(ancestors.begin(), ancestors.end(),
+		       old_ancestors.begin(), old_ancestors.end(),
+		       back_inserter(gained));
+	for (vector<CategoryId>::const_iterator j = lost.begin();
+	     j != lost.end(); ++j) {
+	    --nodes[*j].descendant_count;
+	}
+	for (vector<CategoryId>::const_iterator j = gained.begin();
+	     j != gained.end(); ++j) {
+	    ++nodes[*j].descendant_count;
+	}
+	modified.insert(names[*i]);
+	add_names(lost, modified);
+	old_ancestors.swap(ancestors);
     }
 }
 
 void
-Category::set_ancestors(const Categories & new_ancestors,
-			Categories & modified)
+Taxonomy::add_names(const vector<CategoryId> & cat_ids,
+		    Categories & result) const
 {
-    if (ancestors != new_ancestors) {
-	modified.insert(name);
+    for (vector<CategoryId>::const_iterator i = cat_ids.begin();
+	 i != cat_ids.end(); ++i) {
+	result.insert(names[*i]);
     }
-    ancestors = new_ancestors;
 }
 
-void
-Category::set_descendants(const Categories & new_descendants,
-			  Categories & modified)
+CategoryId
+Taxonomy::find_id(const string & cat_name) const
 {
-    LOG_DEBUG("Setting descendants of '" + name + "' to '" +
-	      string_join(",", new_descendants.begin(),
-			  new_descendants.end()) +
-	      "' from '" +
-	      string_join(",", descendants.begin(),
-			  descendants.end()) + "'");
-    if (descendants != new_descendants) {
-	modified.insert(name);
+    map<string, CategoryId>::const_iterator i = ids.find(cat_name);
+    if (i == ids.end()) {
+	return NO_CATEGORY;
     }
-    descendants = new_descendants;
+    return i->second;
 }
 
+void
+Taxonomy::get_parents(CategoryId id, Categories & result) const
+{
+    add_names(nodes[id].parents, result);
+}
 
 void
-Taxonomy::recalc_ancestors(const string & cat_name, Categories & modified)
+Taxonomy::get_children(CategoryId id, Categories & result) const
 {
-    LOG_DEBUG("Recalculating ancestors of '" + cat_name + "'");
-    Categories ancestors;
-    Categories seen;
-    Categories stack;
-    stack = categories.find(cat_name)->second.parents;
-    while (!stack.empty()) {
-	Category & cat = categories.find(*(stack.begin()))->second;
-	stack.erase(stack.begin());
-	seen.insert(cat.name);
-	ancestors.insert(cat.name);
-	for (Categories::const_iterator i = cat.parents.begin();
-	     i != cat.parents.end(); ++i) {
-	    stack.insert(*i);
-	}
-    }
-    categories.find(cat_name)->second.set_ancestors(ancestors, modified);
+    add_names(nodes[id].children, result);
 }
 
 void
-Taxonomy::recalc_descendants(const string & cat_name, Categories & modified)
+Taxonomy::get_ancestors(CategoryId id, Categories & result) const
 {
-    LOG_DEBUG("Recalculating descendants of '" + cat_name + "'");
-    Categories descendants;
-    Categories seen;
-    Categories stack;
-    stack = categories.find(cat_name)->second.children;
-    while (!stack.empty()) {
-	Category & cat = categories.find(*(stack.begin()))->second;
-	stack.erase(stack.begin());
-	seen.insert(cat.name);
-	descendants.insert(cat.name);
-	for (Categories::const_iterator i = cat.children.begin();
-	     i != cat.children.end(); ++i) {
-	    stack.insert(*i);
-	}
-    }
-    categories.find(cat_name)->second.set_descendants(descendants, modified);
+    add_names(nodes[id].ancestors, result);
 }
 
-const Category *
-Taxonomy::find(const std::string & cat_name) const
+void
+Taxonomy::get_descendants(CategoryId id, Categories & result) const
 {
-    map<string, Category>::const_iterator i = categories.find(cat_name);
-    if (i == categories.end()) {
-	return NULL;
-    }
-    return &(i->second);
+    vector<CategoryId> descendants;
+    collect_descendants(id, descendants);
+    add_names(descendants, result);
+}
+
+bool
+Taxonomy::is_parent(CategoryId id, CategoryId parent_id) const
+{
+    const vector<CategoryId> & parents = nodes[id].parents;
+    return binary_search(parents.begin(), parents.end(), parent_id);
+}
+
+bool
+Taxonomy::is_ancestor(CategoryId id, CategoryId ancestor_id) const
+{
+    const vector<CategoryId> & ancestors = nodes[id].ancestors;
+    return binary_search(ancestors.begin(), ancestors.end(), ancestor_id);
 }
 
 void
 Taxonomy::add(const string & cat_name, Categories & modified)
 {
-    if (categories.find(cat_name) == categories.end()) {
-	categories.insert(make_pair(cat_name, Category(cat_name)));
-	modified.insert(cat_name);
-    }
+    (void) add_id(cat_name, modified);
 }
 
 void
 Taxonomy::remove(const string & cat_name, Categories & modified)
 {
-    map<string, Category>::iterator i = categories.find(cat_name);
-    if (i == categories.end()) return;
-    Category & category = i->second;
-    LOG_DEBUG("Removing category: parents='" +
-	      string_join(",",
-			  category.parents.begin(),
-			  category.parents.end()) +
-	      "' children='" +
-	      string_join(",",
-			  category.children.begin(),
-			  category.children.end()) +
-	      "' ancestors='" +
-	      string_join(",",
-			  category.ancestors.begin(),
-			  category.ancestors.end()) +
-	      "' descendants='" +
-	      string_join(",",
-			  category.descendants.begin(),
-			  category.descendants.end()) +
-	      "'"
-	     );
-
-    for (Categories::const_iterator j = category.parents.begin();
-	 j != category.parents.end(); ++j) {
-	categories.find(*j)->second.remove_child(cat_name, modified);
-    }
-    for (Categories::const_iterator j = category.children.begin();
-	 j != category.children.end(); ++j) {
-	categories.find(*j)->second.remove_parent(cat_name, modified);
-    }
+    CategoryId id = find_id(cat_name);
+    if (id == NO_CATEGORY) return;
+    Node & node = nodes[id];
 
-    for (Categories::const_iterator j = category.ancestors.begin();
-	 j != category.ancestors.end(); ++j) {
-	recalc_descendants(*j, modified);
+    // The category, and all its ancestors and descendants, are modified.
+    vector<CategoryId> descendants;
+    collect_descendants(id, descendants);
+    modified.insert(cat_name);
+    add_names(node.ancestors, modified);
+    add_names(descendants, modified);
+
+    for (vector<CategoryId>::const_iterator i = node.parents.begin();
+	 i != node.parents.end(); ++i) {
+	sorted_erase(nodes[*i].children, id);
     }
-    for (Categories::const_iterator j = category.descendants.begin();
-	 j != category.descendants.end(); ++j) {
-	recalc_ancestors(*j, modified);
+    for (vector<CategoryId>::const_iterator i = node.children.begin();
+	 i != node.children.end(); ++i) {
+	sorted_erase(nodes[*i].parents, id);
     }
-    categories.erase(cat_name);
-    modified.insert(cat_name);
+    recalc_ancestors(descendants, modified);
+    for (vector<CategoryId>::const_iterator i = node.ancestors.begin();
+	 i != node.ancestors.end(); ++i) {
+	--nodes[*i].descendant_count;
+    }
+
+    nodes[id] = Node();
+    names[id].clear();
+    ids.erase(cat_name);
+    free_ids.push_back(id);
 }
 
 void
@@ -223,50 +271,42 @@ Taxonomy::add_parent(const string & cat_name,
     if (cat_name == parent_name) {
 	throw InvalidValueError("Cannot set category as parent of itself");
     }
-    add(cat_name, modified);
-    add(parent_name, modified);
-    Category & cat = categories.find(cat_name)->second;
-    Category & parent = categories.find(parent_name)->second;
-
-    // Ensure no loop happens by checking that none of the ancestors of the
-    // new parent are descendants of the category.
-    for (Categories::iterator i = parent.ancestors.begin();
-	 i != parent.ancestors.end(); ++i) {
-	if (cat.descendants.find(*i) != cat.descendants.end()) {
-	    throw InvalidValueError("Attempt to create loop in taxonomy: '" +
-				    parent_name + "' is a descendant of '" +
-				    cat_name + "' - can't add it as a parent");
-	}
-    }
-    if (cat.descendants.find(parent_name) != cat.descendants.end()) {
+    CategoryId id = add_id(cat_name, modified);
+    CategoryId parent_id = add_id(parent_name, modified);
+
+    // Ensure no loop happens by checking that the category isn't an ancestor
+    // of the new parent.
+    if (is_ancestor(parent_id, id)) {
 	throw InvalidValueError("Attempt to create loop in taxonomy: '" +
 				parent_name + "' is a descendant of '" +
 				cat_name + "' - can't add it as a parent");
     }
 
-    cat.add_parent(parent_name, modified);
-    cat.add_ancestor(parent_name, modified);
-    parent.add_child(cat_name, modified);
-    parent.add_descendant(cat_name, modified);
-
-    // Add all ancestors of cat as ancestors of all descendants of cat.
-    for (Categories::const_iterator i = cat.descendants.begin();
-	 i != cat.descendants.end(); ++i) {
-	for (Categories::const_iterator j = cat.ancestors.begin();
-	     j != cat.ancestors.end(); ++j) {
-	    categories.find(*i)->second.add_ancestor(*j, modified);
-	    categories.find(*j)->second.add_descendant(*i, modified);
-	}
+    if (!sorted_insert(nodes[id].parents, parent_id)) {
+	// Already a parent.
+	return;
     }
+    sorted_insert(nodes[parent_id].children, id);
+    modified.insert(cat_name);
+    modified.insert(parent_name);
 
-    // Add all descendants of parent as descendants of all ancestors of
-    // parent.
-    for (Categories::const_iterator i = parent.ancestors.begin();
-	 i != parent.ancestors.end(); ++i) {
-	for (Categories::const_iterator j = parent.descendants.begin();
-	     j != parent.descendants.end(); ++j) {
-	    categories.find(*i)->second.add_descendant(*j, modified);
-	    categories.find(*j)->second.add_ancestor(*i, modified);
+    // Add the parent and all its ancestors as ancestors of the category and
+    // all its descendants.
+    vector<CategoryId> new_ancestors(nodes[parent_id].ancestors);
+    sorted_insert(new_ancestors, parent_id);
+    vector<CategoryId> affected;
+    collect_descendants(id, affected);
+    affected.push_back(id);
+    for (vector<CategoryId>::const_iterator i = affected.begin();
+	 i != affected.end(); ++i) {
+	vector<CategoryId> & ancestors = nodes[*i].ancestors;
+	for (vector<CategoryId>::const_iterator j = new_ancestors.begin();
+	     j != new_ancestors.end(); ++j) {
+	    if (sorted_insert(ancestors, *j)) {
+		++nodes[*j].descendant_count;
+		modified.insert(names[*i]);
+		modified.insert(names[*j]);
+	    }
 	}
     }
 }
@@ -279,40 +319,37 @@ Taxonomy::remove_parent(const string & cat_name,
     if (cat_name == parent_name) {
 	return;
     }
-    map<string, Category>::iterator i = categories.find(cat_name);
-    if (i == categories.end()) return;
-    Category & child = i->second;
+    CategoryId id = find_id(cat_name);
+    if (id == NO_CATEGORY) return;
+    CategoryId parent_id = find_id(parent_name);
+    if (parent_id == NO_CATEGORY) return;
 
-    i = categories.find(parent_name);
-    if (i == categories.end()) return;
-    Category & parent = i->second;
-
-    parent.remove_child(cat_name, modified);
-    child.remove_parent(parent_name, modified);
-
-    recalc_ancestors(cat_name, modified);
-    recalc_descendants(parent_name, modified);
-
-    for (Categories::const_iterator j = child.descendants.begin();
-	 j != child.descendants.end(); ++j) {
-	recalc_ancestors(*j, modified);
-    }
-    for (Categories::const_iterator j = parent.ancestors.begin();
-	 j != parent.ancestors.end(); ++j) {
-	recalc_descendants(*j, modified);
+    if (!sorted_erase(nodes[id].parents, parent_id)) {
+	return;
     }
+    sorted_erase(nodes[parent_id].children, id);
+    modified.insert(cat_name);
+    modified.insert(parent_name);
+
+    vector<CategoryId> affected;
+    collect_descendants(id, affected);
+    affected.push_back(id);
+    recalc_ancestors(affected, modified);
 }
 
 Json::Value &
 Taxonomy::to_json(Json::Value & value) const
 {
     value = Json::objectValue;
-    for (map<string, Category>::const_iterator i = categories.begin();
-	 i != categories.end(); ++i) {
-	Json::Value & parents = value[i->first] = Json::arrayValue;
-	for (set<string>::const_iterator j = i->second.parents.begin();
-	     j != i->second.parents.end(); ++j) {
-	    parents.append(*j);
+    Categories parents;
+    for (map<string, CategoryId>::const_iterator i = ids.begin();
+	 i != ids.end(); ++i) {
+	Json::Value & parentsval = value[i->first] = Json::arrayValue;
+	parents.clear();
+	get_parents(i->second, parents);
+	for (Categories::const_iterator j = parents.begin();
+	     j != parents.end(); ++j) {
+	    parentsval.append(*j);
 	}
     }
     return value;
@@ -321,19 +358,77 @@ Taxonomy::to_json(Json::Value & value) const
 void
 Taxonomy::from_json(const Json::Value & value)
 {
-    categories.clear();
+    ids.clear();
+    names.clear();
+    nodes.clear();
+    free_ids.clear();
     json_check_object(value, "taxonomy");
+
+    // Add all the categories and links first, and then calculate the
+    // ancestors in a single pass, rather than updating them for each link.
     Categories modified;
     for (Json::ValueIterator i = value.begin(); i != value.end(); ++i) {
 	string name = i.memberName();
-	add(name, modified);
+	CategoryId id = add_id(name, modified);
 	Json::Value & item(*i);
 	if (!item.isNull()) {
 	    json_check_array(item, "list of category parents");
 	    for (Json::ValueIterator j = item.begin(); j != item.end(); ++j) {
 		json_check_string(*j, "category parent");
-		add_parent(name, (*j).asString(), modified);
+		string parent_name = (*j).asString();
+		if (parent_name == name) {
+		    throw InvalidValueError("Cannot set category as parent of "
+					    "itself");
+		}
+		CategoryId parent_id = add_id(parent_name, modified);
+		sorted_insert(nodes[id].parents, parent_id);
+		sorted_insert(nodes[parent_id].children, id);
 	    }
 	}
     }
+
+    // Process categories in topological order: each category is processed
+    // once all its parents have been.
+    vector<size_t> pending_parents(nodes.size());
+    vector<CategoryId> ready;
+    for (CategoryId id = 0; id != nodes.size(); ++id) {
+	pending_parents[id] = nodes[id].parents.size();
+	if (pending_parents[id] == 0) {
+	    ready.push_back(id);
+	}
+    }
+    size_t processed = 0;
+    while (!ready.empty()) {
+	CategoryId id = ready.back();
+	ready.pop_back();
+	++processed;
+	Node & node = nodes[id];
+	for (vector<CategoryId>::const_iterator i = node.parents.begin();
+	     i != node.parents.end(); ++i) {
+	    node.ancestors.push_back(*i);
+	    node.ancestors.insert(node.ancestors.end(),
+				  nodes[*i].ancestors.begin(),
+				  nodes[*i].ancestors.end());
+	}
+	sort(node.ancestors.begin(), node.ancestors.end());
+	node.ancestors.erase(unique(node.ancestors.begin(),
+				    node.ancestors.end()),
+			     node.ancestors.end());
+	for (vector<CategoryId>::const_iterator i = node.ancestors.begin();
+	     i != node.ancestors.end(); ++i) {
+	    ++nodes[*i].descendant_count;
+	}
+	for (vector<CategoryId>::const_iterator i = node.children.begin();
+	     i != node.children.end(); ++i) {
+	    if (--pending_parents[*i] == 0) {
+		ready.push_back(*i);
+	    }
+	}
+    }
+    if (processed != nodes.size()) {
+	ids.clear();
+	names.clear();
+	nodes.clear();
+	throw InvalidValueError("Attempt to create loop in taxonomy");
+    }
 }
@@ -29,79 +29,174 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 namespace RestPose {
 
 typedef std::set<std::string> Categories;
 
-/** A category in the hierarcy.
+/** The hierarchy of categories.
+ *
+ *  Category names are interned: each category is given a small integer ID,
+ *  and the relationships between categories are stored as sorted arrays of
+ *  IDs.  Only the ancestors of each category are stored (since hierarchies
+ *  are usually much wider than they are deep); descendants are found when
+ *  needed by walking down the child links.
+ *
+ *  IDs of removed categories are reused, so IDs must not be held across
+ *  modifications of the taxonomy.
  */
-struct Category {
-    /// Name of this category.
-    std::string name;
+class Taxonomy {
+  public:
+    /// The type of the interned IDs of categories.
+    typedef unsigned int CategoryId;
 
-    /// Direct parents.
-    Categories parents;
+    /// Value returned by find_id() for unknown categories.
+    static const CategoryId NO_CATEGORY = static_cast<CategoryId>(-1);
 
-    /// Direct children.
-    Categories children;
+    /// Iterator over the categories, in name order.
+    typedef std::map<std::string, CategoryId>::const_iterator const_iterator;
 
-    /// All ancestors (including direct parents).
-    Categories ancestors;
+  private:
+    /// The links of a category in the hierarchy.
+    struct Node {
+	/// Direct parents, sorted by ID.
+	std::vector<CategoryId> parents;
 
-    /// All descendants (including direct children).
-    Categories descendants;
+	/// Direct children, sorted by ID.
+	std::vector<CategoryId> children;
 
-    Category(const std::string & name_)
-	    : name(name_)
-    {}
+	/// All ancestors (including direct parents), sorted by ID.
+	std::vector<CategoryId> ancestors;
 
-    void add_parent(const std::string & parent, Categories & modified);
-    void add_child(const std::string & child, Categories & modified);
-    void add_ancestor(const std::string & ancestor, Categories & modified);
-    void add_descendant(const std::string & descendant, Categories & modified);
+	/** Number of descendants.
+	 *
+	 *  Kept up to date whenever the ancestors of a category change, so
+	 *  that it can be read without walking down the child links.
+	 */
+	size_t descendant_count;
 
-    void remove_parent(const std::string & parent, Categories & modified);
-    void remove_child(const std::string & child, Categories & modified);
-    void set_ancestors(const Categories & new_ancestors,
-		       Categories & modified);
-    void set_descendants(const Categories & new_descendants,
-			 Categories & modified);
-};
+	Node() : descendant_count(0) {}
+    };
 
-/** The hierarchy of categories.
- */
-class Taxonomy {
-    /// All the categories, by name.
-    std::map<std::string, Category> categories;
+    /// Map from category name to ID.
+    std::map<std::string, CategoryId> ids;
+
+    /// Category names, indexed by ID (empty for unused IDs).
+    std::vector<std::string> names;
+
+    /// Category links, indexed by ID.
+    std::vector<Node> nodes;
+
+    /// IDs which are currently unused.
+    std::vector<CategoryId> free_ids;
 
-    /// Recalculate the descendants of the given category.
-    void recalc_descendants(const std::string & cat_name,
-			    Categories & modified);
+    /** Get the ID for a category, adding it if it doesn't exist.
+     */
+    CategoryId add_id(const std::string & cat_name, Categories & modified);
+
+    /** Get all the descendants of a category (in no particular order).
+     */
+    void collect_descendants(CategoryId id,
+			     std::vector<CategoryId> & result) const;
 
-    /// Recalculate the ancestors of the given category.
-    void recalc_ancestors(const std::string & cat_name,
+    /** Calculate the ancestors of a category from the parent links.
+     */
+    void calc_ancestors(CategoryId id,
+			std::vector<CategoryId> & result) const;
+
+    /** Recalculate the ancestors of a set of categories.
+     *
+     *  Any categories whose ancestors change (and the ancestors which were
+     *  lost) are added to modified.
+     */
+    void recalc_ancestors(const std::vector<CategoryId> & cat_ids,
 			  Categories & modified);
 
+    /** Add the names of a list of categories to result.
+     */
+    void add_names(const std::vector<CategoryId> & cat_ids,
+		   Categories & result) const;
+
   public:
+    const_iterator begin() const
+    {
+	return ids.begin();
+    }
+
+    const_iterator end() const
+    {
+	return ids.end();
+    }
 
-    const Category * find(const std::string & cat_name) const;
+    size_t size() const
+    {
+	return ids.size();
+    }
+
+    /** Get the ID of a category.
+     *
+     *  Returns NO_CATEGORY if the category doesn't exist.
+     */
+    CategoryId find_id(const std::string & cat_name) const;
 
-    std::map<std::string, Category>::const_iterator begin() const
+    /** Return true iff the category exists.
+     */
+    bool contains(const std::string & cat_name) const
     {
-	return categories.begin();
+	return ids.find(cat_name) != ids.end();
     }
 
-    std::map<std::string, Category>::const_iterator end() const
+    /** Get the name of a category, given its ID.
+     */
+    const std::string & get_name(CategoryId id) const
     {
-	return categories.end();
+	return names[id];
     }
 
-    size_t size() const
+    /** Get the IDs of all the ancestors of a category, sorted by ID.
+     */
+    const std::vector<CategoryId> & get_ancestor_ids(CategoryId id) const
+    {
+	return nodes[id].ancestors;
+    }
+
+    /// Get the names of the direct parents of a category.
+    void get_parents(CategoryId id, Categories & result) const;
+
+    /// Get the names of the direct children of a category.
+    void get_children(CategoryId id, Categories & result) const;
+
+    /// Get the names of all the ancestors of a category.
+    void get_ancestors(CategoryId id, Categories & result) const;
+
+    /// Get the names of all the descendants of a category.
+    void get_descendants(CategoryId id, Categories & result) const;
+
+    /// Return true iff a category has no parents.
+    bool is_top(CategoryId id) const
     {
-	return categories.size();
+	return nodes[id].parents.empty();
     }
 
+    /// Get the number of direct children of a category.
+    size_t child_count(CategoryId id) const
+    {
+	return nodes[id].children.size();
+    }
+
+    /// Get the number of descendants of a category.
+    size_t descendant_count(CategoryId id) const
+    {
+	return nodes[id].descendant_count;
+    }
+
+    /// Return true iff parent_id is a direct parent of id.
+    bool is_parent(CategoryId id, CategoryId parent_id) const;
+
+    /// Return true iff ancestor_id is an ancestor of id.
+    bool is_ancestor(CategoryId id, CategoryId ancestor_id) const;
+
     void add(const std::string & cat_name, Categories & modified);
     void remove(const std::string & cat_name, Categories & modified);
     void add_parent(const std::string & cat_name,
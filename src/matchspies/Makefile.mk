@@ -1,9 +1,13 @@
 noinst_LIBRARIES += libmatchspies.a
 
 noinst_HEADERS += \
+ src/matchspies/countminsketch.h \
  src/matchspies/facetmatchspy.h \
+ src/matchspies/termcounts.h \
  src/matchspies/termoccurmatchspy.h
 
 libmatchspies_a_SOURCES = \
+ src/matchspies/countminsketch.cc \
  src/matchspies/facetmatchspy.cc \
+ src/matchspies/termcounts.cc \
  src/matchspies/termoccurmatchspy.cc
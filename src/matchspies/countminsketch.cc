@@ -0,0 +1,142 @@
+/** @file countminsketch.cc
+ * @brief Approximate counting of occurrences in bounded memory.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "countminsketch.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace RestPose;
+using namespace std;
+
+void
+CountMinSketch::init(size_t max_memory, uint32_t depth_)
+{
+    depth = depth_ ? depth_ : 1;
+    size_t row_width = max_memory / (depth * sizeof(uint32_t));
+    width = uint32_t(min(row_width, size_t(0x7fffffff)));
+    if (width == 0) {
+	width = 1;
+    }
+    cells.assign(size_t(width) * depth, 0);
+    total = 0;
+}
+
+uint32_t
+CountMinSketch::add(uint64_t hash, uint32_t count)
+{
+    // Derive the row hashes from two halves of the hash (Kirsch and
+    // Mitzenmacher), rather than hashing the item once per row.
+    uint32_t h1 = uint32_t(hash);
+    uint32_t h2 = uint32_t(hash >> 32) | 1;
+    uint32_t result = UINT32_MAX;
+    for (uint32_t row = 0; row != depth; ++row) {
+	uint32_t & cell = cells[size_t(row) * width +
+				(h1 + row * h2) % width];
+	cell += count;
+	result = min(result, cell);
+    }
+    total += count;
+    return result;
+}
+
+uint32_t
+CountMinSketch::estimate(uint64_t hash) const
+{
+    uint32_t h1 = uint32_t(hash);
+    uint32_t h2 = uint32_t(hash >> 32) | 1;
+    uint32_t result = UINT32_MAX;
+    for (uint32_t row = 0; row != depth; ++row) {
+	result = min(result,
+		     cells[size_t(row) * width + (h1 + row * h2) % width]);
+    }
+    return result;
+}
+
+Xapian::doccount
+CountMinSketch::error_bound() const
+{
+    if (width == 0) {
+	return 0;
+    }
+    return Xapian::doccount(ceil(M_E * total / width));
+}
+
+double
+CountMinSketch::error_probability() const
+{
+    return exp(-double(depth));
+}
+
+
+void
+HeavyHitters::update(const string & item, Xapian::doccount count)
+{
+    map<string, Xapian::doccount>::iterator i = counts.find(item);
+    if (i != counts.end()) {
+	if (i->second == count) {
+	    return;
+	}
+	order.erase(make_pair(i->second, item));
+	i->second = count;
+	order.insert(make_pair(count, item));
+	return;
+    }
+    if (counts.size() >= limit) {
+	if (limit == 0 || order.begin()->first >= count) {
+	    return;
+	}
+	counts.erase(order.begin()->second);
+	order.erase(order.begin());
+    }
+    counts[item] = count;
+    order.insert(make_pair(count, item));
+}
+
+/// Order items by decreasing count, and then by item.
+static bool
+more_frequent(const pair<string, Xapian::doccount> & a,
+	      const pair<string, Xapian::doccount> & b)
+{
+    if (a.second != b.second) {
+	return a.second > b.second;
+    }
+    return a.first < b.first;
+}
+
+void
+HeavyHitters::get_most_frequent(
+	vector<pair<string, Xapian::doccount> > & result,
+	Xapian::doccount limit_) const
+{
+    result.assign(counts.begin(), counts.end());
+    if (limit_ < result.size()) {
+	partial_sort(result.begin(), result.begin() + limit_, result.end(),
+		     more_frequent);
+	result.resize(limit_);
+    } else {
+	sort(result.begin(), result.end(), more_frequent);
+    }
+}
@@ -0,0 +1,125 @@
+/** @file countminsketch.h
+ * @brief Approximate counting of occurrences in bounded memory.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RESTPOSE_INCLUDED_COUNTMINSKETCH_H
+#define RESTPOSE_INCLUDED_COUNTMINSKETCH_H
+
+#include <map>
+#include <set>
+#include <string>
+#include "utils/safe_inttypes.h"
+#include <utility>
+#include <vector>
+#include <xapian.h>
+
+namespace RestPose {
+
+/** A count-min sketch.
+ *
+ *  Holds approximate counts for any number of distinct items in a fixed
+ *  amount of memory.  Items are identified by a 64 bit hash (eg, from
+ *  TermCounts::hash()).  Estimated counts are never less than the true
+ *  counts; with probability at least 1 - error_probability(), they exceed
+ *  the true counts by no more than error_bound().
+ */
+class CountMinSketch {
+    /// Number of counters in each row.
+    uint32_t width;
+
+    /// Number of rows.
+    uint32_t depth;
+
+    /// The counters, row by row.
+    std::vector<uint32_t> cells;
+
+    /// Total of all the counts added.
+    uint64_t total;
+
+  public:
+    CountMinSketch() : width(0), depth(0), total(0) {}
+
+    /** Allocate the sketch.
+     *
+     *  @param max_memory The memory to use for the counters, in bytes.
+     *  @param depth_ The number of rows (each divides error_probability()
+     *  by e).
+     */
+    void init(size_t max_memory, uint32_t depth_);
+
+    /// Return true if the sketch has been allocated.
+    bool initialised() const { return width != 0; }
+
+    /** Add to the count for an item.
+     *
+     *  Returns the new estimated count for the item.
+     */
+    uint32_t add(uint64_t hash, uint32_t count = 1);
+
+    /// Get the estimated count for an item.
+    uint32_t estimate(uint64_t hash) const;
+
+    /// Get the amount by which estimates may exceed the true counts.
+    Xapian::doccount error_bound() const;
+
+    /// Get the probability that an estimate exceeds error_bound().
+    double error_probability() const;
+};
+
+/** The items with the highest counts seen so far.
+ *
+ *  Keeps at most a given number of items, replacing the item with the
+ *  lowest count when a new item's count exceeds it.
+ */
+class HeavyHitters {
+    /// Maximum number of items to keep.
+    size_t limit;
+
+    /// The count for each item kept.
+    std::map<std::string, Xapian::doccount> counts;
+
+    /// The items kept, ordered by count.
+    std::set<std::pair<Xapian::doccount, std::string> > order;
+
+  public:
+    HeavyHitters() : limit(0) {}
+
+    /// Set the maximum number of items to keep.
+    void set_limit(size_t limit_) { limit = limit_; }
+
+    /// Set the count for an item, keeping the item if it is heavy enough.
+    void update(const std::string & item, Xapian::doccount count);
+
+    /** Get the items kept, with their counts.
+     *
+     *  Returns at most limit_ items, highest count first; items with
+     *  equal counts are returned in lexicographic order.
+     */
+    void get_most_frequent(
+	std::vector<std::pair<std::string, Xapian::doccount> > & result,
+	Xapian::doccount limit_) const;
+};
+
+}
+
+#endif /* RESTPOSE_INCLUDED_COUNTMINSKETCH_H */
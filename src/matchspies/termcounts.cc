@@ -0,0 +1,163 @@
+/** @file termcounts.cc
+ * @brief Hash table for counting occurrences of term suffixes.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "termcounts.h"
+
+#include <algorithm>
+#include <cstring>
+#include "utils/hash.h"
+
+using namespace RestPose;
+using namespace std;
+
+/// Initial number of slots in the table (must be a power of 2).
+#define TERMCOUNTS_INITIAL_SLOTS 64
+
+uint64_t
+TermCounts::hash(const char * data, size_t len)
+{
+    return hash_finish(fnv1a_hash(data, len));
+}
+
+TermCounts::TermCounts()
+	: slots(TERMCOUNTS_INITIAL_SLOTS),
+	  mask(TERMCOUNTS_INITIAL_SLOTS - 1),
+	  used(0)
+{
+    memset(&slots[0], 0, sizeof(Slot) * slots.size());
+}
+
+size_t
+TermCounts::find_slot(uint64_t hash, const char * data, size_t len) const
+{
+    size_t pos = size_t(hash) & mask;
+    while (true) {
+	const Slot & slot = slots[pos];
+	if (slot.hash == 0) {
+	    return pos;
+	}
+	if (slot.hash == hash && slot.len == len &&
+	    memcmp(buf.data() + slot.offset, data, len) == 0) {
+	    return pos;
+	}
+	pos = (pos + 1) & mask;
+    }
+}
+
+void
+TermCounts::grow()
+{
+    vector<Slot> old_slots(slots.size() * 2);
+    memset(&old_slots[0], 0, sizeof(Slot) * old_slots.size());
+    old_slots.swap(slots);
+    mask = slots.size() - 1;
+    for (vector<Slot>::const_iterator i = old_slots.begin();
+	 i != old_slots.end(); ++i) {
+	if (i->hash == 0) {
+	    continue;
+	}
+	size_t pos = size_t(i->hash) & mask;
+	while (slots[pos].hash != 0) {
+	    pos = (pos + 1) & mask;
+	}
+	slots[pos] = *i;
+    }
+}
+
+void
+TermCounts::add(const char * data, size_t len)
+{
+    uint64_t h = hash(data, len);
+    Slot & slot = slots[find_slot(h, data, len)];
+    if (slot.hash != 0) {
+	++slot.count;
+	return;
+    }
+    slot.hash = h;
+    slot.offset = buf.size();
+    slot.len = len;
+    slot.count = 1;
+    buf.append(data, len);
+    // Keep the table at most half full.
+    if (++used * 2 > slots.size()) {
+	grow();
+    }
+}
+
+bool
+TermCounts::contains(const char * data, size_t len) const
+{
+    if (used == 0) {
+	return false;
+    }
+    return slots[find_slot(hash(data, len), data, len)].hash != 0;
+}
+
+/// Order slots by decreasing count, and then by string.
+class TermCounts::MostFrequentFirst {
+    const string & buf;
+  public:
+    MostFrequentFirst(const string & buf_) : buf(buf_) {}
+    bool operator()(const Slot * a, const Slot * b) const {
+	if (a->count != b->count) {
+	    return a->count > b->count;
+	}
+	int cmp = memcmp(buf.data() + a->offset, buf.data() + b->offset,
+			 min(a->len, b->len));
+	if (cmp != 0) {
+	    return cmp < 0;
+	}
+	return a->len < b->len;
+    }
+};
+
+void
+TermCounts::get_most_frequent(
+	vector<pair<string, Xapian::doccount> > & result,
+	Xapian::doccount limit) const
+{
+    result.clear();
+    vector<const Slot *> items;
+    items.reserve(used);
+    for (vector<Slot>::const_iterator i = slots.begin();
+	 i != slots.end(); ++i) {
+	if (i->hash != 0) {
+	    items.push_back(&*i);
+	}
+    }
+    MostFrequentFirst cmp(buf);
+    if (limit < items.size()) {
+	partial_sort(items.begin(), items.begin() + limit, items.end(), cmp);
+	items.resize(limit);
+    } else {
+	sort(items.begin(), items.end(), cmp);
+    }
+    result.reserve(items.size());
+    for (vector<const Slot *>::const_iterator i = items.begin();
+	 i != items.end(); ++i) {
+	result.push_back(make_pair(buf.substr((*i)->offset, (*i)->len),
+				   (*i)->count));
+    }
+}
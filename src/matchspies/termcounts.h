@@ -0,0 +1,210 @@
+/** @file termcounts.h
+ * @brief Hash table for counting occurrences of term suffixes.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RESTPOSE_INCLUDED_TERMCOUNTS_H
+#define RESTPOSE_INCLUDED_TERMCOUNTS_H
+
+#include <string>
+#include "utils/safe_inttypes.h"
+#include <utility>
+#include <vector>
+#include <xapian.h>
+
+namespace RestPose {
+
+/** Counts of the number of times each of a set of strings has been seen.
+ *
+ *  An open-addressed hash table, stored in a single flat array which is at
+ *  most half full.  The strings are held in a single buffer, so counting a
+ *  string which has been seen before doesn't allocate, and a lookup usually
+ *  touches a single slot.
+ */
+class TermCounts {
+  public:
+    class const_iterator;
+
+  private:
+    friend class const_iterator;
+
+    struct Slot {
+	/// Hash of the string; 0 for an empty slot.
+	uint64_t hash;
+
+	/// Offset of the string in the buffer.
+	size_t offset;
+
+	/// Length of the string.
+	size_t len;
+
+	/// Number of times the string has been seen.
+	Xapian::doccount count;
+    };
+
+    /// The hash table.
+    std::vector<Slot> slots;
+
+    /// Mask to apply to a hash to get a slot number.
+    size_t mask;
+
+    /// Number of slots in use.
+    size_t used;
+
+    /// Buffer holding the strings, concatenated.
+    std::string buf;
+
+    /** Find the slot for a string.
+     *
+     *  Returns the position of the slot holding the string, or of the empty
+     *  slot which it should be stored in.
+     */
+    size_t find_slot(uint64_t hash, const char * data, size_t len) const;
+
+    /// Double the size of the table.
+    void grow();
+
+    class MostFrequentFirst;
+
+  public:
+    TermCounts();
+
+    /** Calculate the hash of a string, as used by the table.
+     *
+     *  Never returns 0.
+     */
+    static uint64_t hash(const char * data, size_t len);
+
+    /// Add one to the count for a string.
+    void add(const char * data, size_t len);
+
+    /// Add one to the count for a string.
+    void add(const std::string & value) {
+	add(value.data(), value.size());
+    }
+
+    /// Check if a string has been seen.
+    bool contains(const char * data, size_t len) const;
+
+    /// Check if a string has been seen.
+    bool contains(const std::string & value) const {
+	return contains(value.data(), value.size());
+    }
+
+    /// Return true if no strings have been seen.
+    bool empty() const { return used == 0; }
+
+    /// Return the number of distinct strings seen.
+    size_t size() const { return used; }
+
+    /// Return the approximate amount of memory used by the table, in bytes.
+    size_t memory_used() const {
+	return slots.size() * sizeof(Slot) + buf.capacity();
+    }
+
+    /** An iterator over the strings seen, and their counts.
+     *
+     *  The strings are returned in no particular order.
+     */
+    class const_iterator {
+	friend class TermCounts;
+
+	/// The table being iterated over.
+	const TermCounts * counts;
+
+	/// The current slot.
+	size_t pos;
+
+	/// Move forward to the next slot in use (if not already in one).
+	void skip_empty() {
+	    while (pos != counts->slots.size() &&
+		   counts->slots[pos].hash == 0) {
+		++pos;
+	    }
+	}
+
+	const_iterator(const TermCounts * counts_, size_t pos_)
+		: counts(counts_), pos(pos_)
+	{
+	    skip_empty();
+	}
+
+      public:
+	const_iterator & operator++() {
+	    ++pos;
+	    skip_empty();
+	    return *this;
+	}
+
+	bool operator==(const const_iterator & other) const {
+	    return pos == other.pos;
+	}
+
+	bool operator!=(const const_iterator & other) const {
+	    return pos != other.pos;
+	}
+
+	/// Get the string (which isn't zero terminated).
+	const char * data() const {
+	    return counts->buf.data() + counts->slots[pos].offset;
+	}
+
+	/// Get the length of the string.
+	size_t size() const {
+	    return counts->slots[pos].len;
+	}
+
+	/// Get the hash of the string, as returned by TermCounts::hash().
+	uint64_t hash() const {
+	    return counts->slots[pos].hash;
+	}
+
+	/// Get the number of times the string has been seen.
+	Xapian::doccount count() const {
+	    return counts->slots[pos].count;
+	}
+    };
+
+    /// Get an iterator pointing to the first string seen.
+    const_iterator begin() const {
+	return const_iterator(this, 0);
+    }
+
+    /// Get an iterator pointing to the end of the strings seen.
+    const_iterator end() const {
+	return const_iterator(this, slots.size());
+    }
+
+    /** Get the most frequently seen strings, with their counts.
+     *
+     *  Returns at most limit items, most frequent first; strings with equal
+     *  counts are returned in lexicographic order.  Only the returned items
+     *  are sorted.
+     */
+    void get_most_frequent(
+	std::vector<std::pair<std::string, Xapian::doccount> > & result,
+	Xapian::doccount limit) const;
+};
+
+}
+
+#endif /* RESTPOSE_INCLUDED_TERMCOUNTS_H */
@@ -26,7 +26,9 @@
 #include "termoccurmatchspy.h"
 
 #include <algorithm>
-#include "utils/stringutils.h"
+#include <map>
+#include <string>
+#include <utility>
 #include <vector>
 
 using namespace RestPose;
@@ -56,7 +58,26 @@ BaseTermOccurMatchSpy::BaseTermOccurMatchSpy(const string & group_,
 void
 BaseTermOccurMatchSpy::add_stopword(const std::string & word)
 {
-    stopwords.insert(word);
+    if (!stopwords.contains(word)) {
+	stopwords.add(word);
+    }
+}
+
+void
+BaseTermOccurMatchSpy::get_suffix_termfreqs(
+	map<string, Xapian::doccount> & termfreqs) const
+{
+    Xapian::TermIterator ti = db->allterms_begin(prefix);
+    for (map<string, Xapian::doccount>::iterator l = termfreqs.begin();
+	 l != termfreqs.end(); ++l) {
+	ti.skip_to(prefix + l->first);
+	if (ti == db->allterms_end(prefix)) {
+	    break;
+	}
+	if (*ti == prefix + l->first) {
+	    l->second = ti.get_termfreq();
+	}
+    }
 }
 
 
@@ -66,39 +87,27 @@ TermOccurMatchSpy::operator()(const Xapian::Document &doc, Xapian::weight)
     if (docs_seen >= doc_limit) return;
     ++docs_seen;
     Xapian::TermIterator i = doc.termlist_begin();
-    if (i == doc.termlist_end()) {
+    Xapian::TermIterator end = doc.termlist_end();
+    if (i == end) {
 	return;
     }
     i.skip_to(prefix);
-    while (i != doc.termlist_end()) {
-	if (!string_startswith(*i, prefix)) {
+    bool check_stopwords = !stopwords.empty();
+    while (i != end) {
+	const string & term = *i;
+	if (term.compare(0, prefix.size(), prefix) != 0) {
 	    break;
 	}
-	string suffix((*i).substr(prefix.size()));
-	if (stopwords.find(suffix) == stopwords.end()) {
-	    ++counts[suffix];
+	const char * suffix = term.data() + prefix.size();
+	size_t suffix_len = term.size() - prefix.size();
+	if (!check_stopwords || !stopwords.contains(suffix, suffix_len)) {
+	    counts.add(suffix, suffix_len);
 	    ++terms_seen;
 	}
 	++i;
     }
 }
 
-struct StringAndFreq {
-    string str;
-    Xapian::doccount freq;
-
-    StringAndFreq(const string & str_, Xapian::doccount freq_)
-	    : str(str_), freq(freq_)
-    {}
-
-    /** Compare in reverse order, so that sorting puts these most-frequent
-     *  first.
-     */
-    bool operator<(const StringAndFreq & other) const {
-	return freq > other.freq;
-    }
-};
-
 void
 TermOccurMatchSpy::get_result(Json::Value & result) const
 {
@@ -110,109 +119,105 @@ TermOccurMatchSpy::get_result(Json::Value & result) const
     result["terms_seen"] = terms_seen;
     Json::Value & rcounts = result["counts"] = Json::arrayValue;
 
-    // FIXME - we should only sort the top items (which are wanted) here; see
-    // get_most_frequent_items in xapian-core/api/matchspy.cc for an approach
-    // which avoids sorting everything.
-
-    vector<StringAndFreq> sorted;
-    sorted.reserve(counts.size());
-    for (std::map<std::string, Xapian::doccount>::const_iterator
-	 i = counts.begin(); i != counts.end(); ++i) {
-	sorted.push_back(StringAndFreq(i->first, i->second));
-    }
-    sort(sorted.begin(), sorted.end());
-
-    Xapian::doccount j;
-    vector<StringAndFreq>::const_iterator k;
+    vector<pair<string, Xapian::doccount> > sorted;
+    counts.get_most_frequent(sorted, result_limit);
 
     // Get the termfreqs, if they're wanted.
-    // We want to get the termfreqs in sorted order, to try and reduce random
-    // seeking in the lookup.
     map<string, Xapian::doccount> termfreqs;
     if (get_termfreqs) {
-	for (j = 0, k = sorted.begin();
-	     j != result_limit && k != sorted.end();
-	     ++j, ++k) {
-	    termfreqs[k->str] = 0;
-	}
-	Xapian::TermIterator ti = db->allterms_begin();
-	for (map<string, Xapian::doccount>::iterator l = termfreqs.begin();
-	     l != termfreqs.end(); ++l) {
-	    ti.skip_to(prefix + l->first);
-	    if (ti == db->allterms_end() || !string_startswith(*ti, prefix)) {
-		break;
-	    }
-	    if (*ti == prefix + l->first) {
-		l->second = ti.get_termfreq();
-	    }
+	for (vector<pair<string, Xapian::doccount> >::const_iterator
+	     k = sorted.begin(); k != sorted.end(); ++k) {
+	    termfreqs[k->first] = 0;
 	}
+	get_suffix_termfreqs(termfreqs);
     }
 
-    for (j = 0, k = sorted.begin();
-	 j != result_limit && k != sorted.end();
-	 ++j, ++k) {
+    for (vector<pair<string, Xapian::doccount> >::const_iterator
+	 k = sorted.begin(); k != sorted.end(); ++k) {
 	Json::Value tmp(Json::arrayValue);
-	tmp.append(k->str);
-	tmp.append(k->freq);
+	tmp.append(k->first);
+	tmp.append(k->second);
 	if (get_termfreqs) {
-	    tmp.append(termfreqs[k->str]);
+	    tmp.append(termfreqs[k->first]);
 	}
 	rcounts.append(tmp);
     }
 }
 
+void
+TermCoOccurMatchSpy::start_approximating()
+{
+    sketch.init(max_memory, COOCCUR_SKETCH_DEPTH);
+    heavy.set_limit(min(Xapian::doccount(COOCCUR_MAX_HEAVY_HITTERS),
+			result_limit));
+
+    // Move the exact counts into the sketch, and keep the highest.  The
+    // counts are read straight from the table (rather than from a copy),
+    // which is then freed, so memory use stays within max_memory plus the
+    // sketch.
+    for (TermCounts::const_iterator i = counts.begin();
+	 i != counts.end(); ++i) {
+	sketch.add(i.hash(), i.count());
+    }
+    for (TermCounts::const_iterator i = counts.begin();
+	 i != counts.end(); ++i) {
+	heavy.update(string(i.data(), i.size()), sketch.estimate(i.hash()));
+    }
+    counts = TermCounts();
+}
+
 void
 TermCoOccurMatchSpy::operator()(const Xapian::Document &doc, Xapian::weight)
 {
     if (docs_seen >= doc_limit) return;
     ++docs_seen;
+    if (!sketch.initialised()) {
+	if (docs_seen > exact_doc_limit ||
+	    counts.memory_used() > max_memory) {
+	    start_approximating();
+	} else {
+	    exact_docs = docs_seen;
+	}
+    }
     Xapian::TermIterator i = doc.termlist_begin();
-    if (i == doc.termlist_end()) {
+    Xapian::TermIterator end = doc.termlist_end();
+    if (i == end) {
 	return;
     }
     vector<string> items;
     i.skip_to(prefix);
-    while (i != doc.termlist_end()) {
-	if (!string_startswith(*i, prefix)) {
+    bool check_stopwords = !stopwords.empty();
+    while (i != end) {
+	const string & term = *i;
+	if (term.compare(0, prefix.size(), prefix) != 0) {
 	    break;
 	}
-	string suffix((*i).substr(prefix.size()));
-	if (stopwords.find(suffix) == stopwords.end()) {
-	    items.push_back((*i).substr(prefix.size()));
+	const char * suffix = term.data() + prefix.size();
+	size_t suffix_len = term.size() - prefix.size();
+	if (!check_stopwords || !stopwords.contains(suffix, suffix_len)) {
+	    items.push_back(string(suffix, suffix_len));
 	    ++terms_seen;
 	}
 	++i;
     }
+    string key;
     for (vector<string>::const_iterator j = items.begin();
 	 j != items.end(); ++j) {
 	vector<string>::const_iterator k = j;
 	for (++k; k != items.end(); ++k) {
-	    ++counts[*j + string("\0", 1) + *k];
+	    key.assign(*j);
+	    key += '\0';
+	    key.append(*k);
+	    if (sketch.initialised()) {
+		heavy.update(key, sketch.add(TermCounts::hash(key.data(),
+							      key.size())));
+	    } else {
+		counts.add(key);
+	    }
 	}
     }
 }
 
-struct PairAndFreq {
-    string str1;
-    string str2;
-    Xapian::doccount freq;
-
-    PairAndFreq(const string & strs, Xapian::doccount freq_)
-	    : freq(freq_)
-    {
-	size_t zeropos = strs.find('\0');
-	str1 = strs.substr(0, zeropos);
-	str2 = strs.substr(zeropos + 1);
-    }
-
-    /** Compare in reverse order, so that sorting puts these most-frequent
-     *  first.
-     */
-    bool operator<(const PairAndFreq & other) const {
-	return freq > other.freq;
-    }
-};
-
 void
 TermCoOccurMatchSpy::get_result(Json::Value & result) const
 {
@@ -224,55 +229,46 @@ TermCoOccurMatchSpy::get_result(Json::Value & result) const
     result["terms_seen"] = terms_seen;
     Json::Value & rcounts = result["counts"] = Json::arrayValue;
 
-    // FIXME - we should only sort the top items (which are wanted) here; see
-    // get_most_frequent_items in xapian-core/api/matchspy.cc for an approach
-    // which avoids sorting everything.
-
-    vector<PairAndFreq> sorted;
-    sorted.reserve(counts.size());
-    for (std::map<std::string, Xapian::doccount>::const_iterator
-	 i = counts.begin(); i != counts.end(); ++i) {
-	sorted.push_back(PairAndFreq(i->first, i->second));
+    vector<pair<string, Xapian::doccount> > sorted;
+    if (sketch.initialised()) {
+	result["approximate"] = true;
+	result["exact_docs"] = exact_docs;
+	result["error_bound"] = sketch.error_bound();
+	result["error_probability"] = sketch.error_probability();
+	heavy.get_most_frequent(sorted, result_limit);
+    } else {
+	counts.get_most_frequent(sorted, result_limit);
     }
-    sort(sorted.begin(), sorted.end());
 
-    Xapian::doccount j;
-    vector<PairAndFreq>::const_iterator k;
+    // Split the keys back into pairs of terms.
+    vector<pair<string, string> > pairs;
+    pairs.reserve(sorted.size());
+    for (vector<pair<string, Xapian::doccount> >::const_iterator
+	 k = sorted.begin(); k != sorted.end(); ++k) {
+	size_t zeropos = k->first.find('\0');
+	pairs.push_back(make_pair(k->first.substr(0, zeropos),
+				  k->first.substr(zeropos + 1)));
+    }
 
     // Get the termfreqs, if they're wanted.
-    // We want to get the termfreqs in sorted order, to try and reduce random
-    // seeking in the lookup.
     map<string, Xapian::doccount> termfreqs;
     if (get_termfreqs) {
-	for (j = 0, k = sorted.begin();
-	     j != result_limit && k != sorted.end();
-	     ++j, ++k) {
-	    termfreqs[k->str1] = 0;
-	    termfreqs[k->str2] = 0;
-	}
-	Xapian::TermIterator ti = db->allterms_begin();
-	for (map<string, Xapian::doccount>::iterator l = termfreqs.begin();
-	     l != termfreqs.end(); ++l) {
-	    ti.skip_to(prefix + l->first);
-	    if (ti == db->allterms_end() || !string_startswith(*ti, prefix)) {
-		break;
-	    }
-	    if (*ti == prefix + l->first) {
-		l->second = ti.get_termfreq();
-	    }
+	for (vector<pair<string, string> >::const_iterator
+	     k = pairs.begin(); k != pairs.end(); ++k) {
+	    termfreqs[k->first] = 0;
+	    termfreqs[k->second] = 0;
 	}
+	get_suffix_termfreqs(termfreqs);
     }
 
-    for (j = 0, k = sorted.begin();
-	 j != result_limit && k != sorted.end();
-	 ++j, ++k) {
+    for (size_t k = 0; k != sorted.size(); ++k) {
 	Json::Value tmp(Json::arrayValue);
-	tmp.append(k->str1);
-	tmp.append(k->str2);
-	tmp.append(k->freq);
+	tmp.append(pairs[k].first);
+	tmp.append(pairs[k].second);
+	tmp.append(sorted[k].second);
 	if (get_termfreqs) {
-	    tmp.append(termfreqs[k->str1]);
-	    tmp.append(termfreqs[k->str2]);
+	    tmp.append(termfreqs[pairs[k].first]);
+	    tmp.append(termfreqs[pairs[k].second]);
 	}
 	rcounts.append(tmp);
     }
@@ -25,10 +25,11 @@
 #ifndef RESTPOSE_INCLUDED_TERMOCCURMATCHSPY_H
 #define RESTPOSE_INCLUDED_TERMOCCURMATCHSPY_H
 
+#include "countminsketch.h"
 #include <json/value.h>
 #include <map>
-#include <set>
 #include <string>
+#include "termcounts.h"
 #include <xapian.h>
 
 namespace RestPose {
@@ -65,11 +66,11 @@ class BaseTermOccurMatchSpy : public Xapian::MatchSpy {
 
     /** Term suffixes to ignore.
      */
-    std::set<std::string> stopwords;
+    TermCounts stopwords;
 
     /** Count of number of times each term suffix has been seen;
      */
-    std::map<std::string, Xapian::doccount> counts;
+    TermCounts counts;
 
     /** True iff number of documents each term is contained in should be
      *  returned.
@@ -80,6 +81,14 @@ class BaseTermOccurMatchSpy : public Xapian::MatchSpy {
      */
     const Xapian::Database * db;
 
+    /** Look up the termfreqs of a set of term suffixes.
+     *
+     *  The lookups are made in sorted order, in a single pass over the
+     *  terms with the prefix, to reduce random seeking.
+     */
+    void get_suffix_termfreqs(
+	std::map<std::string, Xapian::doccount> & termfreqs) const;
+
   public:
     BaseTermOccurMatchSpy(const std::string & group_,
 			  const std::string & prefix_,
@@ -112,7 +121,45 @@ class TermOccurMatchSpy : public BaseTermOccurMatchSpy {
     void get_result(Json::Value & result) const;
 };
 
+/** Number of rows used in the sketch for approximate co-occurrence counts.
+ */
+#define COOCCUR_SKETCH_DEPTH 4
+
+/** Maximum number of pairs tracked when counting co-occurrences
+ *  approximately.
+ */
+#define COOCCUR_MAX_HEAVY_HITTERS 10000
+
 class TermCoOccurMatchSpy : public BaseTermOccurMatchSpy {
+    /** Number of documents to count pairs in exactly, before switching to
+     *  approximate counts.
+     */
+    Xapian::doccount exact_doc_limit;
+
+    /** Memory allowed for counting pairs, in bytes.
+     *
+     *  Counting switches to approximate counts when the exact counts use
+     *  more than this, and the sketch used for approximate counts is given
+     *  this much memory.
+     */
+    size_t max_memory;
+
+    /** Number of documents in which pairs were counted exactly.
+     */
+    Xapian::doccount exact_docs;
+
+    /** Approximate counts for all pairs, once counting is approximate.
+     */
+    CountMinSketch sketch;
+
+    /** The pairs with the highest approximate counts.
+     */
+    HeavyHitters heavy;
+
+    /** Switch from exact to approximate counting.
+     */
+    void start_approximating();
+
   public:
     TermCoOccurMatchSpy(const std::string & group_,
 			const std::string & prefix_,
@@ -121,9 +168,27 @@ class TermCoOccurMatchSpy : public BaseTermOccurMatchSpy {
 			bool get_termfreqs_,
 			const Xapian::Database * db_)
 	    : BaseTermOccurMatchSpy(group_, prefix_, doc_limit_, result_limit_,
-				    get_termfreqs_, db_)
+				    get_termfreqs_, db_),
+	      exact_doc_limit(Xapian::doccount(-1)),
+	      max_memory(size_t(-1)),
+	      exact_docs(0)
     {}
 
+    /** Allow switching to approximate counts.
+     *
+     *  Pairs are counted exactly until more than exact_doc_limit_ documents
+     *  have been seen, or the counts use more than max_memory_ bytes.
+     *  After that, all counts are held in a count-min sketch using
+     *  max_memory_ bytes, and the pairs with the highest counts are
+     *  tracked.  The reported counts may then exceed the true counts, but
+     *  are never less than them.
+     */
+    void set_approximation(Xapian::doccount exact_doc_limit_,
+			   size_t max_memory_) {
+	exact_doc_limit = exact_doc_limit_;
+	max_memory = max_memory_;
+    }
+
     void operator()(const Xapian::Document &doc, Xapian::weight wt);
 
     void get_result(Json::Value & result) const;
@@ -63,6 +63,8 @@ Categoriser::add_target_profile(const std::string & label,
 				"already have a target with same label");
     }
     profiles.push_back(make_pair(label, profile));
+    hashed_profiles.push_back(HashedNGramProfile());
+    hashed_profiles.back().init_from_ngram(profile);
     labels.insert(label);
 }
 
@@ -70,15 +72,11 @@ void
 Categoriser::add_target_profile(const std::string & label,
 				const std::string & profile_text)
 {
-    if (labels.find(label) != labels.end()) {
-	throw InvalidValueError("Can't add target profile to categoriser; "
-				"already have a target with same label");
-    }
-
     NGramProfileBuilder builder(max_ngram_length);
     builder.add_text(profile_text);
-    profiles.push_back(std::make_pair(label, NGramProfile()));
-    builder.build(profiles.back().second, max_ngrams);
+    NGramProfile profile;
+    builder.build(profile, max_ngrams);
+    add_target_profile(label, profile);
 }
 
 void
@@ -133,25 +131,50 @@ Categoriser::from_json(const Json::Value & value)
     if (profiles_obj.isNull()) {
 	throw InvalidValueError("Missing profiles property in categoriser");
     }
+    profiles.clear();
+    hashed_profiles.clear();
+    labels.clear();
     for (Json::Value::const_iterator i = profiles_obj.begin();
 	 i != profiles_obj.end(); ++i) {
-	profiles.push_back(std::make_pair(i.memberName(), NGramProfile()));
-	profiles.back().second.from_json(*i);
+	NGramProfile profile;
+	profile.from_json(*i);
+	add_target_profile(i.memberName(), profile);
     }
 }
 
+/** Order target scores by score, and then by label.
+ */
+struct TargetScoreCmp {
+    const std::vector<std::pair<std::string, NGramProfile> > & profiles;
+
+    TargetScoreCmp(const std::vector<std::pair<std::string, NGramProfile> > & profiles_)
+	    : profiles(profiles_)
+    {}
+
+    bool operator()(const std::pair<unsigned int, size_t> & a,
+		    const std::pair<unsigned int, size_t> & b) const
+    {
+	if (a.first != b.first) return a.first < b.first;
+	return profiles[a.second].first < profiles[b.second].first;
+    }
+};
+
 void
-Categoriser::categorise(const SortedNGramProfile & profile,
+Categoriser::categorise(const std::vector<NGramHash> & ngrams,
+			unsigned int profile_max_ngrams,
 			std::vector<std::string> & results) const
 {
     results.clear();
-    std::vector<std::pair<unsigned int, std::string> > scores;
-    for (std::vector<std::pair<std::string, NGramProfile> >::const_iterator
-	 i = profiles.begin(); i != profiles.end(); ++i) {
-	scores.push_back(make_pair(profile.distance(i->second), i->first));
+    if (hashed_profiles.empty()) return;
+
+    // Scores are paired with the index of the target they're for.
+    std::vector<std::pair<unsigned int, size_t> > scores(hashed_profiles.size());
+    for (size_t i = 0; i != hashed_profiles.size(); ++i) {
+	scores[i].first = hashed_profiles[i].distance(ngrams,
+						      profile_max_ngrams);
+	scores[i].second = i;
     }
-    if (scores.empty()) return;
-    std::sort(scores.begin(), scores.end());
+    std::sort(scores.begin(), scores.end(), TargetScoreCmp(profiles));
 
     // Pick scores within threshold of top, and clear if that leaves too many.
     double max_allowed = double(scores.front().first) * accuracy_threshold;
@@ -166,21 +189,30 @@ Categoriser::categorise(const SortedNGramProfile & profile,
 	max_results = scores.size();
     }
 
-    results.push_back(scores[0].second);
+    results.push_back(profiles[scores[0].second].first);
     for (unsigned int j = 1; j < max_results; ++j) {
 	if (scores[j].first > max_allowed)
 	    break;
-	results.push_back(scores[j].second);
+	results.push_back(profiles[scores[j].second].first);
     }
 }
 
+void
+Categoriser::categorise(const SortedNGramProfile & profile,
+			std::vector<std::string> & results) const
+{
+    std::vector<NGramHash> ngrams;
+    profile.get_hashes(ngrams);
+    categorise(ngrams, profile.max_ngrams, results);
+}
+
 void
 Categoriser::categorise(const std::string & text,
 			std::vector<std::string> & results) const
 {
     NGramProfileBuilder builder(max_ngram_length);
     builder.add_text(text);
-    SortedNGramProfile profile;
-    builder.build(profile, max_ngrams);
-    return categorise(profile, results);
+    std::vector<NGramHash> ngrams;
+    builder.build_hashes(ngrams, max_ngrams);
+    categorise(ngrams, max_ngrams, results);
 }
@@ -41,6 +41,13 @@ namespace RestPose {
 	 */
 	std::vector<std::pair<std::string, NGramProfile> > profiles;
 
+	/** The profiles to test, in hashed form.
+	 *
+	 *  Parallel to `profiles`; these are what categorisation uses, and
+	 *  `profiles` is kept only for serialisation.
+	 */
+	std::vector<HashedNGramProfile> hashed_profiles;
+
 	/** The profile labels.
 	 */
 	std::set<std::string> labels;
@@ -96,6 +103,20 @@ namespace RestPose {
 	/// Unserialise the Categoriser from a JSON object.
 	void from_json(const Json::Value & value);
 
+	/** Categorise a profile, given as the hashes of its ngrams.
+	 *
+	 *  @param ngrams The hashes of the ngrams in the profile, in
+	 *  descending frequency order.
+	 *  @param profile_max_ngrams The maximum number of ngrams allowed for
+	 *  the profile.
+	 *
+	 *  Each target is scored independently, and the categoriser is not
+	 *  modified, so this may be called from several threads at once.
+	 */
+	void categorise(const std::vector<NGramHash> & ngrams,
+			unsigned int profile_max_ngrams,
+			std::vector<std::string> & results) const;
+
 	/** Categorise a sorted profile.
 	 *
 	 *  Returns the most likely matches in `results`, in decreasing order
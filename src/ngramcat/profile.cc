@@ -44,8 +44,10 @@
 #include "ngramcat/profile.h"
 
 #include <algorithm>
+#include "utils/hash.h"
 #include "utils/jsonutils.h"
 #include <limits.h>
+#include <string.h>
 #include <xapian/unicode.h>
 
 using namespace RestPose;
@@ -111,6 +113,12 @@ inline unsigned check_suffix(unsigned ch) {
     return 0;
 }
 
+NGramHash
+RestPose::hash_ngram(const char * data, size_t len)
+{
+    return hash_finish(fnv1a_hash(data, len));
+}
+
 void
 NGramProfile::init_from_sorted_ngram(const SortedNGramProfile & other)
 {
@@ -168,6 +176,15 @@ SortedNGramProfile::distance(const NGramProfile & other) const
     return count;
 }
 
+void
+SortedNGramProfile::get_hashes(std::vector<NGramHash> & hashes) const
+{
+    hashes.resize(ngrams.size());
+    for (size_t i = 0; i != ngrams.size(); ++i) {
+	hashes[i] = hash_ngram(ngrams[i]);
+    }
+}
+
 void
 SortedNGramProfile::init_from_ngram(const NGramProfile & other)
 {
@@ -209,18 +226,202 @@ SortedNGramProfile::from_json(const Json::Value & value)
     max_ngrams = json_get_uint64_member(value, "max_ngrams", UINT_MAX);
 }
 
+const unsigned int HashedNGramProfile::NOT_FOUND(UINT_MAX);
+
+/** Number of ngrams looked up at a time when calculating distances.
+ */
+static const unsigned int DISTANCE_BLOCK = 64;
+
+void
+HashedNGramProfile::add(NGramHash hash, unsigned int position)
+{
+    size_t slot = size_t(hash) & mask;
+    while (slots[slot].hash != 0 && slots[slot].hash != hash) {
+	slot = (slot + 1) & mask;
+    }
+    slots[slot].hash = hash;
+    slots[slot].position = position;
+}
+
+void
+HashedNGramProfile::init_from_sorted_ngram(const SortedNGramProfile & other)
+{
+    max_ngrams = other.max_ngrams;
+
+    // Size the table to a power of two at least twice the number of ngrams,
+    // so that there is always an empty slot to end a probe.
+    size_t size = 2;
+    while (size < other.ngrams.size() * 2) {
+	size *= 2;
+    }
+    Slot empty = { 0, 0 };
+    slots.assign(size, empty);
+    mask = size - 1;
+
+    for (size_t i = 0; i != other.ngrams.size(); ++i) {
+	add(hash_ngram(other.ngrams[i]), i);
+    }
+}
+
+void
+HashedNGramProfile::init_from_ngram(const NGramProfile & other)
+{
+    SortedNGramProfile sorted;
+    sorted.init_from_ngram(other);
+    init_from_sorted_ngram(sorted);
+}
+
+unsigned int
+HashedNGramProfile::distance(const std::vector<NGramHash> & ngrams,
+			     unsigned int sample_max_ngrams) const
+{
+    unsigned int ngram_count = std::min(sample_max_ngrams, max_ngrams);
+    unsigned int count = 0;
+    unsigned int ngrams_size = ngrams.size();
+
+    // If we're short on ngrams, all the missing ones incur the maximum score.
+    if (ngrams_size < ngram_count) {
+	count += (ngram_count - ngrams_size) * ngram_count;
+    }
+
+    // Look the ngrams up a block at a time, and then sum the differences in
+    // position for the block in a separate loop.  The summing loop has no
+    // branches, so the compiler can vectorise it.
+    unsigned int len = std::min(ngrams_size, ngram_count);
+    unsigned int found[DISTANCE_BLOCK];
+    for (unsigned int start = 0; start < len; start += DISTANCE_BLOCK) {
+	unsigned int block_len = std::min(len - start, DISTANCE_BLOCK);
+	for (unsigned int i = 0; i != block_len; ++i) {
+	    found[i] = find(ngrams[start + i]);
+	}
+	for (unsigned int i = 0; i != block_len; ++i) {
+	    unsigned int pos = found[i];
+	    unsigned int rank = start + i;
+	    unsigned int diff = (pos > rank) ? pos - rank : rank - pos;
+	    count += (pos == NOT_FOUND) ? ngram_count : diff;
+	}
+    }
+
+    return count;
+}
+
+/** Initial number of entries in a builder's hash table.
+ */
+static const size_t INITIAL_TABLE_SIZE = 256;
+
+NGramProfileBuilder::NGramProfileBuilder(unsigned int max_ngram_length_)
+	: max_ngram_length(max_ngram_length_)
+{
+    Entry empty;
+    empty.hash = 0;
+    empty.count = 0;
+    empty.len = 0;
+    table.assign(INITIAL_TABLE_SIZE, empty);
+}
+
+void
+NGramProfileBuilder::clear()
+{
+    for (std::vector<size_t>::const_iterator i = used.begin();
+	 i != used.end(); ++i) {
+	table[*i].hash = 0;
+    }
+    used.clear();
+    long_keys.clear();
+}
+
+void
+NGramProfileBuilder::grow()
+{
+    std::vector<Entry> old_table;
+    std::swap(table, old_table);
+    Entry empty;
+    empty.hash = 0;
+    empty.count = 0;
+    empty.len = 0;
+    table.assign(old_table.size() * 2, empty);
+    size_t mask = table.size() - 1;
+
+    for (std::vector<size_t>::iterator i = used.begin();
+	 i != used.end(); ++i) {
+	const Entry & entry = old_table[*i];
+	size_t slot = size_t(entry.hash) & mask;
+	while (table[slot].hash != 0) {
+	    slot = (slot + 1) & mask;
+	}
+	table[slot] = entry;
+	*i = slot;
+    }
+}
+
+void
+NGramProfileBuilder::add_ngram(const char * data, size_t len, NGramHash hash)
+{
+    size_t mask = table.size() - 1;
+    size_t slot = size_t(hash) & mask;
+    while (true) {
+	Entry & entry = table[slot];
+	if (entry.hash == 0) {
+	    break;
+	}
+	if (entry.hash == hash && entry.len == len &&
+	    memcmp(entry_key(entry), data, len) == 0) {
+	    ++entry.count;
+	    return;
+	}
+	slot = (slot + 1) & mask;
+    }
+
+    // Not found - add a new entry.
+    if ((used.size() + 1) * 2 > table.size()) {
+	grow();
+	mask = table.size() - 1;
+	slot = size_t(hash) & mask;
+	while (table[slot].hash != 0) {
+	    slot = (slot + 1) & mask;
+	}
+    }
+    Entry & entry = table[slot];
+    entry.hash = hash;
+    entry.count = 1;
+    entry.len = len;
+    if (len <= INLINE_KEY_LEN) {
+	memcpy(entry.key.inline_key, data, len);
+    } else {
+	entry.key.offset = long_keys.size();
+	long_keys.append(data, len);
+    }
+    used.push_back(slot);
+}
+
 void
-NGramProfileBuilder::add_ngrams(const std::string & term)
+NGramProfileBuilder::add_ngrams()
 {
-    Utf8Iterator pos(term);
-    for (unsigned int offset = 0; pos != Utf8Iterator(); ++offset, ++pos) {
-	Utf8Iterator subpos(pos);
-	std::string ngram;
-	for (unsigned int sublen = 0;
-	     sublen < max_ngram_length && subpos != Utf8Iterator();
-	     ++sublen, ++subpos) {
-	    Unicode::append_utf8(ngram, *subpos);
-	    ++(counts[ngram]);
+    // Find the offset of the start of each codepoint in the term.  The term
+    // was built by append_utf8(), so is valid UTF-8: every byte which isn't
+    // a continuation byte starts a codepoint.
+    char_offsets.clear();
+    const char * data = term.data();
+    size_t term_len = term.size();
+    for (size_t i = 0; i != term_len; ++i) {
+	if ((static_cast<unsigned char>(data[i]) & 0xc0) != 0x80) {
+	    char_offsets.push_back(i);
+	}
+    }
+    size_t char_count = char_offsets.size();
+    char_offsets.push_back(term_len);
+
+    // Add each ngram starting at each codepoint, extending the hash a
+    // codepoint at a time.
+    for (size_t start = 0; start != char_count; ++start) {
+	size_t end_char = std::min(char_count, start + max_ngram_length);
+	size_t begin = char_offsets[start];
+	uint64_t h = FNV1A_HASH_INIT;
+	for (size_t next = start + 1; next <= end_char; ++next) {
+	    h = fnv1a_hash_extend(h, data + char_offsets[next - 1],
+				  char_offsets[next] - char_offsets[next - 1]);
+	    add_ngram(data + begin, char_offsets[next] - begin,
+		      hash_finish(h));
 	}
     }
 }
@@ -240,7 +441,7 @@ NGramProfileBuilder::add_text(const char * start, size_t text_len)
 	    ++iter;
 	}
 
-	std::string term;
+	term.assign(1, '|');
 	while (true) {
 	    unsigned prevch;
 	    do {
@@ -286,10 +487,54 @@ NGramProfileBuilder::add_text(const char * start, size_t text_len)
 	}
 
 endofterm:
-	add_ngrams("|" + term + "|");
+	term += '|';
+	add_ngrams();
     }
 }
 
+/** Comparison of entries in the order they appear in a profile.
+ *
+ *  Entries with the highest count come first; entries with equal counts
+ *  are in lexicographic order of their ngrams.
+ */
+struct NGramProfileBuilder::EntryCmp {
+    const NGramProfileBuilder & builder;
+
+    EntryCmp(const NGramProfileBuilder & builder_)
+	    : builder(builder_)
+    {}
+
+    bool operator()(const Entry * a, const Entry * b) const
+    {
+	if (a->count != b->count) return a->count > b->count;
+	int cmp = memcmp(builder.entry_key(*a), builder.entry_key(*b),
+			 std::min(a->len, b->len));
+	if (cmp != 0) return cmp < 0;
+	return a->len < b->len;
+    }
+};
+
+void
+NGramProfileBuilder::top_entries(std::vector<const Entry *> & entries,
+				 unsigned int max_ngrams) const
+{
+    entries.clear();
+    entries.reserve(used.size());
+    for (std::vector<size_t>::const_iterator i = used.begin();
+	 i != used.end(); ++i) {
+	entries.push_back(&(table[*i]));
+    }
+
+    // Select the most frequent entries, and only sort those.
+    EntryCmp cmp(*this);
+    if (entries.size() > max_ngrams) {
+	std::nth_element(entries.begin(), entries.begin() + max_ngrams,
+			 entries.end(), cmp);
+	entries.resize(max_ngrams);
+    }
+    std::sort(entries.begin(), entries.end(), cmp);
+}
+
 void
 NGramProfileBuilder::build(NGramProfile & profile,
 			   unsigned int max_ngrams) const
@@ -299,32 +544,6 @@ NGramProfileBuilder::build(NGramProfile & profile,
     profile.init_from_sorted_ngram(sorted_profile);
 }
 
-struct NGramFreq {
-    std::string ngram;
-    unsigned int freq;
-
-    NGramFreq(const std::string & ngram_,
-	      unsigned int freq_)
-	    : ngram(ngram_), freq(freq_)
-    {}
-
-    NGramFreq(std::map<std::string, unsigned int>::const_iterator & iter)
-	    : ngram(iter->first), freq(iter->second)
-    {}
-
-    /** Comparison operator.
-     *
-     *  Sorts items with the highest frequency lowest, so that standard heap
-     *  operations can be used to get the highest frequency items.
-     */
-    int operator< (const NGramFreq & other)
-    {
-	if (freq > other.freq) return true;
-	if (freq < other.freq) return false;
-	return ngram < other.ngram;
-    }
-};
-
 void
 NGramProfileBuilder::build(SortedNGramProfile & profile,
 			   unsigned int max_ngrams) const
@@ -332,36 +551,23 @@ NGramProfileBuilder::build(SortedNGramProfile & profile,
     profile.max_ngrams = max_ngrams;
     profile.ngrams.clear();
 
-    std::vector<NGramFreq> items;
-    std::map<std::string, unsigned int>::const_iterator iter(counts.begin());
-
-    // Fill the items with ngrams, and make it a heap.
-    while (items.size() < max_ngrams && iter != counts.end()) {
-	items.push_back(iter);
-	++iter;
-    }
-    if (items.empty()) return;
-
-    make_heap(items.begin(), items.end());
-
-    // Add items in, keeping it a heap of fixed size.
-    unsigned int min_freq = items.front().freq;
-    while (iter != counts.end()) {
-	if (iter->second > min_freq) {
-	    items.push_back(iter);
-	    push_heap(items.begin(), items.end());
-	    pop_heap(items.begin(), items.end());
-	    items.pop_back();
-	    min_freq = items.front().freq;
-	}
-	++iter;
+    std::vector<const Entry *> entries;
+    top_entries(entries, max_ngrams);
+    profile.ngrams.reserve(entries.size());
+    for (std::vector<const Entry *>::const_iterator i = entries.begin();
+	 i != entries.end(); ++i) {
+	profile.ngrams.push_back(std::string(entry_key(**i), (*i)->len));
     }
+}
 
-    // Sort the heap into order and then initialise the profile from the sorted
-    // items.
-    sort_heap(items.begin(), items.end());
-    for (std::vector<NGramFreq>::const_iterator i = items.begin();
-	 i != items.end(); ++i) {
-	profile.ngrams.push_back(i->ngram);
+void
+NGramProfileBuilder::build_hashes(std::vector<NGramHash> & hashes,
+				  unsigned int max_ngrams) const
+{
+    std::vector<const Entry *> entries;
+    top_entries(entries, max_ngrams);
+    hashes.resize(entries.size());
+    for (size_t i = 0; i != entries.size(); ++i) {
+	hashes[i] = entries[i]->hash;
     }
 }
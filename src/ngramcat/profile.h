@@ -28,6 +28,7 @@
 #include "json/value.h"
 #include <string>
 #include <map>
+#include "utils/safe_inttypes.h"
 #include <vector>
 #include <xapian/unicode.h>
 
@@ -35,6 +36,26 @@ namespace RestPose {
 
     struct SortedNGramProfile;
 
+    /** A hash of an ngram.
+     *
+     *  Hashed profiles compare these rather than the ngram strings.  The
+     *  hash is 64 bits wide so that collisions between the few hundred
+     *  ngrams in a profile are vanishingly unlikely.
+     */
+    typedef uint64_t NGramHash;
+
+    /** Calculate the hash of an ngram.
+     *
+     *  Never returns 0, so that 0 can be used to mark empty slots.
+     */
+    NGramHash hash_ngram(const char * data, size_t len);
+
+    /** Calculate the hash of an ngram.
+     */
+    inline NGramHash hash_ngram(const std::string & ngram) {
+	return hash_ngram(ngram.data(), ngram.size());
+    }
+
     /** An ngram profile, for a piece of text.
      *
      *  This is the format used for a stored profile that each input is to
@@ -77,6 +98,10 @@ namespace RestPose {
 	/** Get the distance from this profile to another. */
 	unsigned int distance(const NGramProfile & other) const;
 
+	/** Get the hashes of the ngrams in this profile, in order.
+	 */
+	void get_hashes(std::vector<NGramHash> & hashes) const;
+
 	/** Initialise this profile from an ngram profile.
 	 */
 	void init_from_ngram(const NGramProfile & other);
@@ -90,26 +115,177 @@ namespace RestPose {
 	void from_json(const Json::Value & value);
     };
 
+    /** An ngram profile, with ngrams replaced by their hashes.
+     *
+     *  This is the form in which target profiles are held for categorising.
+     *  It is an open-addressed hash table from ngram hash to position,
+     *  stored in a single flat array which is at most half full, so a
+     *  lookup usually touches a single cache line.
+     */
+    class HashedNGramProfile {
+	struct Slot {
+	    NGramHash hash;
+	    unsigned int position;
+	};
+
+	/** Maximum number of ngrams allowed for the profile.
+	 */
+	unsigned int max_ngrams;
+
+	/** The hash table.  Empty slots have a hash of 0.
+	 */
+	std::vector<Slot> slots;
+
+	/** Mask to apply to a hash to get a slot number.
+	 */
+	size_t mask;
+
+	void add(NGramHash hash, unsigned int position);
+
+      public:
+	/** Position returned by find() for an ngram not in the profile.
+	 */
+	static const unsigned int NOT_FOUND;
+
+	HashedNGramProfile() : max_ngrams(0), mask(0) {}
+
+	/** Initialise this profile from a sorted ngram profile.
+	 */
+	void init_from_sorted_ngram(const SortedNGramProfile & other);
+
+	/** Initialise this profile from an ngram profile.
+	 */
+	void init_from_ngram(const NGramProfile & other);
+
+	/** Get the position of an ngram in the profile.
+	 *
+	 *  Returns NOT_FOUND if the ngram isn't in the profile.
+	 */
+	unsigned int find(NGramHash hash) const {
+	    size_t slot = size_t(hash) & mask;
+	    while (true) {
+		const Slot & item = slots[slot];
+		if (item.hash == hash) return item.position;
+		if (item.hash == 0) return NOT_FOUND;
+		slot = (slot + 1) & mask;
+	    }
+	}
+
+	/** Get the distance to this profile from a sample.
+	 *
+	 *  @param ngrams The hashes of the ngrams in the sample, in
+	 *  descending frequency order.
+	 *  @param sample_max_ngrams The maximum number of ngrams allowed for
+	 *  the sample.
+	 *
+	 *  Gives the same result as SortedNGramProfile::distance(), barring
+	 *  hash collisions.
+	 */
+	unsigned int distance(const std::vector<NGramHash> & ngrams,
+			      unsigned int sample_max_ngrams) const;
+    };
+
     /** Build a profile from pieces of text.
+     *
+     *  Ngrams are counted in an open-addressed hash table whose entries
+     *  hold short ngrams inline (longer ones go in a shared buffer), so
+     *  adding text doesn't allocate once the table and buffers have grown
+     *  to fit.  Each term is walked once, with the hash of each ngram
+     *  extended a codepoint at a time from the ngram before it.
      */
     class NGramProfileBuilder {
+	/** Length of ngram (in bytes) which can be stored in a table entry.
+	 */
+	static const unsigned int INLINE_KEY_LEN = 24;
+
+	struct Entry {
+	    /** Hash of the ngram, as returned by hash_ngram().
+	     *
+	     *  0 for an empty entry.
+	     */
+	    NGramHash hash;
+
+	    /** Number of occurrences of the ngram.
+	     */
+	    unsigned int count;
+
+	    /** Length of the ngram, in bytes.
+	     */
+	    unsigned int len;
+
+	    union {
+		/** The ngram, if len <= INLINE_KEY_LEN.
+		 */
+		char inline_key[INLINE_KEY_LEN];
+
+		/** Offset of the ngram in long_keys, otherwise.
+		 */
+		size_t offset;
+	    } key;
+	};
+
+	/** Comparison of entries in the order they appear in a profile.
+	 */
+	struct EntryCmp;
+	friend struct EntryCmp;
 
 	unsigned int max_ngram_length;
 
-	std::map<std::string, unsigned int> counts;
+	/** The hash table of ngram counts.
+	 *
+	 *  Its size is a power of two, and it's kept at most half full.
+	 */
+	std::vector<Entry> table;
+
+	/** Indices of the entries in the table which are in use.
+	 */
+	std::vector<size_t> used;
 
-	void add_ngrams(const std::string & term);
+	/** Storage for ngrams too long to be held in an entry.
+	 */
+	std::string long_keys;
+
+	/** Buffer for the term currently being processed.
+	 */
+	std::string term;
+
+	/** Buffer for the offsets of the codepoints in the current term.
+	 */
+	std::vector<size_t> char_offsets;
+
+	/** Get a pointer to the ngram held in an entry.
+	 */
+	const char * entry_key(const Entry & entry) const {
+	    if (entry.len <= INLINE_KEY_LEN) {
+		return entry.key.inline_key;
+	    }
+	    return long_keys.data() + entry.key.offset;
+	}
+
+	/** Add an occurrence of an ngram.
+	 */
+	void add_ngram(const char * data, size_t len, NGramHash hash);
+
+	/** Double the size of the hash table.
+	 */
+	void grow();
+
+	/** Add the ngrams from the term held in `term`.
+	 */
+	void add_ngrams();
+
+	/** Get the entries for the most frequent ngrams, in the order they
+	 *  belong in a profile.
+	 */
+	void top_entries(std::vector<const Entry *> & entries,
+			 unsigned int max_ngrams) const;
 
       public:
-	NGramProfileBuilder(unsigned int max_ngram_length_)
-		: max_ngram_length(max_ngram_length_)
-	{}
+	NGramProfileBuilder(unsigned int max_ngram_length_);
 
 	/** Clear any text previously added to the profile.
 	 */
-	void clear() {
-	    counts.clear();
-	}
+	void clear();
 
 	/** Add a piece of text to the profile.
 	 */
@@ -133,6 +309,14 @@ namespace RestPose {
 	void build(SortedNGramProfile & profile,
 		   unsigned int max_ngrams) const;
 
+	/** Get the hashes of the ngrams which would be in a profile built
+	 *  from the text previously added to this builder.
+	 *
+	 *  This is equivalent to building a SortedNGramProfile and calling
+	 *  get_hashes() on it, but doesn't need to copy the ngrams.
+	 */
+	void build_hashes(std::vector<NGramHash> & hashes,
+			  unsigned int max_ngrams) const;
     };
 
 };
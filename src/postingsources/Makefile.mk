@@ -1,9 +1,13 @@
 noinst_LIBRARIES += libpostingsources.a
 
 noinst_HEADERS += \
+ src/postingsources/geocells.h \
+ src/postingsources/geonearest_source.h \
  src/postingsources/multivalue_keymaker.h \
  src/postingsources/multivaluerange_source.h
 
 libpostingsources_a_SOURCES = \
+ src/postingsources/geocells.cc \
+ src/postingsources/geonearest_source.cc \
  src/postingsources/multivalue_keymaker.cc \
  src/postingsources/multivaluerange_source.cc
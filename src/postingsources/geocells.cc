@@ -0,0 +1,182 @@
+/** @file geocells.cc
+ * @brief Hierarchical cells for indexing geospatial coordinates
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "geocells.h"
+
+#include <cmath>
+
+using namespace RestPose;
+using namespace std;
+
+/// The maximum number of cells to use to cover a circle.
+#define GEO_MAX_COVER_CELLS 32
+
+/// A small margin, in degrees, added around covers to allow for rounding.
+#define GEO_COVER_MARGIN 1e-7
+
+/// The characters used in geohashes.
+static const char geohash_chars[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+const unsigned int RestPose::geo_cell_lengths[] = { 2, 3, 4, 5, 6, 7 };
+
+const unsigned int RestPose::geo_cell_level_count =
+	sizeof(geo_cell_lengths) / sizeof(geo_cell_lengths[0]);
+
+GeoCellLevel::GeoCellLevel(unsigned int length_)
+	: length(length_),
+	  lon_bits((length_ * 5 + 1) / 2),
+	  lat_bits(length_ * 5 / 2)
+{
+}
+
+int64_t
+GeoCellLevel::column(double longitude) const
+{
+    return int64_t(floor((longitude + 180.0) / cell_width()));
+}
+
+int64_t
+GeoCellLevel::row(double latitude) const
+{
+    int64_t result = int64_t(floor((latitude + 90.0) / cell_height()));
+    if (result < 0) {
+	return 0;
+    }
+    if (uint64_t(result) >= rows()) {
+	return rows() - 1;
+    }
+    return result;
+}
+
+string
+GeoCellLevel::cell_name(int64_t col, int64_t row) const
+{
+    int64_t cols = columns();
+    col %= cols;
+    if (col < 0) {
+	col += cols;
+    }
+
+    // Interleave the bits, starting with the most significant bit of the
+    // column.
+    string result;
+    unsigned int lon_bit = lon_bits;
+    unsigned int lat_bit = lat_bits;
+    unsigned int ch = 0;
+    for (unsigned int i = 0; i != length * 5; ++i) {
+	ch <<= 1;
+	if (i % 2 == 0) {
+	    ch |= (col >> --lon_bit) & 1;
+	} else {
+	    ch |= (row >> --lat_bit) & 1;
+	}
+	if (i % 5 == 4) {
+	    result += geohash_chars[ch];
+	    ch = 0;
+	}
+    }
+    return result;
+}
+
+/** Get a longitude in the range -180 to 180.
+ */
+static double
+normalise_longitude(double longitude)
+{
+    longitude = fmod(longitude, 360.0);
+    if (longitude >= 180.0) {
+	longitude -= 360.0;
+    } else if (longitude < -180.0) {
+	longitude += 360.0;
+    }
+    return longitude;
+}
+
+void
+RestPose::geo_index_terms(const string & prefix,
+			  const Xapian::LatLongCoord & coord,
+			  vector<string> & terms)
+{
+    double longitude = normalise_longitude(coord.longitude);
+    for (unsigned int i = 0; i != geo_cell_level_count; ++i) {
+	GeoCellLevel level(geo_cell_lengths[i]);
+	terms.push_back(prefix + level.cell_name(level.column(longitude),
+						 level.row(coord.latitude)));
+    }
+}
+
+bool
+RestPose::geo_cover_terms(const string & prefix,
+			  const Xapian::LatLongCoord & center,
+			  double radius,
+			  vector<string> & terms)
+{
+    // The angular radius, and the bounding box of the circle.
+    double delta = radius / GEO_EARTH_RADIUS;
+    if (delta >= M_PI) {
+	return false;
+    }
+    double delta_deg = delta * 180.0 / M_PI + GEO_COVER_MARGIN;
+    double south = center.latitude - delta_deg;
+    double north = center.latitude + delta_deg;
+    double longitude = normalise_longitude(center.longitude);
+    bool all_longitudes = (south <= -90.0 || north >= 90.0);
+    double half_width = 0;
+    if (!all_longitudes) {
+	double s = sin(delta) / cos(center.latitude * M_PI / 180.0);
+	if (s >= 1.0) {
+	    all_longitudes = true;
+	} else {
+	    half_width = asin(s) * 180.0 / M_PI + GEO_COVER_MARGIN;
+	}
+    }
+
+    // Use the finest level at which few enough cells are needed.
+    for (unsigned int i = geo_cell_level_count; i != 0; --i) {
+	GeoCellLevel level(geo_cell_lengths[i - 1]);
+	int64_t row_begin = level.row(south);
+	int64_t row_end = level.row(north) + 1;
+	int64_t col_begin = 0;
+	int64_t col_end = level.columns();
+	if (!all_longitudes) {
+	    col_begin = level.column(longitude - half_width);
+	    col_end = level.column(longitude + half_width) + 1;
+	    if (col_end - col_begin > int64_t(level.columns())) {
+		col_end = col_begin + level.columns();
+	    }
+	}
+	if ((row_end - row_begin) * (col_end - col_begin) >
+	    GEO_MAX_COVER_CELLS) {
+	    continue;
+	}
+	for (int64_t row = row_begin; row != row_end; ++row) {
+	    for (int64_t col = col_begin; col != col_end; ++col) {
+		terms.push_back(prefix + level.cell_name(col, row));
+	    }
+	}
+	return true;
+    }
+    return false;
+}
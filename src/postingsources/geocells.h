@@ -0,0 +1,134 @@
+/** @file geocells.h
+ * @brief Hierarchical cells for indexing geospatial coordinates
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef RESTPOSE_INCLUDED_GEOCELLS_H
+#define RESTPOSE_INCLUDED_GEOCELLS_H
+
+#include <string>
+#include "utils/safe_inttypes.h"
+#include <vector>
+#include "xapian/geospatial.h"
+
+/** The radius of the Earth used for calculating cell covers, in metres.
+ *
+ *  This is the radius used by Xapian::GreatCircleMetric by default.
+ */
+#define GEO_EARTH_RADIUS 6372797.6
+
+namespace RestPose {
+
+    /** A level of the hierarchy of geospatial cells.
+     *
+     *  Cells are the rectangles (in longitude and latitude) named by geohash
+     *  strings of a given length: each character of a geohash holds 5 bits,
+     *  alternately refining the longitude and latitude.  Cells at a level
+     *  are numbered by their column (longitude index, from -180 degrees) and
+     *  row (latitude index, from -90 degrees).
+     */
+    class GeoCellLevel {
+	/// The length of geohashes at this level.
+	unsigned int length;
+
+	/// The number of bits of longitude in the geohashes.
+	unsigned int lon_bits;
+
+	/// The number of bits of latitude in the geohashes.
+	unsigned int lat_bits;
+
+      public:
+	GeoCellLevel(unsigned int length_);
+
+	/// The number of columns of cells.
+	uint64_t columns() const {
+	    return uint64_t(1) << lon_bits;
+	}
+
+	/// The number of rows of cells.
+	uint64_t rows() const {
+	    return uint64_t(1) << lat_bits;
+	}
+
+	/// The width of a cell, in degrees of longitude.
+	double cell_width() const {
+	    return 360.0 / columns();
+	}
+
+	/// The height of a cell, in degrees of latitude.
+	double cell_height() const {
+	    return 180.0 / rows();
+	}
+
+	/** Get the column holding a longitude.
+	 *
+	 *  The longitude may be outside the range -180 to 180, in which case
+	 *  the result may be negative, or may be greater than columns().
+	 */
+	int64_t column(double longitude) const;
+
+	/// Get the row holding a latitude.
+	int64_t row(double latitude) const;
+
+	/** Get the geohash of a cell.
+	 *
+	 *  The column will be wrapped into range; the row must be in range.
+	 */
+	std::string cell_name(int64_t column, int64_t row) const;
+    };
+
+    /// The lengths of the geohashes of the cells indexed, coarsest first.
+    extern const unsigned int geo_cell_lengths[];
+
+    /// The number of levels of cells indexed.
+    extern const unsigned int geo_cell_level_count;
+
+    /** Get the terms to index a coordinate with.
+     *
+     *  One term is produced for the cell holding the coordinate at each
+     *  level.
+     */
+    void geo_index_terms(const std::string & prefix,
+			 const Xapian::LatLongCoord & coord,
+			 std::vector<std::string> & terms);
+
+    /** Get terms for a set of cells covering a circle.
+     *
+     *  Uses the finest level at which the circle is covered by at most a
+     *  small number of cells.
+     *
+     *  Returns false (and doesn't return any terms) if the circle is too
+     *  large to be covered usefully.
+     *
+     *  @param prefix The prefix of the terms.
+     *  @param center The center of the circle.
+     *  @param radius The radius of the circle, in metres.
+     *  @param terms A vector to append the terms to.
+     */
+    bool geo_cover_terms(const std::string & prefix,
+			 const Xapian::LatLongCoord & center,
+			 double radius,
+			 std::vector<std::string> & terms);
+}
+
+#endif /* RESTPOSE_INCLUDED_GEOCELLS_H */
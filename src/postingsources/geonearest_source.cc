@@ -0,0 +1,314 @@
+/** @file geonearest_source.cc
+ * @brief PostingSource returning the documents nearest to a point
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "geonearest_source.h"
+
+#include <algorithm>
+#include <cmath>
+#include "geocells.h"
+#include <limits>
+#include <set>
+#include "serialise.h"
+#include "str.h"
+#include "utils/stringutils.h"
+
+using namespace RestPose;
+using namespace std;
+
+/// The number of rings of cells to search at each level.
+#define GEO_NEAREST_RINGS 2
+
+/** Get a lower bound on the distance from a point to anywhere outside a
+ *  block of cells containing it.
+ */
+static double
+block_bound(const GeoCellLevel & level,
+	    double latitude, double longitude,
+	    int64_t col_begin, int64_t col_end,
+	    int64_t row_begin, int64_t row_end)
+{
+    double bound = numeric_limits<double>::infinity();
+    double north = row_end * level.cell_height() - 90.0;
+    double south = row_begin * level.cell_height() - 90.0;
+    if (north < 90.0) {
+	bound = min(bound, (north - latitude) * M_PI / 180.0);
+    }
+    if (south > -90.0) {
+	bound = min(bound, (latitude - south) * M_PI / 180.0);
+    }
+    if (col_end - col_begin < int64_t(level.columns())) {
+	// Distance to the great circles holding the east and west edges.
+	double west = col_begin * level.cell_width() - 180.0;
+	double east = col_end * level.cell_width() - 180.0;
+	double coslat = cos(latitude * M_PI / 180.0);
+	double dlon = min(longitude - west, east - longitude) * M_PI / 180.0;
+	bound = min(bound, asin(min(1.0, sin(dlon) * coslat)));
+    }
+    return bound * GEO_EARTH_RADIUS;
+}
+
+/** Get the k-th smallest distance in a list of distances.
+ */
+static double
+kth_distance(vector<pair<double, Xapian::docid> > & distances,
+	     Xapian::doccount k)
+{
+    nth_element(distances.begin(), distances.begin() + (k - 1),
+		distances.end());
+    return distances[k - 1].first;
+}
+
+GeoNearestSource::GeoNearestSource(Xapian::valueno slot_,
+				   const string & prefix_,
+				   const Xapian::LatLongCoord & center_,
+				   Xapian::doccount count_,
+				   double k1_,
+				   double k2_)
+	: slot(slot_),
+	  prefix(prefix_),
+	  center(center_),
+	  count(count_),
+	  k1(k1_),
+	  k2(k2_),
+	  started(false)
+{
+    set_maxweight(k1 * pow(k1, -k2));
+}
+
+void
+GeoNearestSource::add_distance(Xapian::docid did,
+			       const string & coords,
+			       const Xapian::LatLongCoords & centers,
+			       vector<pair<double, Xapian::docid> > & distances) const
+{
+    if (coords.empty()) {
+	return;
+    }
+    Xapian::GreatCircleMetric metric;
+    distances.push_back(make_pair(metric(centers, coords), did));
+}
+
+void
+GeoNearestSource::find_nearest()
+{
+    results.clear();
+    if (count == 0) {
+	return;
+    }
+
+    Xapian::LatLongCoords centers(center);
+    double longitude = fmod(center.longitude, 360.0);
+    if (longitude >= 180.0) {
+	longitude -= 360.0;
+    } else if (longitude < -180.0) {
+	longitude += 360.0;
+    }
+
+    vector<pair<double, Xapian::docid> > distances;
+    set<Xapian::docid> seen;
+    bool done = false;
+
+    // Search rings of cells around the center, starting at the finest level.
+    for (unsigned int i = geo_cell_level_count; i != 0 && !done; --i) {
+	GeoCellLevel level(geo_cell_lengths[i - 1]);
+	int64_t col0 = level.column(longitude);
+	int64_t row0 = level.row(center.latitude);
+	set<string> visited;
+	for (int64_t r = 0; r <= GEO_NEAREST_RINGS; ++r) {
+	    for (int64_t row = row0 - r; row <= row0 + r; ++row) {
+		if (row < 0 || uint64_t(row) >= level.rows()) {
+		    continue;
+		}
+		for (int64_t col = col0 - r; col <= col0 + r; ++col) {
+		    if (row != row0 - r && row != row0 + r &&
+			col != col0 - r && col != col0 + r) {
+			// Not on the ring; already searched.
+			continue;
+		    }
+		    string term(prefix + level.cell_name(col, row));
+		    if (!visited.insert(term).second) {
+			continue;
+		    }
+		    for (Xapian::PostingIterator p = db.postlist_begin(term);
+			 p != db.postlist_end(term); ++p) {
+			if (seen.insert(*p).second) {
+			    add_distance(*p, db.get_document(*p).get_value(slot),
+					 centers, distances);
+			}
+		    }
+		}
+	    }
+
+	    if (distances.size() >= count &&
+		kth_distance(distances, count) <=
+		block_bound(level, center.latitude, longitude,
+			    col0 - r, col0 + r + 1, row0 - r, row0 + r + 1)) {
+		done = true;
+		break;
+	    }
+	}
+    }
+
+    if (!done) {
+	// The cells didn't find enough documents; check every document.
+	for (Xapian::ValueIterator v = db.valuestream_begin(slot);
+	     v != db.valuestream_end(slot); ++v) {
+	    if (seen.find(v.get_docid()) == seen.end()) {
+		add_distance(v.get_docid(), *v, centers, distances);
+	    }
+	}
+    }
+
+    // Keep the nearest documents, breaking ties by docid.
+    if (distances.size() > count) {
+	partial_sort(distances.begin(), distances.begin() + count,
+		     distances.end());
+	distances.resize(count);
+    }
+    for (vector<pair<double, Xapian::docid> >::const_iterator
+	 j = distances.begin(); j != distances.end(); ++j) {
+	results.push_back(make_pair(j->second, j->first));
+    }
+    sort(results.begin(), results.end());
+}
+
+Xapian::weight
+GeoNearestSource::get_weight() const
+{
+    return k1 * pow(pos->second + k1, -k2);
+}
+
+Xapian::docid
+GeoNearestSource::get_docid() const
+{
+    return pos->first;
+}
+
+void
+GeoNearestSource::next(Xapian::weight min_wt)
+{
+    if (!started) {
+	started = true;
+	pos = results.begin();
+    } else if (pos != results.end()) {
+	++pos;
+    }
+    while (pos != results.end() && get_weight() < min_wt) {
+	++pos;
+    }
+}
+
+void
+GeoNearestSource::skip_to(Xapian::docid did, Xapian::weight min_wt)
+{
+    if (!started) {
+	started = true;
+	pos = results.begin();
+    }
+    while (pos != results.end() &&
+	   (pos->first < did || get_weight() < min_wt)) {
+	++pos;
+    }
+}
+
+bool
+GeoNearestSource::check(Xapian::docid did, Xapian::weight min_wt)
+{
+    skip_to(did, min_wt);
+    return true;
+}
+
+bool
+GeoNearestSource::at_end() const
+{
+    return started && pos == results.end();
+}
+
+Xapian::PostingSource *
+GeoNearestSource::clone() const
+{
+    return new GeoNearestSource(slot, prefix, center, count, k1, k2);
+}
+
+string
+GeoNearestSource::name() const
+{
+    return "GeoNearestSource";
+}
+
+string
+GeoNearestSource::serialise() const
+{
+    string serialised_center(center.serialise());
+    return encode_length(slot) +
+	    encode_length(prefix.size()) + prefix +
+	    encode_length(serialised_center.size()) + serialised_center +
+	    encode_length(count) +
+	    encode_length(Xapian::sortable_serialise(k1).size()) +
+	    Xapian::sortable_serialise(k1) +
+	    Xapian::sortable_serialise(k2);
+}
+
+Xapian::PostingSource *
+GeoNearestSource::unserialise(const string &s) const
+{
+    const char * p = s.data();
+    const char * end = p + s.size();
+
+    Xapian::valueno new_slot = rsp_decode_length(&p, end, false);
+    size_t prefix_len = rsp_decode_length(&p, end, true);
+    string new_prefix(p, prefix_len);
+    p += prefix_len;
+    size_t center_len = rsp_decode_length(&p, end, true);
+    Xapian::LatLongCoord new_center;
+    new_center.unserialise(string(p, center_len));
+    p += center_len;
+    Xapian::doccount new_count = rsp_decode_length(&p, end, false);
+    size_t k1_len = rsp_decode_length(&p, end, true);
+    double new_k1 = Xapian::sortable_unserialise(string(p, k1_len));
+    p += k1_len;
+    double new_k2 = Xapian::sortable_unserialise(string(p, end - p));
+
+    return new GeoNearestSource(new_slot, new_prefix, new_center, new_count,
+				new_k1, new_k2);
+}
+
+void
+GeoNearestSource::init(const Xapian::Database & db_)
+{
+    db = db_;
+    started = false;
+    find_nearest();
+}
+
+string
+GeoNearestSource::get_description() const
+{
+    return string("GeoNearestSource(") +
+	    str(slot) + ", " +
+	    hexesc(prefix) + ", " +
+	    center.get_description() + ", " +
+	    str(count) + ")";
+}
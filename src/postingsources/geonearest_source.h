@@ -0,0 +1,113 @@
+/** @file geonearest_source.h
+ * @brief PostingSource returning the documents nearest to a point
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef RESTPOSE_INCLUDED_GEONEAREST_SOURCE_H
+#define RESTPOSE_INCLUDED_GEONEAREST_SOURCE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <xapian.h>
+#include "xapian/geospatial.h"
+
+namespace RestPose {
+
+    /** A posting source returning the documents nearest to a point.
+     *
+     *  Requires the coordinates to be stored in a slot, and also indexed as
+     *  cell terms with a given prefix (using geo_index_terms()).
+     *
+     *  On init, the cells around the point are searched in rings of
+     *  increasing size, moving to coarser levels of cells as the rings grow,
+     *  until the requested number of documents have been found which are
+     *  closer than any document outside the searched cells could be.  The
+     *  documents are weighted by distance in the same way as
+     *  Xapian::LatLongDistancePostingSource.
+     */
+    class GeoNearestSource : public Xapian::PostingSource {
+	Xapian::Database db;
+	Xapian::valueno slot;
+	std::string prefix;
+	Xapian::LatLongCoord center;
+	Xapian::doccount count;
+	double k1;
+	double k2;
+
+	/// The matching documents, and their distances, in docid order.
+	std::vector<std::pair<Xapian::docid, double> > results;
+
+	/// The current position in results.
+	std::vector<std::pair<Xapian::docid, double> >::const_iterator pos;
+
+	/// Flag, true once next() or skip_to() has been called.
+	bool started;
+
+	/** Calculate the distance of a document, and add it to distances.
+	 *
+	 *  Does nothing if the document has no coordinates.
+	 */
+	void add_distance(Xapian::docid did,
+			  const std::string & coords,
+			  const Xapian::LatLongCoords & centers,
+			  std::vector<std::pair<double, Xapian::docid> > & distances) const;
+
+	/** Find the nearest documents, and set results.
+	 */
+	void find_nearest();
+
+      public:
+	GeoNearestSource(Xapian::valueno slot_,
+			 const std::string & prefix_,
+			 const Xapian::LatLongCoord & center_,
+			 Xapian::doccount count_,
+			 double k1_ = 1000.0,
+			 double k2_ = 1.0);
+
+	Xapian::doccount get_termfreq_min() const {
+	    return results.size();
+	}
+	Xapian::doccount get_termfreq_est() const {
+	    return results.size();
+	}
+	Xapian::doccount get_termfreq_max() const {
+	    return results.size();
+	}
+	Xapian::weight get_weight() const;
+	Xapian::docid get_docid() const;
+	void next(Xapian::weight min_wt);
+	void skip_to(Xapian::docid did, Xapian::weight min_wt);
+	bool check(Xapian::docid did, Xapian::weight min_wt);
+	bool at_end() const;
+	Xapian::PostingSource * clone() const;
+	std::string name() const;
+	std::string serialise() const;
+	Xapian::PostingSource * unserialise(const std::string &s) const;
+	void init(const Xapian::Database & db);
+	std::string get_description() const;
+    };
+
+}
+
+#endif /* RESTPOSE_INCLUDED_GEONEAREST_SOURCE_H */
@@ -1,5 +1,5 @@
 /** @file multivalue_keymaker.cc
- * @brief KeyMaker for sorting by multivalued slots
+ * @brief KeyMakers for sorting by multivalued slots
  */
 /* Copyright (c) 2011 Richard Boulton
  *
@@ -95,3 +95,21 @@ MultiValueKeyMaker::operator()(const Xapian::Document & doc) const
     }
     return result;
 }
+
+/** Key used for documents with no sort key, when sorting in ascending order.
+ *
+ *  Longer than any sort key, and made of \xff bytes, so it sorts after them
+ *  all.
+ */
+#define MISSING_SORT_KEY string(16, '\xff')
+
+string
+SortSlotKeyMaker::operator()(const Xapian::Document & doc) const
+{
+    string result(doc.get_value(slot));
+    if (result.empty() && !reverse) {
+	// In reverse order, empty keys already sort to the end.
+	return MISSING_SORT_KEY;
+    }
+    return result;
+}
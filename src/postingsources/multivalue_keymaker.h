@@ -1,5 +1,5 @@
 /** @file multivalue_keymaker.h
- * @brief KeyMaker for sorting by multivalued slots
+ * @brief KeyMakers for sorting by multivalued slots
  */
 /* Copyright (c) 2011 Richard Boulton
  *
@@ -39,6 +39,23 @@ namespace RestPose {
 	std::string operator()(const Xapian::Document & doc) const;
     };
 
+    /** KeyMaker for sorting by a slot holding precomputed sort keys.
+     *
+     *  Sort slots hold a single fixed-width key for each document, so the
+     *  key can be used directly, with no decoding or escaping.  Documents
+     *  without a key are sorted to the end, as for MultiValueKeyMaker, so
+     *  the reverse flag given here must also be passed to the Enquire.
+     */
+    class SortSlotKeyMaker : public Xapian::KeyMaker {
+	Xapian::valueno slot;
+	bool reverse;
+      public:
+	SortSlotKeyMaker(Xapian::valueno slot_, bool reverse_)
+		: slot(slot_), reverse(reverse_)
+	{}
+	std::string operator()(const Xapian::Document & doc) const;
+    };
+
 }
 
 #endif /* RESTPOSE_INCLUDED_MULTIVALUE_KEYMAKER_H */
@@ -27,30 +27,146 @@
 #include "serialise.h"
 #include "str.h"
 #include "utils/stringutils.h"
+#include <algorithm>
 
 using namespace RestPose;
 using namespace std;
 
+const unsigned int MultiValueRangeSource::MAX_VALUE_LENGTH;
+
+/** The lengths of the value prefixes indexed for each level of precision.
+ *
+ *  The last level holds the whole (padded) value.
+ */
+static const unsigned int range_levels[] = { 2, 4, 6, 8,
+	MultiValueRangeSource::MAX_VALUE_LENGTH };
+
+/// The number of levels of precision.
+#define RANGE_LEVEL_COUNT (sizeof(range_levels) / sizeof(range_levels[0]))
+
+/// Characters used to mark the level of precision of a term.
+static const char range_level_chars[] = "2468c";
+
+/** Pad a value with zero bytes to MAX_VALUE_LENGTH.
+ *
+ *  As values don't end with a zero byte, this preserves their order.
+ */
+static string
+pad_value(const string & value)
+{
+    string result(value);
+    if (result.size() < MultiValueRangeSource::MAX_VALUE_LENGTH) {
+	result.append(MultiValueRangeSource::MAX_VALUE_LENGTH - result.size(),
+		      '\0');
+    }
+    return result;
+}
+
+/** Order posting iterators so that a heap has the lowest docid first.
+ */
+struct PostingIteratorGreater {
+    bool operator()(const Xapian::PostingIterator & a,
+		    const Xapian::PostingIterator & b) const {
+	return *a > *b;
+    }
+};
+
 MultiValueRangeSource::MultiValueRangeSource(Xapian::valueno slot_,
 					     Xapian::weight wt_,
 					     const string & start_val_,
-					     const string & end_val_)
+					     const string & end_val_,
+					     const string & prefix_)
 	: slot(slot_),
 	  wt(wt_),
 	  start_val(start_val_),
-	  end_val(end_val_)
+	  end_val(end_val_),
+	  prefix(prefix_)
 {
 }
 
+void
+MultiValueRangeSource::find_terms(unsigned int level,
+				  const string & node,
+				  const string & start,
+				  const string & end,
+				  vector<string> & terms) const
+{
+    unsigned int len = range_levels[level];
+    string level_prefix(prefix);
+    level_prefix += range_level_chars[level];
+
+    // The range of prefixes at this level to look at: those within the
+    // node, and overlapping the range.
+    string lo(start, 0, len);
+    string hi(end, 0, len);
+    if (!node.empty()) {
+	lo = max(lo, node + string(len - node.size(), '\0'));
+	hi = min(hi, node + string(len - node.size(), '\xff'));
+    }
+    if (lo > hi) {
+	return;
+    }
+
+    Xapian::TermIterator i = db.allterms_begin(level_prefix);
+    i.skip_to(level_prefix + lo);
+    for (; i != db.allterms_end(level_prefix); ++i) {
+	string value((*i).substr(level_prefix.size()));
+	if (value > hi) {
+	    break;
+	}
+	if (level + 1 == RANGE_LEVEL_COUNT) {
+	    terms.push_back(*i);
+	    continue;
+	}
+	unsigned int pad = MultiValueRangeSource::MAX_VALUE_LENGTH - len;
+	if (start <= value + string(pad, '\0') &&
+	    value + string(pad, '\xff') <= end) {
+	    // All values with this prefix are in the range.
+	    terms.push_back(*i);
+	} else {
+	    // Only some values are; only possible at the ends of the range.
+	    find_terms(level + 1, value, start, end, terms);
+	}
+    }
+}
+
+void
+MultiValueRangeSource::skip_postings(Xapian::docid did)
+{
+    while (!postings.empty() && *postings.front() < did) {
+	pop_heap(postings.begin(), postings.end(), PostingIteratorGreater());
+	Xapian::PostingIterator & p = postings.back();
+	p.skip_to(did);
+	if (p == Xapian::PostingIterator()) {
+	    postings.pop_back();
+	} else {
+	    push_heap(postings.begin(), postings.end(),
+		      PostingIteratorGreater());
+	}
+    }
+    current = postings.empty() ? 0 : *postings.front();
+}
+
 Xapian::docid
 MultiValueRangeSource::get_docid() const
 {
+    if (!prefix.empty()) {
+	return current;
+    }
     return it.get_docid();
 }
 
 void
 MultiValueRangeSource::next(Xapian::weight min_wt)
 {
+    if (!prefix.empty()) {
+	if (min_wt > wt) {
+	    postings.clear();
+	}
+	skip_postings(started ? current + 1 : 1);
+	started = true;
+	return;
+    }
     if (!started) {
 	it = db.valuestream_begin(slot);
 	started = true;
@@ -72,6 +188,16 @@ MultiValueRangeSource::next(Xapian::weight min_wt)
 void
 MultiValueRangeSource::skip_to(Xapian::docid did, Xapian::weight min_wt)
 {
+    if (!prefix.empty()) {
+	if (min_wt > wt) {
+	    postings.clear();
+	}
+	if (!started || did > current) {
+	    skip_postings(did);
+	}
+	started = true;
+	return;
+    }
     if (!started) {
 	it = db.valuestream_begin(slot);
 	started = true;
@@ -94,6 +220,10 @@ MultiValueRangeSource::skip_to(Xapian::docid did, Xapian::weight min_wt)
 bool
 MultiValueRangeSource::check(Xapian::docid did, Xapian::weight min_wt)
 {
+    if (!prefix.empty()) {
+	skip_to(did, min_wt);
+	return true;
+    }
     if (!started) {
 	it = db.valuestream_begin(slot);
 	started = true;
@@ -114,13 +244,16 @@ MultiValueRangeSource::check(Xapian::docid did, Xapian::weight min_wt)
 bool
 MultiValueRangeSource::at_end() const
 {
+    if (!prefix.empty()) {
+	return started && postings.empty();
+    }
     return started && it == db.valuestream_end(slot);
 }
 
 Xapian::PostingSource *
 MultiValueRangeSource::clone() const
 {
-    return new MultiValueRangeSource(slot, wt, start_val, end_val);
+    return new MultiValueRangeSource(slot, wt, start_val, end_val, prefix);
 }
 
 string
@@ -135,6 +268,7 @@ MultiValueRangeSource::serialise() const
     return encode_length(slot) +
 	    encode_length(start_val.size()) + start_val +
 	    encode_length(end_val.size()) + end_val +
+	    encode_length(prefix.size()) + prefix +
 	    Xapian::sortable_serialise(wt);
 }
 
@@ -151,12 +285,16 @@ MultiValueRangeSource::unserialise(const string &s) const
     size_t end_len = rsp_decode_length(&p, end, true);
     string new_end_val(p, end_len);
     p += end_len;
+    size_t prefix_len = rsp_decode_length(&p, end, true);
+    string new_prefix(p, prefix_len);
+    p += prefix_len;
     Xapian::weight new_wt = Xapian::sortable_unserialise(string(p, end - p));
     if (p != end) {
 	throw Xapian::NetworkError("Bad serialised MultiValueRangeSource");
     }
 
-    return new MultiValueRangeSource(new_slot, new_wt, new_start_val, new_end_val);
+    return new MultiValueRangeSource(new_slot, new_wt, new_start_val,
+				     new_end_val, new_prefix);
 }
 
 void
@@ -168,6 +306,30 @@ MultiValueRangeSource::init(const Xapian::Database & db_)
     termfreq_max = db.get_value_freq(slot);
     termfreq_min = 0;
 
+    if (!prefix.empty()) {
+	// Open the posting lists for the terms covering the range.  Each
+	// document may be in several of them, if it has several values.
+	postings.clear();
+	current = 0;
+	vector<string> terms;
+	if (start_val <= end_val) {
+	    find_terms(0, string(), pad_value(start_val), pad_value(end_val),
+		       terms);
+	}
+	Xapian::doccount total = 0;
+	for (vector<string>::const_iterator i = terms.begin();
+	     i != terms.end(); ++i) {
+	    Xapian::doccount termfreq = db.get_termfreq(*i);
+	    termfreq_min = max(termfreq_min, termfreq);
+	    total += termfreq;
+	    postings.push_back(db.postlist_begin(*i));
+	}
+	make_heap(postings.begin(), postings.end(), PostingIteratorGreater());
+	termfreq_max = min(termfreq_max, total);
+	termfreq_est = termfreq_max;
+	return;
+    }
+
     // Note - could improve estimate based on how much of the range of slot
     // values is covered by the range.
     termfreq_est = termfreq_max / 2.0;
@@ -180,7 +342,8 @@ MultiValueRangeSource::get_description() const
 	    str(slot) + ", " +
 	    str(wt) + ", " +
 	    hexesc(start_val) + ", " +
-	    hexesc(end_val) + ")";
+	    hexesc(end_val) +
+	    (prefix.empty() ? string() : ", " + hexesc(prefix)) + ")";
 }
 
 bool
@@ -198,3 +361,20 @@ MultiValueRangeSource::check_range(const std::string & value) const
     }
     return false;
 }
+
+void
+MultiValueRangeSource::get_index_terms(const string & prefix,
+				       const string & value,
+				       vector<string> & terms)
+{
+    if (value.size() > MAX_VALUE_LENGTH) {
+	return;
+    }
+    string padded(pad_value(value));
+    for (unsigned int level = 0; level != RANGE_LEVEL_COUNT; ++level) {
+	string term(prefix);
+	term += range_level_chars[level];
+	term.append(padded, 0, range_levels[level]);
+	terms.push_back(term);
+    }
+}
@@ -25,10 +25,20 @@
 #ifndef RESTPOSE_INCLUDED_MULTIVALUERANGE_SOURCE_H
 #define RESTPOSE_INCLUDED_MULTIVALUERANGE_SOURCE_H
 
+#include <string>
+#include <vector>
 #include <xapian.h>
 
 namespace RestPose {
 
+    /** A posting source returning documents with any value in a range.
+     *
+     *  Values are stored in a slot, encoded as a list of values with
+     *  lengths.  If a term prefix is supplied, the values must also have
+     *  been indexed as terms with that prefix (using get_index_terms()), and
+     *  the source reads the posting lists of the terms covering the range,
+     *  instead of checking the value of every document with the slot.
+     */
     class MultiValueRangeSource : public Xapian::PostingSource {
 	Xapian::Database db;
 	Xapian::valueno slot;
@@ -40,11 +50,44 @@ namespace RestPose {
 	Xapian::weight wt;
 	std::string start_val;
 	std::string end_val;
+
+	/** The prefix of the terms indexing the values.
+	 *
+	 *  Empty if the values aren't indexed by terms.
+	 */
+	std::string prefix;
+
+	/** Posting lists for the terms covering the range.
+	 *
+	 *  Kept as a heap, with the iterator at the lowest docid first.
+	 */
+	std::vector<Xapian::PostingIterator> postings;
+
+	/// The current docid, when using posting lists.
+	Xapian::docid current;
+
+	/** Find the terms covering the part of the range within a node.
+	 *
+	 *  @param level The index of the precision level to look at.
+	 *  @param node The padded value prefix of the node, at the previous
+	 *  level (empty for the root).
+	 *  @param start The padded start of the range.
+	 *  @param end The padded end of the range.
+	 */
+	void find_terms(unsigned int level,
+			const std::string & node,
+			const std::string & start,
+			const std::string & end,
+			std::vector<std::string> & terms) const;
+
+	/// Move to the next docid in the posting lists which is >= did.
+	void skip_postings(Xapian::docid did);
       public:
 	MultiValueRangeSource(Xapian::valueno slot_,
 			      Xapian::weight wt_,
 			      const std::string & start_val_,
-			      const std::string & end_val_);
+			      const std::string & end_val_,
+			      const std::string & prefix_ = std::string());
 
 	Xapian::doccount get_termfreq_min() const {
 	    return termfreq_min;
@@ -73,6 +116,22 @@ namespace RestPose {
 	/** Check if a the value matches the range.
 	 */
 	bool check_range(const std::string & value) const;
+
+	/** Get the terms to index a value with, so that ranges can be found
+	 *  using a term prefix.
+	 *
+	 *  The value is indexed at several levels of precision, so that a
+	 *  range can be covered by a small number of terms.  Values must be
+	 *  at most MAX_VALUE_LENGTH bytes long, and mustn't end with a zero
+	 *  byte (as is true of values produced by Xapian::sortable_serialise,
+	 *  and of dates as produced by DateIndexer).
+	 */
+	static void get_index_terms(const std::string & prefix,
+				    const std::string & value,
+				    std::vector<std::string> & terms);
+
+	/// The longest value which may be indexed by terms.
+	static const unsigned int MAX_VALUE_LENGTH = 12;
     };
 
 }
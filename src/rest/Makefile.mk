@@ -4,10 +4,12 @@ noinst_HEADERS += \
  src/rest/handler.h \
  src/rest/handlers.h \
  src/rest/router.h \
- src/rest/routes.h
+ src/rest/routes.h \
+ src/rest/static_files.h
 
 librest_a_SOURCES = \
  src/rest/handler.cc \
  src/rest/handlers.cc \
  src/rest/router.cc \
- src/rest/routes.cc
+ src/rest/routes.cc \
+ src/rest/static_files.cc
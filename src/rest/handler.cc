@@ -26,18 +26,134 @@
 #include "rest/handler.h"
 
 #include "httpserver/httpserver.h"
+#include "httpserver/response.h"
 #include "logger/logger.h"
 #include <microhttpd.h>
 #include "server/task_manager.h"
 #include "str.h"
+#include <strings.h>
+#include "utils/compression.h"
 #include "utils/jsonutils.h"
+#include "utils/msgpack.h"
+#include "utils/rsperrors.h"
 
 using namespace std;
 using namespace RestPose;
 
+/** The largest uncompressed size accepted for a compressed request body.
+ *
+ *  This stops a small compressed body from using unlimited memory when
+ *  uncompressed.
+ */
+#define MAX_INFLATED_BODY_SIZE (256 * 1024 * 1024)
+
+/** Parse a request body, as JSON or MessagePack according to its
+ *  Content-Type.
+ */
+static void
+parse_body(const ConnectionInfo & conn, const string & data,
+	   Json::Value & body)
+{
+    if (conn.body_is_msgpack()) {
+	msgpack_unserialise(data, body);
+    } else {
+	json_unserialise(data, body);
+    }
+}
+
 // Virtual destructor to ensure there's a vtable.
 Handler::~Handler() {}
 
+RequestBody::RequestBody()
+	: inflater(NULL),
+	  checked_encoding(false),
+	  error_status(0)
+{
+}
+
+RequestBody::~RequestBody()
+{
+    delete inflater;
+}
+
+void
+RequestBody::check_encoding(const ConnectionInfo & conn)
+{
+    checked_encoding = true;
+    const char * encoding = conn.get_header("Content-Encoding");
+    if (encoding == NULL || *encoding == '\0' ||
+	strcasecmp(encoding, "identity") == 0) {
+	return;
+    }
+    if (strcasecmp(encoding, "gzip") == 0 ||
+	strcasecmp(encoding, "x-gzip") == 0) {
+	inflater = new ZlibInflater(ZLIB_FORMAT_GZIP);
+    } else if (strcasecmp(encoding, "deflate") == 0) {
+	// The "deflate" content coding is the zlib format.
+	inflater = new ZlibInflater(ZLIB_FORMAT_ZLIB);
+    } else {
+	set_error(string("Unsupported Content-Encoding \"") + encoding +
+		  "\" for request body", MHD_HTTP_UNSUPPORTED_MEDIA_TYPE);
+	return;
+    }
+    inflater->start();
+}
+
+void
+RequestBody::set_error(const string & error_, int error_status_)
+{
+    error = error_;
+    error_status = error_status_;
+    data.clear();
+    delete inflater;
+    inflater = NULL;
+}
+
+void
+RequestBody::append(const ConnectionInfo & conn,
+		    const char * piece, size_t len)
+{
+    if (!checked_encoding) {
+	check_encoding(conn);
+    }
+    if (!error.empty()) {
+	return;
+    }
+    if (inflater == NULL) {
+	data.append(piece, len);
+	return;
+    }
+    // Stop uncompressing as soon as the limit is passed, so that a single
+    // highly compressed piece can't use unlimited memory.
+    bool within_limit;
+    try {
+	within_limit = inflater->inflate_chunk(piece, len, data,
+	    MAX_INFLATED_BODY_SIZE - data.size());
+    } catch(const CompressionError & e) {
+	set_error(string("Invalid compressed request body: ") + e.what(),
+		  MHD_HTTP_BAD_REQUEST);
+	return;
+    }
+    if (!within_limit) {
+	set_error("Compressed request body too large when uncompressed",
+		  MHD_HTTP_REQUEST_ENTITY_TOO_LARGE);
+    }
+}
+
+bool
+RequestBody::finish()
+{
+    if (error.empty() && inflater != NULL) {
+	try {
+	    inflater->finish();
+	} catch(const CompressionError & e) {
+	    set_error(string("Invalid compressed request body: ") + e.what(),
+		      MHD_HTTP_BAD_REQUEST);
+	}
+    }
+    return error.empty();
+}
+
 QueuedHandler::QueuedHandler()
 	: Handler(),
 	  queued(false)
@@ -79,24 +195,34 @@ QueuedHandler::handle(ConnectionInfo & conn)
     if (!queued) {
 	if (*(conn.upload_data_size) != 0) {
 	    // FIXME - enforce an upload size limit
-	    uploaded_data += string(conn.upload_data, *(conn.upload_data_size));
+	    uploaded_data.append(conn, conn.upload_data,
+				 *(conn.upload_data_size));
 	    *(conn.upload_data_size) = 0;
 	    return;
 	}
+	if (!uploaded_data.finish()) {
+	    resulthandle.failed(uploaded_data.get_error(),
+				uploaded_data.get_error_status());
+	    conn.respond(resulthandle);
+	    return;
+	}
 
-	// FIXME - check Content-Type
 	Json::Value body(Json::nullValue);
-	if (uploaded_data.size() != 0) {
+	if (uploaded_data.get().size() != 0) {
 	    // Handle failure to parse data
 	    try {
-		json_unserialise(uploaded_data, body);
+		parse_body(conn, uploaded_data.get(), body);
 	    } catch(InvalidValueError & e) {
-		LOG_ERROR(string("Invalid JSON supplied in request body: ") + e.what());
+		LOG_ERROR(string("Invalid data supplied in request body: ") + e.what());
 		resulthandle.failed(e.what(), 400);
 		conn.respond(resulthandle);
 		return;
 	    }
 	}
+	// Let the task compress and encode its response, so that this is
+	// done on a worker thread.
+	resulthandle.response().set_accepted_codings(conn.accepted_codings());
+	resulthandle.response().set_msgpack(conn.accepts_msgpack());
 	Queue::QueueState state = enqueue(conn, body);
 	if (handle_queue_push_fail(state, conn)) {
 	    return;
@@ -147,16 +273,22 @@ NoWaitQueuedHandler::handle(ConnectionInfo & conn)
 
     if (*(conn.upload_data_size) != 0) {
 	// FIXME - enforce an upload size limit
-	uploaded_data += string(conn.upload_data, *(conn.upload_data_size));
+	uploaded_data.append(conn, conn.upload_data, *(conn.upload_data_size));
 	*(conn.upload_data_size) = 0;
 	return;
     }
+    if (!uploaded_data.finish()) {
+	Json::Value result(Json::objectValue);
+	result["err"] = uploaded_data.get_error();
+	conn.respond(uploaded_data.get_error_status(),
+		     json_serialise(result), "application/json");
+	return;
+    }
 
-    // FIXME - check Content-Type
     Json::Value body(Json::nullValue);
-    if (uploaded_data.size() != 0) {
+    if (uploaded_data.get().size() != 0) {
 	// FIXME - handle failure to parse data
-	json_unserialise(uploaded_data, body);
+	parse_body(conn, uploaded_data.get(), body);
     }
 
     Queue::QueueState state;
@@ -33,6 +33,7 @@
 class TaskManager;
 class Server;
 class ConnectionInfo;
+class ZlibInflater;
 
 /** Handlers for restful resources.
  *
@@ -76,6 +77,63 @@ class HandlerFactory {
     virtual Handler * create(const std::vector<std::string> & path_params) const = 0;
 };
 
+/** The body of a request, collected as it is uploaded.
+ *
+ *  If the request has a Content-Encoding of gzip or deflate, each piece of
+ *  the body is uncompressed as it arrives, so that only the uncompressed
+ *  body is held.
+ */
+class RequestBody {
+    /// The body received so far (uncompressed).
+    std::string data;
+
+    /// Inflater for the body, or NULL if the body isn't compressed.
+    ZlibInflater * inflater;
+
+    /// True once the Content-Encoding of the request has been checked.
+    bool checked_encoding;
+
+    /// Message describing why the body couldn't be read, or empty.
+    std::string error;
+
+    /// HTTP status code to report the error with.
+    int error_status;
+
+    /// Set up an inflater for the request's Content-Encoding, if any.
+    void check_encoding(const ConnectionInfo & conn);
+
+    /// Record an error; the rest of the body will be ignored.
+    void set_error(const std::string & error_, int error_status_);
+
+    RequestBody(const RequestBody &);
+    void operator=(const RequestBody &);
+  public:
+    RequestBody();
+    ~RequestBody();
+
+    /** Add a piece of the body, as received from the connection.
+     *
+     *  Errors are recorded, and reported by finish().
+     */
+    void append(const ConnectionInfo & conn, const char * piece, size_t len);
+
+    /** Finish receiving the body.
+     *
+     *  Returns false if the body couldn't be read, in which case
+     *  get_error() and get_error_status() describe the problem.
+     */
+    bool finish();
+
+    /// Get the body.
+    const std::string & get() const { return data; }
+
+    /// Get a message describing why the body couldn't be read.
+    const std::string & get_error() const { return error; }
+
+    /// Get the HTTP status code to report a failure to read the body with.
+    int get_error_status() const { return error_status; }
+};
+
 /** Base class of handlers which put a task on a queue and wait for the
  *  response.
  */
@@ -85,7 +143,7 @@ class QueuedHandler : public Handler {
      */
     bool queued;
 
-    std::string uploaded_data;
+    RequestBody uploaded_data;
 
     /** Handle the request if the queue push failed.
      *
@@ -110,7 +168,7 @@ class QueuedHandler : public Handler {
  */
 class NoWaitQueuedHandler : public Handler {
     // FIXME - share code with QueuedHandler
-    std::string uploaded_data;
+    RequestBody uploaded_data;
     bool handle_queue_push_fail(Queue::QueueState state,
 				ConnectionInfo & conn);
   public:
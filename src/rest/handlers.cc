@@ -28,9 +28,12 @@
 #include "httpserver/httpserver.h"
 #include "logger/logger.h"
 #include <microhttpd.h>
+#include "rest/static_files.h"
 #include "server/task_manager.h"
 #include "server/tasks.h"
+#include "str.h"
 #include "utils/jsonutils.h"
+#include "utils/rsperrors.h"
 #include "utils/validation.h"
 
 using namespace std;
@@ -50,6 +53,11 @@ FileHandlerFactory::create(const vector<string> &path_params) const
     string filepath("static" DIR_SEPARATOR "static");
     for (vector<string>::const_iterator i = path_params.begin();
 	 i != path_params.end(); ++i) {
+	if (*i == "..") {
+	    // Don't allow access to files outside the static directory; an
+	    // empty path is reported as not found.
+	    return new FileHandler(string());
+	}
 	filepath += DIR_SEPARATOR;
 	filepath += *i;
     }
@@ -57,12 +65,10 @@ FileHandlerFactory::create(const vector<string> &path_params) const
     return new FileHandler(filepath);
 }
 
-Queue::QueueState
-FileHandler::enqueue(ConnectionInfo &,
-		     const Json::Value &)
+void
+FileHandler::handle(ConnectionInfo & conn)
 {
-    return taskman->queue_readonly("static",
-	new StaticFileTask(resulthandle, path));
+    g_static_files.respond(conn, path);
 }
 
 
@@ -228,6 +234,63 @@ GetDocumentHandler::enqueue(ConnectionInfo &,
 	new GetDocumentTask(resulthandle, coll_name, doc_type, doc_id));
 }
 
+/** Largest number of documents which may be requested at once.
+ */
+static const Json::ArrayIndex GET_DOCUMENTS_MAX = 10000;
+
+Handler *
+GetDocumentsHandlerFactory::create(const std::vector<std::string> & path_params) const
+{
+    string coll_name = path_params[0];
+    validate_collname_throw(coll_name);
+    return new GetDocumentsHandler(coll_name);
+}
+
+Queue::QueueState
+GetDocumentsHandler::enqueue(ConnectionInfo &,
+			     const Json::Value & body)
+{
+    vector<pair<string, string> > ids;
+    bool lines;
+    try {
+	json_check_object(body, "document request");
+	string format = json_get_string_member(body, "format", "json");
+	if (format != "json" && format != "lines") {
+	    throw InvalidValueError("Unknown result format \"" + format +
+				    "\"; must be \"json\" or \"lines\"");
+	}
+	lines = (format == "lines");
+
+	const Json::Value & docs_obj = body["docs"];
+	json_check_array(docs_obj, "documents to get");
+	if (docs_obj.size() > GET_DOCUMENTS_MAX) {
+	    throw InvalidValueError("Too many documents requested; maximum is " +
+				    str(GET_DOCUMENTS_MAX));
+	}
+	ids.reserve(docs_obj.size());
+	for (Json::Value::const_iterator i = docs_obj.begin();
+	     i != docs_obj.end(); ++i) {
+	    json_check_object(*i, "document to get");
+	    string doc_type = json_get_string_member(*i, "type", string());
+	    string doc_id = json_get_string_member(*i, "id", string());
+	    string error = validate_doc_type(doc_type);
+	    if (error.empty()) {
+		error = validate_doc_id(doc_id);
+	    }
+	    if (!error.empty()) {
+		throw InvalidValueError(error);
+	    }
+	    ids.push_back(make_pair(doc_type, doc_id));
+	}
+    } catch (const InvalidValueError & e) {
+	resulthandle.failed(e.what(), 400);
+	return Queue::HAS_SPACE;
+    }
+
+    return taskman->queue_readonly("search",
+	new GetDocumentsTask(resulthandle, coll_name, ids, lines));
+}
+
 
 Handler *
 NotFoundHandlerFactory::create(const std::vector<std::string> &) const
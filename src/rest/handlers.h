@@ -36,15 +36,19 @@ class FileHandlerFactory : public HandlerFactory {
     Handler * create(const std::vector<std::string> & path_params) const;
 };
 
-class FileHandler : public QueuedHandler {
+/** Handler for static files.
+ *
+ *  Files are served directly from the static file cache, without using a
+ *  task queue.
+ */
+class FileHandler : public Handler {
     std::string path;
   public:
     FileHandler(const std::string & path_)
 	    : path(path_)
     {}
 
-    Queue::QueueState enqueue(ConnectionInfo & conn,
-			      const Json::Value & body);
+    void handle(ConnectionInfo & conn);
 };
 
 
@@ -192,6 +196,23 @@ class GetDocumentHandler : public QueuedHandler {
 };
 
 
+class GetDocumentsHandlerFactory : public HandlerFactory {
+  public:
+    Handler * create(const std::vector<std::string> & path_params) const;
+};
+
+class GetDocumentsHandler : public QueuedHandler {
+    std::string coll_name;
+  public:
+    GetDocumentsHandler(const std::string & coll_name_)
+	    : coll_name(coll_name_)
+    {}
+
+    Queue::QueueState enqueue(ConnectionInfo & conn,
+			      const Json::Value & body);
+};
+
+
 class NotFoundHandlerFactory : public HandlerFactory {
   public:
     Handler * create(const std::vector<std::string> & path_params) const;
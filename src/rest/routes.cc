@@ -25,6 +25,7 @@
 #include <config.h>
 #include "rest/routes.h"
 
+#include "features/categoriser_handlers.h"
 #include "features/checkpoint_handlers.h"
 #include "features/category_handlers.h"
 #include "features/coll_handlers.h"
@@ -48,6 +49,7 @@ setup_routes(Router & router)
     router.add("/coll/?", HTTP_DELETE, new CollDeleteHandlerFactory);
     router.add("/coll/?/config", HTTP_GETHEAD, new CollGetConfigHandlerFactory);
     router.add("/coll/?/config", HTTP_PUT, new CollSetConfigHandlerFactory);
+    router.add("/coll/?/compression", HTTP_POST, new CollTrainCompressionHandlerFactory);
 
     // Checkpoints
     router.add("/coll/?/checkpoint", HTTP_GETHEAD, new CollGetCheckpointsHandlerFactory);
@@ -69,10 +71,14 @@ setup_routes(Router & router)
     router.add("/coll/?/taxonomy/?/id/?", HTTP_DELETE, new CollDeleteCategoryHandlerFactory);
     router.add("/coll/?/taxonomy/?/id/?/parent/?", HTTP_DELETE, new CollDeleteCategoryHandlerFactory);
 
+    // Categorisers
+    router.add("/coll/?/categorise/?", HTTP_POST, new CollCategoriseHandlerFactory);
+
     // Documents
     router.add("/coll/?/type/?/id/?", HTTP_PUT, new IndexDocumentHandlerFactory);
     router.add("/coll/?/type/?/id/?", HTTP_DELETE, new DeleteDocumentHandlerFactory);
     router.add("/coll/?/type/?/id/?", HTTP_GETHEAD, new GetDocumentHandlerFactory);
+    router.add("/coll/?/mget", HTTP_GETHEAD | HTTP_POST, new GetDocumentsHandlerFactory);
 
     router.add("/coll/?/type/?", HTTP_POST, new IndexDocumentTypeHandlerFactory);
     router.add("/coll/?/id/?", HTTP_POST, new IndexDocumentIdHandlerFactory);
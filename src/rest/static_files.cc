@@ -0,0 +1,334 @@
+/** @file static_files.cc
+ * @brief Cache of static files served over HTTP.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "rest/static_files.h"
+
+#include <cstring>
+#include "httpserver/httpserver.h"
+#include "loadfile.h"
+#include <memory>
+#include <microhttpd.h>
+#include "safeerrno.h"
+#include "safefcntl.h"
+#include "safesysstat.h"
+#include "safeunistd.h"
+#include "str.h"
+#include "utils/compression.h"
+#include "utils/jsonutils.h"
+#include "utils/rsperrors.h"
+#include "utils/stringutils.h"
+
+using namespace std;
+using namespace RestPose;
+
+/// The largest static file which will be held in memory.
+#define STATIC_FILE_MAX_CACHED_SIZE (1024 * 1024)
+
+/// The total size of static files which will be held in memory.
+#define STATIC_FILE_CACHE_SIZE (16 * 1024 * 1024)
+
+StaticFileCache g_static_files(STATIC_FILE_MAX_CACHED_SIZE,
+			       STATIC_FILE_CACHE_SIZE);
+
+/// Guess the content type of a file from its extension.
+static string
+guess_content_type(const string & path)
+{
+    if (string_endswith(path, ".html")) {
+	return "text/html";
+    } else if (string_endswith(path, ".js")) {
+	return "application/javascript";
+    } else if (string_endswith(path, ".css")) {
+	return "text/css";
+    } else if (string_endswith(path, ".png")) {
+	return "image/png";
+    } else if (string_endswith(path, ".jpg")) {
+	return "image/jpeg";
+    }
+    return "text/plain";
+}
+
+/// Check if a content type is worth compressing.
+static bool
+is_compressible(const string & content_type)
+{
+    return string_startswith(content_type, "text/") ||
+	    content_type == "application/javascript" ||
+	    content_type == "application/json";
+}
+
+/** Check if an If-None-Match header matches an ETag.
+ *
+ *  The header holds a comma separated list of ETags, or "*".  Weak ETags
+ *  are compared as if they were strong, as allowed for GET requests.
+ */
+static bool
+etag_matches(const char * header, const string & etag)
+{
+    const char * pos = header;
+    while (*pos != '\0') {
+	while (*pos == ' ' || *pos == '\t' || *pos == ',') ++pos;
+	if (*pos == '\0') break;
+	if (*pos == '*') return true;
+	if (pos[0] == 'W' && pos[1] == '/') pos += 2;
+	const char * end = pos;
+	if (*end == '"') {
+	    end = strchr(end + 1, '"');
+	    if (end == NULL) return false;
+	    ++end;
+	}
+	while (*end != '\0' && *end != ',' && *end != ' ' && *end != '\t')
+	    ++end;
+	if (etag.compare(0, string::npos, pos, end - pos) == 0) {
+	    return true;
+	}
+	pos = end;
+    }
+    return false;
+}
+
+/** Make a response from a buffer, with the headers for a static file.
+ *
+ *  The buffer is copied into the response.
+ */
+static struct MHD_Response *
+make_response(const string & data,
+	      const string & content_type,
+	      const string & etag,
+	      const char * content_encoding,
+	      bool vary)
+{
+    struct MHD_Response * response = MHD_create_response_from_buffer(
+	data.size(), const_cast<char *>(data.data()), MHD_RESPMEM_MUST_COPY);
+    if (response == NULL) {
+	throw HTTPServerError("Couldn't create response");
+    }
+    if (!content_type.empty()) {
+	MHD_add_response_header(response, "Content-Type", content_type.c_str());
+    }
+    MHD_add_response_header(response, "ETag", etag.c_str());
+    if (content_encoding != NULL) {
+	MHD_add_response_header(response, "Content-Encoding",
+				content_encoding);
+    }
+    if (vary) {
+	MHD_add_response_header(response, "Vary", "Accept-Encoding");
+    }
+    return response;
+}
+
+StaticFileCache::CachedFile::~CachedFile()
+{
+    // Responses which are still being sent are kept alive by libmicrohttpd
+    // until they're finished with.
+    if (plain) {
+	MHD_destroy_response(plain);
+    }
+    if (gzipped) {
+	MHD_destroy_response(gzipped);
+    }
+}
+
+StaticFileCache::StaticFileCache(size_t max_file_size_,
+				 size_t max_total_size_)
+	: max_file_size(max_file_size_),
+	  max_total_size(max_total_size_),
+	  total_size(0)
+{
+}
+
+StaticFileCache::~StaticFileCache()
+{
+    clear();
+}
+
+/// Build the ETag for a file from its size and modification time.
+static string
+make_etag(off_t size, time_t mtime)
+{
+    return "\"" + str(size_t(size)) + "-" + str(size_t(mtime)) + "\"";
+}
+
+StaticFileCache::CachedFile *
+StaticFileCache::load(const string & path, time_t mtime, off_t size)
+{
+    auto_ptr<CachedFile> file(new CachedFile);
+    file->mtime = mtime;
+    file->size = size;
+    file->content_type = guess_content_type(path);
+    file->etag = make_etag(size, mtime);
+    file->gzip_etag = file->etag;
+    file->gzip_etag.insert(file->gzip_etag.size() - 1, "-gz");
+
+    if (size_t(size) > max_file_size ||
+	total_size + size_t(size) > max_total_size) {
+	// Too large to hold in memory; the file will be sent from disk.
+	return file.release();
+    }
+
+    string data;
+    if (!load_file(path, data)) {
+	return NULL;
+    }
+    if (data.size() != size_t(size)) {
+	// The file changed while it was being read; send it from disk this
+	// time, and try caching it again on the next request.
+	return file.release();
+    }
+
+    // Files are loaded on the HTTP thread, so use the default compression
+    // level rather than the best, which is several times slower for little
+    // gain.
+    string compressed;
+    if (is_compressible(file->content_type)) {
+	ZlibDeflater deflater(ZLIB_FORMAT_GZIP, Z_DEFAULT_COMPRESSION);
+	compressed = deflater.deflate(data.data(), data.size());
+	if (compressed.size() >= data.size()) {
+	    compressed.clear();
+	}
+    }
+
+    bool vary = !compressed.empty();
+    file->plain = make_response(data, file->content_type, file->etag,
+				NULL, vary);
+    if (vary) {
+	file->gzipped = make_response(compressed, file->content_type,
+				      file->gzip_etag, "gzip", vary);
+    }
+    file->memory = data.size() + compressed.size();
+    total_size += file->memory;
+    return file.release();
+}
+
+void
+StaticFileCache::remove(map<string, CachedFile *>::iterator i)
+{
+    total_size -= i->second->memory;
+    delete i->second;
+    files.erase(i);
+}
+
+/** Send a response, and release our reference to it.
+ */
+static void
+respond_and_release(ConnectionInfo & conn, int status_code,
+		    struct MHD_Response * response)
+{
+    try {
+	conn.respond(status_code, response);
+    } catch(...) {
+	MHD_destroy_response(response);
+	throw;
+    }
+    MHD_destroy_response(response);
+}
+
+/// Send a 404 response for a static file.
+static void
+respond_not_found(ConnectionInfo & conn, const string & path)
+{
+    Json::Value result(Json::objectValue);
+    result["err"] = "Couldn't load file " + path;
+    conn.respond(MHD_HTTP_NOT_FOUND, json_serialise(result),
+		 "application/json");
+}
+
+void
+StaticFileCache::respond(ConnectionInfo & conn, const string & path)
+{
+    struct stat sbuf;
+    if (path.empty() || stat(path.c_str(), &sbuf) != 0 ||
+	!S_ISREG(sbuf.st_mode)) {
+	respond_not_found(conn, path);
+	return;
+    }
+
+    ContextLocker lock(mutex);
+    map<string, CachedFile *>::iterator i = files.find(path);
+    if (i != files.end() &&
+	(i->second->mtime != sbuf.st_mtime ||
+	 i->second->size != sbuf.st_size)) {
+	remove(i);
+	i = files.end();
+    }
+    if (i == files.end()) {
+	CachedFile * newfile = load(path, sbuf.st_mtime, sbuf.st_size);
+	if (newfile == NULL) {
+	    respond_not_found(conn, path);
+	    return;
+	}
+	i = files.insert(make_pair(path, newfile)).first;
+    }
+    const CachedFile & file = *(i->second);
+
+    bool use_gzip = file.gzipped != NULL && conn.accepts_encoding("gzip");
+    const string & etag = use_gzip ? file.gzip_etag : file.etag;
+    const char * if_none_match = conn.get_header("If-None-Match");
+    if (if_none_match != NULL && etag_matches(if_none_match, etag)) {
+	respond_and_release(conn, MHD_HTTP_NOT_MODIFIED,
+	    make_response(string(), string(), etag, NULL,
+			  file.gzipped != NULL));
+	return;
+    }
+
+    if (file.plain != NULL) {
+	conn.respond(MHD_HTTP_OK, use_gzip ? file.gzipped : file.plain);
+	return;
+    }
+
+    // Send the file directly from disk; libmicrohttpd uses sendfile() for
+    // this where available, and closes the file when done.
+    int fd = open(path.c_str(), O_RDONLY | O_BINARY);
+    if (fd < 0) {
+	respond_not_found(conn, path);
+	return;
+    }
+    struct stat fbuf;
+    struct MHD_Response * response = NULL;
+    if (fstat(fd, &fbuf) == 0) {
+	response = MHD_create_response_from_fd(size_t(fbuf.st_size), fd);
+    }
+    if (response == NULL) {
+	int err = errno;
+	(void) close(fd);
+	throw SysError("Couldn't send file \"" + path + "\"", err);
+    }
+    MHD_add_response_header(response, "Content-Type",
+			    file.content_type.c_str());
+    // The file may have changed since it was looked up, so base the ETag on
+    // the file actually being sent.
+    string fd_etag(make_etag(fbuf.st_size, fbuf.st_mtime));
+    MHD_add_response_header(response, "ETag", fd_etag.c_str());
+    respond_and_release(conn, MHD_HTTP_OK, response);
+}
+
+void
+StaticFileCache::clear()
+{
+    ContextLocker lock(mutex);
+    while (!files.empty()) {
+	remove(files.begin());
+    }
+}
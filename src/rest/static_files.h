@@ -0,0 +1,137 @@
+/** @file static_files.h
+ * @brief Cache of static files served over HTTP.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef RESTPOSE_INCLUDED_STATIC_FILES_H
+#define RESTPOSE_INCLUDED_STATIC_FILES_H
+
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include "utils/threading.h"
+
+/* Forward declarations */
+struct MHD_Response;
+class ConnectionInfo;
+
+/** A cache of static files, ready to be sent in responses.
+ *
+ *  Static files are served directly by the HTTP server, rather than being
+ *  put on a task queue.  Small files are held in memory as prepared
+ *  responses, together with a gzip compressed variant for text files, so
+ *  that serving them requires no file access or copying.  Larger files are
+ *  sent directly from the file.
+ *
+ *  Each request checks the size and modification time of the file, and
+ *  reloads it if it has changed.  Responses carry an ETag, and requests with
+ *  a matching If-None-Match header get a 304 response.
+ */
+class StaticFileCache {
+    /// A cached file.
+    struct CachedFile {
+	/// Modification time of the file when it was loaded.
+	time_t mtime;
+
+	/// Size of the file when it was loaded.
+	off_t size;
+
+	/// The content type to send the file with.
+	std::string content_type;
+
+	/// ETag for the uncompressed file.
+	std::string etag;
+
+	/// ETag for the gzip compressed file.
+	std::string gzip_etag;
+
+	/** Response holding the uncompressed file.
+	 *
+	 *  NULL if the file is too large to cache, in which case it is sent
+	 *  from the file for each request.
+	 */
+	struct MHD_Response * plain;
+
+	/// Response holding the gzip compressed file, or NULL if none.
+	struct MHD_Response * gzipped;
+
+	/// Number of bytes held in memory for the responses.
+	size_t memory;
+
+	CachedFile()
+		: mtime(0), size(0), plain(NULL), gzipped(NULL), memory(0)
+	{}
+	~CachedFile();
+
+      private:
+	/// No copying.
+	CachedFile(const CachedFile &);
+	/// No assignment.
+	void operator=(const CachedFile &);
+    };
+
+    /// Mutex protecting the cache.
+    Mutex mutex;
+
+    /// The cached files, by path.
+    std::map<std::string, CachedFile *> files;
+
+    /// The largest file which will be held in memory.
+    size_t max_file_size;
+
+    /// The total size of files which will be held in memory.
+    size_t max_total_size;
+
+    /// The total size of files currently held in memory.
+    size_t total_size;
+
+    /** Load a file into the cache.
+     *
+     *  Returns NULL if the file couldn't be read.
+     */
+    CachedFile * load(const std::string & path, time_t mtime, off_t size);
+
+    /// Remove a file from the cache.
+    void remove(std::map<std::string, CachedFile *>::iterator i);
+
+    /// No copying.
+    StaticFileCache(const StaticFileCache &);
+    /// No assignment.
+    void operator=(const StaticFileCache &);
+
+  public:
+    StaticFileCache(size_t max_file_size_, size_t max_total_size_);
+    ~StaticFileCache();
+
+    /** Respond to a request for a static file.
+     *
+     *  Sends a 404 response if the file doesn't exist.
+     */
+    void respond(ConnectionInfo & conn, const std::string & path);
+
+    /// Remove all the files from the cache.
+    void clear();
+};
+
+/// The cache of files served from the static directory.
+extern StaticFileCache g_static_files;
+
+#endif /* RESTPOSE_INCLUDED_STATIC_FILES_H */
@@ -28,13 +28,14 @@
 #include "httpserver/response.h"
 #include "jsonxapian/collection.h"
 #include "jsonxapian/collection_pool.h"
+#include "jsonxapian/document_cache.h"
 #include "jsonxapian/indexing.h"
 #include "jsonxapian/pipe.h"
-#include "loadfile.h"
+#include "jsonxapian/query_plan_cache.h"
 #include "logger/logger.h"
 #include "server/task_manager.h"
+#include "str.h"
 #include "utils/jsonutils.h"
-#include "utils/stringutils.h"
 #include "utils/validation.h"
 
 using namespace std;
@@ -42,35 +43,6 @@ using namespace RestPose;
 
 Task::~Task() {}
 
-void
-StaticFileTask::perform(RestPose::Collection *)
-{
-    Response & response(resulthandle.response());
-    string data;
-    if (load_file(path, data)) {
-	response.set_data(data);
-	if (string_endswith(path, ".html")) {
-	    response.set_content_type("text/html");
-	} else if (string_endswith(path, ".js")) {
-	    response.set_content_type("application/javascript");
-	} else if (string_endswith(path, ".css")) {
-	    response.set_content_type("text/css");
-	} else if (string_endswith(path, ".png")) {
-	    response.set_content_type("image/png");
-	} else if (string_endswith(path, ".jpg")) {
-	    response.set_content_type("image/jpeg");
-	} else {
-	    response.set_content_type("text/plain");
-	}
-	response.set_status(200);
-    } else {
-	Json::Value result(Json::objectValue);
-	result["err"] = "Couldn't load file" + path; // FIXME - explain the error
-	response.set(result, 404); // FIXME - only return 404 if it's a file not found error.
-    }
-    resulthandle.set_ready();
-}
-
 void
 PerformSearchTask::perform(RestPose::Collection * collection)
 {
@@ -82,15 +54,26 @@ PerformSearchTask::perform(RestPose::Collection * collection)
 	}
     }
 
-    Json::Value result(Json::objectValue);
-    collection->perform_search(search, doc_type, result);
+    Response & response = resulthandle.response();
+    if (response.is_msgpack()) {
+	Json::Value result(Json::objectValue);
+	collection->perform_search(search, doc_type, result);
+	response.set(result, 200);
+    } else {
+	// Write the JSON directly, rather than building a Json::Value holding
+	// all the matching documents.
+	string body;
+	collection->perform_search_json(search, doc_type, body);
+	response.set_data(body);
+	response.set_content_type("application/json");
+	response.set_status(200);
+    }
     if (doc_type.empty()) {
 	LOG_DEBUG("searched collection '" + collection->get_name() + "'");
     } else {
 	LOG_DEBUG("searched collection '" + collection->get_name() +
 		  "' within type '" + doc_type + "'");
     }
-    resulthandle.response().set(result, 200);
     resulthandle.set_ready();
 }
 
@@ -106,18 +89,81 @@ GetDocumentTask::perform(RestPose::Collection * collection)
 	return;
     }
 
-    Json::Value result(Json::objectValue);
-    collection->get_document(doc_type, doc_id, result);
+    Response & response = resulthandle.response();
+    if (response.is_msgpack()) {
+	// The document cache holds serialised JSON, so isn't used here.
+	Json::Value result(Json::objectValue);
+	collection->get_document(doc_type, doc_id, result);
+	if (result.isNull()) {
+	    resulthandle.failed("No document found of type \"" + doc_type +
+				"\" and id \"" + doc_id + "\"", 404);
+	    return;
+	}
+	response.set(result, 200);
+	resulthandle.set_ready();
+	return;
+    }
+
+    string body;
+    string gzipped;
     LOG_DEBUG("GetDocument '" + doc_id + "' from '" + collection->get_name() + "'");
-    if (result.isNull()) {
+    if (!collection->get_document_json(doc_type, doc_id, body, &gzipped)) {
 	resulthandle.failed("No document found of type \"" + doc_type +
 			    "\" and id \"" + doc_id + "\"", 404);
 	return;
     }
-    resulthandle.response().set(result, 200);
+    if (response.will_gzip(body.size()) && gzipped.empty()) {
+	gzipped = Response::gzip(body);
+	collection->cache_document_gzipped(doc_type, doc_id, body, gzipped);
+    }
+    response.set_data(body, gzipped);
+    response.set_content_type("application/json");
+    response.set_status(200);
     resulthandle.set_ready();
 }
 
+void
+GetDocumentsTask::perform(RestPose::Collection * collection)
+{
+    LOG_DEBUG("GetDocuments: " + str(ids.size()) + " documents from '" +
+	      collection->get_name() + "'");
+    Json::Value docs;
+    collection->get_documents(ids, docs);
+
+    Response & response = resulthandle.response();
+    if (!lines && response.is_msgpack()) {
+	Json::Value result(Json::objectValue);
+	result["items"].swap(docs);
+	response.set(result, 200);
+	resulthandle.set_ready();
+	return;
+    }
+
+    // Serialise each document separately, so that they can be written one
+    // per line.
+    string body;
+    if (!lines) {
+	body = "{\"items\":[";
+    }
+    for (Json::ArrayIndex i = 0; i != docs.size(); ++i) {
+	if (!lines && i != 0) {
+	    body += ',';
+	}
+	body += json_serialise(docs[i]);
+	if (lines) {
+	    body += '\n';
+	}
+    }
+    if (!lines) {
+	body += "]}";
+    }
+
+    response.set_data(body);
+    response.set_content_type(lines ? "application/x-ndjson" :
+				      "application/json");
+    response.set_status(200);
+    resulthandle.set_ready();
+}
 
 void
 ServerStatusTask::perform(RestPose::Collection *)
@@ -139,34 +185,43 @@ ServerStatusTask::perform(RestPose::Collection *)
 	taskman->search_queues.get_status(search["queues"]);
 	taskman->search_threads.get_status(search["threads"]);
     }
+    g_query_plans.get_status(result["query_plan_cache"]);
+    g_document_cache.get_status(result["document_cache"]);
     resulthandle.response().set(result, 200);
     resulthandle.set_ready();
 }
 
-void
-ProcessorPipeDocumentTask::perform(const string & coll_name,
-				   TaskManager * taskman)
-{
-    LOG_DEBUG("PipeDocument to '" + target_pipe + "' in '" + coll_name + "'");
-    auto_ptr<CollectionConfig> config(taskman->get_collconfigs()
-				      .get(coll_name));
-    bool new_fields(false);
-    config->send_to_pipe(taskman, target_pipe, doc, new_fields);
-}
-
-void
-ProcessorProcessDocumentTask::perform(const string & coll_name,
-				      TaskManager * taskman)
+/** Process a document and queue it for indexing.
+ *
+ *  The document is processed using the shared snapshot of the
+ *  configuration, if that can be done without changing it.  Otherwise, the
+ *  document is processed with a private copy of the configuration, which
+ *  is then published to replace the snapshot.
+ *
+ *  The snapshot is updated to refer to the new configuration if one is
+ *  published.
+ */
+static void
+process_and_queue(TaskManager * taskman,
+		  const string & coll_name,
+		  CollectionConfigSnapshot & config,
+		  Json::Value & doc,
+		  const string & doc_type,
+		  const string & doc_id)
 {
-    LOG_DEBUG("ProcessDocument type '" + doc_type + "' in '" + coll_name + "'");
-    auto_ptr<CollectionConfig> config(taskman->get_collconfigs()
-				      .get(coll_name));
     string idterm;
-    config->clear_changed();
     IndexingErrors errors;
-    // Validation happens in process_doc
+    Xapian::Document xdoc;
+    auto_ptr<CollectionConfig> newconfig;
     bool new_fields(false);
-    Xapian::Document xdoc = config->process_doc(doc, doc_type, doc_id, idterm, errors, new_fields);
+    // Validation happens in process_doc
+    if (!config->try_process_doc(doc, doc_type, doc_id, idterm, errors,
+				 xdoc)) {
+	newconfig = auto_ptr<CollectionConfig>(config->clone());
+	xdoc = newconfig->process_doc(doc, doc_type, doc_id, idterm, errors,
+				      new_fields);
+    }
+
     for (vector<pair<string, string> >::const_iterator
 	 i = errors.errors.begin(); i != errors.errors.end(); ++i) {
 	string msg("Indexing error in field \"" + i->first + "\": \"" +
@@ -182,28 +237,55 @@ ProcessorProcessDocumentTask::perform(const string & coll_name,
 				errors.errors[0].second);
     }
 
+    // Send just the new schema configuration to the indexer, rather than
+    // the whole config, so that new fields added by tasks running in
+    // parallel aren't overwritten.  The delta is queued before the document,
+    // so that the fields are known by the time the document is indexed.
+    if (newconfig.get() != NULL) {
+	Json::Value delta;
+	newconfig->get_schema_delta(*config, delta);
+	if (!delta.empty()) {
+	    LOG_DEBUG("New schema configuration found by processing");
+	    taskman->queue_indexing_from_processing(coll_name,
+		new IndexerSchemaDeltaTask(delta));
+
+	    // Publish the new config, and use it for any further documents.
+	    config = taskman->get_collconfigs().publish_schema_delta(
+		coll_name, config, newconfig.release(), delta);
+	}
+    }
+
     taskman->queue_indexing_from_processing(coll_name,
 	new IndexerUpdateDocumentTask(idterm, xdoc));
+}
 
-    // FIXME - when it's just new fields that have been added, should send
-    // out a task that updates the collection config with the new fields,
-    // without overwriting any other new fields that have been added by
-    // tasks running in parallel.
-
-    if (config->is_changed() || new_fields) {
-	LOG_DEBUG("Config has changed due to processing; applying new config");
-	// FIXME - could push just the new config for the schema for the doc_type in question, to save work.
-	Json::Value tmp;
-	config->to_json(tmp);
-	taskman->queue_indexing_from_processing(coll_name,
-	    new IndexerConfigChangedTask(tmp));
-	config->clear_changed();
-
-	// Push the new config back to the cache.
-	taskman->get_collconfigs().set(coll_name, config.release());
+void
+ProcessorPipeDocumentTask::perform(const string & coll_name,
+				   TaskManager * taskman)
+{
+    LOG_DEBUG("PipeDocument to '" + target_pipe + "' in '" + coll_name + "'");
+    CollectionConfigSnapshot config(taskman->get_collconfigs()
+				    .get_snapshot(coll_name));
+    vector<Json::Value> outputs;
+    config->run_pipe(target_pipe, doc, outputs);
+    for (vector<Json::Value>::iterator i = outputs.begin();
+	 i != outputs.end(); ++i) {
+	// FIXME - remove hardcoded "default" here - pipes should have a way to
+	// say what type the output document is.
+	process_and_queue(taskman, coll_name, config, *i, "default", "");
     }
 }
 
+void
+ProcessorProcessDocumentTask::perform(const string & coll_name,
+				      TaskManager * taskman)
+{
+    LOG_DEBUG("ProcessDocument type '" + doc_type + "' in '" + coll_name + "'");
+    CollectionConfigSnapshot config(taskman->get_collconfigs()
+				    .get_snapshot(coll_name));
+    process_and_queue(taskman, coll_name, config, doc, doc_type, doc_id);
+}
+
 void
 IndexerConfigChangedTask::perform_task(const string & coll_name,
 				       RestPose::Collection * & collection,
@@ -232,6 +314,35 @@ IndexerConfigChangedTask::clone() const
     return new IndexerConfigChangedTask(new_config);
 }
 
+void
+IndexerSchemaDeltaTask::perform_task(const string & coll_name,
+				     RestPose::Collection * & collection,
+				     TaskManager * taskman)
+{
+    LOG_DEBUG("Merging new schema configuration for collection " +
+	      coll_name);
+    if (collection == NULL) {
+	collection = taskman->get_collections().get_writable(coll_name);
+    }
+    collection->apply_schema_delta(delta);
+}
+
+void
+IndexerSchemaDeltaTask::info(string & description,
+			     string & doc_type,
+			     string & doc_id) const
+{
+    description = "Adding new fields to schema";
+    doc_type.resize(0);
+    doc_id.resize(0);
+}
+
+IndexingTask *
+IndexerSchemaDeltaTask::clone() const
+{
+    return new IndexerSchemaDeltaTask(delta);
+}
+
 void
 IndexerUpdateDocumentTask::perform_task(const string & coll_name,
 					RestPose::Collection * & collection,
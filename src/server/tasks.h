@@ -26,6 +26,8 @@
 
 #include "server/basetasks.h"
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace Xapian {
     class Document;
@@ -37,17 +39,6 @@ namespace RestPose {
 
 class CollectionPool;
 
-class StaticFileTask : public ReadonlyTask {
-    std::string path;
-  public:
-    StaticFileTask(const RestPose::ResultHandle & resulthandle_,
-		   const std::string & path_)
-	    : ReadonlyTask(resulthandle_), path(path_)
-    {}
-
-    void perform(RestPose::Collection * collection);
-};
-
 class PerformSearchTask : public ReadonlyCollTask {
     Json::Value search;
     std::string doc_type;
@@ -80,6 +71,26 @@ class GetDocumentTask : public ReadonlyCollTask {
     void perform(RestPose::Collection * collection);
 };
 
+/// Get a set of documents, given their types and IDs.
+class GetDocumentsTask : public ReadonlyCollTask {
+    /// The type and ID of each document to get.
+    std::vector<std::pair<std::string, std::string> > ids;
+
+    /// Flag, true to return one document per line, rather than an object.
+    bool lines;
+  public:
+    GetDocumentsTask(const RestPose::ResultHandle & resulthandle_,
+		     const std::string & coll_name_,
+		     const std::vector<std::pair<std::string, std::string> > & ids_,
+		     bool lines_)
+	    : ReadonlyCollTask(resulthandle_, coll_name_),
+	      ids(ids_),
+	      lines(lines_)
+    {}
+
+    void perform(RestPose::Collection * collection);
+};
+
 class ServerStatusTask : public ReadonlyTask {
     const TaskManager * taskman;
   public:
@@ -151,6 +162,25 @@ class IndexerConfigChangedTask : public IndexingTask {
     IndexingTask * clone() const;
 };
 
+/// Merge new schema configuration found while processing documents.
+class IndexerSchemaDeltaTask : public IndexingTask {
+    /// The delta, as returned by CollectionConfig::get_schema_delta().
+    Json::Value delta;
+  public:
+    IndexerSchemaDeltaTask(const Json::Value & delta_)
+	    : delta(delta_)
+    {}
+
+    void perform_task(const std::string & coll_name,
+		      RestPose::Collection * & collection,
+		      TaskManager * taskman);
+    void info(std::string & description,
+	      std::string & doc_type,
+	      std::string & doc_id) const;
+
+    IndexingTask * clone() const;
+};
+
 /// Add or update a document.
 class IndexerUpdateDocumentTask : public IndexingTask {
     /// The unique ID term for the document.
@@ -2,8 +2,11 @@ noinst_LIBRARIES += libutils.a
 
 noinst_HEADERS += \
  src/utils/compression.h \
+ src/utils/hash.h \
  src/utils/io_wrappers.h \
+ src/utils/jsonparser.h \
  src/utils/jsonutils.h \
+ src/utils/msgpack.h \
  src/utils/queueing.h \
  src/utils/rmdir.h \
  src/utils/rsperrors.h \
@@ -19,7 +22,9 @@ noinst_HEADERS += \
 libutils_a_SOURCES = \
  src/utils/compression.cc \
  src/utils/io_wrappers.cc \
+ src/utils/jsonparser.cc \
  src/utils/jsonutils.cc \
+ src/utils/msgpack.cc \
  src/utils/rmdir.cc \
  src/utils/rsperrors.cc \
  src/utils/threading.cc \
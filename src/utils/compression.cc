@@ -26,30 +26,70 @@
 #include "str.h"
 #include "rsperrors.h"
 
+/// Get the windowBits parameter to pass to zlib for a given format.
+static int
+zlib_window_bits(ZlibFormat format)
+{
+    switch (format) {
+	case ZLIB_FORMAT_RAW:
+	    return -15;
+	case ZLIB_FORMAT_GZIP:
+	    return 15 + 16;
+	case ZLIB_FORMAT_ZLIB:
+	    break;
+    }
+    return 15;
+}
+
+/// Build an error message from a zlib error code, and throw it.
+static void
+throw_zlib_error(const char * context, int err, const z_stream * stream)
+{
+    if (err == Z_MEM_ERROR) {
+	throw std::bad_alloc();
+    }
+    std::string msg(context);
+    msg += " failed (";
+    if (stream != NULL && stream->msg) {
+	msg += stream->msg;
+    } else {
+	msg += str(err);
+    }
+    msg += ')';
+    throw RestPose::CompressionError(msg);
+}
+
+ZlibInflater::~ZlibInflater()
+{
+    if (stream) {
+	(void) inflateEnd(stream);
+	delete stream;
+    }
+}
+
 void
 ZlibInflater::make_inflate_zstream()
 {
+    if (stream) {
+	int err = inflateReset(stream);
+	if (rare(err != Z_OK)) {
+	    throw_zlib_error("inflateReset", err, stream);
+	}
+	return;
+    }
+
     std::auto_ptr<z_stream> inflate_zstream(new z_stream);
 
     inflate_zstream->zalloc = reinterpret_cast<alloc_func>(0);
     inflate_zstream->zfree = reinterpret_cast<free_func>(0);
+    inflate_zstream->opaque = static_cast<voidpf>(0);
 
     inflate_zstream->next_in = Z_NULL;
     inflate_zstream->avail_in = 0;
 
-    int err = inflateInit2(inflate_zstream.get(), 15);
+    int err = inflateInit2(inflate_zstream.get(), zlib_window_bits(format));
     if (rare(err != Z_OK)) {
-	if (err == Z_MEM_ERROR) {
-	    throw std::bad_alloc();
-	}
-	std::string msg = "inflateInit2 failed (";
-	if (inflate_zstream->msg) {
-	    msg += inflate_zstream->msg;
-	} else {
-	    msg += str(err);
-	}
-	msg += ')';
-	throw RestPose::ImporterError(msg);
+	throw_zlib_error("inflateInit2", err, inflate_zstream.get());
     }
     stream = inflate_zstream.release();
 }
@@ -57,41 +97,171 @@ ZlibInflater::make_inflate_zstream()
 std::string
 ZlibInflater::inflate(const char * data, size_t data_len)
 {
-    if (stream) {
-	delete stream;
-	stream = NULL;
+    std::string uncompressed;
+    start();
+    inflate_chunk(data, data_len, uncompressed);
+    finish();
+    if (uncompressed.size() != stream->total_out) {
+	std::string msg = "compressed tag didn't expand to the expected size: ";
+	msg += str(uncompressed.size());
+	msg += " != ";
+	// OpenBSD's zlib.h uses off_t instead of uLong for total_out.
+	msg += str((size_t)stream->total_out);
+	throw RestPose::CompressionError(msg);
     }
+    return uncompressed;
+}
+
+void
+ZlibInflater::start()
+{
     make_inflate_zstream();
-    std::string uncompressed;
+    ended = false;
+    if (format == ZLIB_FORMAT_RAW && !dictionary.empty()) {
+	// Raw streams don't ask for the dictionary, so it must be set up
+	// front.
+	int err = inflateSetDictionary(stream,
+	    reinterpret_cast<const Bytef *>(dictionary.data()),
+	    (uInt)dictionary.size());
+	if (rare(err != Z_OK)) {
+	    throw_zlib_error("inflateSetDictionary", err, stream);
+	}
+    }
+}
+
+bool
+ZlibInflater::inflate_chunk(const char * data, size_t data_len,
+			    std::string & output, size_t max_output)
+{
+    if (data_len == 0) {
+	return true;
+    }
+    if (ended) {
+	throw RestPose::CompressionError("inflate failed (data found after "
+					 "the end of the compressed data)");
+    }
     stream->next_in = (Bytef*)const_cast<char *>(data);
     stream->avail_in = (uInt)data_len;
     Bytef buf[8192];
-    int err = Z_OK;
-    while (err != Z_STREAM_END) {
+    while (true) {
 	stream->next_out = buf;
 	stream->avail_out = (uInt)sizeof(buf);
-	err = ::inflate(stream, Z_SYNC_FLUSH);
+	int err = ::inflate(stream, Z_SYNC_FLUSH);
 
+	if (err == Z_NEED_DICT) {
+	    if (dictionary.empty()) {
+		throw RestPose::CompressionError(
+			"inflate failed (a preset dictionary is required, "
+			"but none was supplied)");
+	    }
+	    err = inflateSetDictionary(stream,
+		reinterpret_cast<const Bytef *>(dictionary.data()),
+		(uInt)dictionary.size());
+	    if (err != Z_OK) {
+		throw_zlib_error("inflateSetDictionary", err, stream);
+	    }
+	    continue;
+	}
+	if (err == Z_BUF_ERROR && stream->next_out == buf) {
+	    // No progress is possible until more data is supplied.
+	    return true;
+	}
 	if (err != Z_OK && err != Z_STREAM_END) {
-	    if (err == Z_MEM_ERROR) throw std::bad_alloc();
-	    std::string msg = "inflate failed";
-	    if (stream->msg) {
-		msg += " (";
-		msg += stream->msg;
-		msg += ')';
+	    throw_zlib_error("inflate", err, stream);
+	}
+	size_t produced = stream->next_out - buf;
+	if (produced > max_output) {
+	    return false;
+	}
+	max_output -= produced;
+	output.append(reinterpret_cast<const char *>(buf), produced);
+	if (err == Z_STREAM_END) {
+	    ended = true;
+	    if (stream->avail_in != 0) {
+		throw RestPose::CompressionError("inflate failed (data found "
+			"after the end of the compressed data)");
 	    }
-	    throw RestPose::ImporterError(msg);
+	    return true;
+	}
+	if (stream->avail_in == 0 && stream->avail_out != 0) {
+	    // All the input has been used, and all the output it produced
+	    // has been collected.
+	    return true;
 	}
-	uncompressed.append(reinterpret_cast<const char *>(buf),
-			    stream->next_out - buf);
     }
-    if (uncompressed.size() != stream->total_out) {
-	std::string msg = "compressed tag didn't expand to the expected size: ";
-	msg += str(uncompressed.size());
-	msg += " != ";
-	// OpenBSD's zlib.h uses off_t instead of uLong for total_out.
-	msg += str((size_t)stream->total_out);
-	throw RestPose::ImporterError(msg);
+}
+
+void
+ZlibInflater::finish()
+{
+    if (!ended) {
+	throw RestPose::CompressionError("inflate failed (compressed "
+					 "data was truncated)");
     }
-    return uncompressed;
+}
+
+ZlibDeflater::~ZlibDeflater()
+{
+    if (stream) {
+	(void) deflateEnd(stream);
+	delete stream;
+    }
+}
+
+void
+ZlibDeflater::make_deflate_zstream()
+{
+    if (stream) {
+	int err = deflateReset(stream);
+	if (rare(err != Z_OK)) {
+	    throw_zlib_error("deflateReset", err, stream);
+	}
+	return;
+    }
+
+    std::auto_ptr<z_stream> deflate_zstream(new z_stream);
+
+    deflate_zstream->zalloc = reinterpret_cast<alloc_func>(0);
+    deflate_zstream->zfree = reinterpret_cast<free_func>(0);
+    deflate_zstream->opaque = static_cast<voidpf>(0);
+
+    int err = deflateInit2(deflate_zstream.get(), level, Z_DEFLATED,
+			   zlib_window_bits(format), 8, Z_DEFAULT_STRATEGY);
+    if (rare(err != Z_OK)) {
+	throw_zlib_error("deflateInit2", err, deflate_zstream.get());
+    }
+    stream = deflate_zstream.release();
+}
+
+std::string
+ZlibDeflater::deflate(const char * data, size_t data_len)
+{
+    make_deflate_zstream();
+    if (!dictionary.empty()) {
+	// The dictionary has to be set again after every reset.
+	int err = deflateSetDictionary(stream,
+	    reinterpret_cast<const Bytef *>(dictionary.data()),
+	    (uInt)dictionary.size());
+	if (rare(err != Z_OK)) {
+	    throw_zlib_error("deflateSetDictionary", err, stream);
+	}
+    }
+
+    std::string compressed;
+    compressed.reserve(deflateBound(stream, (uLong)data_len));
+    stream->next_in = (Bytef*)const_cast<char *>(data);
+    stream->avail_in = (uInt)data_len;
+    Bytef buf[8192];
+    int err = Z_OK;
+    while (err != Z_STREAM_END) {
+	stream->next_out = buf;
+	stream->avail_out = (uInt)sizeof(buf);
+	err = ::deflate(stream, Z_FINISH);
+	if (err != Z_OK && err != Z_STREAM_END) {
+	    throw_zlib_error("deflate", err, stream);
+	}
+	compressed.append(reinterpret_cast<const char *>(buf),
+			  stream->next_out - buf);
+    }
+    return compressed;
 }
@@ -28,17 +28,98 @@
 #include "safe_zlib.h"
 #include <string>
 
+/** The stream formats supported by the zlib wrappers.
+ */
+enum ZlibFormat {
+    /// zlib format (RFC 1950): a small header and an adler32 trailer.
+    ZLIB_FORMAT_ZLIB,
+
+    /// Raw deflate data (RFC 1951), with no header or trailer.
+    ZLIB_FORMAT_RAW,
+
+    /// gzip format (RFC 1952), as used for HTTP content codings.
+    ZLIB_FORMAT_GZIP
+};
+
 class ZlibInflater {
     z_stream * stream;
+    ZlibFormat format;
+    std::string dictionary;
+
+    /// True if the end of the stream being inflated has been reached.
+    bool ended;
+
     void make_inflate_zstream();
   public:
-    ZlibInflater() : stream(NULL) {}
-    ~ZlibInflater() {
-	delete stream;
+    ZlibInflater(ZlibFormat format_ = ZLIB_FORMAT_ZLIB)
+	    : stream(NULL), format(format_), ended(false) {}
+    ~ZlibInflater();
+
+    /** Set a preset dictionary to use when inflating.
+     *
+     *  This must be the same dictionary as was used when the data was
+     *  compressed.  An empty string means that no dictionary is used.
+     */
+    void set_dictionary(const std::string & dictionary_) {
+	dictionary = dictionary_;
     }
+
     /** Uncompress some data compressed with zlib.
      */
     std::string inflate(const char * data, size_t len);
+
+    /** Start uncompressing data which is supplied in pieces.
+     *
+     *  Each piece should then be passed to inflate_chunk(), followed by a
+     *  call to finish().
+     */
+    void start();
+
+    /** Uncompress the next piece of the data, appending it to output.
+     *
+     *  At most max_output bytes are appended: if the piece uncompresses to
+     *  more than this, uncompressing stops as soon as the limit is passed
+     *  and false is returned, and start() must be called before using the
+     *  inflater again.  Otherwise, true is returned.
+     *
+     *  Throws CompressionError if the data is invalid, or continues past
+     *  the end of the compressed stream.
+     */
+    bool inflate_chunk(const char * data, size_t len, std::string & output,
+		       size_t max_output = size_t(-1));
+
+    /** Finish uncompressing data supplied in pieces.
+     *
+     *  Throws CompressionError if the compressed stream was incomplete.
+     */
+    void finish();
+};
+
+class ZlibDeflater {
+    z_stream * stream;
+    ZlibFormat format;
+    int level;
+    std::string dictionary;
+    void make_deflate_zstream();
+  public:
+    ZlibDeflater(ZlibFormat format_ = ZLIB_FORMAT_ZLIB,
+		 int level_ = Z_DEFAULT_COMPRESSION)
+	    : stream(NULL), format(format_), level(level_) {}
+    ~ZlibDeflater();
+
+    /** Set a preset dictionary to use when deflating.
+     *
+     *  Strings which occur often in the data to be compressed should be put
+     *  towards the end of the dictionary.  An empty string means that no
+     *  dictionary is used.
+     */
+    void set_dictionary(const std::string & dictionary_) {
+	dictionary = dictionary_;
+    }
+
+    /** Compress some data with zlib.
+     */
+    std::string deflate(const char * data, size_t len);
 };
 
-#endif /* RESTPOSE_INCLUDED_UTILS_H */
+#endif /* RESTPOSE_INCLUDED_COMPRESSION_H */
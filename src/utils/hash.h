@@ -0,0 +1,75 @@
+/** @file hash.h
+ * @brief Hash functions for strings.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RESTPOSE_INCLUDED_HASH_H
+#define RESTPOSE_INCLUDED_HASH_H
+
+#include <cstddef>
+#include "utils/safe_inttypes.h"
+
+/** Initial state for 64 bit FNV-1a hashing (the offset basis).
+ */
+#define FNV1A_HASH_INIT 14695981039346656037ULL
+
+/** Extend a 64 bit FNV-1a hash state with some bytes.
+ *
+ *  This allows a hash to be built up from several pieces of data, starting
+ *  from FNV1A_HASH_INIT.
+ */
+inline uint64_t
+fnv1a_hash_extend(uint64_t h, const char * data, size_t len)
+{
+    for (size_t i = 0; i != len; ++i) {
+	h ^= static_cast<unsigned char>(data[i]);
+	h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/** Calculate the 64 bit FNV-1a hash of some bytes.
+ */
+inline uint64_t
+fnv1a_hash(const char * data, size_t len)
+{
+    return fnv1a_hash_extend(FNV1A_HASH_INIT, data, len);
+}
+
+/** Mix the bits of a hash, for use as an index into a hash table.
+ *
+ *  The low bits of an FNV-1a hash depend only on the low bits of the input
+ *  bytes, so this mixes them so that every bit depends on all the input.
+ *  Never returns 0, so that 0 can be used to mark empty slots.
+ */
+inline uint64_t
+hash_finish(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h ? h : 1;
+}
+
+#endif /* RESTPOSE_INCLUDED_HASH_H */
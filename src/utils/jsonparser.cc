@@ -0,0 +1,387 @@
+/** @file jsonparser.cc
+ * @brief A fast single pass JSON parser.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "utils/jsonparser.h"
+
+#include <cstdlib>
+#include <cstring>
+#include "str.h"
+#include <string>
+#include "utils/rsperrors.h"
+
+using namespace RestPose;
+using namespace std;
+
+/// The maximum depth of nested arrays and objects accepted.
+#define JSON_MAX_DEPTH 1000
+
+/// State for parsing a JSON value.
+class JsonFastParser {
+    const char * begin;
+    const char * pos;
+    const char * end;
+
+    /// Raise an error, giving the position reached.
+    void fail(const char * message) {
+	unsigned line = 1;
+	const char * line_start = begin;
+	for (const char * i = begin; i != pos && i != end; ++i) {
+	    if (*i == '\n') {
+		++line;
+		line_start = i + 1;
+	    }
+	}
+	throw InvalidValueError(string("Invalid JSON: ") + message +
+				" at line " + str(line) + ", column " +
+				str(size_t(pos - line_start) + 1));
+    }
+
+    /// Skip whitespace and comments.
+    void skip_space() {
+	while (pos != end) {
+	    switch (*pos) {
+		case ' ': case '\t': case '\r': case '\n':
+		    ++pos;
+		    break;
+		case '/':
+		    if (end - pos >= 2 && pos[1] == '/') {
+			pos += 2;
+			while (pos != end && *pos != '\n' && *pos != '\r') ++pos;
+		    } else if (end - pos >= 2 && pos[1] == '*') {
+			const char * comment_start = pos;
+			pos += 2;
+			while (true) {
+			    if (end - pos < 2) {
+				pos = comment_start;
+				fail("unterminated comment");
+			    }
+			    if (pos[0] == '*' && pos[1] == '/') break;
+			    ++pos;
+			}
+			pos += 2;
+		    } else {
+			return;
+		    }
+		    break;
+		default:
+		    return;
+	    }
+	}
+    }
+
+    /// Read four hex digits.
+    unsigned read_hex4() {
+	if (end - pos < 4) {
+	    fail("bad unicode escape sequence");
+	}
+	unsigned result = 0;
+	for (int i = 0; i != 4; ++i) {
+	    char c = *pos++;
+	    result *= 16;
+	    if (c >= '0' && c <= '9') {
+		result += c - '0';
+	    } else if (c >= 'a' && c <= 'f') {
+		result += c - 'a' + 10;
+	    } else if (c >= 'A' && c <= 'F') {
+		result += c - 'A' + 10;
+	    } else {
+		--pos;
+		fail("bad unicode escape sequence");
+	    }
+	}
+	return result;
+    }
+
+    /// Append a unicode codepoint in UTF-8, as jsoncpp does.
+    static void append_utf8(string & result, unsigned cp) {
+	if (cp <= 0x7f) {
+	    result += char(cp);
+	} else if (cp <= 0x7ff) {
+	    result += char(0xc0 | (0x1f & (cp >> 6)));
+	    result += char(0x80 | (0x3f & cp));
+	} else if (cp <= 0xffff) {
+	    result += char(0xe0 | (0xf & (cp >> 12)));
+	    result += char(0x80 | (0x3f & (cp >> 6)));
+	    result += char(0x80 | (0x3f & cp));
+	} else if (cp <= 0x10ffff) {
+	    result += char(0xf0 | (0x7 & (cp >> 18)));
+	    result += char(0x80 | (0x3f & (cp >> 12)));
+	    result += char(0x80 | (0x3f & (cp >> 6)));
+	    result += char(0x80 | (0x3f & cp));
+	}
+    }
+
+    /** Read a string, with pos just after the opening quote.
+     *
+     *  Strings without escapes are copied in one go.
+     */
+    void read_string(string & result) {
+	const char * start = pos;
+	while (pos != end && *pos != '"' && *pos != '\\') ++pos;
+	result.assign(start, pos - start);
+	while (true) {
+	    if (pos == end) {
+		fail("missing '\"' at end of string");
+	    }
+	    char c = *pos++;
+	    if (c == '"') {
+		return;
+	    }
+	    if (c != '\\') {
+		result += c;
+		continue;
+	    }
+	    if (pos == end) {
+		fail("empty escape sequence in string");
+	    }
+	    switch (*pos++) {
+		case '"': result += '"'; break;
+		case '/': result += '/'; break;
+		case '\\': result += '\\'; break;
+		case 'b': result += '\b'; break;
+		case 'f': result += '\f'; break;
+		case 'n': result += '\n'; break;
+		case 'r': result += '\r'; break;
+		case 't': result += '\t'; break;
+		case 'u': {
+		    unsigned cp = read_hex4();
+		    if (cp >= 0xd800 && cp <= 0xdbff) {
+			// Surrogate pair.
+			if (end - pos < 6 || pos[0] != '\\' || pos[1] != 'u') {
+			    fail("expected second half of surrogate pair");
+			}
+			pos += 2;
+			unsigned low = read_hex4();
+			cp = 0x10000 + ((cp & 0x3ff) << 10) + (low & 0x3ff);
+		    }
+		    append_utf8(result, cp);
+		    break;
+		}
+		default:
+		    --pos;
+		    fail("bad escape sequence in string");
+	    }
+	    // Copy the run up to the next quote or escape.
+	    start = pos;
+	    while (pos != end && *pos != '"' && *pos != '\\') ++pos;
+	    result.append(start, pos - start);
+	}
+    }
+
+    /// Read a number, converting it as jsoncpp does.
+    void read_number(Json::Value & value) {
+	const char * start = pos;
+	bool negative = false;
+	if (*pos == '-') {
+	    negative = true;
+	    ++pos;
+	}
+	if (pos == end || *pos < '0' || *pos > '9') {
+	    fail("invalid number");
+	}
+	// Accumulate the integer part, checking for overflow as jsoncpp
+	// does: numbers which don't fit are read as doubles.
+	Json::Value::LargestUInt max_value = negative ?
+		Json::Value::LargestUInt(-Json::Value::minLargestInt) :
+		Json::Value::maxLargestUInt;
+	Json::Value::LargestUInt threshold = max_value / 10;
+	unsigned last_digit_threshold = unsigned(max_value % 10);
+	Json::Value::LargestUInt num = 0;
+	bool overflow = false;
+	if (*pos == '0') {
+	    ++pos;
+	} else {
+	    while (pos != end && *pos >= '0' && *pos <= '9') {
+		unsigned digit = *pos++ - '0';
+		if (num >= threshold &&
+		    (num > threshold || digit > last_digit_threshold ||
+		     (pos != end && *pos >= '0' && *pos <= '9'))) {
+		    overflow = true;
+		}
+		num = num * 10 + digit;
+	    }
+	}
+	bool is_double = overflow;
+	if (pos != end && *pos == '.') {
+	    ++pos;
+	    if (pos == end || *pos < '0' || *pos > '9') {
+		fail("invalid number");
+	    }
+	    while (pos != end && *pos >= '0' && *pos <= '9') ++pos;
+	    is_double = true;
+	}
+	if (pos != end && (*pos == 'e' || *pos == 'E')) {
+	    ++pos;
+	    if (pos != end && (*pos == '+' || *pos == '-')) ++pos;
+	    if (pos == end || *pos < '0' || *pos > '9') {
+		fail("invalid number");
+	    }
+	    while (pos != end && *pos >= '0' && *pos <= '9') ++pos;
+	    is_double = true;
+	}
+
+	if (is_double) {
+	    // strtod needs a nul terminated string.
+	    char buf[64];
+	    size_t len = pos - start;
+	    double result;
+	    if (len < sizeof(buf)) {
+		memcpy(buf, start, len);
+		buf[len] = '\0';
+		result = strtod(buf, NULL);
+	    } else {
+		result = strtod(string(start, len).c_str(), NULL);
+	    }
+	    value = result;
+	} else if (negative) {
+	    value = -Json::Value::LargestInt(num);
+	} else if (num <= Json::Value::LargestUInt(Json::Value::maxInt)) {
+	    value = Json::Value::LargestInt(num);
+	} else {
+	    value = num;
+	}
+    }
+
+    /// Check for a literal word, such as "true".
+    void read_literal(const char * word, size_t len) {
+	if (size_t(end - pos) < len || memcmp(pos, word, len) != 0) {
+	    fail("syntax error: value, object or array expected");
+	}
+	pos += len;
+    }
+
+    void read_value(Json::Value & value, unsigned depth) {
+	if (depth > JSON_MAX_DEPTH) {
+	    fail("nested too deeply");
+	}
+	skip_space();
+	if (pos == end) {
+	    fail("syntax error: value, object or array expected");
+	}
+	switch (*pos) {
+	    case '{': {
+		++pos;
+		value = Json::objectValue;
+		skip_space();
+		if (pos != end && *pos == '}') {
+		    ++pos;
+		    return;
+		}
+		string key;
+		while (true) {
+		    skip_space();
+		    if (pos == end || *pos != '"') {
+			fail("missing object member name");
+		    }
+		    ++pos;
+		    read_string(key);
+		    skip_space();
+		    if (pos == end || *pos != ':') {
+			fail("missing ':' after object member name");
+		    }
+		    ++pos;
+		    read_value(value[key], depth + 1);
+		    skip_space();
+		    if (pos != end && *pos == ',') {
+			++pos;
+			continue;
+		    }
+		    if (pos != end && *pos == '}') {
+			++pos;
+			return;
+		    }
+		    fail("missing ',' or '}' in object declaration");
+		}
+	    }
+	    case '[': {
+		++pos;
+		value = Json::arrayValue;
+		skip_space();
+		if (pos != end && *pos == ']') {
+		    ++pos;
+		    return;
+		}
+		while (true) {
+		    read_value(value.append(Json::Value()), depth + 1);
+		    skip_space();
+		    if (pos != end && *pos == ',') {
+			++pos;
+			continue;
+		    }
+		    if (pos != end && *pos == ']') {
+			++pos;
+			return;
+		    }
+		    fail("missing ',' or ']' in array declaration");
+		}
+	    }
+	    case '"': {
+		++pos;
+		string str;
+		read_string(str);
+		value = str;
+		return;
+	    }
+	    case 't':
+		read_literal("true", 4);
+		value = true;
+		return;
+	    case 'f':
+		read_literal("false", 5);
+		value = false;
+		return;
+	    case 'n':
+		read_literal("null", 4);
+		value = Json::nullValue;
+		return;
+	    case '-': case '0': case '1': case '2': case '3': case '4':
+	    case '5': case '6': case '7': case '8': case '9':
+		read_number(value);
+		return;
+	}
+	fail("syntax error: value, object or array expected");
+    }
+
+  public:
+    JsonFastParser(const char * begin_, const char * end_)
+	    : begin(begin_), pos(begin_), end(end_)
+    {}
+
+    void parse(Json::Value & value) {
+	read_value(value, 0);
+	skip_space();
+	if (pos != end) {
+	    fail("data found after the end of the value");
+	}
+    }
+};
+
+void
+RestPose::json_fast_parse(const char * begin, const char * end,
+			  Json::Value & value)
+{
+    JsonFastParser parser(begin, end);
+    parser.parse(value);
+}
@@ -0,0 +1,46 @@
+/** @file jsonparser.h
+ * @brief A fast single pass JSON parser.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RESTPOSE_INCLUDED_JSONPARSER_H
+#define RESTPOSE_INCLUDED_JSONPARSER_H
+
+#include "json/value.h"
+
+namespace RestPose {
+    /** Parse a JSON value from a buffer, building the value directly.
+     *
+     *  This produces the same value as jsoncpp's Json::Reader would for any
+     *  valid JSON (including the C and C++ style comments which it allows),
+     *  but makes a single pass over the input, without tokenising it first or
+     *  copying it.
+     *
+     *  Unlike Json::Reader, anything other than whitespace or comments after
+     *  the value is an error.  Raises InvalidValueError if the input is
+     *  invalid.
+     */
+    void json_fast_parse(const char * begin, const char * end,
+			 Json::Value & value);
+};
+
+#endif /* RESTPOSE_INCLUDED_JSONPARSER_H */
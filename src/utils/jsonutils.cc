@@ -31,6 +31,7 @@
 #include "json/writer.h"
 #include <string>
 
+#include "utils/jsonparser.h"
 #include "utils/rsperrors.h"
 
 namespace RestPose {
@@ -223,18 +224,48 @@ json_serialise(const Json::Value & value)
     return writer.write(value);
 }
 
+/// The parser used by json_unserialise().
+static JsonParserType json_parser = JSON_PARSER_FAST;
+
+void
+json_set_parser(JsonParserType type)
+{
+    json_parser = type;
+}
+
+JsonParserType
+json_get_parser()
+{
+    return json_parser;
+}
+
 Json::Value &
-json_unserialise(const std::string & serialised, Json::Value & value)
+json_unserialise(const char * begin, const char * end, Json::Value & value)
 {
-    Json::Reader reader;
-    bool ok = reader.parse(serialised, value, false);
-    if (!ok) {
-	throw InvalidValueError("Invalid JSON: " +
-				reader.getFormatedErrorMessages());
+    switch (json_parser) {
+	case JSON_PARSER_FAST:
+	    json_fast_parse(begin, end, value);
+	    break;
+	case JSON_PARSER_JSONCPP: {
+	    Json::Reader reader;
+	    bool ok = reader.parse(begin, end, value, false);
+	    if (!ok) {
+		throw InvalidValueError("Invalid JSON: " +
+					reader.getFormatedErrorMessages());
+	    }
+	    break;
+	}
     }
     return value;
 }
 
+Json::Value &
+json_unserialise(const std::string & serialised, Json::Value & value)
+{
+    const char * begin = serialised.data();
+    return json_unserialise(begin, begin + serialised.size(), value);
+}
+
 std::string
 json_get_lonlat(const Json::Value & value,
 		double * longitude, double * latitude)
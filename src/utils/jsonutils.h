@@ -136,12 +136,38 @@ namespace RestPose {
      */
     std::string json_serialise(const Json::Value & value);
 
+    /// The parsers which json_unserialise() can use.
+    enum JsonParserType {
+	/// The single pass parser in jsonparser.h.  This is the default.
+	JSON_PARSER_FAST,
+
+	/// jsoncpp's Json::Reader.
+	JSON_PARSER_JSONCPP
+    };
+
+    /** Set the parser used by json_unserialise().
+     *
+     *  This isn't threadsafe, so should only be called at startup (or in
+     *  tests).
+     */
+    void json_set_parser(JsonParserType type);
+
+    /// Get the parser used by json_unserialise().
+    JsonParserType json_get_parser();
+
     /** Parse a JSON value from a string.
      *
      *  Returns a reference to the value supplied, to allow easier use inline.
      */
     Json::Value & json_unserialise(const std::string & serialised, Json::Value & value);
 
+    /** Parse a JSON value from a buffer.
+     *
+     *  Returns a reference to the value supplied, to allow easier use inline.
+     */
+    Json::Value & json_unserialise(const char * begin, const char * end,
+				   Json::Value & value);
+
     /** Read a longitude-latitude coordinate from a Json value.
      *
      *  Returns an error string if the value was invalid - otherwise, assigns
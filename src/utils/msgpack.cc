@@ -0,0 +1,351 @@
+/** @file msgpack.cc
+ * @brief Conversion between JSON values and MessagePack.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "utils/msgpack.h"
+
+#include <cstring>
+#include "str.h"
+#include "utils/rsperrors.h"
+#include "utils/safe_inttypes.h"
+
+using namespace RestPose;
+using namespace std;
+
+/// The maximum depth of nested arrays and maps accepted when parsing.
+#define MSGPACK_MAX_DEPTH 1000
+
+/// Append a big-endian integer of the given number of bytes.
+static inline void
+append_be(string & output, uint64_t value, unsigned bytes)
+{
+    while (bytes != 0) {
+	--bytes;
+	output += char((value >> (bytes * 8)) & 0xff);
+    }
+}
+
+/// Append a type byte followed by a length, using the smallest form.
+static void
+append_length(string & output, size_t len,
+	      unsigned char fix, size_t fix_max,
+	      unsigned char type8, unsigned char type16,
+	      unsigned char type32)
+{
+    if (len <= fix_max) {
+	output += char(fix | len);
+    } else if (type8 != 0 && len <= 0xff) {
+	output += char(type8);
+	append_be(output, len, 1);
+    } else if (len <= 0xffff) {
+	output += char(type16);
+	append_be(output, len, 2);
+    } else {
+	output += char(type32);
+	append_be(output, len, 4);
+    }
+}
+
+/// Append an unsigned integer, using the smallest form.
+static void
+append_uint(string & output, uint64_t num)
+{
+    if (num < 0x80) {
+	output += char(num);
+    } else if (num <= 0xff) {
+	output += char(0xcc);
+	append_be(output, num, 1);
+    } else if (num <= 0xffff) {
+	output += char(0xcd);
+	append_be(output, num, 2);
+    } else if (num <= 0xffffffffULL) {
+	output += char(0xce);
+	append_be(output, num, 4);
+    } else {
+	output += char(0xcf);
+	append_be(output, num, 8);
+    }
+}
+
+static void
+append_string(string & output, const char * data, size_t len)
+{
+    append_length(output, len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+    output.append(data, len);
+}
+
+void
+RestPose::msgpack_serialise(const Json::Value & value, string & output)
+{
+    switch (value.type()) {
+	case Json::nullValue:
+	    output += char(0xc0);
+	    break;
+	case Json::booleanValue:
+	    output += char(value.asBool() ? 0xc3 : 0xc2);
+	    break;
+	case Json::intValue: {
+	    Json::Int64 num = value.asInt64();
+	    if (num >= 0) {
+		append_uint(output, uint64_t(num));
+	    } else if (num >= -32) {
+		output += char(num);
+	    } else if (num >= -0x80) {
+		output += char(0xd0);
+		append_be(output, uint64_t(num), 1);
+	    } else if (num >= -0x8000) {
+		output += char(0xd1);
+		append_be(output, uint64_t(num), 2);
+	    } else if (num >= -0x80000000LL) {
+		output += char(0xd2);
+		append_be(output, uint64_t(num), 4);
+	    } else {
+		output += char(0xd3);
+		append_be(output, uint64_t(num), 8);
+	    }
+	    break;
+	}
+	case Json::uintValue:
+	    append_uint(output, value.asUInt64());
+	    break;
+	case Json::realValue: {
+	    double num = value.asDouble();
+	    uint64_t bits;
+	    memcpy(&bits, &num, sizeof(bits));
+	    output += char(0xcb);
+	    append_be(output, bits, 8);
+	    break;
+	}
+	case Json::stringValue: {
+	    const char * str = value.asCString();
+	    append_string(output, str, strlen(str));
+	    break;
+	}
+	case Json::arrayValue:
+	    append_length(output, value.size(), 0x90, 15, 0, 0xdc, 0xdd);
+	    for (Json::ArrayIndex i = 0; i != value.size(); ++i) {
+		msgpack_serialise(value[i], output);
+	    }
+	    break;
+	case Json::objectValue:
+	    append_length(output, value.size(), 0x80, 15, 0, 0xde, 0xdf);
+	    for (Json::Value::const_iterator i = value.begin();
+		 i != value.end(); ++i) {
+		const char * key = i.memberName();
+		append_string(output, key, strlen(key));
+		msgpack_serialise(*i, output);
+	    }
+	    break;
+    }
+}
+
+string
+RestPose::msgpack_serialise(const Json::Value & value)
+{
+    string result;
+    msgpack_serialise(value, result);
+    return result;
+}
+
+/// State for parsing a MessagePack value.
+class MsgPackParser {
+    const unsigned char * pos;
+    const unsigned char * end;
+
+    void fail(const string & message) {
+	throw InvalidValueError("Invalid MessagePack: " + message);
+    }
+
+    /// Read a big-endian integer of the given number of bytes.
+    uint64_t read_be(unsigned bytes) {
+	if (size_t(end - pos) < bytes) {
+	    fail("data truncated");
+	}
+	uint64_t result = 0;
+	while (bytes != 0) {
+	    result = (result << 8) | *pos++;
+	    --bytes;
+	}
+	return result;
+    }
+
+    /// Read a string of the given length.
+    void read_string(size_t len, string & result) {
+	if (size_t(end - pos) < len) {
+	    fail("data truncated");
+	}
+	result.assign(reinterpret_cast<const char *>(pos), len);
+	pos += len;
+    }
+
+    /// Set value to an unsigned integer, as the JSON parser would.
+    static void set_uint(uint64_t num, Json::Value & value) {
+	if (num <= uint64_t(Json::Value::maxInt)) {
+	    value = Json::Value::LargestInt(num);
+	} else {
+	    value = Json::Value::LargestUInt(num);
+	}
+    }
+
+    void read_array(size_t len, Json::Value & value, unsigned depth) {
+	if (size_t(end - pos) < len) {
+	    // Each item takes at least one byte.
+	    fail("data truncated");
+	}
+	value = Json::arrayValue;
+	if (len != 0) {
+	    value.resize(Json::ArrayIndex(len));
+	}
+	for (size_t i = 0; i != len; ++i) {
+	    read_value(value[Json::ArrayIndex(i)], depth + 1);
+	}
+    }
+
+    void read_map(size_t len, Json::Value & value, unsigned depth) {
+	value = Json::objectValue;
+	string key;
+	for (size_t i = 0; i != len; ++i) {
+	    if (pos == end) {
+		fail("data truncated");
+	    }
+	    unsigned char type = *pos++;
+	    if ((type & 0xe0) == 0xa0) {
+		read_string(type & 0x1f, key);
+	    } else if (type >= 0xd9 && type <= 0xdb) {
+		read_string(read_be(1 << (type - 0xd9)), key);
+	    } else {
+		fail("map key is not a string");
+	    }
+	    read_value(value[key], depth + 1);
+	}
+    }
+
+  public:
+    MsgPackParser(const string & serialised)
+	    : pos(reinterpret_cast<const unsigned char *>(serialised.data())),
+	      end(pos + serialised.size())
+    {}
+
+    void read_value(Json::Value & value, unsigned depth) {
+	if (depth > MSGPACK_MAX_DEPTH) {
+	    fail("nested too deeply");
+	}
+	if (pos == end) {
+	    fail("data truncated");
+	}
+	unsigned char type = *pos++;
+	if (type < 0x80) {
+	    value = Json::Value::LargestInt(type);
+	    return;
+	}
+	if (type >= 0xe0) {
+	    value = Json::Value::LargestInt(int(type) - 0x100);
+	    return;
+	}
+	if ((type & 0xf0) == 0x80) {
+	    read_map(type & 0x0f, value, depth);
+	    return;
+	}
+	if ((type & 0xf0) == 0x90) {
+	    read_array(type & 0x0f, value, depth);
+	    return;
+	}
+	if ((type & 0xe0) == 0xa0) {
+	    string str;
+	    read_string(type & 0x1f, str);
+	    value = str;
+	    return;
+	}
+	switch (type) {
+	    case 0xc0:
+		value = Json::nullValue;
+		return;
+	    case 0xc2:
+		value = false;
+		return;
+	    case 0xc3:
+		value = true;
+		return;
+	    case 0xc4: case 0xc5: case 0xc6: // bin 8, 16, 32
+	    case 0xd9: case 0xda: case 0xdb: { // str 8, 16, 32
+		unsigned bytes = 1 << ((type >= 0xd9 ? type - 0xd9 : type - 0xc4));
+		string str;
+		read_string(read_be(bytes), str);
+		value = str;
+		return;
+	    }
+	    case 0xca: { // float 32
+		uint32_t bits = uint32_t(read_be(4));
+		float num;
+		memcpy(&num, &bits, sizeof(num));
+		value = double(num);
+		return;
+	    }
+	    case 0xcb: { // float 64
+		uint64_t bits = read_be(8);
+		double num;
+		memcpy(&num, &bits, sizeof(num));
+		value = num;
+		return;
+	    }
+	    case 0xcc: case 0xcd: case 0xce: case 0xcf: // uint 8, 16, 32, 64
+		set_uint(read_be(1 << (type - 0xcc)), value);
+		return;
+	    case 0xd0: // int 8
+		value = Json::Value::LargestInt(int8_t(read_be(1)));
+		return;
+	    case 0xd1: // int 16
+		value = Json::Value::LargestInt(int16_t(read_be(2)));
+		return;
+	    case 0xd2: // int 32
+		value = Json::Value::LargestInt(int32_t(read_be(4)));
+		return;
+	    case 0xd3: // int 64
+		value = Json::Value::LargestInt(int64_t(read_be(8)));
+		return;
+	    case 0xdc: case 0xdd: // array 16, 32
+		read_array(read_be(type == 0xdc ? 2 : 4), value, depth);
+		return;
+	    case 0xde: case 0xdf: // map 16, 32
+		read_map(read_be(type == 0xde ? 2 : 4), value, depth);
+		return;
+	}
+	fail("unsupported type " + str(unsigned(type)));
+    }
+
+    void check_end() {
+	if (pos != end) {
+	    fail("data found after the end of the value");
+	}
+    }
+};
+
+Json::Value &
+RestPose::msgpack_unserialise(const string & serialised, Json::Value & value)
+{
+    MsgPackParser parser(serialised);
+    parser.read_value(value, 0);
+    parser.check_end();
+    return value;
+}
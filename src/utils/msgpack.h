@@ -0,0 +1,55 @@
+/** @file msgpack.h
+ * @brief Conversion between JSON values and MessagePack.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RESTPOSE_INCLUDED_MSGPACK_H
+#define RESTPOSE_INCLUDED_MSGPACK_H
+
+#include "json/value.h"
+#include <string>
+
+namespace RestPose {
+    /** Serialise a JSON value in MessagePack format.
+     *
+     *  The result is appended to output.
+     */
+    void msgpack_serialise(const Json::Value & value, std::string & output);
+
+    /** Serialise a JSON value as a string, in MessagePack format.
+     */
+    std::string msgpack_serialise(const Json::Value & value);
+
+    /** Parse a JSON value from a string in MessagePack format.
+     *
+     *  Produces the same value as json_unserialise() would for the JSON
+     *  equivalent of the data.  Binary data is converted to strings.  Raises
+     *  InvalidValueError if the data is invalid, or uses features with no
+     *  JSON equivalent (such as non-string map keys, or extension types).
+     *
+     *  Returns a reference to the value supplied, to allow easier use inline.
+     */
+    Json::Value & msgpack_unserialise(const std::string & serialised,
+				      Json::Value & value);
+};
+
+#endif /* RESTPOSE_INCLUDED_MSGPACK_H */
@@ -89,6 +89,13 @@ namespace RestPose {
       public:
 	ImporterError(const std::string & message_) : Error(message_, "ImporterError") {}
     };
+
+    /** An error when compressing or decompressing data.
+     */
+    class CompressionError : public Error {
+      public:
+	CompressionError(const std::string & message_) : Error(message_, "CompressionError") {}
+    };
 };
 
 #endif /* RESTPOSE_INCLUDED_RSPERRORS_H */
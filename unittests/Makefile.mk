@@ -1,3 +1,5 @@
+INCLUDES += -I$(top_srcdir)/unittests
+
 check_PROGRAMS += unittest
 
 TESTS += unittest$(EXEEXT)
@@ -6,14 +8,23 @@ TESTS += unittest$(EXEEXT)
 unittest_SOURCES = \
  unittests/category_hierarchy.cc \
  unittests/collection.cc \
+ unittests/compression.cc \
  unittests/docdata.cc \
  unittests/doctojson.cc \
+ unittests/docvalues.cc \
+ unittests/document_cache.cc \
+ unittests/features/categoriser_tasks.cc \
  unittests/jsonmanip/conditionals.cc \
  unittests/jsonmanip/mapping.cc \
  unittests/jsonmanip/walker.cc \
+ unittests/jsonparser.cc \
+ unittests/matchspies/countminsketch.cc \
+ unittests/matchspies/termcounts.cc \
+ unittests/msgpack.cc \
  unittests/ngramcat/categoriser.cc \
  unittests/ngramcat/profile.cc \
  unittests/pipe.cc \
+ unittests/query_plan_cache.cc \
  unittests/schema.cc \
  unittests/search.cc \
  unittests/server/checkpoints.cc \
@@ -23,7 +34,11 @@ unittest_SOURCES = \
 unittest_SOURCES += \
  unittests/runner.cc
 
+noinst_HEADERS += \
+ unittests/tempdir.h
+
 unittest_LDADD = \
+ libfeatures.a \
  libserver.a \
  libhttpserver.a \
  librest.a \
@@ -52,15 +52,21 @@ flatten(const Categories & cats)
 }
 
 static string
-flatten(const Category * cat)
+flatten(const Taxonomy & h, const string & cat_name)
 {
-    if (cat == NULL) {
+    Taxonomy::CategoryId cat = h.find_id(cat_name);
+    if (cat == Taxonomy::NO_CATEGORY) {
 	return "NULL";
     }
-    return flatten(cat->parents) + ":" +
-	   flatten(cat->ancestors) + ":" +
-	   flatten(cat->children) + ":" +
-	   flatten(cat->descendants);
+    Categories parents, ancestors, children, descendants;
+    h.get_parents(cat, parents);
+    h.get_ancestors(cat, ancestors);
+    h.get_children(cat, children);
+    h.get_descendants(cat, descendants);
+    return flatten(parents) + ":" +
+	   flatten(ancestors) + ":" +
+	   flatten(children) + ":" +
+	   flatten(descendants);
 }
 
 /// Test building a basic hierarchy
@@ -80,7 +86,7 @@ TEST(TaxonomyBasic)
     CHECK_EQUAL("{\"cat1\":[]}",
 		json_serialise(h.to_json(tmp)));
     CHECK_EQUAL("cat1", flatten(modified));
-    CHECK_EQUAL(":::", flatten(h.find("cat1")));
+    CHECK_EQUAL(":::", flatten(h, "cat1"));
 
     // Adding the same category again doesn't put it in modified.
     modified.clear();
@@ -88,7 +94,7 @@ TEST(TaxonomyBasic)
     CHECK_EQUAL("{\"cat1\":[]}",
 		json_serialise(h.to_json(tmp)));
     CHECK_EQUAL("", flatten(modified));
-    CHECK_EQUAL(":::", flatten(h.find("cat1")));
+    CHECK_EQUAL(":::", flatten(h, "cat1"));
 
     // Add a parent.
     modified.clear();
@@ -96,8 +102,8 @@ TEST(TaxonomyBasic)
     CHECK_EQUAL("{\"cat1\":[\"cat2\"],\"cat2\":[]}",
 		json_serialise(h.to_json(tmp)));
     CHECK_EQUAL("cat1,cat2", flatten(modified));
-    CHECK_EQUAL("cat2:cat2::", flatten(h.find("cat1")));
-    CHECK_EQUAL("::cat1:cat1", flatten(h.find("cat2")));
+    CHECK_EQUAL("cat2:cat2::", flatten(h, "cat1"));
+    CHECK_EQUAL("::cat1:cat1", flatten(h, "cat2"));
 
     // Add the child as a parent of something else.
     modified.clear();
@@ -105,9 +111,9 @@ TEST(TaxonomyBasic)
     CHECK_EQUAL("{\"cat0\":[\"cat1\"],\"cat1\":[\"cat2\"],\"cat2\":[]}",
 		json_serialise(h.to_json(tmp)));
     CHECK_EQUAL("cat0,cat1,cat2", flatten(modified));
-    CHECK_EQUAL("cat1:cat1,cat2::", flatten(h.find("cat0")));
-    CHECK_EQUAL("cat2:cat2:cat0:cat0", flatten(h.find("cat1")));
-    CHECK_EQUAL("::cat1:cat0,cat1", flatten(h.find("cat2")));
+    CHECK_EQUAL("cat1:cat1,cat2::", flatten(h, "cat0"));
+    CHECK_EQUAL("cat2:cat2:cat0:cat0", flatten(h, "cat1"));
+    CHECK_EQUAL("::cat1:cat0,cat1", flatten(h, "cat2"));
 
     Json::Value saved_config;
     h.to_json(saved_config);
@@ -118,9 +124,9 @@ TEST(TaxonomyBasic)
     CHECK_EQUAL("{\"cat0\":[],\"cat2\":[]}",
 		json_serialise(h.to_json(tmp)));
     CHECK_EQUAL("cat0,cat1,cat2", flatten(modified));
-    CHECK_EQUAL(":::", flatten(h.find("cat0")));
-    CHECK_EQUAL("NULL", flatten(h.find("cat1")));
-    CHECK_EQUAL(":::", flatten(h.find("cat2")));
+    CHECK_EQUAL(":::", flatten(h, "cat0"));
+    CHECK_EQUAL("NULL", flatten(h, "cat1"));
+    CHECK_EQUAL(":::", flatten(h, "cat2"));
 
     // Deleting it again should have no effect.
     modified.clear();
@@ -128,9 +134,9 @@ TEST(TaxonomyBasic)
     CHECK_EQUAL("{\"cat0\":[],\"cat2\":[]}",
 		json_serialise(h.to_json(tmp)));
     CHECK_EQUAL("", flatten(modified));
-    CHECK_EQUAL(":::", flatten(h.find("cat0")));
-    CHECK_EQUAL("NULL", flatten(h.find("cat1")));
-    CHECK_EQUAL(":::", flatten(h.find("cat2")));
+    CHECK_EQUAL(":::", flatten(h, "cat0"));
+    CHECK_EQUAL("NULL", flatten(h, "cat1"));
+    CHECK_EQUAL(":::", flatten(h, "cat2"));
 
     Json::Value saved_config2;
     h.to_json(saved_config2);
@@ -139,18 +145,30 @@ TEST(TaxonomyBasic)
     h.from_json(saved_config);
     CHECK_EQUAL("{\"cat0\":[\"cat1\"],\"cat1\":[\"cat2\"],\"cat2\":[]}",
 		json_serialise(h.to_json(tmp)));
-    CHECK_EQUAL("cat1:cat1,cat2::", flatten(h.find("cat0")));
-    CHECK_EQUAL("cat2:cat2:cat0:cat0", flatten(h.find("cat1")));
-    CHECK_EQUAL("::cat1:cat0,cat1", flatten(h.find("cat2")));
+    CHECK_EQUAL("cat1:cat1,cat2::", flatten(h, "cat0"));
+    CHECK_EQUAL("cat2:cat2:cat0:cat0", flatten(h, "cat1"));
+    CHECK_EQUAL("::cat1:cat0,cat1", flatten(h, "cat2"));
 
     h.from_json(saved_config2);
     CHECK_EQUAL("{\"cat0\":[],\"cat2\":[]}",
 		json_serialise(h.to_json(tmp)));
-    CHECK_EQUAL(":::", flatten(h.find("cat0")));
-    CHECK_EQUAL("NULL", flatten(h.find("cat1")));
-    CHECK_EQUAL(":::", flatten(h.find("cat2")));
+    CHECK_EQUAL(":::", flatten(h, "cat0"));
+    CHECK_EQUAL("NULL", flatten(h, "cat1"));
+    CHECK_EQUAL(":::", flatten(h, "cat2"));
 }
 
+/// The relationships of a category, for checking invariants.
+struct Category {
+    Categories parents, ancestors, children, descendants;
+
+    Category(const Taxonomy & h, Taxonomy::CategoryId id) {
+	h.get_parents(id, parents);
+	h.get_ancestors(id, ancestors);
+	h.get_children(id, children);
+	h.get_descendants(id, descendants);
+    }
+};
+
 static bool
 check_for_loop(const Taxonomy & h, const string & child, const string & parent)
 {
@@ -159,21 +177,25 @@ check_for_loop(const Taxonomy & h, const string & child, const string & parent)
 	return true;
     }
 
-    const Category * child_cat = h.find(child);
-    const Category * parent_cat = h.find(parent);
-    if (child_cat == NULL || parent_cat == NULL) {
+    Taxonomy::CategoryId child_cat = h.find_id(child);
+    Taxonomy::CategoryId parent_cat = h.find_id(parent);
+    if (child_cat == Taxonomy::NO_CATEGORY ||
+	parent_cat == Taxonomy::NO_CATEGORY) {
 	// If either is new, can't be a loop.
 	return false;
     }
 
     // Check all the ancestors for the parent.  If any are descendants of the child, we have a loop.
-    for (Categories::const_iterator i = parent_cat->ancestors.begin();
-	 i != parent_cat->ancestors.end(); ++i) {
-	if (child_cat->descendants.find(*i) != child_cat->descendants.end()) {
+    Categories ancestors, descendants;
+    h.get_ancestors(parent_cat, ancestors);
+    h.get_descendants(child_cat, descendants);
+    for (Categories::const_iterator i = ancestors.begin();
+	 i != ancestors.end(); ++i) {
+	if (descendants.find(*i) != descendants.end()) {
 	    return true;
 	}
     }
-    if (child_cat->descendants.find(parent) != child_cat->descendants.end()) {
+    if (descendants.find(parent) != descendants.end()) {
 	return true;
     }
 
@@ -196,15 +218,19 @@ TEST(TaxonomyRandomOp)
 	Categories modified;
 	if (action < 30) {
 	    // 30% of time, add a parent.
-	    const Category * old = h.find(c1);
+	    Taxonomy::CategoryId old = h.find_id(c1);
+	    Categories old_descendants;
+	    if (old != Taxonomy::NO_CATEGORY) {
+		h.get_descendants(old, old_descendants);
+	    }
 	    if (check_for_loop(h, c1, c2)) {
 		CHECK_THROW(h.add_parent(c1, c2, modified), InvalidValueError);
-	    } else if (old == NULL) {
+	    } else if (old == Taxonomy::NO_CATEGORY) {
 		// Category didn't exist, so both it and the parent should be modified.
 		h.add_parent(c1, c2, modified);
 		CHECK(modified.find(c1) != modified.end());
 		CHECK(modified.find(c2) != modified.end());
-	    } else if (old->descendants.find(c2) != old->descendants.end()) {
+	    } else if (old_descendants.find(c2) != old_descendants.end()) {
 		// Parent was already a child of this category, so should get an error.
 		CHECK_THROW(h.add_parent(c1, c2, modified), InvalidValueError);
 	    } else {
@@ -213,18 +239,18 @@ TEST(TaxonomyRandomOp)
 	    }
 	} else if (action < 60) {
 	    // 30% of time, add a category, with no parent.
-	    const Category * old = h.find(c1);
+	    bool existed = h.contains(c1);
 	    h.add(c1, modified);
-	    if (old == NULL) {
+	    if (!existed) {
 		CHECK(modified.find(c1) != modified.end());
 	    } else {
 		CHECK_EQUAL(size_t(0), modified.size());
 	    }
 	} else if (action < 80) {
 	    // 20% of time, remove a category.
-	    const Category * old = h.find(c1);
+	    bool existed = h.contains(c1);
 	    h.remove(c1, modified);
-	    if (old == NULL) {
+	    if (!existed) {
 		CHECK_EQUAL(size_t(0), modified.size());
 	    } else {
 		CHECK(modified.find(c1) != modified.end());
@@ -234,8 +260,11 @@ TEST(TaxonomyRandomOp)
 	} else {
 	    // 20% of time, remove a parent.
 	    bool changed = false;
-	    const Category * old = h.find(c1);
-	    if (old != NULL && old->parents.find(c2) != old->parents.end()) {
+	    Taxonomy::CategoryId old = h.find_id(c1);
+	    Taxonomy::CategoryId old_parent = h.find_id(c2);
+	    if (old != Taxonomy::NO_CATEGORY &&
+		old_parent != Taxonomy::NO_CATEGORY &&
+		h.is_parent(old, old_parent)) {
 		changed = true;
 	    }
 	    h.remove_parent(c1, c2, modified);
@@ -248,15 +277,16 @@ TEST(TaxonomyRandomOp)
 	}
 
 	// Check that "modified" matches the categories which have changed.
-	for (map<string, Category>::const_iterator i = h.begin();
-	     i != h.end(); ++i) {
-	    const Category & cat(i->second);
-	    string newflat = flatten(&cat);
-	    map<string, string>::iterator j = flat_cats.find(cat.name);
+	for (Taxonomy::const_iterator i = h.begin(); i != h.end(); ++i) {
+	    string newflat = flatten(h, i->first);
+	    map<string, string>::iterator j = flat_cats.find(i->first);
 	    if (j == flat_cats.end() || j->second != newflat) {
-		actual_modified.insert(cat.name);
+		actual_modified.insert(i->first);
 	    }
-	    flat_cats[cat.name] = newflat;
+	    flat_cats[i->first] = newflat;
+
+	    Category cat(h, i->second);
+	    CHECK_EQUAL(cat.descendants.size(), h.descendant_count(i->second));
 
 	    // Check that all parents are also ancestors.
 	    for (Categories::const_iterator k = cat.parents.begin();
@@ -288,13 +318,13 @@ TEST(TaxonomyRandomOp)
 	h.to_json(tmp);
 	h.from_json(tmp);
 	CHECK_EQUAL(flat_cats.size(), h.size());
-	for (map<string, Category>::const_iterator i = h.begin();
-	     i != h.end(); ++i) {
-	    const Category & cat(i->second);
-	    string newflat = flatten(&cat);
-	    map<string, string>::iterator j = flat_cats.find(cat.name);
+	for (Taxonomy::const_iterator i = h.begin(); i != h.end(); ++i) {
+	    string newflat = flatten(h, i->first);
+	    map<string, string>::iterator j = flat_cats.find(i->first);
 	    CHECK(j != flat_cats.end());
 	    CHECK_EQUAL(j->second, newflat);
+	    Category cat(h, i->second);
+	    CHECK_EQUAL(cat.descendants.size(), h.descendant_count(i->second));
 	}
 	
     }
@@ -26,22 +26,21 @@
 #include "UnitTest++.h"
 
 #include <cstdlib>
-#include <cstring>
-#include <cerrno>
+#include <memory>
+#include "jsonxapian/collconfigs.h"
 #include "jsonxapian/collection.h"
 #include "jsonxapian/collection_pool.h"
 #include "jsonxapian/doctojson.h"
 #include "jsonxapian/indexing.h"
 #include "jsonxapian/pipe.h"
 #include "server/task_manager.h"
+#include "str.h"
+#include "tempdir.h"
 #include "utils.h"
 #include "utils/jsonutils.h"
 #include "utils/rsperrors.h"
-
-#ifdef __WIN32__
-#include <windows.h>
-#include <tchar.h>
-#endif
+#include <utility>
+#include <vector>
 
 using namespace RestPose;
 
@@ -50,18 +49,18 @@ using namespace RestPose;
   "\"patterns\":[" \
     "[\"*_text\",{\"group\":\"t*\",\"processor\":\"stem_en\",\"store_field\":\"*_text\",\"type\":\"text\"}]," \
     "[\"text\",{\"group\":\"t\",\"processor\":\"stem_en\",\"store_field\":\"text\",\"type\":\"text\"}]," \
-    "[\"*_num\",{\"slot\":\"n*\",\"store_field\":\"*_num\",\"type\":\"double\"}]," \
-    "[\"num\",{\"slot\":\"n\",\"store_field\":\"num\",\"type\":\"double\"}]," \
-    "[\"*_time\",{\"slot\":\"d*\",\"store_field\":\"*_time\",\"type\":\"timestamp\"}]," \
-    "[\"time\",{\"slot\":\"d\",\"store_field\":\"time\",\"type\":\"timestamp\"}]," \
+    "[\"*_num\",{\"group\":\"n*\",\"slot\":\"n*\",\"sort_slot\":\"sn*\",\"store_field\":\"*_num\",\"type\":\"double\"}]," \
+    "[\"num\",{\"group\":\"n\",\"slot\":\"n\",\"sort_slot\":\"sn\",\"store_field\":\"num\",\"type\":\"double\"}]," \
+    "[\"*_time\",{\"group\":\"d*\",\"slot\":\"d*\",\"sort_slot\":\"sd*\",\"store_field\":\"*_time\",\"type\":\"timestamp\"}]," \
+    "[\"time\",{\"group\":\"d\",\"slot\":\"d\",\"sort_slot\":\"sd\",\"store_field\":\"time\",\"type\":\"timestamp\"}]," \
     "[\"*_tag\",{\"group\":\"g*\",\"max_length\":100,\"slot\":\"g*\",\"store_field\":\"*_tag\",\"too_long_action\":\"hash\",\"type\":\"exact\"}]," \
     "[\"tag\",{\"group\":\"g\",\"max_length\":100,\"slot\":\"g\",\"store_field\":\"tag\",\"too_long_action\":\"hash\",\"type\":\"exact\"}]," \
     "[\"*_url\",{\"group\":\"u*\",\"max_length\":100,\"slot\":\"u*\",\"store_field\":\"*_url\",\"too_long_action\":\"hash\",\"type\":\"exact\"}]," \
     "[\"url\",{\"group\":\"u\",\"max_length\":100,\"slot\":\"u\",\"store_field\":\"url\",\"too_long_action\":\"hash\",\"type\":\"exact\"}]," \
     "[\"*_cat\",{\"group\":\"c*\",\"max_length\":32,\"slot\":\"c*\",\"store_field\":\"*_cat\",\"taxonomy\":\"*_cat\",\"too_long_action\":\"hash\",\"type\":\"cat\"}]," \
     "[\"cat\",{\"group\":\"c\",\"max_length\":32,\"slot\":\"c\",\"store_field\":\"cat\",\"taxonomy\":\"cat\",\"too_long_action\":\"hash\",\"type\":\"cat\"}]," \
-    "[\"*_lonlat\",{\"slot\":\"l*\",\"store_field\":\"*_lonlat\",\"type\":\"lonlat\"}]," \
-    "[\"lonlat\",{\"slot\":\"l\",\"store_field\":\"lonlat\",\"type\":\"lonlat\"}]," \
+    "[\"*_lonlat\",{\"group\":\"l*\",\"slot\":\"l*\",\"store_field\":\"*_lonlat\",\"type\":\"lonlat\"}]," \
+    "[\"lonlat\",{\"group\":\"l\",\"slot\":\"l\",\"store_field\":\"lonlat\",\"type\":\"lonlat\"}]," \
     "[\"id\",{\"store_field\":\"id\",\"type\":\"id\"}]," \
     "[\"type\",{\"group\":\"!\",\"slot\":1,\"store_field\":\"type\",\"type\":\"exact\"}]," \
     "[\"_meta\",{\"group\":\"#\",\"slot\":0,\"type\":\"meta\"}]," \
@@ -71,56 +70,6 @@ using namespace RestPose;
 
 #define DEFAULT_SPECIAL_FIELDS "\"special_fields\":{\"id_field\":\"id\",\"meta_field\":\"_meta\",\"type_field\":\"type\"}"
 
-class TempDir {
-    std::string path;
-
-    TempDir(const TempDir &);
-    void operator=(const TempDir &);
-  public:
-    TempDir(const std::string & prefix) {
-#ifndef __WIN32__
-	std::string full_prefix = "/tmp/" + prefix;
-	char tmpl[full_prefix.size() + 7];
-	memcpy(tmpl, full_prefix.c_str(), full_prefix.size());
-	memset(tmpl + full_prefix.size(), 'X', 6);
-	tmpl[full_prefix.size() + 6] = '\0';
-	char * result = mkdtemp(tmpl);
-	if (result == NULL) {
-	    throw SysError("Can't make temporary directory", errno);
-	}
-	path = std::string(result, full_prefix.size() + 6);
-#else
-	TCHAR path_buf[MAX_PATH];
-	DWORD path_len = GetTempPath(MAX_PATH, path_buf);
-	if (path_len > MAX_PATH || path_len == 0) {
-	    throw SysError("Can't get temp path", 0);
-	}
-
-	TCHAR dirname_buf[MAX_PATH]; 
-	if (GetTempFileName(path_buf, TEXT(prefix.c_str()), 1, dirname_buf) == 0) {
-	    throw SysError("Can't get temp filename", 0);
-	}
-	path = dirname_buf;
-	mkdir(dirname_buf);
-#endif
-    }
-
-    ~TempDir() {
-	// destroy the directory at path.
-	if (!path.empty()) {
-	    try {
-		removedir(path);
-	    } catch (const Xapian::Error & e) {
-		printf("Error removing temporary directory: %s\n", e.get_description().c_str());
-	    }
-	}
-    }
-
-    std::string get() {
-	return path;
-    };
-};
-
 /// Test checking of the format in collection configs.
 TEST(CollectionConfigFormatCheck)
 {
@@ -652,3 +601,297 @@ TEST(MetaInfoMissing)
 		    json_serialise(doc_to_json(xdoc, tmp)));
     }
 }
+
+/// Test processing documents without changing the configuration.
+TEST(TryProcessDoc)
+{
+    CollectionConfig c("testcoll");
+    Json::Value tmp;
+    c.set_default();
+    std::string idterm;
+    Xapian::Document xdoc;
+
+    // The type isn't known yet, so the config would need to change.
+    {
+	Json::Value doc(Json::objectValue);
+	doc["foo_text"] = "hello";
+	IndexingErrors errors;
+	CHECK(!c.try_process_doc(doc, "default", "0", idterm, errors, xdoc));
+	CHECK_EQUAL(0u, errors.errors.size());
+	CHECK(c.get_schema("default") == NULL);
+
+	bool new_fields(false);
+	xdoc = c.process_doc(doc, "default", "0", idterm, errors, new_fields);
+	CHECK_EQUAL(true, new_fields);
+    }
+    std::string expected(json_serialise(doc_to_json(xdoc, tmp)));
+    std::string config_before(json_serialise(c.to_json(tmp)));
+
+    // All the fields are known now, so the document can be processed
+    // without changing the config, and gives the same result.
+    {
+	Json::Value doc(Json::objectValue);
+	doc["foo_text"] = "hello";
+	IndexingErrors errors;
+	idterm.clear();
+	CHECK(c.try_process_doc(doc, "default", "0", idterm, errors, xdoc));
+	CHECK_EQUAL(0u, errors.errors.size());
+	CHECK_EQUAL("\tdefault\t0", idterm);
+	CHECK_EQUAL(expected, json_serialise(doc_to_json(xdoc, tmp)));
+    }
+
+    // A new field needs the config to change.
+    {
+	Json::Value doc(Json::objectValue);
+	doc["foo_text"] = "hello";
+	doc["bar_tag"] = "world";
+	IndexingErrors errors;
+	CHECK(!c.try_process_doc(doc, "default", "1", idterm, errors, xdoc));
+    }
+
+    // Type and id errors are still reported.
+    {
+	Json::Value doc(Json::objectValue);
+	doc["foo_text"] = "hello";
+	IndexingErrors errors;
+	CHECK(c.try_process_doc(doc, "default", "", idterm, errors, xdoc));
+	CHECK_EQUAL(1u, errors.errors.size());
+	CHECK(errors.total_failure);
+    }
+
+    CHECK_EQUAL(config_before, json_serialise(c.to_json(tmp)));
+}
+
+/// Test that snapshots of a configuration share it.
+TEST(CollectionConfigSnapshots)
+{
+    CollectionConfig * config = new CollectionConfig("testcoll");
+    config->set_default();
+    CollectionConfigSnapshot snapshot(config);
+    CHECK(&(*snapshot) == config);
+
+    CollectionConfigSnapshot copy(snapshot);
+    CHECK(copy.operator->() == config);
+
+    CollectionConfigSnapshot other(new CollectionConfig("othercoll"));
+    CHECK_EQUAL("othercoll", other->get_name());
+    other = copy;
+    CHECK(other.operator->() == config);
+    other = other;
+    CHECK_EQUAL("testcoll", other->get_name());
+}
+
+/// Test getting and applying deltas of new schema configuration.
+TEST(SchemaDelta)
+{
+    CollectionConfig base("testcoll");
+    Json::Value tmp;
+    base.set_default();
+
+    // A new type gives the whole schema for the type.
+    std::auto_ptr<CollectionConfig> updated(base.clone());
+    {
+	Json::Value doc(Json::objectValue);
+	doc["foo_tag"] = "hello";
+	std::string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	updated->process_doc(doc, "default", "0", idterm, errors, new_fields);
+    }
+    Json::Value delta;
+    updated->get_schema_delta(base, delta);
+    CHECK_EQUAL(1u, delta.size());
+    CHECK(delta["default"]["fields"].isMember("foo_tag"));
+    CHECK(delta["default"]["fields"].isMember("_meta"));
+    CHECK(delta["default"].isMember("patterns"));
+
+    CHECK(base.apply_schema_delta(delta));
+    CHECK_EQUAL(json_serialise(updated->to_json(tmp)),
+		json_serialise(base.to_json(tmp)));
+
+    // Applying the same delta again has no effect.
+    CHECK(!base.apply_schema_delta(delta));
+
+    // A new field in an existing type gives just that field.
+    updated = std::auto_ptr<CollectionConfig>(base.clone());
+    {
+	Json::Value doc(Json::objectValue);
+	doc["bar_text"] = "world";
+	std::string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	updated->process_doc(doc, "default", "1", idterm, errors, new_fields);
+	CHECK(new_fields);
+    }
+    updated->get_schema_delta(base, delta);
+    CHECK_EQUAL(1u, delta.size());
+    CHECK_EQUAL(1u, delta["default"]["fields"].size());
+    CHECK(delta["default"]["fields"].isMember("bar_text"));
+    CHECK(!delta["default"].isMember("patterns"));
+
+    // Deltas from processing in parallel don't lose each other's fields.
+    std::auto_ptr<CollectionConfig> parallel(base.clone());
+    {
+	Json::Value doc(Json::objectValue);
+	doc["baz_tag"] = "again";
+	std::string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	parallel->process_doc(doc, "default", "2", idterm, errors, new_fields);
+    }
+    Json::Value delta2;
+    parallel->get_schema_delta(base, delta2);
+    CHECK(base.apply_schema_delta(delta));
+    CHECK(base.apply_schema_delta(delta2));
+    CHECK(base.get_schema("default")->get("bar_text") != NULL);
+    CHECK(base.get_schema("default")->get("baz_tag") != NULL);
+
+    // Nothing new gives an empty delta.
+    CHECK(base.get_schema_delta(base, delta).empty());
+}
+
+/// Test that schema deltas applied to a collection are kept when it's closed.
+TEST(CollectionSchemaDeltaClose)
+{
+    TempDir path("jsonxapian");
+    Json::Value delta;
+    {
+	CollectionConfig base("test");
+	base.set_default();
+	std::auto_ptr<CollectionConfig> updated(base.clone());
+	Json::Value doc(Json::objectValue);
+	doc["foo_tag"] = "hello";
+	doc["bar_text"] = "world";
+	std::string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	updated->process_doc(doc, "default", "0", idterm, errors, new_fields);
+	updated->get_schema_delta(base, delta);
+    }
+
+    // Apply the delta, and close without committing.
+    {
+	Collection c("test", path.get() + "/test");
+	c.open_writable();
+	c.apply_schema_delta(delta);
+	c.close();
+    }
+    {
+	Collection c("test", path.get() + "/test");
+	c.open_readonly();
+	CHECK(c.get_schema("default").get("foo_tag") != NULL);
+	CHECK(c.get_schema("default").get("bar_text") != NULL);
+    }
+
+    // Apply the delta, and let the destructor close the collection.
+    {
+	Collection c("test2", path.get() + "/test2");
+	c.open_writable();
+	c.apply_schema_delta(delta);
+    }
+    {
+	Collection c("test2", path.get() + "/test2");
+	c.open_readonly();
+	CHECK(c.get_schema("default").get("foo_tag") != NULL);
+	CHECK(c.get_schema("default").get("bar_text") != NULL);
+    }
+}
+
+/// Test getting several documents at once.
+TEST(CollectionGetDocuments)
+{
+    TempDir path("jsonxapian");
+    Collection c("test", path.get() + "/test");
+    c.open_writable();
+    Json::Value tmp;
+    c.from_json(json_unserialise(std::string("{\"format\": 3}"), tmp));
+
+    for (int i = 0; i != 5; ++i) {
+	Json::Value doc(Json::objectValue);
+	doc["foo_tag"] = "hello" + str(i);
+	std::string idterm;
+	bool new_fields(false);
+	Xapian::Document xdoc = c.process_doc(doc, "default", str(i), idterm,
+					      new_fields);
+	c.raw_update_doc(xdoc, idterm);
+    }
+    c.commit();
+
+    std::vector<std::pair<std::string, std::string> > ids;
+    ids.push_back(std::make_pair(std::string("default"), std::string("3")));
+    ids.push_back(std::make_pair(std::string("default"), std::string("9")));
+    ids.push_back(std::make_pair(std::string("other"), std::string("1")));
+    ids.push_back(std::make_pair(std::string("default"), std::string("1")));
+    ids.push_back(std::make_pair(std::string("default"), std::string("3")));
+
+    Json::Value docs;
+    c.get_documents(ids, docs);
+    CHECK_EQUAL(5u, docs.size());
+    for (Json::ArrayIndex i = 0; i != docs.size(); ++i) {
+	c.get_document(ids[i].first, ids[i].second, tmp);
+	CHECK_EQUAL(json_serialise(tmp), json_serialise(docs[i]));
+    }
+    CHECK(!docs[0u].isNull());
+    CHECK(docs[1u].isNull());
+    CHECK(docs[2u].isNull());
+    CHECK(!docs[3u].isNull());
+
+    // No documents requested.
+    ids.clear();
+    c.get_documents(ids, docs);
+    CHECK_EQUAL("[]", json_serialise(docs));
+}
+
+TEST(CollectionConfigKeepsCompression)
+{
+    TempDir path("jsonxapian");
+    Collection c("test", path.get() + "/test");
+    c.open_writable();
+    Json::Value tmp;
+    c.from_json(json_unserialise(std::string("{\"format\": 3}"), tmp));
+
+    Json::Value samples(Json::arrayValue);
+    for (int i = 0; i != 5; ++i) {
+	Json::Value & doc = samples.append(Json::objectValue);
+	doc["id"] = str(i);
+	doc["text"] = "Some example text which is repeated in each document";
+    }
+    Json::Value stats;
+    c.get_config().train_docdata_compression(samples, 32768, 6, stats);
+    CHECK_EQUAL(1u, c.get_config().get_docdata_compressor().dictionary_count());
+
+    std::string idterm;
+    bool new_fields(false);
+    Xapian::Document xdoc = c.process_doc(samples[0u], "default", "0", idterm,
+					  new_fields);
+    CHECK(DocumentDataCompressor::is_compressed(xdoc.get_data()));
+    c.raw_update_doc(xdoc, idterm);
+    c.commit();
+    c.get_document("default", "0", tmp);
+    std::string expected(json_serialise(tmp));
+
+    // A config without compression settings keeps the dictionaries, so the
+    // document can still be read.
+    c.from_json(json_unserialise(std::string("{\"format\": 3}"), tmp));
+    CHECK_EQUAL(1u, c.get_config().get_docdata_compressor().dictionary_count());
+    c.get_document("default", "0", tmp);
+    CHECK_EQUAL(expected, json_serialise(tmp));
+
+    // A config which drops the dictionaries is rejected.
+    CHECK_THROW(c.from_json(json_unserialise(std::string(
+		"{\"format\": 3, \"docdata_compression\": {}}"), tmp)),
+		InvalidValueError);
+    Json::Value config;
+    c.to_json(config);
+    config["docdata_compression"]["dictionaries"][0u] = "other";
+    CHECK_THROW(c.from_json(config), InvalidValueError);
+
+    // A config which keeps them, and adds another, is accepted.
+    c.to_json(config);
+    config["docdata_compression"]["dictionaries"].append("other");
+    c.from_json(config);
+    CHECK_EQUAL(2u, c.get_config().get_docdata_compressor().dictionary_count());
+    c.get_document("default", "0", tmp);
+    CHECK_EQUAL(expected, json_serialise(tmp));
+    c.close();
+}
@@ -0,0 +1,88 @@
+/** @file compression.cc
+ * @brief Tests for the zlib wrappers
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "UnitTest++.h"
+#include <string>
+#include "utils/compression.h"
+#include "utils/rsperrors.h"
+
+using namespace RestPose;
+using namespace std;
+
+TEST(ZlibGzipPieces)
+{
+    string data;
+    for (unsigned i = 0; i != 10000; ++i) {
+	data += char('a' + (i * 7919) % 26);
+    }
+    ZlibDeflater deflater(ZLIB_FORMAT_GZIP);
+    string compressed = deflater.deflate(data.data(), data.size());
+    CHECK(compressed.size() < data.size());
+
+    ZlibInflater inflater(ZLIB_FORMAT_GZIP);
+    CHECK_EQUAL(data, inflater.inflate(compressed.data(), compressed.size()));
+
+    // Uncompress the data in pieces of various sizes.
+    size_t piece_sizes[] = { 1, 7, 1000 };
+    for (unsigned i = 0; i != sizeof(piece_sizes) / sizeof(size_t); ++i) {
+	size_t piece_size = piece_sizes[i];
+	string result;
+	inflater.start();
+	for (size_t pos = 0; pos < compressed.size(); pos += piece_size) {
+	    size_t len = compressed.size() - pos;
+	    if (len > piece_size) len = piece_size;
+	    inflater.inflate_chunk(compressed.data() + pos, len, result);
+	}
+	inflater.finish();
+	CHECK_EQUAL(data, result);
+    }
+
+    // Truncated data.
+    string result;
+    inflater.start();
+    inflater.inflate_chunk(compressed.data(), compressed.size() - 1, result);
+    CHECK_THROW(inflater.finish(), CompressionError);
+
+    // Data after the end of the compressed data.
+    inflater.start();
+    inflater.inflate_chunk(compressed.data(), compressed.size(), result);
+    CHECK_THROW(inflater.inflate_chunk("x", 1, result), CompressionError);
+
+    // Data which isn't compressed.
+    inflater.start();
+    CHECK_THROW(inflater.inflate_chunk("hello", 5, result), CompressionError);
+
+    // A limit on the uncompressed size.
+    result.clear();
+    inflater.start();
+    CHECK(inflater.inflate_chunk(compressed.data(), compressed.size(), result,
+				 data.size()));
+    CHECK_EQUAL(data, result);
+    result.clear();
+    inflater.start();
+    CHECK(!inflater.inflate_chunk(compressed.data(), compressed.size(),
+				  result, data.size() - 1));
+    CHECK(result.size() < data.size());
+}
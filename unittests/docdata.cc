@@ -22,9 +22,12 @@
  * IN THE SOFTWARE.
  */
 
+#include <config.h>
 #include "UnitTest++.h"
 #include "jsonxapian/docdata.h"
+#include "utils/jsonutils.h"
 #include "utils/rsperrors.h"
+#include <vector>
 
 using namespace RestPose;
 
@@ -72,3 +75,93 @@ TEST(DocumentDataSerialise)
     ++i;
     CHECK(i == docdata2.end());
 }
+
+TEST(DocumentDataCompressed)
+{
+    DocumentData docdata;
+    docdata.set("title", "[\"An example document title\"]");
+    docdata.set("body", "[\"Some example text for the document body\"]");
+    std::string plain = docdata.serialise();
+
+    std::vector<std::string> samples;
+    samples.push_back(plain);
+    samples.push_back(plain);
+
+    DocumentDataCompressor compressor;
+    CHECK(!compressor.is_enabled());
+    CHECK_EQUAL(compressor.compress(plain), plain);
+
+    compressor.add_dictionary(DocumentDataCompressor::train(samples));
+    CHECK(compressor.is_enabled());
+    std::string s = docdata.serialise(&compressor);
+    CHECK(DocumentDataCompressor::is_compressed(s));
+    CHECK(s.size() < plain.size());
+    CHECK(!DocumentDataCompressor::is_compressed(plain));
+
+    // Compressed data can't be read without the compressor.
+    DocumentData docdata2;
+    CHECK_THROW(docdata2.unserialise(s), UnserialisationError);
+    docdata2.unserialise(s, &compressor);
+    CHECK_EQUAL(docdata2.get("title"), docdata.get("title"));
+    CHECK_EQUAL(docdata2.get("body"), docdata.get("body"));
+
+    // Uncompressed data can still be read with a compressor.
+    docdata2.unserialise(plain, &compressor);
+    CHECK_EQUAL(docdata2.get("title"), docdata.get("title"));
+
+    // Settings round-trip through JSON, and old dictionaries are kept.
+    Json::Value tmp;
+    DocumentDataCompressor compressor2;
+    compressor2.from_json(compressor.to_json(tmp));
+    compressor2.add_dictionary("other");
+    CHECK_EQUAL(compressor2.dictionary_count(), 2u);
+    docdata2.unserialise(s, &compressor2);
+    CHECK_EQUAL(docdata2.get("body"), docdata.get("body"));
+
+    // New settings must keep the existing dictionaries, in order.
+    compressor.check_keeps_dictionaries(compressor2.to_json(tmp));
+    CHECK_THROW(compressor2.check_keeps_dictionaries(compressor.to_json(tmp)),
+		InvalidValueError);
+    CHECK_THROW(compressor.check_keeps_dictionaries(Json::Value()),
+		InvalidValueError);
+    compressor2.to_json(tmp)["dictionaries"][0u] = "other";
+    CHECK_THROW(compressor.check_keeps_dictionaries(tmp), InvalidValueError);
+    DocumentDataCompressor().check_keeps_dictionaries(Json::Value());
+
+    // A missing dictionary is reported as an error.
+    DocumentDataCompressor compressor3;
+    compressor3.set_level(6);
+    CHECK_THROW(docdata2.unserialise(s, &compressor3), UnserialisationError);
+}
+
+TEST(DocumentDataWriteDisplay)
+{
+    DocumentData docdata;
+    docdata.set("title", json_serialise(Json::Value("A \"quoted\" title")));
+    Json::Value tmp(Json::arrayValue);
+    tmp.append(0.1);
+    tmp.append(-3);
+    tmp.append(Json::Value(Json::Value::maxLargestUInt));
+    tmp.append("\xc3\xa9\t\x01");
+    docdata.set("values", json_serialise(tmp));
+    docdata.set("a\nfield", "{\"x\":[true,null]}");
+
+    Json::Value fieldlists(Json::arrayValue);
+    fieldlists.append(Json::nullValue);
+    fieldlists.append(Json::arrayValue);
+    Json::Value & fields = fieldlists.append(Json::arrayValue);
+    fields.append("values");
+    fields.append("missing");
+    fields.append("title");
+    fields.append("values");
+    fields.append("a\nfield");
+
+    // The output is the same as serialising the display form.
+    for (unsigned i = 0; i != fieldlists.size(); ++i) {
+	std::string output("prefix");
+	docdata.write_display(fieldlists[i], output);
+	CHECK_EQUAL("prefix" +
+		    json_serialise(docdata.to_display(fieldlists[i], tmp)),
+		    output);
+    }
+}
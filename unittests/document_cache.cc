@@ -0,0 +1,153 @@
+/** @file document_cache.cc
+ * @brief Tests for the cache of rendered documents
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "UnitTest++.h"
+#include "jsonxapian/document_cache.h"
+#include <set>
+#include "str.h"
+#include <string>
+#include "utils/jsonutils.h"
+
+using namespace RestPose;
+using namespace std;
+
+TEST(DocumentCache)
+{
+    DocumentCache cache(1024 * 1024);
+    Json::Value status;
+    string doc;
+
+    cache.get_status(status);
+    CHECK_EQUAL("{\"bytes\":0,\"collections\":{},\"entries\":0,"
+		"\"max_bytes\":1048576}",
+		json_serialise(status));
+
+    uint64_t gen = cache.get_generation("c1");
+    CHECK(!cache.get("c1", "\tt\ta", doc));
+    cache.set("c1", "\tt\ta", "{\"a\":1}", gen);
+    cache.set("c1", "\tt\tb", "{\"b\":1}", gen);
+    cache.set("c2", "\tt\ta", "{\"a\":2}", cache.get_generation("c2"));
+    CHECK(cache.get("c1", "\tt\ta", doc));
+    CHECK_EQUAL("{\"a\":1}", doc);
+    CHECK(cache.get("c2", "\tt\ta", doc));
+    CHECK_EQUAL("{\"a\":2}", doc);
+
+    // Invalidating a document removes only that document, and stops
+    // documents read before the invalidation from being stored.
+    set<string> changed;
+    changed.insert("\tt\ta");
+    cache.invalidate("c1", changed);
+    CHECK(!cache.get("c1", "\tt\ta", doc));
+    CHECK(cache.get("c1", "\tt\tb", doc));
+    CHECK(cache.get("c2", "\tt\ta", doc));
+    cache.set("c1", "\tt\ta", "{\"a\":1}", gen);
+    CHECK(!cache.get("c1", "\tt\ta", doc));
+    gen = cache.get_generation("c1");
+    cache.set("c1", "\tt\ta", "{\"a\":3}", gen);
+    CHECK(cache.get("c1", "\tt\ta", doc));
+    CHECK_EQUAL("{\"a\":3}", doc);
+
+    cache.get_status(status);
+    CHECK_EQUAL(3, status["entries"].asInt());
+    CHECK_EQUAL(3, status["collections"]["c1"]["hits"].asInt());
+    CHECK_EQUAL(3, status["collections"]["c1"]["misses"].asInt());
+    CHECK_EQUAL(2, status["collections"]["c2"]["hits"].asInt());
+    CHECK_EQUAL(0, status["collections"]["c2"]["misses"].asInt());
+
+    // Invalidating a whole collection leaves other collections alone.
+    cache.invalidate_all("c1");
+    CHECK(!cache.get("c1", "\tt\ta", doc));
+    CHECK(!cache.get("c1", "\tt\tb", doc));
+    CHECK(cache.get("c2", "\tt\ta", doc));
+
+    cache.clear();
+    CHECK(!cache.get("c2", "\tt\ta", doc));
+    cache.get_status(status);
+    CHECK_EQUAL("{\"bytes\":0,\"collections\":{\"c2\":{\"hit_rate\":0.0,"
+		"\"hits\":0,\"misses\":1}},\"entries\":0,"
+		"\"max_bytes\":1048576}",
+		json_serialise(status));
+}
+
+TEST(DocumentCacheEviction)
+{
+    // Room for a single small document in each shard.
+    DocumentCache cache(DocumentCache::SHARD_COUNT * 200);
+    string doc;
+    string last;
+    for (unsigned i = 0; i != 100; ++i) {
+	last = "\tt\t" + str(i);
+	cache.set("c", last, "{}", cache.get_generation("c"));
+    }
+    CHECK(cache.get("c", last, doc));
+    CHECK_EQUAL("{}", doc);
+
+    Json::Value status;
+    cache.get_status(status);
+    CHECK(status["entries"].asInt() <= int(DocumentCache::SHARD_COUNT));
+    CHECK(status["bytes"].asInt() <= int(DocumentCache::SHARD_COUNT * 200));
+
+    // Documents too large for a shard aren't stored.
+    cache.set("c", "\tt\tbig", string(500, 'x'), cache.get_generation("c"));
+    CHECK(!cache.get("c", "\tt\tbig", doc));
+}
+
+TEST(DocumentCacheGzipped)
+{
+    DocumentCache cache(1024 * 1024);
+    string doc;
+    string gzipped;
+
+    // Compressed forms are only stored for documents in the cache.
+    cache.set_gzipped("c", "\tt\ta", "{\"a\":1}", "gz1");
+    CHECK(!cache.get("c", "\tt\ta", doc, &gzipped));
+
+    cache.set("c", "\tt\ta", "{\"a\":1}", cache.get_generation("c"));
+    CHECK(cache.get("c", "\tt\ta", doc, &gzipped));
+    CHECK_EQUAL("{\"a\":1}", doc);
+    CHECK_EQUAL("", gzipped);
+
+    // A compressed form of a different version of the document is ignored.
+    cache.set_gzipped("c", "\tt\ta", "{\"a\":2}", "gz2");
+    CHECK(cache.get("c", "\tt\ta", doc, &gzipped));
+    CHECK_EQUAL("", gzipped);
+
+    cache.set_gzipped("c", "\tt\ta", "{\"a\":1}", "gz1");
+    CHECK(cache.get("c", "\tt\ta", doc, &gzipped));
+    CHECK_EQUAL("{\"a\":1}", doc);
+    CHECK_EQUAL("gz1", gzipped);
+
+    Json::Value status;
+    cache.get_status(status);
+    size_t bytes = status["bytes"].asUInt();
+
+    // Replacing the document discards the compressed form.
+    cache.set("c", "\tt\ta", "{\"a\":3}", cache.get_generation("c"));
+    CHECK(cache.get("c", "\tt\ta", doc, &gzipped));
+    CHECK_EQUAL("{\"a\":3}", doc);
+    CHECK_EQUAL("", gzipped);
+    cache.get_status(status);
+    CHECK_EQUAL(bytes - 3, status["bytes"].asUInt());
+}
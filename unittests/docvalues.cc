@@ -0,0 +1,108 @@
+/** @file docvalues.cc
+ * @brief Tests for DocumentValues and SlotDecoders
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "UnitTest++.h"
+#include "jsonxapian/docvalues.h"
+
+#include <memory>
+#include "serialise.h"
+#include <string>
+#include <xapian.h>
+
+using namespace RestPose;
+using namespace std;
+
+/// Read all the values from a slot with a decoder, separated by commas.
+static string
+decode_slot(const Xapian::Document & doc, Xapian::valueno slot,
+	    ValueEncoding encoding)
+{
+    auto_ptr<SlotDecoder> decoder(SlotDecoder::create(slot, encoding));
+    decoder->newdoc(doc);
+    string result;
+    const char * begin;
+    size_t len;
+    bool first = true;
+    while (decoder->next(&begin, &len)) {
+	if (!first) {
+	    result += ",";
+	}
+	result.append(begin, len);
+	first = false;
+    }
+    return result;
+}
+
+TEST(DocumentValuesVintLengths)
+{
+    DocumentValues vals;
+    CHECK(vals.empty(0));
+    vals.add(0, "pear");
+    vals.add(0, "apple");
+    vals.add(0, "pear");
+    vals.add(0, "apples");
+    vals.add(1, "b");
+    vals.add(0, "");
+    CHECK(!vals.empty(0));
+    CHECK(!vals.empty(1));
+    CHECK(vals.empty(2));
+
+    Xapian::Document doc;
+    vals.apply(doc);
+    CHECK_EQUAL(doc.get_value(0), encode_length(0) +
+		encode_length(5) + "apple" +
+		encode_length(6) + "apples" +
+		encode_length(4) + "pear");
+    CHECK_EQUAL(decode_slot(doc, 0, ENC_VINT_LENGTHS), ",apple,apples,pear");
+    CHECK_EQUAL(decode_slot(doc, 1, ENC_VINT_LENGTHS), "b");
+    CHECK_EQUAL(doc.get_value(2), "");
+
+    vals.remove(0, "apples");
+    vals.remove(1, "b");
+    CHECK(vals.empty(1));
+    Xapian::Document doc2;
+    vals.apply(doc2);
+    CHECK_EQUAL(decode_slot(doc2, 0, ENC_VINT_LENGTHS), ",apple,pear");
+    CHECK_EQUAL(doc2.get_value(1), "");
+}
+
+TEST(DocumentValuesOtherEncodings)
+{
+    DocumentValues vals;
+    vals.set_slot_format(3, ENC_SINGLY_VALUED);
+    vals.set_slot_format(4, ENC_GEOENCODE);
+    vals.add(3, "zz");
+    vals.add(3, "aa");
+    vals.add(4, "bbbbbb");
+    vals.add(4, "aaaaaa");
+    vals.add(4, "bbbbbb");
+
+    Xapian::Document doc;
+    vals.apply(doc);
+    // Singly valued slots hold the lowest value.
+    CHECK_EQUAL(doc.get_value(3), "aa");
+    CHECK_EQUAL(decode_slot(doc, 3, ENC_SINGLY_VALUED), "aa");
+    CHECK_EQUAL(doc.get_value(4), "aaaaaabbbbbb");
+    CHECK_EQUAL(decode_slot(doc, 4, ENC_GEOENCODE), "aaaaaa,bbbbbb");
+}
@@ -0,0 +1,211 @@
+/** @file categoriser_tasks.cc
+ * @brief Tests for categorising batches of texts
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "UnitTest++.h"
+#include "features/categoriser_tasks.h"
+#include "httpserver/response.h"
+#include "jsonxapian/collection.h"
+#include "ngramcat/categoriser.h"
+#include "server/result_handle.h"
+#include "str.h"
+#include "tempdir.h"
+#include "utils/jsonutils.h"
+#include "utils/msgpack.h"
+#include "utils/rsperrors.h"
+
+using namespace RestPose;
+using namespace std;
+
+/// Make a temporary collection, with a categoriser called "lang".
+class CategoriserCollection {
+    TempDir path;
+  public:
+    Collection coll;
+
+    CategoriserCollection()
+	    : path("categorisetasks"),
+	      coll("test", path.get() + "/test")
+    {
+	coll.open_writable();
+	Categoriser cat(1.03, 4, 10, 1);
+	cat.add_target_profile("english", "hello world");
+	cat.add_target_profile("russian", "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 \xd0\x94\xd0\xbe\xd0\xb1\xd1\x80\xd0\xbe");
+	coll.set_categoriser("lang", cat);
+    }
+
+    ~CategoriserCollection() {
+	coll.close();
+    }
+};
+
+/** Categorise a batch of texts, performing the chunks in reverse order.
+ *
+ *  Returns the response body, or "(no response)" if no response was made.
+ */
+static string
+categorise_batch(Collection & coll, const char * categoriser_name,
+		 const vector<string> & texts, bool lines,
+		 bool msgpack = false)
+{
+    ResultHandle resulthandle;
+    resulthandle.response().set_msgpack(msgpack);
+    CategoriseBatch * batch = new CategoriseBatch(resulthandle,
+						  categoriser_name, lines);
+    batch->get_texts() = texts;
+    vector<pair<size_t, size_t> > chunks;
+    CategoriseBatch::split(texts.size(), chunks);
+    batch->set_chunk_count(chunks.size());
+
+    // The tasks hold the only references to the batch.
+    vector<CategoriseChunkTask *> tasks;
+    for (vector<pair<size_t, size_t> >::const_iterator i = chunks.begin();
+	 i != chunks.end(); ++i) {
+	tasks.push_back(new CategoriseChunkTask(resulthandle, "test", batch,
+						i->first, i->second));
+    }
+    while (!tasks.empty()) {
+	try {
+	    tasks.back()->perform(&coll);
+	} catch (const InvalidValueError &) {
+	    // The task runner would report the error.
+	}
+	delete tasks.back();
+	tasks.pop_back();
+    }
+    if (!resulthandle.is_ready()) {
+	return "(no response)";
+    }
+    return resulthandle.response().get_body();
+}
+
+TEST(CategoriseBatchSplit)
+{
+    vector<pair<size_t, size_t> > chunks;
+
+    // An empty batch still has a chunk, so that a response is made.
+    CategoriseBatch::split(0, chunks);
+    CHECK_EQUAL(1u, chunks.size());
+    CHECK_EQUAL(0u, chunks[0].first);
+    CHECK_EQUAL(0u, chunks[0].second);
+
+    CategoriseBatch::split(CATEGORISE_MIN_CHUNK_SIZE, chunks);
+    CHECK_EQUAL(1u, chunks.size());
+    CHECK_EQUAL(size_t(CATEGORISE_MIN_CHUNK_SIZE), chunks[0].second);
+
+    // The chunks cover all the texts, in order and without gaps, and
+    // none are empty.
+    size_t counts[] = { 1, 63, 65, 200, 1000, 1025, 100000 };
+    for (size_t i = 0; i != sizeof(counts) / sizeof(counts[0]); ++i) {
+	CategoriseBatch::split(counts[i], chunks);
+	CHECK(chunks.size() >= 1);
+	CHECK(chunks.size() <= CATEGORISE_MAX_CHUNKS);
+	size_t next_chunk = 0;
+	for (size_t j = 0; j != chunks.size(); ++j) {
+	    CHECK_EQUAL(next_chunk, chunks[j].first);
+	    CHECK(chunks[j].second > chunks[j].first);
+	    if (j + 1 != chunks.size()) {
+		CHECK(chunks[j].second - chunks[j].first >=
+		      CATEGORISE_MIN_CHUNK_SIZE);
+	    }
+	    next_chunk = chunks[j].second;
+	}
+	CHECK_EQUAL(counts[i], next_chunk);
+    }
+    CategoriseBatch::split(1000, chunks);
+    CHECK_EQUAL(size_t(CATEGORISE_MAX_CHUNKS), chunks.size());
+}
+
+TEST(CategoriseBatchOrder)
+{
+    CategoriserCollection c;
+    const char * english = "Hello";
+    const char * russian = "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82";
+
+    // Enough texts for several chunks, which are performed in reverse
+    // order; the results must still be in the order of the texts.
+    vector<string> texts;
+    string expected("{\"results\":[");
+    string expected_lines;
+    for (unsigned i = 0; i != 5 * CATEGORISE_MIN_CHUNK_SIZE; ++i) {
+	if (i != 0) {
+	    expected += ',';
+	}
+	if (i % 3 == 0) {
+	    texts.push_back(russian);
+	    expected += "[\"russian\"]";
+	    expected_lines += "[\"russian\"]\n";
+	} else if (i % 3 == 1) {
+	    texts.push_back(english);
+	    expected += "[\"english\"]";
+	    expected_lines += "[\"english\"]\n";
+	} else {
+	    texts.push_back("caf\xc3\xa9");
+	    expected += "[]";
+	    expected_lines += "[]\n";
+	}
+    }
+    expected += "]}";
+
+    CHECK_EQUAL(expected, categorise_batch(c.coll, "lang", texts, false));
+    CHECK_EQUAL(expected_lines, categorise_batch(c.coll, "lang", texts, true));
+
+    // A MessagePack response holds the same results; the lines format is
+    // still JSON.
+    Json::Value tmp;
+    CHECK_EQUAL(expected, json_serialise(msgpack_unserialise(
+	categorise_batch(c.coll, "lang", texts, false, true), tmp)));
+    CHECK_EQUAL(expected_lines,
+		categorise_batch(c.coll, "lang", texts, true, true));
+
+    // An empty batch.
+    texts.clear();
+    CHECK_EQUAL("{\"results\":[]}",
+		categorise_batch(c.coll, "lang", texts, false));
+    CHECK_EQUAL("", categorise_batch(c.coll, "lang", texts, true));
+}
+
+TEST(CategoriseBatchMissingCategoriser)
+{
+    CategoriserCollection c;
+    vector<string> texts;
+    for (unsigned i = 0; i != 3 * CATEGORISE_MIN_CHUNK_SIZE; ++i) {
+	texts.push_back("Hello");
+    }
+
+    // Every chunk fails, so no response is made by the batch; the error is
+    // reported by the task runner.
+    CHECK_EQUAL("(no response)",
+		categorise_batch(c.coll, "missing", texts, false));
+
+    // Performing a chunk throws the error.
+    ResultHandle resulthandle;
+    CategoriseBatch * batch = new CategoriseBatch(resulthandle, "missing",
+						  false);
+    batch->get_texts() = texts;
+    batch->set_chunk_count(1);
+    CategoriseChunkTask task(resulthandle, "test", batch, 0, texts.size());
+    CHECK_THROW(task.perform(&c.coll), InvalidValueError);
+    CHECK(!resulthandle.is_ready());
+}
@@ -26,6 +26,7 @@
 #include "UnitTest++.h"
 
 #include "jsonmanip/conditionals.h"
+#include "jsonmanip/mappingprogram.h"
 #include "utils/jsonutils.h"
 #include "utils/rsperrors.h"
 #include <json/json.h>
@@ -35,7 +36,11 @@
 
 using namespace RestPose;
 
-/** Apply a conditional test to several docs, returning a string */
+/** Apply a conditional test to several docs, returning a string.
+ *
+ *  Also checks that the compiled form of the conditional gives the same
+ *  results.
+ */
 static std::string
 test_docs(const std::vector<Json::Value> & docs, const Conditional & cond)
 {
@@ -48,6 +53,14 @@ test_docs(const std::vector<Json::Value> & docs, const Conditional & cond)
 	    result += "F";
 	}
     }
+
+    ConditionalProgram program;
+    cond.compile(program);
+    std::string compiled_result;
+    for (i = docs.begin(); i != docs.end(); ++i) {
+	compiled_result += program.test(*i) ? "T" : "F";
+    }
+    CHECK_EQUAL(result, compiled_result);
     return result;
 }
 
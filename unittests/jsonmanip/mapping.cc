@@ -26,6 +26,7 @@
 #include "UnitTest++.h"
 
 #include "jsonmanip/mapping.h"
+#include "jsonmanip/mappingprogram.h"
 #include "jsonxapian/collection.h"
 #include "utils/jsonutils.h"
 #include "utils/rsperrors.h"
@@ -38,14 +39,19 @@
 
 using namespace RestPose;
 
-/** Apply a mapping test to several docs, returning a string */
+/** Apply a mapping test to several docs, returning a string.
+ *
+ *  Also checks that the compiled form of the mapping gives the same output.
+ */
 static std::string
 map_docs(const std::string & docs, const Mapping & mapping)
 {
     std::vector<Json::Value>::const_iterator i;
     std::string result;
-    Json::Value input, output;
+    Json::Value input, output, compiled_output;
     Collection collection("foo", "foo");
+    MappingProgram program;
+    program.compile(mapping);
 
     size_t pos = 0;
     while (true) {
@@ -57,6 +63,11 @@ map_docs(const std::string & docs, const Mapping & mapping)
 	result += pass ? "T" : "F";
 	result += json_serialise(output);
 	result += '\n';
+
+	bool compiled_pass = program.apply(collection.get_config(), input,
+					   compiled_output);
+	CHECK_EQUAL(pass, compiled_pass);
+	CHECK_EQUAL(json_serialise(output), json_serialise(compiled_output));
     }
     return result;
 }
@@ -170,3 +181,40 @@ TEST(MappingIndexes)
 		map_docs(docs, m));
 
 }
+
+static const char * nested_docs =
+"{\"a\": 1, \"b\": {\"c\": [2, 3], \"d\": 4}, \"e\": [5, {\"f\": 6}]}\n"
+"{\"b\": [{\"c\": 7}], \"e\": {\"f\": 8}, \"type\": \"x\"}\n"
+"{\"a\": [9], \"type\": \"y\", \"z\": 10}\n"
+;
+
+/// Test preserving and discarding unmapped fields
+TEST(MappingDefaults)
+{
+    Mapping m;
+    Json::Value tmp;
+    json_unserialise("{\"map\": ["
+		     "{\"from\": [\"b\", \"c\"], \"to\": \"a\"},"
+		     "{\"from\": [\"e\", 1, \"f\"], \"to\": \"f\"},"
+		     "{\"from\": [\"b\", \"missing\"], \"to\": \"m\"}"
+		     "]}",
+		     tmp);
+    m.from_json(tmp);
+    CHECK_EQUAL("T{\"a\":[1,2,3],\"f\":[6]}\n"
+		"T{\"b\":[{\"c\":7}],\"e\":[{\"f\":8}],\"type\":[\"x\"]}\n"
+		"T{\"a\":[9],\"type\":[\"y\"],\"z\":[10]}\n",
+		map_docs(nested_docs, m));
+
+    json_unserialise("{\"map\": ["
+		     "{\"from\": [\"b\", \"c\"], \"to\": \"a\"},"
+		     "{\"from\": [\"e\", 1, \"f\"], \"to\": \"f\"}"
+		     "], \"default\": \"discard\","
+		     "\"when\": {\"equals\": [{\"get\": [\"type\"]},"
+		     "{\"literal\": \"x\"}]}}",
+		     tmp);
+    m.from_json(tmp);
+    CHECK_EQUAL("Fnull\n"
+		"T{}\n"
+		"Fnull\n",
+		map_docs(nested_docs, m));
+}
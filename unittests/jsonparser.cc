@@ -0,0 +1,136 @@
+/** @file jsonparser.cc
+ * @brief Tests for the fast JSON parser
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "UnitTest++.h"
+#include "json/reader.h"
+#include <string>
+#include "utils/jsonparser.h"
+#include "utils/jsonutils.h"
+#include "utils/rsperrors.h"
+
+using namespace RestPose;
+using namespace std;
+
+/// Check that the fast parser gives the same value as jsoncpp.
+static bool
+same_as_jsoncpp(const string & json)
+{
+    Json::Value expected;
+    Json::Reader reader;
+    if (!reader.parse(json, expected, false)) {
+	return false;
+    }
+    Json::Value value;
+    json_fast_parse(json.data(), json.data() + json.size(), value);
+    return value == expected;
+}
+
+TEST(JsonFastParserSameValues)
+{
+    CHECK(same_as_jsoncpp("null"));
+    CHECK(same_as_jsoncpp("true"));
+    CHECK(same_as_jsoncpp(" false "));
+    CHECK(same_as_jsoncpp("{}"));
+    CHECK(same_as_jsoncpp("[]"));
+    CHECK(same_as_jsoncpp("[0, -0, 1, -1, 2147483647, 2147483648, "
+			  "-2147483649, 9223372036854775807, "
+			  "9223372036854775808, -9223372036854775808, "
+			  "18446744073709551615, 18446744073709551616, "
+			  "-9223372036854775809]"));
+    CHECK(same_as_jsoncpp("[1.5, -0.25, 1e10, 1E-5, 2.5e+3, 0.1]"));
+    CHECK(same_as_jsoncpp("[\"\", \"abc\", \"a\\\"b\\\\c\\/d\", "
+			  "\"\\b\\f\\n\\r\\t\", \"\\u00e9\\u20ac\", "
+			  "\"\\ud83d\\ude00\", \"caf\xc3\xa9\"]"));
+    CHECK(same_as_jsoncpp("{\"a\": {\"b\": [1, {\"c\": null}]}, "
+			  "\"d\": \"e\", \"a\": 2}"));
+    CHECK(same_as_jsoncpp("// comment\n{\"a\": 1 /* comment */}\n"));
+    CHECK(same_as_jsoncpp("/* comment */ [1, /* comment */ 2]"));
+    CHECK(same_as_jsoncpp("\t\r\n[\n1\n,\n2\n]\n"));
+}
+
+TEST(JsonFastParserErrors)
+{
+    Json::Value value;
+    const char * invalid[] = {
+	"",
+	"   ",
+	"{",
+	"[1,",
+	"[1 2]",
+	"{\"a\" 1}",
+	"{a: 1}",
+	"\"abc",
+	"\"\\x\"",
+	"\"\\u12\"",
+	"\"\\ud83d\"",
+	"tru",
+	"nul",
+	"-",
+	"1.",
+	"1e",
+	"01",
+	"[1]]",
+	"1 2",
+	"/* unterminated",
+	NULL
+    };
+    for (const char ** i = invalid; *i != NULL; ++i) {
+	string json(*i);
+	CHECK_THROW(json_fast_parse(json.data(), json.data() + json.size(),
+				    value),
+		    InvalidValueError);
+    }
+
+    string nested(2000, '[');
+    nested += string(2000, ']');
+    CHECK_THROW(json_fast_parse(nested.data(),
+				nested.data() + nested.size(), value),
+		InvalidValueError);
+
+    try {
+	string json("{\n  \"a\": tru\n}");
+	json_fast_parse(json.data(), json.data() + json.size(), value);
+	CHECK(false);
+    } catch (const InvalidValueError & e) {
+	CHECK_EQUAL("RestPose::InvalidValueError: Invalid JSON: syntax "
+		    "error: value, object or array expected at line 2, "
+		    "column 8", e.what());
+    }
+}
+
+TEST(JsonUnserialiseParsers)
+{
+    Json::Value value;
+    CHECK_EQUAL(JSON_PARSER_FAST, json_get_parser());
+    CHECK_EQUAL("{\"a\":[1,2]}",
+		json_serialise(json_unserialise("{\"a\":[1,2]}", value)));
+    CHECK_THROW(json_unserialise("{\"a\":[1,2]", value), InvalidValueError);
+
+    json_set_parser(JSON_PARSER_JSONCPP);
+    CHECK_EQUAL("{\"a\":[1,2]}",
+		json_serialise(json_unserialise("{\"a\":[1,2]}", value)));
+    CHECK_THROW(json_unserialise("{\"a\":[1,2]", value), InvalidValueError);
+    json_set_parser(JSON_PARSER_FAST);
+}
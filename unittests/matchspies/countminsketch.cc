@@ -0,0 +1,142 @@
+/** @file countminsketch.cc
+ * @brief Tests for approximate counting
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "UnitTest++.h"
+#include <json/json.h>
+#include <map>
+#include "matchspies/countminsketch.h"
+#include "matchspies/termcounts.h"
+#include "matchspies/termoccurmatchspy.h"
+#include "str.h"
+#include <string>
+#include <utility>
+#include <vector>
+#include <xapian.h>
+
+using namespace RestPose;
+using namespace std;
+
+TEST(CountMinSketchBounds)
+{
+    CountMinSketch sketch;
+    CHECK(!sketch.initialised());
+    sketch.init(4096, 4);
+    CHECK(sketch.initialised());
+
+    map<string, uint32_t> expected;
+    for (unsigned i = 0; i != 20000; ++i) {
+	string item(str((i * i) % 997));
+	++expected[item];
+	sketch.add(TermCounts::hash(item.data(), item.size()));
+    }
+    // 256 counters in each row, so the bound is ceil(e * 20000 / 256).
+    CHECK_EQUAL(213u, sketch.error_bound());
+    unsigned over_bound = 0;
+    for (map<string, uint32_t>::const_iterator i = expected.begin();
+	 i != expected.end(); ++i) {
+	uint32_t estimate = sketch.estimate(
+		TermCounts::hash(i->first.data(), i->first.size()));
+	CHECK(estimate >= i->second);
+	if (estimate > i->second + sketch.error_bound()) {
+	    ++over_bound;
+	}
+    }
+    CHECK(over_bound <= expected.size() * sketch.error_probability());
+}
+
+TEST(HeavyHitters)
+{
+    HeavyHitters heavy;
+    heavy.set_limit(2);
+    heavy.update("a", 1);
+    heavy.update("b", 2);
+    heavy.update("c", 1); // Not heavier than "a", so not kept.
+    heavy.update("d", 3); // Replaces "a".
+    heavy.update("b", 4);
+
+    vector<pair<string, Xapian::doccount> > result;
+    heavy.get_most_frequent(result, 10);
+    CHECK_EQUAL(2u, result.size());
+    CHECK_EQUAL("b", result[0].first);
+    CHECK_EQUAL(4u, result[0].second);
+    CHECK_EQUAL("d", result[1].first);
+    CHECK_EQUAL(3u, result[1].second);
+
+    heavy.get_most_frequent(result, 1);
+    CHECK_EQUAL(1u, result.size());
+    CHECK_EQUAL("b", result[0].first);
+}
+
+TEST(CoOccurApproximate)
+{
+    Xapian::WritableDatabase db = Xapian::InMemory::open();
+    for (unsigned i = 0; i != 1000; ++i) {
+	Xapian::Document doc;
+	// Every document has tag a; every other has b, and so on.
+	for (unsigned j = 1; j != 12; ++j) {
+	    if (i % j == 0) {
+		doc.add_boolean_term("t\t" + string(1, char('a' + j - 1)));
+	    }
+	}
+	doc.add_boolean_term("t\tx" + str(i % 50));
+	db.add_document(doc);
+    }
+
+    Json::Value exact_result, approx_result;
+    {
+	TermCoOccurMatchSpy spy("t", "", 1000, 10, false, &db);
+	Xapian::Enquire enq(db);
+	enq.set_query(Xapian::Query(string()));
+	enq.add_matchspy(&spy);
+	(void) enq.get_mset(0, 0, 1000);
+	spy.get_result(exact_result);
+    }
+    {
+	TermCoOccurMatchSpy spy("t", "", 1000, 10, false, &db);
+	spy.set_approximation(100, 65536);
+	Xapian::Enquire enq(db);
+	enq.set_query(Xapian::Query(string()));
+	enq.add_matchspy(&spy);
+	(void) enq.get_mset(0, 0, 1000);
+	spy.get_result(approx_result);
+    }
+    CHECK(!exact_result.isMember("approximate"));
+    CHECK_EQUAL(true, approx_result["approximate"].asBool());
+    CHECK_EQUAL(100u, approx_result["exact_docs"].asUInt());
+
+    // The heaviest pairs are found, with counts within the error bound.
+    Xapian::doccount bound = approx_result["error_bound"].asUInt();
+    const Json::Value & exact = exact_result["counts"];
+    const Json::Value & approx = approx_result["counts"];
+    CHECK_EQUAL(10u, approx.size());
+    CHECK_EQUAL("a", approx[0u][0u].asString());
+    CHECK_EQUAL("b", approx[0u][1u].asString());
+    for (Json::Value::ArrayIndex i = 0; i != 2; ++i) {
+	CHECK_EQUAL(exact[i][0u].asString(), approx[i][0u].asString());
+	CHECK_EQUAL(exact[i][1u].asString(), approx[i][1u].asString());
+	CHECK(approx[i][2u].asUInt() >= exact[i][2u].asUInt());
+	CHECK(approx[i][2u].asUInt() <= exact[i][2u].asUInt() + bound);
+    }
+}
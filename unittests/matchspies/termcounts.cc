@@ -0,0 +1,119 @@
+/** @file termcounts.cc
+ * @brief Tests for the TermCounts hash table
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "UnitTest++.h"
+#include <map>
+#include "matchspies/termcounts.h"
+#include "str.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace RestPose;
+using namespace std;
+
+TEST(TermCountsMostFrequent)
+{
+    TermCounts counts;
+    CHECK(counts.empty());
+    counts.add("b");
+    counts.add("a");
+    counts.add(string("a\0b", 3));
+    counts.add("b");
+    counts.add("");
+    counts.add("c");
+    counts.add("c");
+    CHECK_EQUAL(5u, counts.size());
+    CHECK(counts.contains("a"));
+    CHECK(counts.contains(string("a\0b", 3)));
+    CHECK(!counts.contains("ab"));
+    CHECK(!counts.contains("d"));
+
+    // Ties are returned in lexicographic order.
+    vector<pair<string, Xapian::doccount> > result;
+    counts.get_most_frequent(result, 3);
+    CHECK_EQUAL(3u, result.size());
+    CHECK_EQUAL("b", result[0].first);
+    CHECK_EQUAL(2u, result[0].second);
+    CHECK_EQUAL("c", result[1].first);
+    CHECK_EQUAL(2u, result[1].second);
+    CHECK_EQUAL("", result[2].first);
+    CHECK_EQUAL(1u, result[2].second);
+
+    counts.get_most_frequent(result, 10);
+    CHECK_EQUAL(5u, result.size());
+    CHECK_EQUAL("a", result[3].first);
+    CHECK_EQUAL(string("a\0b", 3), result[4].first);
+}
+
+TEST(TermCountsGrow)
+{
+    // Add enough strings to make the table grow several times, and check
+    // the counts against a map.
+    TermCounts counts;
+    map<string, Xapian::doccount> expected;
+    for (unsigned i = 0; i != 20000; ++i) {
+	string value(str((i * 7919) % 3001));
+	counts.add(value);
+	++expected[value];
+    }
+    CHECK_EQUAL(expected.size(), counts.size());
+
+    vector<pair<string, Xapian::doccount> > result;
+    counts.get_most_frequent(result, Xapian::doccount(-1));
+    CHECK_EQUAL(expected.size(), result.size());
+    for (vector<pair<string, Xapian::doccount> >::const_iterator
+	 i = result.begin(); i != result.end(); ++i) {
+	CHECK_EQUAL(expected[i->first], i->second);
+    }
+    for (size_t i = 1; i < result.size(); ++i) {
+	CHECK(result[i - 1].second >= result[i].second);
+    }
+}
+
+TEST(TermCountsIterate)
+{
+    // Check that iterating over the table returns each string once, with
+    // its count and hash.
+    TermCounts counts;
+    CHECK(counts.begin() == counts.end());
+
+    map<string, Xapian::doccount> expected;
+    for (unsigned i = 0; i != 1000; ++i) {
+	string value(str((i * 7919) % 301));
+	counts.add(value);
+	++expected[value];
+    }
+
+    map<string, Xapian::doccount> seen;
+    for (TermCounts::const_iterator i = counts.begin();
+	 i != counts.end(); ++i) {
+	string value(i.data(), i.size());
+	CHECK(seen.find(value) == seen.end());
+	seen[value] = i.count();
+	CHECK_EQUAL(TermCounts::hash(value.data(), value.size()), i.hash());
+    }
+    CHECK(seen == expected);
+}
@@ -0,0 +1,111 @@
+/** @file msgpack.cc
+ * @brief Tests for conversion between JSON and MessagePack
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "UnitTest++.h"
+#include <string>
+#include "utils/jsonutils.h"
+#include "utils/msgpack.h"
+#include "utils/rsperrors.h"
+
+using namespace RestPose;
+using namespace std;
+
+/// Convert a JSON string to MessagePack, and back, checking it's unchanged.
+static string
+roundtrip(const string & json)
+{
+    Json::Value value;
+    Json::Value result;
+    msgpack_unserialise(msgpack_serialise(json_unserialise(json, value)),
+			result);
+    CHECK(value == result);
+    return json_serialise(result);
+}
+
+TEST(MsgPackEncoding)
+{
+    Json::Value value;
+    CHECK_EQUAL(string("\xc0", 1), msgpack_serialise(Json::Value()));
+    CHECK_EQUAL(string("\x00", 1),
+		msgpack_serialise(json_unserialise("0", value)));
+    CHECK_EQUAL("\x7f", msgpack_serialise(json_unserialise("127", value)));
+    CHECK_EQUAL("\xcc\x80", msgpack_serialise(json_unserialise("128", value)));
+    CHECK_EQUAL("\xff", msgpack_serialise(json_unserialise("-1", value)));
+    CHECK_EQUAL("\xd0\xdf", msgpack_serialise(json_unserialise("-33", value)));
+    CHECK_EQUAL(string("\xcd\x01\x00", 3),
+		msgpack_serialise(json_unserialise("256", value)));
+    CHECK_EQUAL("\xcf\xff\xff\xff\xff\xff\xff\xff\xff",
+		msgpack_serialise(json_unserialise("18446744073709551615",
+						   value)));
+    CHECK_EQUAL("\xa3" "abc",
+		msgpack_serialise(json_unserialise("\"abc\"", value)));
+    CHECK_EQUAL("\x82\xa1" "a\x01\xa1" "b\x92\xc3\xc2",
+		msgpack_serialise(json_unserialise("{\"a\":1,\"b\":[true,false]}",
+						   value)));
+}
+
+TEST(MsgPackRoundtrip)
+{
+    CHECK_EQUAL("null", roundtrip("null"));
+    CHECK_EQUAL("[0,1,-1,127,128,-32,-33,255,256,65535,65536,-129,-32769]",
+		roundtrip("[0,1,-1,127,128,-32,-33,255,256,65535,65536,-129,"
+			  "-32769]"));
+    CHECK_EQUAL("[2147483647,2147483648,4294967296,-2147483649,"
+		"9223372036854775807,-9223372036854775808,"
+		"18446744073709551615]",
+		roundtrip("[2147483647,2147483648,4294967296,-2147483649,"
+			  "9223372036854775807,-9223372036854775808,"
+			  "18446744073709551615]"));
+    CHECK_EQUAL("[1.50,-0.250]", roundtrip("[1.5,-0.25]"));
+    CHECK_EQUAL("{\"\":\"\",\"a\":{\"b\":[[],{}]}}",
+		roundtrip("{\"a\":{\"b\":[[],{}]},\"\":\"\"}"));
+
+    // Strings and containers needing longer length forms.
+    string json = "{\"items\":[";
+    for (unsigned i = 0; i != 300; ++i) {
+	if (i != 0) json += ',';
+	json += "\"" + string(i, 'x') + "\"";
+    }
+    json += "]}";
+    CHECK_EQUAL(json, roundtrip(json));
+}
+
+TEST(MsgPackInvalid)
+{
+    Json::Value value;
+    CHECK_THROW(msgpack_unserialise("", value), InvalidValueError);
+    // Truncated string and array.
+    CHECK_THROW(msgpack_unserialise("\xa3" "ab", value), InvalidValueError);
+    CHECK_THROW(msgpack_unserialise("\x92\x01", value), InvalidValueError);
+    // Data after the value.
+    CHECK_THROW(msgpack_unserialise("\x01\x02", value), InvalidValueError);
+    // Non-string map key.
+    CHECK_THROW(msgpack_unserialise("\x81\x01\x02", value), InvalidValueError);
+    // Extension type.
+    CHECK_THROW(msgpack_unserialise("\xd4\x01\x02", value), InvalidValueError);
+    // Binary data is read as a string.
+    CHECK_EQUAL("\"ab\"",
+		json_serialise(msgpack_unserialise("\xc4\x02" "ab", value)));
+}
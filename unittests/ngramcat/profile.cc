@@ -93,6 +93,21 @@ TEST(NGramCatProfileBuilder2)
 		"\"bb\"" // 2
 		"]}", json_serialise(tmp));
     CHECK_EQUAL(json_serialise(tmp2), json_serialise(tmp));
+    // Check that hashes built directly match those of the sorted profile.
+    std::vector<NGramHash> hashes, expected;
+    builder.build_hashes(hashes, 3);
+    sorted_profile.get_hashes(expected);
+    CHECK_EQUAL(3u, hashes.size());
+    CHECK(hashes == expected);
+
+    // Check that clearing the builder discards the counts.
+    builder.clear();
+    builder.add_text("b");
+    builder.build(sorted_profile, 100);
+    sorted_profile.to_json(tmp2);
+    CHECK_EQUAL("{\"max_ngrams\":100,\"ngrams\":["
+		"\"|\",\"b\",\"b|\",\"|b\""
+		"]}", json_serialise(tmp2));
 }
 
 TEST(NGramProfileDistances)
@@ -130,4 +145,18 @@ TEST(NGramProfileDistances)
     CHECK_EQUAL(76u, sample2.distance(target4));
     sample2.init_from_ngram(target3);
     CHECK_EQUAL(0u, sample2.distance(target4));
+
+    // Check that hashed profiles give the same distances.
+    HashedNGramProfile hashed;
+    std::vector<NGramHash> hashes;
+    sample1.get_hashes(hashes);
+    hashed.init_from_ngram(target1);
+    CHECK_EQUAL(36u, hashed.distance(hashes, sample1.max_ngrams));
+    hashed.init_from_ngram(target2);
+    CHECK_EQUAL(76u, hashed.distance(hashes, sample1.max_ngrams));
+    hashed.init_from_ngram(target3);
+    CHECK_EQUAL(0u, hashed.distance(hashes, sample1.max_ngrams));
+    hashed.init_from_sorted_ngram(sample1);
+    sample2.get_hashes(hashes);
+    CHECK_EQUAL(0u, hashed.distance(hashes, sample2.max_ngrams));
 }
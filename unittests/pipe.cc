@@ -82,6 +82,10 @@ TEST(Pipes)
     CHECK_EQUAL(2u, p.mappings.size());
     CHECK_EQUAL(true, p.apply_all);
     CHECK_EQUAL("next", p.target);
+    CHECK_EQUAL(false, p.compiled);
+    p.compile();
+    CHECK_EQUAL(true, p.compiled);
+    CHECK_EQUAL(2u, p.programs.size());
     p.to_json(tmp);
     CHECK_EQUAL("{"
       "\"apply_all\":true,"
@@ -113,6 +117,8 @@ TEST(Pipes)
     // Check setting the pipe to an empty configuration.
     json_unserialise("{}", tmp);
     p.from_json(tmp);
+    CHECK_EQUAL(false, p.compiled);
+    CHECK_EQUAL(0u, p.programs.size());
     p.to_json(tmp);
     CHECK_EQUAL("{}", json_serialise(tmp));
     CHECK_EQUAL(0u, p.mappings.size());
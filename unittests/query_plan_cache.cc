@@ -0,0 +1,88 @@
+/** @file query_plan_cache.cc
+ * @brief Tests for the cache of query plans
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include "UnitTest++.h"
+#include "jsonxapian/query_plan_cache.h"
+#include "utils/jsonutils.h"
+
+using namespace RestPose;
+
+TEST(QueryPlanCache)
+{
+    QueryPlanCache cache(2);
+    const QueryPlan * plan;
+    Json::Value status;
+
+    cache.get_status(status);
+    CHECK_EQUAL("{\"entries\":0,\"hit_rate\":null,\"hits\":0,"
+		"\"max_entries\":2,\"misses\":0}",
+		json_serialise(status));
+
+    CHECK(cache.get("a") == NULL);
+    cache.release(cache.set("a", new QueryPlan("plan a")));
+    cache.release(cache.set("b", new QueryPlan("plan b")));
+    plan = cache.get("a");
+    CHECK(plan != NULL);
+    CHECK_EQUAL("\"plan a\"", json_serialise(plan->get_plan()));
+    cache.release(plan);
+
+    // "b" is now the least recently used entry, so is discarded.
+    cache.release(cache.set("c", new QueryPlan("plan c")));
+    CHECK(cache.get("b") == NULL);
+    plan = cache.get("a");
+    CHECK(plan != NULL);
+    CHECK_EQUAL("\"plan a\"", json_serialise(plan->get_plan()));
+    cache.release(plan);
+
+    // A plan stays valid while held, even once discarded from the cache.
+    QueryPlanRef held(cache, cache.get("c"));
+    CHECK(held.get() != NULL);
+    cache.release(cache.set("d", new QueryPlan("plan d")));
+    cache.release(cache.set("e", new QueryPlan("plan e")));
+    CHECK(cache.get("c") == NULL);
+    CHECK_EQUAL("\"plan c\"", json_serialise(held->get_plan()));
+    held.reset(NULL);
+
+    cache.get_status(status);
+    CHECK_EQUAL("{\"entries\":2,\"hit_rate\":0.50,\"hits\":3,"
+		"\"max_entries\":2,\"misses\":3}",
+		json_serialise(status));
+
+    cache.clear();
+    CHECK(cache.get("a") == NULL);
+    cache.get_status(status);
+    CHECK_EQUAL("{\"entries\":0,\"hit_rate\":0.0,\"hits\":0,"
+		"\"max_entries\":2,\"misses\":1}",
+		json_serialise(status));
+}
+
+TEST(QueryPlanCacheEmpty)
+{
+    // A cache with no space returns plans without storing them.
+    QueryPlanCache cache(0);
+    QueryPlanRef plan(cache, cache.set("a", new QueryPlan("plan a")));
+    CHECK_EQUAL("\"plan a\"", json_serialise(plan->get_plan()));
+    CHECK(cache.get("a") == NULL);
+}
@@ -27,9 +27,14 @@
 #include <json/json.h>
 #include "jsonxapian/collconfig.h"
 #include "jsonxapian/doctojson.h"
+#include "jsonxapian/docvalues.h"
 #include "jsonxapian/indexing.h"
 #include "jsonxapian/query_builder.h"
 #include "jsonxapian/schema.h"
+#include "postingsources/geocells.h"
+#include "postingsources/multivalue_keymaker.h"
+#include <set>
+#include "str.h"
 #include "utils/jsonutils.h"
 #include "utils/rsperrors.h"
 
@@ -377,6 +382,281 @@ TEST(DoubleFields)
     CHECK_EQUAL("Xapian::Query(PostingSource(MultiValueRangeSource(7, 1, \\x80, \\xa0)))", q.get_description());
 }
 
+/** Get the ids of the documents matching a query, as a string.
+ */
+static string
+matching_docids(const Xapian::Database & db, const Xapian::Query & query)
+{
+    Xapian::Enquire enq(db);
+    enq.set_query(query);
+    enq.set_weighting_scheme(Xapian::BoolWeight());
+    enq.set_docid_order(Xapian::Enquire::ASCENDING);
+    Xapian::MSet mset(enq.get_mset(0, db.get_doccount()));
+    string result;
+    for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
+	result += str(*i) + ",";
+    }
+    return result;
+}
+
+TEST(DoubleFieldRangeIndex)
+{
+    CollectionConfig config("test"); // dummy config, used for testing.
+    config.set_default();
+    Json::Value tmp, tmp2;
+    Schema s2("");
+    s2.set("num", new DoubleFieldConfig(7, "num", "n"));
+    s2.set("plain", new DoubleFieldConfig(8, "plain"));
+    CHECK_EQUAL("{\"fields\":{"
+		"\"num\":{\"group\":\"n\",\"slot\":7,\"store_field\":\"num\",\"type\":\"double\"},"
+		"\"plain\":{\"slot\":8,\"store_field\":\"plain\",\"type\":\"double\"}"
+		"},\"patterns\":[]}",
+		json_serialise(s2.to_json(tmp2)));
+
+    Schema s("");
+    s.from_json(s2.to_json(tmp));
+    tmp = tmp2 = Json::nullValue;
+    CHECK_EQUAL(json_serialise(s.to_json(tmp)),
+		json_serialise(s2.to_json(tmp2)));
+
+    // Index the same values in a field with a range index, and a field
+    // without one, and check that range searches give the same results.
+    Xapian::WritableDatabase db = Xapian::InMemory::open();
+    for (int i = 0; i != 300; ++i) {
+	Json::Value v(Json::objectValue);
+	Json::Value & values = v["num"] = Json::arrayValue;
+	values.append((i * 37) % 101 - 50);
+	if (i % 3 == 0) {
+	    values.append(i * 0.25);
+	}
+	if (i % 7 == 0) {
+	    values.append(i * 1000000.5);
+	}
+	v["plain"] = values;
+	string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	Xapian::Document doc = s.process(v, config, idterm, errors, new_fields);
+	CHECK_EQUAL(0u, errors.errors.size());
+	db.add_document(doc);
+    }
+
+    config.set_schema("test", s);
+    CollectionQueryBuilder builder(config);
+
+    const char * ranges[] = {
+	"[-1, 1]", "[0, 0]", "[-50, 50]", "[-1000, -51]", "[10, 5]",
+	"[0.25, 2.5]", "[-7.5, 33.3]", "[0, 1e12]", "[1e6, 1e8]",
+	"[-1e12, 1e12]",
+    };
+    for (unsigned i = 0; i != sizeof(ranges) / sizeof(ranges[0]); ++i) {
+	string range(ranges[i]);
+	Xapian::Query q = builder.build(json_unserialise(
+		"{\"field\": [\"num\", \"range\", " + range + "]}", tmp));
+	Xapian::Query q2 = builder.build(json_unserialise(
+		"{\"field\": [\"plain\", \"range\", " + range + "]}", tmp));
+	CHECK_EQUAL(matching_docids(db, q2), matching_docids(db, q));
+    }
+
+    Xapian::Query q = builder.build(json_unserialise(
+	"{\"field\": [\"num\", \"range\", [-1, 1]]}", tmp));
+    CHECK_EQUAL("1,4,16,46,87,117,147,188,218,248,289,", matching_docids(db, q));
+}
+
+/** Get the ids of the top documents matching a query, in a set.
+ */
+static set<Xapian::docid>
+top_docids(const Xapian::Database & db, const Xapian::Query & query,
+	   Xapian::doccount count)
+{
+    Xapian::Enquire enq(db);
+    enq.set_query(query);
+    Xapian::MSet mset(enq.get_mset(0, count));
+    set<Xapian::docid> result;
+    for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
+	result.insert(*i);
+    }
+    return result;
+}
+
+TEST(LonLatFieldCells)
+{
+    // Cells are named by geohashes.
+    GeoCellLevel level(5);
+    CHECK_EQUAL("9q8yy", level.cell_name(level.column(-122.4194),
+					 level.row(37.7749)));
+
+    CollectionConfig config("test"); // dummy config, used for testing.
+    config.set_default();
+    Json::Value tmp, tmp2;
+    Schema s2("");
+    Json::Value fieldconfig(Json::objectValue);
+    fieldconfig["slot"] = 9;
+    fieldconfig["group"] = "l";
+    s2.set("loc", new LonLatFieldConfig(fieldconfig));
+    fieldconfig = Json::objectValue;
+    fieldconfig["slot"] = 10;
+    s2.set("plain", new LonLatFieldConfig(fieldconfig));
+    CHECK_EQUAL("{\"fields\":{"
+		"\"loc\":{\"group\":\"l\",\"slot\":9,\"store_field\":\"\",\"type\":\"lonlat\"},"
+		"\"plain\":{\"slot\":10,\"store_field\":\"\",\"type\":\"lonlat\"}"
+		"},\"patterns\":[]}",
+		json_serialise(s2.to_json(tmp2)));
+
+    Schema s("");
+    s.from_json(s2.to_json(tmp));
+
+    // Index the same points in a field with cells, and a field without, and
+    // check that searches give the same results.
+    Xapian::WritableDatabase db = Xapian::InMemory::open();
+    for (int i = 0; i != 500; ++i) {
+	Json::Value v(Json::objectValue);
+	Json::Value & points = v["loc"] = Json::arrayValue;
+	Json::Value & point = points.append(Json::arrayValue);
+	point.append(-1.0 + ((i * 7919) % 1000) * 0.002);
+	point.append(51.0 + ((i * 104729) % 997) * 0.001);
+	if (i % 10 == 0) {
+	    Json::Value & far_point = points.append(Json::arrayValue);
+	    far_point.append(i * 0.3 - 75);
+	    far_point.append(i * 0.1 - 25);
+	}
+	v["plain"] = points;
+	string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	Xapian::Document doc = s.process(v, config, idterm, errors, new_fields);
+	CHECK_EQUAL(0u, errors.errors.size());
+	db.add_document(doc);
+    }
+
+    config.set_schema("test", s);
+    CollectionQueryBuilder builder(config);
+
+    const char * searches[] = {
+	"{\"center\": [0, 51.5], \"max_range\": 1000}",
+	"{\"center\": [0, 51.5], \"max_range\": 20000}",
+	"{\"center\": [-1, 51], \"max_range\": 500.0}",
+	"{\"center\": [0.5, 51.2], \"max_range\": 100000}",
+	"{\"center\": [-60, -20], \"max_range\": 2000000}",
+	"{\"center\": [179, 89], \"max_range\": 3000000}",
+    };
+    for (unsigned i = 0; i != sizeof(searches) / sizeof(searches[0]); ++i) {
+	string search(searches[i]);
+	Xapian::Query q = builder.build(json_unserialise(
+		"{\"field\": [\"loc\", \"distscore\", " + search + "]}", tmp));
+	Xapian::Query q2 = builder.build(json_unserialise(
+		"{\"field\": [\"plain\", \"distscore\", " + search + "]}", tmp));
+	CHECK_EQUAL(matching_docids(db, q2), matching_docids(db, q));
+    }
+
+    // Nearest neighbour searches return the closest documents.
+    const char * centers[] = {
+	"[0, 51.5]", "[-1, 51]", "[10, 40]", "[-75, -25]", "[180, -90]",
+    };
+    for (unsigned i = 0; i != sizeof(centers) / sizeof(centers[0]); ++i) {
+	string center(centers[i]);
+	Xapian::Query q = builder.build(json_unserialise(
+		"{\"field\": [\"loc\", \"nearest\", {\"center\": " + center +
+		", \"count\": 5}]}", tmp));
+	Xapian::Query q2 = builder.build(json_unserialise(
+		"{\"field\": [\"plain\", \"distscore\", {\"center\": " +
+		center + "}]}", tmp));
+	set<Xapian::docid> nearest = top_docids(db, q, 10);
+	CHECK_EQUAL(5u, nearest.size());
+	CHECK(nearest == top_docids(db, q2, 5));
+    }
+
+    CHECK_THROW(builder.build(json_unserialise(
+	"{\"field\": [\"plain\", \"nearest\", {\"center\": [0, 0]}]}", tmp)),
+	InvalidValueError);
+}
+
+/** Get the ids of all documents, sorted with a keymaker, as a string.
+ */
+static string
+sorted_docids(const Xapian::Database & db, Xapian::KeyMaker * sorter,
+	      bool reverse)
+{
+    Xapian::Enquire enq(db);
+    enq.set_query(Xapian::Query(std::string()));
+    enq.set_sort_by_key(sorter, reverse);
+    Xapian::MSet mset(enq.get_mset(0, db.get_doccount()));
+    string result;
+    for (Xapian::MSetIterator i = mset.begin(); i != mset.end(); ++i) {
+	result += str(*i) + ",";
+    }
+    return result;
+}
+
+TEST(SortSlots)
+{
+    CollectionConfig config("test"); // dummy config, used for testing.
+    config.set_default();
+    Json::Value tmp, tmp2;
+    Schema s2("");
+    s2.set("num", new DoubleFieldConfig(7, "num", "", 8));
+    s2.set("date", new DateFieldConfig(9, "date", "", 10));
+    CHECK_EQUAL("{\"fields\":{"
+		"\"date\":{\"slot\":9,\"sort_slot\":10,\"store_field\":\"date\",\"type\":\"date\"},"
+		"\"num\":{\"slot\":7,\"sort_slot\":8,\"store_field\":\"num\",\"type\":\"double\"}"
+		"},\"patterns\":[]}",
+		json_serialise(s2.to_json(tmp2)));
+
+    Schema s("");
+    s.from_json(s2.to_json(tmp));
+    tmp = tmp2 = Json::nullValue;
+    CHECK_EQUAL(json_serialise(s.to_json(tmp)),
+		json_serialise(s2.to_json(tmp2)));
+
+    // Sort keys are fixed-width, and hold the lowest value.
+    {
+	Json::Value v(Json::objectValue);
+	v["num"] = Json::arrayValue;
+	v["num"].append(3);
+	v["num"].append(0);
+	v["date"] = "2010-06-08";
+	string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	Xapian::Document doc = s.process(v, config, idterm, errors, new_fields);
+	CHECK_EQUAL(0u, errors.errors.size());
+	CHECK_EQUAL(string("\x80\0\0\0\0\0\0\0\0", 9), doc.get_value(8));
+	CHECK_EQUAL(string("\xcf\xda\0\0\0\0\0\0\0&(", 11), doc.get_value(10));
+    }
+
+    // Sorting by the sort slot gives the same order as sorting by the
+    // values, with documents with no values last in both directions.
+    Xapian::WritableDatabase db = Xapian::InMemory::open();
+    for (int i = 0; i != 200; ++i) {
+	Json::Value v(Json::objectValue);
+	if (i % 7 != 0) {
+	    v["num"] = Json::arrayValue;
+	    v["num"].append(((i * 37) % 101) * 0.5 - 20);
+	    if (i % 3 == 0) {
+		v["num"].append(((i * 53) % 89) - 30);
+	    }
+	}
+	string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	db.add_document(s.process(v, config, idterm, errors, new_fields));
+    }
+
+    for (int reverse = 0; reverse != 2; ++reverse) {
+	MultiValueKeyMaker values_sorter;
+	values_sorter.add_decoder(SlotDecoder::create(7, ENC_VINT_LENGTHS),
+				  reverse);
+	SortSlotKeyMaker slot_sorter(8, reverse);
+	CHECK_EQUAL(sorted_docids(db, &values_sorter, false),
+		    sorted_docids(db, &slot_sorter, reverse));
+    }
+
+    config.set_schema("test", s);
+    CollectionQueryBuilder builder(config);
+    CHECK_EQUAL(8u, builder.get_sort_slot("num"));
+    CHECK_EQUAL(Xapian::BAD_VALUENO, builder.get_sort_slot("missing"));
+}
+
 TEST(TimestampFields)
 {
     CollectionConfig config("test"); // dummy config, used for testing.
@@ -470,6 +750,57 @@ TEST(CategoryFields)
     }
 }
 
+/// Test category fields which find ancestors at query time.
+TEST(CategoryFieldsQueryAncestors)
+{
+    CollectionConfig config("test");
+    Categories modified;
+    config.category_add_parent("cat1", "child", "parent", modified);
+    config.category_add_parent("cat1", "grandchild", "child", modified);
+
+    Json::Value tmp, tmp2;
+    Schema s2("");
+    s2.set("cat", new CategoryFieldConfig("cat", "cat1", 30, ExactFieldConfig::TOOLONG_ERROR, "category", true));
+    CHECK_EQUAL("{\"fields\":{\"cat\":{\"ancestors\":\"query\",\"group\":\"cat\",\"max_length\":30,\"store_field\":\"category\",\"taxonomy\":\"cat1\",\"too_long_action\":\"error\",\"type\":\"cat\"}},\"patterns\":[]}",
+		json_serialise(s2.to_json(tmp2)));
+
+    Schema s("");
+    s.from_json(s2.to_json(tmp));
+    tmp = tmp2 = Json::nullValue;
+    CHECK_EQUAL(json_serialise(s.to_json(tmp)),
+		json_serialise(s2.to_json(tmp2)));
+
+    {
+	// No ancestor terms are stored.
+	Json::Value v(Json::objectValue);
+	v["cat"] = "grandchild";
+	string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	Xapian::Document doc = s.process(v, config, idterm, errors, new_fields);
+	CHECK_EQUAL(0u, errors.errors.size());
+	CHECK_EQUAL("{\"data\":{\"category\":[\"grandchild\"]},\"terms\":{\"cat\\\\tCgrandchild\":{}}}",
+		    json_serialise(doc_to_json(doc, tmp)));
+    }
+
+    // Searches for descendants are expanded using the taxonomy.
+    config.set_schema("test", s);
+    CollectionQueryBuilder builder(config);
+    Xapian::Query q = builder.build(json_unserialise("{\"field\": [\"cat\", \"is_descendant\", \"parent\"]}", tmp));
+    CHECK_EQUAL("Xapian::Query((cat\tCchild OR cat\tCgrandchild))", q.get_description());
+    q = builder.build(json_unserialise("{\"field\": [\"cat\", \"is_or_is_descendant\", [\"child\"]]}", tmp));
+    CHECK_EQUAL("Xapian::Query((cat\tCchild OR cat\tCgrandchild))", q.get_description());
+    q = builder.build(json_unserialise("{\"field\": [\"cat\", \"is_descendant\", \"grandchild\"]}", tmp));
+    CHECK_EQUAL("Xapian::Query()", q.get_description());
+
+    Json::Value bad(Json::objectValue);
+    bad["type"] = "cat";
+    bad["group"] = "cat";
+    bad["taxonomy"] = "cat1";
+    bad["ancestors"] = "sometimes";
+    CHECK_THROW(CategoryFieldConfig c(bad), InvalidValueError);
+}
+
 TEST(StoreFields)
 {
     CollectionConfig config("test"); // dummy config, used for testing.
@@ -29,6 +29,7 @@
 #include "jsonxapian/collection.h"
 #include "jsonxapian/doctojson.h"
 #include "jsonxapian/indexing.h"
+#include "jsonxapian/query_plan_cache.h"
 #include "jsonxapian/schema.h"
 #include "utils/rmdir.h"
 #include "utils/rsperrors.h"
@@ -156,3 +157,280 @@ TEST(SearchIntegerExactFields)
     coll.close();
     rmdir_recursive("tmp_testdir");
 }
+
+TEST(SearchQueryPlan)
+{
+    rmdir_recursive("tmp_testdir");
+    mkdir("tmp_testdir", 0777);
+    Collection coll("test", "tmp_testdir/test"); // dummy config, used for testing.
+    Json::Value tmp;
+    Schema s("testtype");
+    s.set("id", new IDFieldConfig(""));
+    s.set("type", new ExactFieldConfig("type", 30, ExactFieldConfig::TOOLONG_ERROR, "", 0, false));
+    s.set("tag", new ExactFieldConfig("tag", 30, ExactFieldConfig::TOOLONG_ERROR, "tag", 0, false));
+    s.set("text", new TextFieldConfig("t", "text", "stem_en"));
+    coll.open_writable();
+    coll.set_schema("testtype", s);
+    CollectionConfig & config(coll.get_config());
+
+    const char * docs[] = {
+	"{\"id\": 1, \"type\": \"testtype\", \"tag\": [\"a\"], \"text\": \"hello world\"}",
+	"{\"id\": 2, \"type\": \"testtype\", \"tag\": [\"a\", \"b\"], \"text\": \"hello\"}",
+	"{\"id\": 3, \"type\": \"testtype\", \"tag\": [\"a\", \"b\", \"c\"], \"text\": \"goodbye\"}",
+    };
+    for (unsigned i = 0; i != sizeof(docs) / sizeof(docs[0]); ++i) {
+	string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	Xapian::Document doc(config.process_doc(json_unserialise(docs[i], tmp),
+						"", "", idterm, errors,
+						new_fields));
+	CHECK_EQUAL(0u, errors.errors.size());
+	coll.raw_update_doc(doc, idterm);
+    }
+    coll.commit();
+
+    // Nested conjunctions are flattened, and ordered rarest first.
+    {
+	Json::Value search_results(Json::objectValue);
+	string search_str = "{\"verbose\":true,\"query\":{\"and\":["
+	    "{\"field\":[\"tag\",\"is\",\"a\"]},"
+	    "{\"field\":[\"tag\",\"is\",\"c\"]},"
+	    "{\"and\":[{\"field\":[\"tag\",\"is\",\"b\"]}]}"
+	    "]}}";
+	coll.perform_search(json_unserialise(search_str, tmp), "", search_results);
+	CHECK_EQUAL("{\"and\":["
+		    "{\"field\":[\"tag\",\"is\",\"c\"]},"
+		    "{\"field\":[\"tag\",\"is\",\"b\"]},"
+		    "{\"field\":[\"tag\",\"is\",\"a\"]}"
+		    "]}",
+		    json_serialise(search_results["query_plan"]));
+	CHECK_EQUAL(1u, search_results["matches_estimated"].asUInt());
+    }
+
+    // Searches for values in the same field are combined.
+    {
+	Json::Value search_results(Json::objectValue);
+	string search_str = "{\"verbose\":true,\"query\":{\"or\":["
+	    "{\"field\":[\"tag\",\"is\",\"c\"]},"
+	    "{\"field\":[\"tag\",\"is\",[\"b\",\"c\"]]}"
+	    "]}}";
+	coll.perform_search(json_unserialise(search_str, tmp), "", search_results);
+	CHECK_EQUAL("{\"field\":[\"tag\",\"is\",[\"c\",\"b\"]]}",
+		    json_serialise(search_results["query_plan"]));
+	CHECK_EQUAL(2u, search_results["matches_estimated"].asUInt());
+    }
+
+    // Repeated subqueries are removed, and filters moved into a FILTER.
+    {
+	Json::Value search_results(Json::objectValue);
+	string search_str = "{\"verbose\":true,\"query\":{\"and\":["
+	    "{\"field\":[\"tag\",\"is\",\"b\"]},"
+	    "{\"field\":[\"text\",\"text\",\"hello\"]},"
+	    "{\"field\":[\"tag\",\"is\",\"b\"]}"
+	    "]}}";
+	coll.perform_search(json_unserialise(search_str, tmp), "", search_results);
+	CHECK_EQUAL("{\"filter\":["
+		    "{\"field\":[\"text\",\"text\",\"hello\"]},"
+		    "{\"field\":[\"tag\",\"is\",\"b\"]}"
+		    "]}",
+		    json_serialise(search_results["query_plan"]));
+	CHECK_EQUAL(1u, search_results["matches_estimated"].asUInt());
+    }
+
+    // Repeated subqueries which contribute to the weights are kept, since
+    // removing them would change the weights.
+    {
+	Json::Value search_results(Json::objectValue);
+	string search_str = "{\"verbose\":true,\"query\":{\"or\":["
+	    "{\"field\":[\"text\",\"text\",\"hello\"]},"
+	    "{\"field\":[\"text\",\"text\",\"hello\"]}"
+	    "]}}";
+	coll.perform_search(json_unserialise(search_str, tmp), "", search_results);
+	CHECK_EQUAL("{\"or\":["
+		    "{\"field\":[\"text\",\"text\",\"hello\"]},"
+		    "{\"field\":[\"text\",\"text\",\"hello\"]}"
+		    "]}",
+		    json_serialise(search_results["query_plan"]));
+	CHECK_EQUAL(2u, search_results["matches_estimated"].asUInt());
+    }
+
+    // A search with the same shape as an earlier one, but different values,
+    // uses the cached plan.
+    {
+	Json::Value status;
+	g_query_plans.get_status(status);
+	uint64_t hits = status["hits"].asUInt64();
+
+	Json::Value search_results(Json::objectValue);
+	string search_str = "{\"verbose\":true,\"query\":{\"or\":["
+	    "{\"field\":[\"tag\",\"is\",\"a\"]},"
+	    "{\"field\":[\"tag\",\"is\",[\"c\",\"a\"]]}"
+	    "]}}";
+	coll.perform_search(json_unserialise(search_str, tmp), "", search_results);
+	CHECK_EQUAL("{\"field\":[\"tag\",\"is\",[\"a\",\"c\"]]}",
+		    json_serialise(search_results["query_plan"]));
+	CHECK_EQUAL(3u, search_results["matches_estimated"].asUInt());
+
+	g_query_plans.get_status(status);
+	CHECK_EQUAL(hits + 1, status["hits"].asUInt64());
+    }
+
+    // The order of subqueries isn't cached with the plan; it depends on the
+    // frequencies of the values in each search.
+    {
+	Json::Value search_results(Json::objectValue);
+	string search_str = "{\"verbose\":true,\"query\":{\"and\":["
+	    "{\"field\":[\"tag\",\"is\",\"a\"]},"
+	    "{\"field\":[\"tag\",\"is\",\"b\"]}"
+	    "]}}";
+	coll.perform_search(json_unserialise(search_str, tmp), "", search_results);
+	CHECK_EQUAL("{\"and\":["
+		    "{\"field\":[\"tag\",\"is\",\"b\"]},"
+		    "{\"field\":[\"tag\",\"is\",\"a\"]}"
+		    "]}",
+		    json_serialise(search_results["query_plan"]));
+	CHECK_EQUAL(2u, search_results["matches_estimated"].asUInt());
+
+	Json::Value status;
+	g_query_plans.get_status(status);
+	uint64_t hits = status["hits"].asUInt64();
+
+	search_str = "{\"verbose\":true,\"query\":{\"and\":["
+	    "{\"field\":[\"tag\",\"is\",\"c\"]},"
+	    "{\"field\":[\"tag\",\"is\",\"a\"]}"
+	    "]}}";
+	coll.perform_search(json_unserialise(search_str, tmp), "", search_results);
+	CHECK_EQUAL("{\"and\":["
+		    "{\"field\":[\"tag\",\"is\",\"c\"]},"
+		    "{\"field\":[\"tag\",\"is\",\"a\"]}"
+		    "]}",
+		    json_serialise(search_results["query_plan"]));
+	CHECK_EQUAL(1u, search_results["matches_estimated"].asUInt());
+
+	g_query_plans.get_status(status);
+	CHECK_EQUAL(hits + 1, status["hits"].asUInt64());
+    }
+
+    coll.close();
+    rmdir_recursive("tmp_testdir");
+}
+
+TEST(SearchQueryPlanMixedTypes)
+{
+    rmdir_recursive("tmp_testdir");
+    mkdir("tmp_testdir", 0777);
+    Collection coll("test", "tmp_testdir/test"); // dummy config, used for testing.
+    Json::Value tmp;
+
+    // The tag field is purely boolean in type1, but not in type2, where it
+    // has wdfinc set, so affects the weights.
+    Schema s1("type1");
+    s1.set("id", new IDFieldConfig(""));
+    s1.set("type", new ExactFieldConfig("type", 30, ExactFieldConfig::TOOLONG_ERROR, "", 0, false));
+    s1.set("tag", new ExactFieldConfig("tag", 30, ExactFieldConfig::TOOLONG_ERROR, "tag", 0, false));
+    s1.set("text", new TextFieldConfig("t", "text", "stem_en"));
+    Schema s2("type2");
+    s2.set("id", new IDFieldConfig(""));
+    s2.set("type", new ExactFieldConfig("type", 30, ExactFieldConfig::TOOLONG_ERROR, "", 0, false));
+    s2.set("tag", new ExactFieldConfig("tag", 30, ExactFieldConfig::TOOLONG_ERROR, "tag", 1, false));
+    s2.set("text", new TextFieldConfig("t", "text", "stem_en"));
+    coll.open_writable();
+    coll.set_schema("type1", s1);
+    coll.set_schema("type2", s2);
+
+    string search_str = "{\"verbose\":true,\"query\":{\"and\":["
+	"{\"field\":[\"text\",\"text\",\"hello\"]},"
+	"{\"field\":[\"tag\",\"is\",\"b\"]}"
+	"]}}";
+
+    // Within type1, the tag search only filters.
+    {
+	Json::Value search_results(Json::objectValue);
+	coll.perform_search(json_unserialise(search_str, tmp), "type1",
+			    search_results);
+	CHECK_EQUAL("{\"filter\":["
+		    "{\"field\":[\"text\",\"text\",\"hello\"]},"
+		    "{\"field\":[\"tag\",\"is\",\"b\"]}"
+		    "]}",
+		    json_serialise(search_results["query_plan"]));
+    }
+
+    // Within type2, it contributes to the weights.
+    {
+	Json::Value search_results(Json::objectValue);
+	coll.perform_search(json_unserialise(search_str, tmp), "type2",
+			    search_results);
+	CHECK_EQUAL("and",
+		    search_results["query_plan"].getMemberNames()[0]);
+    }
+
+    // Across the whole collection, it contributes to the weights of type2
+    // documents, so mustn't be moved into a filter.
+    {
+	Json::Value search_results(Json::objectValue);
+	coll.perform_search(json_unserialise(search_str, tmp), "",
+			    search_results);
+	CHECK_EQUAL("and",
+		    search_results["query_plan"].getMemberNames()[0]);
+    }
+
+    coll.close();
+    rmdir_recursive("tmp_testdir");
+}
+
+TEST(SearchJson)
+{
+    rmdir_recursive("tmp_testdir");
+    mkdir("tmp_testdir", 0777);
+    Collection coll("test", "tmp_testdir/test"); // dummy config, used for testing.
+    Json::Value tmp;
+    Schema s("testtype");
+    s.set("id", new IDFieldConfig(""));
+    s.set("type", new ExactFieldConfig("type", 30, ExactFieldConfig::TOOLONG_ERROR, "", 0, false));
+    s.set("tag", new ExactFieldConfig("tag", 30, ExactFieldConfig::TOOLONG_ERROR, "tag", 0, false));
+    s.set("text", new TextFieldConfig("t", "text", "stem_en"));
+    s.set("stored", new StoredFieldConfig(string("stored")));
+    coll.open_writable();
+    coll.set_schema("testtype", s);
+    CollectionConfig & config(coll.get_config());
+
+    const char * docs[] = {
+	"{\"id\": 1, \"type\": \"testtype\", \"tag\": [\"a\"], \"text\": \"hello \\\"world\\\"\"}",
+	"{\"id\": 2, \"type\": \"testtype\", \"tag\": [\"a\", \"b\"], \"text\": \"hello\\n\\u00e9\", \"stored\": {\"x\": 0.1, \"y\": [1, -2, 1e300]}}",
+	"{\"id\": 3, \"type\": \"testtype\", \"tag\": [\"a\", \"b\", \"c\"], \"stored\": [true, null, \"\\u0001\"]}",
+    };
+    for (unsigned i = 0; i != sizeof(docs) / sizeof(docs[0]); ++i) {
+	string idterm;
+	IndexingErrors errors;
+	bool new_fields(false);
+	Xapian::Document doc(config.process_doc(json_unserialise(docs[i], tmp),
+						"", "", idterm, errors,
+						new_fields));
+	CHECK_EQUAL(0u, errors.errors.size());
+	coll.raw_update_doc(doc, idterm);
+    }
+    coll.commit();
+
+    // The directly written JSON is the same as the serialised results.
+    const char * searches[] = {
+	"{\"query\":{\"field\":[\"tag\",\"is\",\"z\"]}}",
+	"{\"query\":{\"field\":[\"tag\",\"is\",\"a\"]}}",
+	"{\"query\":{\"field\":[\"tag\",\"is\",\"a\"]},\"display\":[\"text\",\"stored\",\"id\",\"text\",\"missing\"]}",
+	"{\"query\":{\"field\":[\"tag\",\"is\",\"a\"]},\"display\":[]}",
+	"{\"query\":{\"field\":[\"tag\",\"is\",\"b\"]},\"verbose\":true,\"from\":1,\"size\":5}",
+	"{\"query\":{\"field\":[\"tag\",\"is\",\"a\"]},\"info\":[{\"facet_count\":{\"doc_limit\":null,\"field\":\"tag\",\"result_limit\":null}}]}",
+    };
+    for (unsigned i = 0; i != sizeof(searches) / sizeof(searches[0]); ++i) {
+	Json::Value search;
+	json_unserialise(searches[i], search);
+	Json::Value search_results(Json::objectValue);
+	coll.perform_search(search, "testtype", search_results);
+	string output;
+	coll.perform_search_json(search, "testtype", output);
+	CHECK_EQUAL(json_serialise(search_results), output);
+    }
+
+    coll.close();
+    rmdir_recursive("tmp_testdir");
+}
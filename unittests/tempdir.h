@@ -0,0 +1,94 @@
+/** @file tempdir.h
+ * @brief Temporary directories for tests.
+ */
+/* Copyright (c) 2011 Richard Boulton
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef RESTPOSE_INCLUDED_TEMPDIR_H
+#define RESTPOSE_INCLUDED_TEMPDIR_H
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "utils.h"
+#include "utils/rsperrors.h"
+#include <xapian.h>
+
+#ifdef __WIN32__
+#include <windows.h>
+#include <tchar.h>
+#endif
+
+/** A temporary directory, which is removed (with its contents) when this
+ *  object is destroyed.
+ */
+class TempDir {
+    std::string path;
+
+    TempDir(const TempDir &);
+    void operator=(const TempDir &);
+  public:
+    TempDir(const std::string & prefix) {
+#ifndef __WIN32__
+	std::string full_prefix = "/tmp/" + prefix;
+	char tmpl[full_prefix.size() + 7];
+	memcpy(tmpl, full_prefix.c_str(), full_prefix.size());
+	memset(tmpl + full_prefix.size(), 'X', 6);
+	tmpl[full_prefix.size() + 6] = '\0';
+	char * result = mkdtemp(tmpl);
+	if (result == NULL) {
+	    throw RestPose::SysError("Can't make temporary directory", errno);
+	}
+	path = std::string(result, full_prefix.size() + 6);
+#else
+	TCHAR path_buf[MAX_PATH];
+	DWORD path_len = GetTempPath(MAX_PATH, path_buf);
+	if (path_len > MAX_PATH || path_len == 0) {
+	    throw RestPose::SysError("Can't get temp path", 0);
+	}
+
+	TCHAR dirname_buf[MAX_PATH]; 
+	if (GetTempFileName(path_buf, TEXT(prefix.c_str()), 1, dirname_buf) == 0) {
+	    throw RestPose::SysError("Can't get temp filename", 0);
+	}
+	path = dirname_buf;
+	mkdir(dirname_buf);
+#endif
+    }
+
+    ~TempDir() {
+	// destroy the directory at path.
+	if (!path.empty()) {
+	    try {
+		removedir(path);
+	    } catch (const Xapian::Error & e) {
+		printf("Error removing temporary directory: %s\n", e.get_description().c_str());
+	    }
+	}
+    }
+
+    std::string get() {
+	return path;
+    };
+};
+
+#endif /* RESTPOSE_INCLUDED_TEMPDIR_H */